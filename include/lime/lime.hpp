@@ -27,7 +27,11 @@
 #include <functional>
 #include <string>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
 #include <ostream>
+#include <variant>
 
 namespace lime {
 
@@ -48,7 +52,14 @@ namespace lime {
 		DRMessage, /**< the plaintext input is encrypted inside the Double Ratchet message (each recipient get a different encryption): not optimal for messages with numerous recipient */
 		cipherMessage, /**< the plaintext input is encrypted with a random key and this random key is encrypted to each participant inside the Double Ratchet message(for a single recipient the overhead is 48 bytes) */
 		optimizeUploadSize, /**< optimize upload size: encrypt in DR message if plaintext is short enougth to beat the overhead introduced by cipher message scheme, otherwise use cipher message. Selection is made on upload size only. This is the default policy used */
-		optimizeGlobalBandwidth /**< optimize bandwith usage: encrypt in DR message if plaintext is short enougth to beat the overhead introduced by cipher message scheme, otherwise use cipher message. Selection is made on uploadand download (from server to recipients) sizes added. */
+		optimizeGlobalBandwidth, /**< optimize bandwith usage: encrypt in DR message if plaintext is short enougth to beat the overhead introduced by cipher message scheme, otherwise use cipher message. Selection is made on uploadand download (from server to recipients) sizes added. */
+		senderKey, /**< the plaintext input is encrypted once in the cipher message using a per group sending chain, the group being identified by the associated data. The sending chain is distributed to the recipients not holding it yet inside their Double Ratchet message.
+				Recipients already holding the chain get an empty DRmessage: the cipher message must be routed to all recipients and given to decrypt with the possibly empty DRmessage.
+				A recipient which missed the DR message distributing the chain cannot decrypt the group messages (its status is PeerDeviceStatus::fail) until the sender
+				generates a new chain, which is then distributed to all recipients.
+				When the recipients use several base algorithms, this policy falls back to cipherMessage. */
+		optimizeCost /**< select between DR message and cipher message on a cost: the output size plus the transport overhead of a cipher message and the weighted encryption CPU cost, both set in the EncryptionContext(see lime::EncryptionCost).
+				With both set to 0, this policy selects as optimizeUploadSize does. */
 	};
 
 	/**
@@ -122,9 +133,53 @@ namespace lime {
 	 */
 	using limeX3DHServerPostData = std::function<void(const std::string &url, const std::string &from, std::vector<uint8_t> &&message, const limeX3DHServerResponseProcess &reponseProcess)>;
 
+	/**
+	 * @brief Tracing interface: install one with LimeManager::set_tracer to receive the spans of the library operations
+	 *
+	 * The spans map to OpenTelemetry ones: a name(ie: lime.encrypt), a parent span and typed attributes. They nest on a thread
+	 * and across the asynchronous requests to the X3DH server, so the time spent waiting for the server, creating sessions or
+	 * committing to local storage within an encryption can be told apart.
+	 * The methods are called from any thread calling the library, including the one forwarding the X3DH server responses:
+	 * implementations must be thread safe. When no tracer is installed, the library does not build any span.
+	 */
+	class Tracer {
+		public:
+			/// span identifier, 0 is never a span
+			using SpanId = uint64_t;
+			/// span attributes value
+			using AttributeValue = std::variant<bool, int64_t, std::string>;
+
+			/**
+			 * @brief A span starts
+			 *
+			 * @param[in]	name	the span name
+			 * @param[in]	parent	the parent span, 0 for a root span
+			 *
+			 * @return	an identifier, unique among the spans not ended yet. Return 0 to drop this span, its children are then attached to its parent
+			 */
+			virtual SpanId startSpan(const std::string &name, const SpanId parent) = 0;
+			/**
+			 * @brief Set an attribute on a started span
+			 *
+			 * @param[in]	span	the span
+			 * @param[in]	key	the attribute key, ie: lime.recipients
+			 * @param[in]	value	the attribute value
+			 */
+			virtual void setAttribute(const SpanId span, const std::string &key, const AttributeValue &value) = 0;
+			/**
+			 * @brief A span ends
+			 *
+			 * @param[in]	span	the span
+			 * @param[in]	success	false if the operation failed
+			 */
+			virtual void endSpan(const SpanId span, const bool success) = 0;
+			virtual ~Tracer() = default;
+	};
+
 	/* Forward declare the class managing one lime user and class managing database */
 	class LimeGeneric;
 	class Db;
+	class Capture;
 
 	/****************************************************************************/
 	/*                                                                          */
@@ -172,23 +227,37 @@ namespace lime {
 		private:
 			std::string username;
 			lime::CurveId baseAlgo;
+			std::size_t m_hash; // computed once at construction: a DeviceId is used as key in the users cache on each manager call
+			static std::size_t computeHash(const std::string &username, const lime::CurveId baseAlgo) {
+				std::hash<std::string> username_hash;
+				std::hash<lime::CurveId> baseAlgo_hash;
+				// combine the hash
+				return username_hash(username) ^ (baseAlgo_hash(baseAlgo) << 1);
+			}
 		public:
-			DeviceId(const std::string &username, const lime::CurveId baseAlgo) : username{username}, baseAlgo{baseAlgo} {};
+			DeviceId(const std::string &username, const lime::CurveId baseAlgo) : username{username}, baseAlgo{baseAlgo}, m_hash{computeHash(username, baseAlgo)} {};
 			const std::string &getUsername() const {return username;}
 			const lime::CurveId &getAlgo() const {return baseAlgo;}
 			const std::string getAlgoString() const {return CurveId2String(baseAlgo);}
 			explicit operator std::string() const { return std::string{username}.append(" on ").append(CurveId2String(baseAlgo));}
 			bool operator==(const DeviceId &other) const {
-				return (username==other.username && baseAlgo == other.baseAlgo);
+				return (m_hash == other.m_hash && baseAlgo == other.baseAlgo && username==other.username);
 			}
 			static std::size_t hash(const lime::DeviceId& d) {
-				std::hash<std::string> username_hash;
-				std::hash<lime::CurveId> baseAlgo_hash;
-				// combine the hash
-				return username_hash(d.username) ^ (baseAlgo_hash(d.baseAlgo) << 1);
+				return d.m_hash;
 			}
 	};
 
+	/** @brief Weights used by the optimizeCost encryption policy, ignored by the other policies
+	 *
+	 * The cost of an encryption mode is its output size plus the weighted number of bytes encrypted by the AEAD scheme:
+	 * the plaintext once per recipient in DR message mode, the plaintext once and the random seed once per recipient in cipher message mode.
+	 */
+	struct EncryptionCost {
+		size_t cipherMessageTransportOverhead = 0; /**< in bytes, added by the transport when it carries a cipher message besides the DR messages(ie: a multipart boundary) */
+		size_t encryptionWeight = 0; /**< cost of encrypting one byte, in thousandths of an output byte. 0 selects on output size only */
+	};
+
 	// a class holding all data structure to encrypt
 	struct EncryptionContext {
 			const std::vector<uint8_t> m_associatedData;
@@ -196,6 +265,7 @@ namespace lime {
 			const std::vector<uint8_t> m_plainMessage;
 			std::vector<uint8_t> m_cipherMessage;
 			const lime::EncryptionPolicy m_encryptionPolicy;
+			lime::EncryptionCost m_encryptionCost; // used by the optimizeCost policy only
 
 			// constructor with associated data being a string or a buffer
 			EncryptionContext(const std::vector<uint8_t> &associatedData, const std::vector<uint8_t> &plainMessage, const lime::EncryptionPolicy encryptionPolicy=lime::EncryptionPolicy::optimizeUploadSize ) :
@@ -222,11 +292,19 @@ namespace lime {
 		private :
 
 			std::unordered_map<lime::DeviceId, std::shared_ptr<LimeGeneric>, decltype(&lime::DeviceId::hash)> m_users_cache; // cache of already opened Lime Session, identified by user Id (GRUU/algo)
-			std::mutex m_users_mutex; // m_users_cache mutex
+			std::shared_mutex m_users_mutex; // m_users_cache mutex: shared to look up users, exclusive to modify the cache
+			uint64_t m_usersErasedCount{0}; // number of users erased from m_users_cache, protected by m_users_mutex: lets the cache warmer detect a deletion while it loads a user
 			std::shared_ptr<lime::Db> m_localStorage; // DB access information forwarded to SOCI to correctly access database
 			limeX3DHServerPostData m_X3DH_post_data; // send data to the X3DH key server
 			std::shared_ptr<LimeGeneric> load_user(const lime::DeviceId &localDeviceId, const bool allStatus=false); // helper function, get from m_users_cache or local Storage the requested Lime object
 			std::shared_ptr<LimeGeneric> load_user_noexcept(const lime::DeviceId &localDeviceId) noexcept; // helper function, get from m_users_cache or local Storage the requested Lime object
+			std::thread m_cacheWarmer; // background thread loading in cache the most recently active users and sessions
+			std::mutex m_cacheWarmer_mutex; // protect the cache warmer thread object
+			std::atomic<bool> m_cacheWarmerRunning; // the cache warmer thread is running
+			std::atomic<bool> m_cacheWarmerStop; // request the cache warmer thread to stop, set at destruction
+			void cacheWarmer_run(const uint16_t maxSessions, const size_t memoryBudget, const limeCallback callback); // cache warmer thread body
+			std::shared_ptr<LimeGeneric> cacheWarmer_loadUser(const lime::DeviceId &localDeviceId, bool &loaded); // helper function, get from m_users_cache or local Storage the requested Lime object without holding the users cache lock during the load
+			std::shared_ptr<Capture> m_capture; // operations capture, nullptr when not capturing. Accessed through std::atomic_load/atomic_store only
 
 		public :
 
@@ -333,7 +411,7 @@ namespace lime {
 			 * @param[in]		recipientUserId	the Id of intended recipient, shall be a sip:uri of user or conference, is used as associated data to ensure no-one can mess with intended recipient
 			 * 					it is not necessarily the sip:uri base of the GRUU as this could be a message from alice first device intended to bob being decrypted on alice second device
 			 * @param[in]		senderDeviceId	Identify sender Device. This field shall be extracted from signaling data in transport protocol, is used to rebuild the authenticated data associated to the encrypted message
-			 * @param[in]		DRmessage	Double Ratchet message targeted to current device
+			 * @param[in]		DRmessage	Double Ratchet message targeted to current device, can be empty when the message was encrypted in senderKey policy
 			 * @param[in]		cipherMessage	when present (depends on encryption policy) holds a common part of the encrypted message. Can be ignored or set to empty vector if not present in the incoming message.
 			 * @param[out]		plainMessage	the output buffer
 			 *
@@ -383,6 +461,59 @@ namespace lime {
 			 */
 			void update(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, limeCallback callback);
 
+			/**
+			 * @brief Prefetch: build in advance the Double Ratchet sessions with a list of peer devices
+			 * so the first encryption to them does not have to wait for the X3DH server
+			 *
+			 *  - peer devices already sharing an active session with the local user are ignored
+			 *  - key bundles of the remaining ones are requested to the X3DH server by chunks(chunk size is set in lime::settings)
+			 *  - sessions are built and stored in local storage, next encryption to these devices will load them from there
+			 *
+			 * Each key bundle retrieved may consume one of the peer device OPks on the X3DH server: at most OPkBudget peer devices
+			 * are processed by algorithm, the others are ignored and will get their session at first encryption.
+			 * A prefetched session never used to encrypt a message is deleted by the update after a delay defined in lime::settings.
+			 *
+			 * if specified localDeviceId is not found in local Storage, throw an exception
+			 *
+			 * @param[in]	localDeviceId		Identify the local user acount to use, it shall be the GRUU
+			 * @param[in]	algos			the algorithms to build sessions for, one session per peer device and algorithm
+			 * @param[in]	peerDeviceIds		the peer devices to build a session with, shall be their GRUU
+			 * @param[in]	callback		This operation contacts the X3DH server and is thus asynchronous, when all sessions are built,
+			 * 					this callback will be called giving the exit status and an error message in case of failure.
+			 * @param[in]	OPkBudget		Maximum number of peer devices requested to the X3DH server for each algorithm
+			 *
+			 * @note
+			 * The last parameter is optional, if not used, set to default defined in lime::settings
+			 */
+			void prefetch_sessions(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const std::vector<std::string> &peerDeviceIds, limeCallback callback, uint16_t OPkBudget);
+			/**
+			 * @overload void prefetch_sessions(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const std::vector<std::string> &peerDeviceIds, limeCallback callback)
+			 */
+			void prefetch_sessions(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const std::vector<std::string> &peerDeviceIds, limeCallback callback);
+
+			/**
+			 * @brief Warm the cache: load in background the most recently active local users and Double Ratchet sessions
+			 * so the first messages exchanged after a restart do not have to load them from local storage
+			 *
+			 *  - active sessions of all the active local users are loaded, most recently used first
+			 *  - sessions already in cache or with a peer device currently involved in an encryption or decryption are skipped
+			 *  - the warmer stops once it loaded maxSessions sessions or once the estimated memory used by the users and sessions it loaded reaches memoryBudget
+			 *
+			 * Only one cache warmer runs at a time, a call while it is running fails.
+			 *
+			 * @param[in]	maxSessions	Maximum number of sessions to load
+			 * @param[in]	memoryBudget	In bytes, memory the loaded users and sessions may use
+			 * @param[in]	callback	Called from the cache warmer thread when it is done, giving the exit status and a summary or an error message in case of failure.
+			 *
+			 * @note
+			 * The first two parameters are optional, if not used, set to defaults defined in lime::settings
+			 */
+			void warm_cache(const uint16_t maxSessions, const size_t memoryBudget, limeCallback callback);
+			/**
+			 * @overload void warm_cache(limeCallback callback)
+			 */
+			void warm_cache(limeCallback callback);
+
 			/**
 			 * @brief retrieve self Identity Key, an EdDSA formatted public key
 			 *
@@ -464,6 +595,15 @@ namespace lime {
 			 */
 			lime::PeerDeviceStatus get_peerDeviceStatus(const std::list<std::string> &peerDeviceIds);
 
+			/**
+			 * @brief get the status of each device in a list, all fetched from local storage in one query
+			 * device's Id matching a local account are always considered as trusted
+			 *
+			 * @param[in]	peerDeviceIds		The list of device Ids to consider, shall be a list of GRUUs
+			 * @param[out]	peerDeviceStatuses	The status of each device, indexed by device Id: unknown, untrusted, trusted or unsafe
+			 */
+			void get_peerDeviceStatus(const std::list<std::string> &peerDeviceIds, std::map<std::string, lime::PeerDeviceStatus> &peerDeviceStatuses);
+
 			/**
 			 * @brief delete a peerDevice from local storage
 			 *
@@ -507,6 +647,60 @@ namespace lime {
 			 */
 			std::string get_x3dhServerUrl(const DeviceId &localDeviceId);
 
+			/**
+			 * @brief Get the library counters and latency histograms(encryption, decryption, sessions storage, X3DH exchanges...)
+			 *
+			 * The metrics are process wide: they cover all the LimeManager instances
+			 *
+			 * @return The metrics in Prometheus text exposition format, an empty string if the library was not built with ENABLE_METRICS
+			 */
+			static std::string get_metrics(void);
+
+			/**
+			 * @brief Install a tracer receiving the spans of the library operations
+			 *
+			 * The tracer is process wide: it gets the spans of all the LimeManager instances
+			 *
+			 * @param[in]	tracer	the tracer, nullptr to remove the current one
+			 */
+			static void set_tracer(std::shared_ptr<lime::Tracer> tracer);
+
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+			/**
+			 * @brief Replace the random number generator by a deterministic one, so test and benchmark runs are reproducible
+			 *
+			 * The generator is process wide and shared by all the users created or loaded afterward: call it before creating the managers.
+			 * The keys generated are predictable: this is declared only in libraries built with ENABLE_DETERMINISTIC_RNG, which cannot be release builds.
+			 * Note: the KEM key pairs and encapsulations use the post quantum engine own generator and stay random.
+			 *
+			 * @param[in]	seed	the generator seed, the same seed produces the same sequence
+			 */
+			static void set_deterministic_RNG(const uint64_t seed);
+
+			/**
+			 * @brief Go back to the system random number generator for the users created or loaded afterward
+			 */
+			static void clear_deterministic_RNG(void);
+#endif // LIME_DETERMINISTIC_RNG_ENABLED
+
+			/**
+			 * @brief Start recording an anonymized trace of this manager operations: create_user, delete_user, update, encrypt and decrypt
+			 *
+			 * Device and group ids are replaced by pseudonyms, the capture holds no key material nor message content: only the operations
+			 * types, sizes, recipients count, skipped messages per sender and timing. It can be replayed with the lime-replay tool.
+			 * A capture already running is stopped first.
+			 *
+			 * @param[in]	filename	the capture file, overwritten if it exists
+			 *
+			 * @return false if the file cannot be opened
+			 */
+			bool start_capture(const std::string &filename);
+
+			/**
+			 * @brief Stop the running capture, if any. Operations still in progress are recorded when they complete
+			 */
+			void stop_capture(void);
+
 			LimeManager() = delete; // no manager without Database and http provider
 			LimeManager(const LimeManager&) = delete; // no copy constructor
 			LimeManager operator=(const LimeManager &) = delete; // nor copy operator
@@ -518,8 +712,19 @@ namespace lime {
 			 * @param[in]	X3DH_post_data	A function to send data to the X3DH server, parameters includes a callback to transfer back the server response
 			 */
 			LimeManager(const std::string &db_access, const limeX3DHServerPostData &X3DH_post_data);
+			/**
+			 * @brief Lime Manager constructor, optionally starting the cache warmer
+			 *
+			 * @param[in]	db_access	string used to access DB: can be filename for sqlite3 or access params for mysql, directly forwarded to SOCI session opening
+			 * @param[in]	X3DH_post_data	A function to send data to the X3DH server, parameters includes a callback to transfer back the server response
+			 * @param[in]	warmCache	when true, start the cache warmer with its default settings, see warm_cache
+			 */
+			LimeManager(const std::string &db_access, const limeX3DHServerPostData &X3DH_post_data, const bool warmCache);
 
-			~LimeManager() = default;
+			/**
+			 * @brief Lime Manager destructor, stops the cache warmer if it is running
+			 */
+			~LimeManager();
 	};
 
 } //namespace lime
@@ -24,13 +24,83 @@
 #include "lime_double_ratchet.hpp"
 #include "lime_double_ratchet_protocol.hpp"
 #include "lime_x3dh.hpp"
+#include "lime_metrics.hpp"
+#include "lime_trace.hpp"
 #include <soci/soci.h>
 #include <mutex>
+#include <algorithm>
 
 using namespace::std;
 using namespace::soci;
 
 namespace lime {
+	/****************************************************************************/
+	/*                                                                          */
+	/* Peer device locks                                                        */
+	/*                                                                          */
+	/****************************************************************************/
+	void PeerDeviceLocks::prune(void) {
+		for (auto it = m_locks.begin(); it != m_locks.end();) {
+			if (it->second.expired()) {
+				it = m_locks.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	PeerDevicesLock PeerDeviceLocks::lock(std::vector<std::string> deviceIds) {
+		std::sort(deviceIds.begin(), deviceIds.end());
+		deviceIds.erase(std::unique(deviceIds.begin(), deviceIds.end()), deviceIds.end());
+
+		PeerDevicesLock ret{};
+		ret.mutexes.reserve(deviceIds.size());
+		{ // get the mutexes, create the missing ones
+			std::lock_guard<std::mutex> lock(m_mutex);
+			bool inserted = false;
+			for (const auto &deviceId : deviceIds) {
+				auto mutex = m_locks[deviceId].lock();
+				if (!mutex) {
+					mutex = std::make_shared<std::mutex>();
+					m_locks[deviceId] = mutex;
+					inserted = true;
+				}
+				ret.mutexes.push_back(std::move(mutex));
+			}
+			if (inserted) {
+				prune();
+			}
+		}
+
+		// lock them, in device Id order
+		ret.locks.reserve(ret.mutexes.size());
+		for (const auto &mutex : ret.mutexes) {
+			ret.locks.emplace_back(*mutex);
+		}
+		return ret;
+	}
+
+	PeerDevicesLock PeerDeviceLocks::try_lock(const std::string &deviceId) {
+		std::shared_ptr<std::mutex> mutex{};
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			mutex = m_locks[deviceId].lock();
+			if (!mutex) {
+				mutex = std::make_shared<std::mutex>();
+				m_locks[deviceId] = mutex;
+				prune();
+			}
+		}
+
+		PeerDevicesLock ret{};
+		std::unique_lock<std::mutex> lock(*mutex, std::try_to_lock);
+		if (lock.owns_lock()) {
+			ret.mutexes.push_back(std::move(mutex));
+			ret.locks.push_back(std::move(lock));
+		}
+		return ret;
+	}
+
 	/****************************************************************************/
 	/*                                                                          */
 	/* Private methods: DR session cache management                             */
@@ -101,6 +171,7 @@ namespace lime {
 
 			auto DRsession = make_DR_from_localStorage<Curve>(m_localStorage, sessionId, m_RNG); // load session from local storage
 			requestedDevices[peerDeviceId] = DRsession; // store found session in a our temp container
+			std::lock_guard<std::mutex> cacheLock(m_mutex);
 			m_DR_sessions_cache[peerDeviceId] = DRsession; // session is also stored in cache
 		}
 
@@ -117,10 +188,91 @@ namespace lime {
 		}
 	}
 
-	// load from local storage in DRSessions all DR session matching the peerDeviceId, ignore the one picked by id in 2nd arg
+	/* load from local storage in DRSessions all DR session matching the peerDeviceId, ignore the one picked by id in 2nd arg
+	 * The peer ratchet key found in the DRmessage header is matched against the one stored in session(or in the skipped message keys chains):
+	 * - if some sessions match, only them are loaded, others could not decrypt this message
+	 *   if the ignored session is the only match, it is reloaded from local storage: the caller's copy may be out of date
+	 * - if none match, this message is the first of a new receiving chain. On KEM based curves, its header usually holds the index
+	 *   of our KEM ratchet key the sender used: only the sessions holding this key are loaded.
+	 *   EC only headers carry nothing identifying our ratchet key: the message could belong to any session, load them all
+	 */
 	template <typename Curve>
-	void Lime<Curve>::get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDRSessionId, std::vector<std::shared_ptr<DR>> &DRSessions) {
+	void Lime<Curve>::get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDRSessionId, const std::vector<uint8_t> &DRmessage, std::vector<std::shared_ptr<DR>> &DRSessions) {
 		std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+
+		// load the matching sessions, return false if there is none
+		auto loadMatchingSessions = [this, &senderDeviceId, ignoreThisDRSessionId, &DRSessions](const std::vector<int> &matchingSessionsId) {
+			bool ignoredSessionMatch = false;
+			for (const auto sessionId : matchingSessionsId) {
+				if (sessionId != ignoreThisDRSessionId) {
+					DRSessions.push_back(make_DR_from_localStorage<Curve>(m_localStorage, sessionId, m_RNG)); // load session from local storage
+				} else {
+					ignoredSessionMatch = true;
+				}
+			}
+			// Only the ignored session(the cached one) matches: the cached instance may be behind the local storage when an other
+			// manager on the same storage moved this session forward. Reload it from local storage instead of giving up.
+			if (ignoredSessionMatch && DRSessions.empty()) {
+				LIME_LOGD<<m_selfDeviceId<<" decrypts from "<<senderDeviceId<<" : message header matches the cached session only, reload it";
+				DRSessions.push_back(make_DR_from_localStorage<Curve>(m_localStorage, ignoreThisDRSessionId, m_RNG));
+				return true;
+			}
+			if (!matchingSessionsId.empty()) {
+				LIME_LOGD<<m_selfDeviceId<<" decrypts from "<<senderDeviceId<<" : message header matches "<<DRSessions.size()<<" sessions not tried yet";
+				return true;
+			}
+			return false;
+		};
+
+		std::vector<uint8_t> ECDHr{};
+		std::vector<uint8_t> DHrIndex{};
+		if (getDRmessageDHr<Curve>(DRmessage, ECDHr, DHrIndex)) {
+			blob ECDHr_blob(m_localStorage->sql);
+			ECDHr_blob.write(0, (char *)(ECDHr.data()), ECDHr.size());
+			blob DHrIndex_blob(m_localStorage->sql);
+			DHrIndex_blob.write(0, (char *)(DHrIndex.data()), DHrIndex.size());
+			blob legacyDHr_blob(m_localStorage->sql); // older versions stored the raw DHr in the skipped message keys chains
+			legacyDHr_blob.write(0, (char *)(ECDHr.data()), ECDHr.size());
+			int ECDHrSize = static_cast<int>(ECDHr.size());
+
+			int sessionId = 0;
+			std::vector<int> matchingSessionsId{};
+			// do not ignore the session given in parameter in this query: if it matches, no other session can decrypt this message
+			statement st = (m_localStorage->sql.prepare << "SELECT s.sessionId FROM DR_sessions as s INNER JOIN lime_PeerDevices as d ON s.Did=d.Did WHERE d.DeviceId = :senderDeviceId AND s.Uid = :Uid \
+						AND (substr(s.DHr, 1, :ECDHrSize) = :ECDHr OR EXISTS (SELECT 1 FROM DR_MSk_DHr as m WHERE m.sessionId = s.sessionId AND m.DHr IN (:DHrIndex, :legacyDHr))) \
+						ORDER BY s.Status DESC, timeStamp ASC;", into(sessionId), use(senderDeviceId), use(m_db_Uid), use(ECDHrSize), use(ECDHr_blob), use(DHrIndex_blob), use(legacyDHr_blob));
+			st.execute();
+			while (st.fetch()) {
+				matchingSessionsId.push_back(sessionId);
+			}
+			if (loadMatchingSessions(matchingSessionsId)) {
+				return;
+			}
+
+			// new receiving chain: select the sessions by the self KEM ratchet key the sender used, the index is not stored
+			// so compute it from the sessions self keys, still much cheaper than a ratchet attempt
+			if constexpr (std::is_base_of_v<genericKEM, Curve>) {
+				std::vector<uint8_t> DHsIndex{};
+				if (getDRmessageDHsIndex<Curve>(DRmessage, DHsIndex)) {
+					rowset<int> rs = (m_localStorage->sql.prepare << "SELECT s.sessionId FROM DR_sessions as s INNER JOIN lime_PeerDevices as d ON s.Did=d.Did WHERE d.DeviceId = :senderDeviceId AND s.Uid = :Uid ORDER BY s.Status DESC, timeStamp ASC;", use(senderDeviceId), use(m_db_Uid));
+					std::vector<int> sessionsId(rs.begin(), rs.end());
+					for (const auto candidateSessionId : sessionsId) {
+						blob DHs_blob(m_localStorage->sql);
+						m_localStorage->sql<<"SELECT DHs FROM DR_sessions WHERE sessionId = :sessionId LIMIT 1;", into(DHs_blob), use(candidateSessionId);
+						if (!m_localStorage->sql.got_data() || DHs_blob.get_len() != ARsKey<Curve>::serializedSize()) continue;
+						typename ARsKey<Curve>::serializedBuffer serializedDHs{}; // holds our private keys, cleaned at destruction
+						DHs_blob.read(0, (char *)(serializedDHs.data()), serializedDHs.size());
+						if (ARsKey<Curve>(serializedDHs).getKEMIndex() == DHsIndex) {
+							matchingSessionsId.push_back(candidateSessionId);
+						}
+					}
+					if (loadMatchingSessions(matchingSessionsId)) {
+						return;
+					}
+				}
+			}
+		}
+
 		rowset<int> rs = (m_localStorage->sql.prepare << "SELECT s.sessionId FROM DR_sessions as s INNER JOIN lime_PeerDevices as d ON s.Did=d.Did WHERE d.DeviceId = :senderDeviceId AND s.Uid = :Uid AND s.sessionId <> :ignoreThisDRSessionId ORDER BY s.Status DESC, timeStamp ASC;", use(senderDeviceId), use (m_db_Uid), use(ignoreThisDRSessionId));
 
 		for (const auto &sessionId : rs) {
@@ -186,6 +338,7 @@ namespace lime {
 
 	template <typename Curve>
 	void Lime<Curve>::delete_peerDevice(const std::string &peerDeviceId) {
+		std::lock_guard<std::mutex> lock(m_mutex);
 		m_DR_sessions_cache.erase(peerDeviceId); // remove session from cache if any
 	}
 
@@ -211,6 +364,45 @@ namespace lime {
 		m_X3DH->update_OPk(userData);
 	}
 
+	template <typename Curve>
+	void Lime<Curve>::prefetch_sessions(const std::vector<std::string> &peerDeviceIds, const std::shared_ptr<limeCallback> callback, uint16_t OPkBudget) {
+		// ignore ourself and the peer devices with an active session in cache
+		std::list<std::string> candidates{};
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (const auto &peerDeviceId : peerDeviceIds) {
+				if (peerDeviceId == m_selfDeviceId) continue;
+				auto sessionElem = m_DR_sessions_cache.find(peerDeviceId);
+				if (sessionElem == m_DR_sessions_cache.end() || !sessionElem->second->isActive()) {
+					candidates.push_back(peerDeviceId);
+				}
+			}
+		}
+
+		// and the ones with an active session in local storage
+		std::vector<std::string> missingDevices{};
+		m_localStorage->get_devicesWithoutSession(m_db_Uid, candidates, missingDevices);
+
+		// each key bundle may consume one peer OPk on the X3DH server: do not request more than the given budget
+		size_t skippedCount = 0;
+		if (missingDevices.size() > OPkBudget) {
+			skippedCount = missingDevices.size() - OPkBudget;
+			missingDevices.resize(OPkBudget);
+		}
+
+		auto prefetchContext = make_shared<PrefetchContext>(std::move(missingDevices), skippedCount);
+		if (prefetchContext->peerDeviceIds.empty()) { // nothing to fetch, we're done
+			if (callback) (*callback)(lime::CallbackReturn::success, prefetchContext->report());
+			return;
+		}
+
+		LIME_LOGI<<"User "<<m_selfDeviceId<<" on "<<CurveId2String(Curve::curveId())<<" prefetches sessions with "<<prefetchContext->peerDeviceIds.size()<<" peer devices";
+		// the X3DH engine requests the next chunks when processing the server responses
+		auto userData = make_shared<callbackUserData>(std::static_pointer_cast<LimeGeneric>(this->shared_from_this()), callback, prefetchContext);
+		auto chunk = prefetchContext->nextChunk();
+		m_X3DH->fetch_peerBundles(userData, chunk);
+	}
+
 	template <typename Curve>
 	void Lime<Curve>::get_Ik(std::vector<uint8_t> &Ik) {
 		m_X3DH->get_Ik(Ik);
@@ -220,6 +412,11 @@ namespace lime {
 	void Lime<Curve>::encrypt(std::shared_ptr<lime::EncryptionContext> encryptionContext, const std::shared_ptr<limeCallback> callback, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback) {
 	//void Lime<Curve>::encrypt(std::shared_ptr<const std::vector<uint8_t>> recipientUserId, std::shared_ptr<std::vector<RecipientData>> recipients, std::shared_ptr<const std::vector<uint8_t>> plainMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<std::vector<uint8_t>> cipherMessage, const std::shared_ptr<limeCallback> callback, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback) {
 		LIME_LOGI<<"encrypt from "<<m_selfDeviceId<<" on "<<CurveId2String(Curve::curveId())<<" to "<<encryptionContext->m_recipients.size()<<" recipients";
+		trace::ScopedSpan span("lime.encrypt");
+		if (span) {
+			span.setAttribute("lime.curve", CurveId2String(Curve::curveId()));
+			span.setAttribute("lime.recipients", encryptionContext->m_recipients.size());
+		}
 		/* Check if we have all the Double Ratchet sessions ready or shall we go for an X3DH */
 
 		/* Create the appropriate recipient infos and fill it with sessions found in cache */
@@ -227,124 +424,267 @@ namespace lime {
 		// This allows fast copying of relevant information back to recipients when encryption is completed
 		std::vector<RecipientInfos> internal_recipients{};
 
+		// lock the DR sessions of all recipients until the encryption is done, encryptions to other peer devices can run concurrently
+		std::vector<std::string> recipientDeviceIds{};
+		for (const auto &recipient : encryptionContext->m_recipients) {
+			if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
+				recipientDeviceIds.push_back(recipient.deviceId);
+			}
+		}
+		auto peerLock = m_peerDeviceLocks.lock(std::move(recipientDeviceIds));
+
+		// sender key mode: the message is encrypted once with our sending chain for the group, only the recipients not holding it
+		// yet need a DR session. When called by the manager with a random seed callback, other base algorithms are involved and
+		// the message is already (or will be) encrypted in a cipher message: fallback to it
+		std::unique_ptr<SenderKeySendingChain<Curve>> senderChain{};
+		PeerDevicesLock senderChainLock{};
+		std::list<std::string> senderChainHolders{};
+		if (encryptionContext->m_encryptionPolicy == lime::EncryptionPolicy::senderKey && !(randomSeedCallback && *randomSeedCallback)) {
+			std::string groupId{encryptionContext->m_associatedData.cbegin(), encryptionContext->m_associatedData.cend()};
+			senderChainLock = m_senderChainLocks.lock({groupId});
+			senderChain = std::make_unique<SenderKeySendingChain<Curve>>(m_localStorage, m_db_Uid, groupId, encryptionContext->m_recipients);
+		}
+
+		// append a recipient to the internal ones with its session from cache when there is an active one, a nullptr otherwise
+		// must be called with the cache lock held
+		auto addInternalRecipient = [this, &internal_recipients](const std::string &deviceId) {
+			auto sessionElem = m_DR_sessions_cache.find(deviceId);
+			if (sessionElem != m_DR_sessions_cache.end()) { // session is in cache
+				if (sessionElem->second->isActive()) { // the session in cache is active
+					LIME_METRICS_COUNT(sessionsCacheHit);
+					internal_recipients.emplace_back(deviceId, sessionElem->second);
+				} else { // session in cache is not active(may append if last encryption reach sending chain symmetric ratchet usage)
+					LIME_METRICS_COUNT(sessionsCacheMiss);
+					internal_recipients.emplace_back(deviceId);
+					m_DR_sessions_cache.erase(deviceId); // remove unactive session from cache
+				}
+			} else { // session is not in cache, just create it and the session ptr will be a nullptr
+				LIME_METRICS_COUNT(sessionsCacheMiss);
+				internal_recipients.emplace_back(deviceId);
+			}
+		};
+
 		std::unique_lock<std::mutex> lock(m_mutex);
 		for (const auto &recipient : encryptionContext->m_recipients) {
 			// if the input recipient peerStatus is fail we must ignore it
 			// most likely: we're in a call after a key bundle fetch and this peer device does not have keys on the X3DH server
 			// also ignore the one tags as done as they were already computer in previous call (with another base algo probably)
 			if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
-				auto sessionElem = m_DR_sessions_cache.find(recipient.deviceId);
-				if (sessionElem != m_DR_sessions_cache.end()) { // session is in cache
-					if (sessionElem->second->isActive()) { // the session in cache is active
-						internal_recipients.emplace_back(recipient.deviceId, sessionElem->second);
-					} else { // session in cache is not active(may append if last encryption reach sending chain symmetric ratchet usage)
-						internal_recipients.emplace_back(recipient.deviceId);
-						m_DR_sessions_cache.erase(recipient.deviceId); // remove unactive session from cache
-					}
-				} else { // session is not in cache, just create it and the session ptr will be a nullptr
-					internal_recipients.emplace_back(recipient.deviceId);
+				if (senderChain && senderChain->isDistributed(recipient.deviceId)) { // this one does not need its DR session
+					senderChainHolders.push_back(recipient.deviceId);
+					continue;
 				}
+				addInternalRecipient(recipient.deviceId);
 			}
 		}
 
+		lock.unlock(); // the cache is not accessed while loading sessions from local storage and encrypting
+		if (span) {
+			span.setAttribute("lime.sessions_cache_hits", std::count_if(internal_recipients.cbegin(), internal_recipients.cend(), [](const RecipientInfos &recipient){return recipient.DRSession != nullptr;}));
+			span.setAttribute("lime.sender_key_holders", senderChainHolders.size());
+		}
+
 		/* try to load all the session that are not in cache and set the peer Device status for all recipients*/
 		std::vector<std::string> missing_devices{};
 		cache_DR_sessions(internal_recipients, missing_devices);
 
+		// sender key mode: a peer device which never advertised it can process a sender key distribution would deliver it to its
+		// application as the message plaintext. When such a recipient is found, encrypt this message in cipher message mode for
+		// all recipients, the sender chain holders included. A session just created from a key bundle did not advertise anything
+		// yet: it is found again here when encrypt is called back after the bundles fetch.
+		if (senderChain && missing_devices.empty()
+				&& std::any_of(internal_recipients.cbegin(), internal_recipients.cend(), [](const RecipientInfos &recipient){return !recipient.DRSession->peerSupportsSenderKey();})) {
+			LIME_LOGI<<"Encrypt from "<<m_selfDeviceId<<" to group "<<std::string{encryptionContext->m_associatedData.cbegin(), encryptionContext->m_associatedData.cend()}<<" in cipher message mode: some recipients do not support sender key";
+			senderChain.reset();
+			senderChainHolders.clear();
+			// rebuild the internal recipients in the recipients order, the sessions already loaded are in cache
+			internal_recipients.clear();
+			lock.lock();
+			for (const auto &recipient : encryptionContext->m_recipients) {
+				if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
+					addInternalRecipient(recipient.deviceId);
+				}
+			}
+			lock.unlock();
+			cache_DR_sessions(internal_recipients, missing_devices);
+		}
+
+		std::map<std::string, lime::PeerDeviceStatus> senderChainHoldersStatus{};
+		if (!senderChainHolders.empty()) {
+			m_localStorage->get_peerDeviceStatus(senderChainHolders, senderChainHoldersStatus);
+		}
+
 		/* If we are still missing session we must ask the X3DH server for key bundles */
+		span.setAttribute("lime.missing_sessions", missing_devices.size());
 		if (missing_devices.size()>0) {
 			// create a new callbackUserData, it shall be then deleted in callback, store in all shared_ptr to input/output values needed to call this encrypt function
 			auto userData = make_shared<callbackUserData>(std::static_pointer_cast<LimeGeneric>(this->shared_from_this()), callback, randomSeedCallback, encryptionContext);
+			lock.lock();
 			if (m_ongoing_encryption == nullptr) { // no ongoing asynchronous encryption process it
 				m_ongoing_encryption = userData;
 			} else { // some one else is expecting X3DH server response, enqueue this request
 				m_encryption_queue.push(userData);
+				span.setAttribute("lime.queue_depth", m_encryption_queue.size());
 				return;
 			}
 			lock.unlock(); // unlock before calling external callbacks
+			senderChainLock.unlock();
+			peerLock.unlock(); // encrypt is called again when the server response is processed
 			// retrieve bundles from X3DH server, when they arrive, it will run the X3DH initiation and create the DR sessions
 			m_X3DH->fetch_peerBundles(userData, missing_devices);
 			return;
 		}
 
 		// We have everyone: encrypt
-		encryptMessage(internal_recipients, encryptionContext->m_plainMessage, encryptionContext->m_associatedData, m_selfDeviceId, encryptionContext->m_cipherMessage, encryptionContext->m_encryptionPolicy, m_localStorage, randomSeedCallback);
+		if (senderChain) {
+			senderChain->encrypt(encryptionContext->m_plainMessage, m_selfDeviceId, m_X3DH, encryptionContext->m_cipherMessage, internal_recipients);
+		} else {
+			encryptMessage(internal_recipients, encryptionContext->m_plainMessage, encryptionContext->m_associatedData, m_selfDeviceId, encryptionContext->m_cipherMessage, encryptionContext->m_encryptionPolicy, m_localStorage, randomSeedCallback, encryptionContext->m_encryptionCost);
+		}
+		senderChainLock.unlock();
 
 		// move DR messages to the input/output structure, ignoring again the input with peerStatus set to fail and the ones done
 		// so the index on the internal_recipients still matches the way we created it from recipients
+		// the sender chain holders get an empty DR message, they decrypt the cipher message only
 		size_t i=0;
 		auto callbackStatus = lime::CallbackReturn::fail;
 		std::string callbackMessage{"All recipients failed to provide a key bundle"};
 		for (auto &recipient : encryptionContext->m_recipients) {
 			if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
-				recipient.DRmessage = std::move(internal_recipients[i].DRmessage);
-				recipient.peerStatus = internal_recipients[i].peerStatus;
+				auto holder = senderChainHoldersStatus.find(recipient.deviceId);
+				if (holder != senderChainHoldersStatus.end()) {
+					recipient.DRmessage.clear();
+					recipient.peerStatus = holder->second;
+				} else {
+					recipient.DRmessage = std::move(internal_recipients[i].DRmessage);
+					recipient.peerStatus = internal_recipients[i].peerStatus;
+					i++;
+				}
 				recipient.done = true;
-				i++;
 				callbackStatus = lime::CallbackReturn::success; // we must have at least one recipient with a successful encryption to return success
 				callbackMessage.clear();
 			}
 		}
 
+		span.setStatus(callbackStatus == lime::CallbackReturn::success);
+		peerLock.unlock(); // unlock before calling external callbacks
 		if (callback) {
 			if (*callback) {
-				lock.unlock(); // unlock before calling external callbacks
 				(*callback)(callbackStatus, callbackMessage);
-				lock.lock();
 			}
 		}
 
 		// is there no one in an asynchronous encryption process and do we have something in encryption queue to process
+		lock.lock();
 		if (m_ongoing_encryption == nullptr && !m_encryption_queue.empty()) { // may happend when an encryption was queued but session was created by a previously queued encryption request
 			auto userData = m_encryption_queue.front();
 			m_encryption_queue.pop(); // remove it from queue and do it
 			lock.unlock(); // unlock before recursive call
+			trace::Scope traceScope(userData->traceParent);
 			encrypt(userData->encryptionContext, userData->callback, userData->randomSeedCallback);
 		}
 	}
 
 	template <typename Curve>
 	lime::PeerDeviceStatus Lime<Curve>::decrypt(const std::vector<uint8_t> &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) {
-		std::lock_guard<std::mutex> lock(m_mutex);
+		// lock the DR sessions with this sender until the decryption is done, decryptions from other peer devices can run concurrently
+		auto peerLock = m_peerDeviceLocks.lock({senderDeviceId});
+		trace::ScopedSpan span("lime.decrypt");
+		if (span) {
+			span.setAttribute("lime.curve", CurveId2String(Curve::curveId()));
+			span.setAttribute("lime.dr_message_bytes", DRmessage.size());
+			span.setAttribute("lime.cipher_message_bytes", cipherMessage.size());
+		}
 		// before trying to decrypt, we must check if the sender device is known in the local Storage and if we trust it
 		// a successful decryption will insert it in local storage so we must check first if it is there in order to detect new devices
 		// Note: a device could already be trusted in DB even before the first message (if we established trust before sending the first message)
 		// senderDeviceStatus can only be unknown, untrusted, trusted or unsafe.
 		// If decryption succeed, we will return this status but it has no effect on the decryption process
 		auto senderDeviceStatus = m_localStorage->get_peerDeviceStatus(senderDeviceId);
+		// map the decryption success to the returned status, and the span status
+		auto decryptStatus = [&span, senderDeviceStatus](const bool success) {
+			span.setStatus(success);
+			return success ? senderDeviceStatus : lime::PeerDeviceStatus::fail;
+		};
 
 		LIME_LOGI<<m_selfDeviceId<<" decrypts from "<<senderDeviceId;
+		// sender key mode: no DR message, we shall already hold the sender chain
+		if (DRmessage.empty()) {
+			const std::string groupId{recipientUserId.cbegin(), recipientUserId.cend()};
+			span.setAttribute("lime.sender_key", true);
+			return decryptStatus(senderKey_decrypt<Curve>(m_localStorage, m_db_Uid, senderDeviceId, groupId, cipherMessage, plainMessage));
+		}
+
+		// sender key mode: the DR message header flags the sender chain distribution, it comes with the group cipher message
+		if (double_ratchet_protocol::parseMessage_isSenderKeyDistribution(DRmessage)) {
+			span.setAttribute("lime.sender_key", true);
+			if (cipherMessage.empty()) {
+				LIME_LOGE<<"Sender key distribution from "<<senderDeviceId<<" comes without the group message";
+				return decryptStatus(false);
+			}
+			std::vector<uint8_t> distribution{};
+			if (!decrypt_DRmessage(recipientUserId, senderDeviceId, DRmessage, std::vector<uint8_t>{}, distribution)) {
+				return decryptStatus(false);
+			}
+			const std::string groupId{recipientUserId.cbegin(), recipientUserId.cend()};
+			if (!senderKey_storeReceivingChain<Curve>(m_localStorage, m_db_Uid, senderDeviceId, groupId, distribution)) {
+				return decryptStatus(false);
+			}
+			return decryptStatus(senderKey_decrypt<Curve>(m_localStorage, m_db_Uid, senderDeviceId, groupId, cipherMessage, plainMessage));
+		}
+
+		return decryptStatus(decrypt_DRmessage(recipientUserId, senderDeviceId, DRmessage, cipherMessage, plainMessage));
+	}
+
+	template <typename Curve>
+	bool Lime<Curve>::decrypt_DRmessage(const std::vector<uint8_t> &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) {
 		// do we have any session (loaded or not) matching that senderDeviceId ?
-		auto sessionElem = m_DR_sessions_cache.find(senderDeviceId);
+		std::shared_ptr<DR> cachedDRSession = nullptr;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto sessionElem = m_DR_sessions_cache.find(senderDeviceId);
+			if (sessionElem != m_DR_sessions_cache.end()) {
+				LIME_METRICS_COUNT(sessionsCacheHit);
+				cachedDRSession = sessionElem->second;
+			} else {
+				LIME_METRICS_COUNT(sessionsCacheMiss);
+			}
+		}
 		long db_sessionIdInCache = 0; // this would be the db_sessionId of the session stored in cache if there is one, no session has the Id 0
-		if (sessionElem != m_DR_sessions_cache.end()) { // session is in cache, it is the active one, just give it a try
-			db_sessionIdInCache = sessionElem->second->dbSessionId();
-			std::vector<std::shared_ptr<DR>> cached_DRSessions{1, sessionElem->second}; // copy the session pointer into a vector as the decrypt function ask for it
+		if (cachedDRSession != nullptr) { // session is in cache, it is the active one, just give it a try
+			db_sessionIdInCache = cachedDRSession->dbSessionId();
+			std::vector<std::shared_ptr<DR>> cached_DRSessions{1, cachedDRSession}; // copy the session pointer into a vector as the decrypt function ask for it
 			if (decryptMessage(senderDeviceId, m_selfDeviceId, recipientUserId, cached_DRSessions, DRmessage, cipherMessage, plainMessage) != nullptr) {
 				// we manage to decrypt the message with the current active session loaded in cache
-				return senderDeviceStatus;
+				return true;
 			} else { // remove session from cache
 				// session in local storage is not modified, so it's still the active one, it will change status to stale when an other active session will be created
-				m_DR_sessions_cache.erase(sessionElem);
+				// the X3DH engine may have replaced it in cache in the meantime, do not remove that one
+				std::lock_guard<std::mutex> lock(m_mutex);
+				auto sessionElem = m_DR_sessions_cache.find(senderDeviceId);
+				if (sessionElem != m_DR_sessions_cache.end() && sessionElem->second == cachedDRSession) {
+					m_DR_sessions_cache.erase(sessionElem);
+				}
 			}
 		}
 
 		// If we are still here, no session in cache or it didn't decrypt with it. Lookup in localStorage
 		std::vector<std::shared_ptr<DR>> DRSessions{};
 		// load in DRSessions all the session found in cache for this peer device, except the one with id db_sessionIdInCache(is ignored if 0) as we already tried it
-		get_DRSessions(senderDeviceId, db_sessionIdInCache, DRSessions);
+		get_DRSessions(senderDeviceId, db_sessionIdInCache, DRmessage, DRSessions);
 		LIME_LOGI<<m_selfDeviceId<<" decrypts from "<<senderDeviceId<<" : found "<<DRSessions.size()<<" sessions in DB";
 		auto usedDRSession = decryptMessage(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage, plainMessage);
 		if (usedDRSession != nullptr) { // we manage to decrypt with a session
+			std::lock_guard<std::mutex> lock(m_mutex);
 			m_DR_sessions_cache[senderDeviceId] = std::move(usedDRSession); // store it in cache
-			return senderDeviceStatus;
+			return true;
 		}
 
 		// No luck yet, is this message holds a X3DH header - if no we must give up
 		std::vector<uint8_t> X3DH_initMessage{};
 		if (!double_ratchet_protocol::parseMessage_get_X3DHinit<Curve>(DRmessage, X3DH_initMessage)) {
 			LIME_LOGE<<"Fail to decrypt: No DR session found and no X3DH init message";
-			return lime::PeerDeviceStatus::fail;
+			return false;
 		}
 
 		// parse the X3DH init message, get keys from localStorage, compute the shared secrets, create DR_Session and return a shared pointer to it
@@ -354,16 +694,17 @@ namespace lime {
 			DRSessions.push_back(DRSession);
 		} catch (BctbxException const &e) {
 			LIME_LOGE<<"Fail to create the DR session from the X3DH init message : "<<e;
-			return lime::PeerDeviceStatus::fail;
+			return false;
 		}
 
 		if (decryptMessage(senderDeviceId, m_selfDeviceId, recipientUserId, DRSessions, DRmessage, cipherMessage, plainMessage) != 0) {
 			// we manage to decrypt the message with this session, set it in cache
+			std::lock_guard<std::mutex> lock(m_mutex);
 			m_DR_sessions_cache[senderDeviceId] = std::move(DRSessions.front());
-			return senderDeviceStatus;
+			return true;
 		}
 		LIME_LOGE<<"Fail to decrypt: Newly created DR session failed to decrypt the message";
-		return lime::PeerDeviceStatus::fail;
+		return false;
 	}
 
 	template <typename Curve>
@@ -394,11 +735,14 @@ namespace lime {
 
 	template <typename Curve>
 	void Lime<Curve>::processEncryptionQueue(void) {
+		std::unique_lock<std::mutex> lock(m_mutex);
 		m_ongoing_encryption = nullptr; // make sure to free any ongoing encryption
 		// check if others encryptions are in queue and call them if needed
 		if (!m_encryption_queue.empty()) {
 			auto userData = m_encryption_queue.front();
 			m_encryption_queue.pop(); // remove it from queue and do it, as there is no more ongoing it shall be processed even if the queue still holds elements
+			lock.unlock(); // unlock before recursive call
+			trace::Scope traceScope(userData->traceParent);
 			encrypt(userData->encryptionContext, userData->callback, userData->randomSeedCallback);
 		}
 	}
@@ -413,6 +757,52 @@ namespace lime {
 		m_DR_sessions_cache.emplace(deviceId, DRsession);
 	}
 
+	template <typename Curve>
+	bool Lime<Curve>::store_prefetchedSession(const std::string &deviceId, std::shared_ptr<DR> DRsession) {
+		// an encryption may have built a session with this peer device while we were waiting for its key bundle, keep that one
+		auto peerLock = m_peerDeviceLocks.lock({deviceId});
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			auto sessionElem = m_DR_sessions_cache.find(deviceId);
+			if (sessionElem != m_DR_sessions_cache.end() && sessionElem->second->isActive()) {
+				return false;
+			}
+		}
+
+		std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+		std::vector<std::string> missingDevices{};
+		m_localStorage->get_devicesWithoutSession(m_db_Uid, std::list<std::string>{deviceId}, missingDevices);
+		if (missingDevices.empty()) {
+			return false;
+		}
+
+		// the session is not kept in cache, it is loaded from local storage at first encryption
+		return DRsession->save();
+	}
+
+	template <typename Curve>
+	size_t Lime<Curve>::DRcache_warm(const std::string &deviceId, const long int sessionId) {
+		// do not wait for the peer device lock: if someone holds it, a foreground operation is already loading this session
+		auto peerLock = m_peerDeviceLocks.try_lock(deviceId);
+		if (!peerLock.owns_lock()) {
+			return 0;
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_DR_sessions_cache.find(deviceId) != m_DR_sessions_cache.end()) {
+				return 0;
+			}
+		}
+
+		auto DRsession = make_DR_from_localStorage<Curve>(m_localStorage, sessionId, m_RNG);
+		if (!DRsession->isActive()) { // the session was staled since the warmer selected it
+			return 0;
+		}
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_DR_sessions_cache.emplace(deviceId, DRsession);
+		return DRsession->memoryFootprint();
+	}
+
 	/* instantiate Lime for C255 and C448 */
 #ifdef EC25519_ENABLED
 	template class Lime<C255>;
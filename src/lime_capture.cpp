@@ -0,0 +1,139 @@
+/*
+	lime_capture.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime_capture.hpp"
+#include "bctoolbox/exception.hh"
+#include <algorithm>
+#include <sstream>
+
+namespace lime {
+	namespace {
+		thread_local capture::Decryption *currentCapturedDecryption{nullptr};
+
+		uint64_t elapsed_us(const Capture::time_point from, const Capture::time_point to) {
+			return static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(to - from).count(), 0));
+		}
+
+		const char *status2String(const lime::CallbackReturn status) {
+			return (status == lime::CallbackReturn::success)?"ok":"fail";
+		}
+	}
+
+	Capture::Capture(const std::string &filename) : m_file{filename, std::ios::out|std::ios::trunc}, m_start{now()} {
+		if (!m_file) {
+			throw BCTBX_EXCEPTION << "Cannot open capture file "<<filename;
+		}
+		m_file<<"# lime capture 1"<<std::endl;
+	}
+
+	/* Must be called with m_mutex held */
+	std::string Capture::devicePseudonym(const std::string &deviceId) {
+		auto pseudonym = m_devices.emplace(deviceId, m_devices.size()).first->second;
+		return std::string{"d"}.append(std::to_string(pseudonym));
+	}
+
+	/* Must be called with m_mutex held */
+	void Capture::write(const uint64_t start, const char *operation, const std::string &status, const std::string &details) {
+		m_file<<start<<" "<<operation<<" "<<elapsed_us(m_start, now()) - start<<" "<<status<<" "<<details<<"\n";
+	}
+
+	/**
+	 * @brief Record a user management operation once completed: create_user, delete_user or update
+	 *
+	 * @param[in]	start		when the operation was requested
+	 * @param[in]	operation	the operation name
+	 * @param[in]	localDeviceId	the local device
+	 * @param[in]	algos		the base algorithms involved
+	 * @param[in]	status		the operation status
+	 */
+	void Capture::userOperation(const time_point start, const char *operation, const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const lime::CallbackReturn status) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::ostringstream details;
+		details<<"device="<<devicePseudonym(localDeviceId)<<" curves="<<CurveId2String(algos);
+		write(elapsed_us(m_start, start), operation, status2String(status), details.str());
+	}
+
+	/**
+	 * @brief Record an encryption once completed
+	 *
+	 * @param[in]	start			when the encryption was requested
+	 * @param[in]	localDeviceId		the sender device
+	 * @param[in]	algos			the sender base algorithms
+	 * @param[in]	encryptionContext	the encryption context, as given to the callback
+	 * @param[in]	newRecipients		number of recipients not known to the sender before this encryption
+	 * @param[in]	status			the encryption status
+	 */
+	void Capture::encrypt(const time_point start, const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const lime::EncryptionContext &encryptionContext, const size_t newRecipients, const lime::CallbackReturn status) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::ostringstream details;
+		const std::string groupId{encryptionContext.m_associatedData.cbegin(), encryptionContext.m_associatedData.cend()};
+		size_t output = encryptionContext.m_cipherMessage.size();
+		details<<"device="<<devicePseudonym(localDeviceId)<<" curves="<<CurveId2String(algos)
+			<<" group=g"<<m_groups.emplace(groupId, m_groups.size()).first->second
+			<<" policy="<<static_cast<unsigned int>(encryptionContext.m_encryptionPolicy)
+			<<" plaintext="<<encryptionContext.m_plainMessage.size()<<" recipients=";
+		for (size_t i=0; i<encryptionContext.m_recipients.size(); i++) {
+			const auto &recipient = encryptionContext.m_recipients[i];
+			details<<(i>0?",":"")<<devicePseudonym(recipient.deviceId);
+			output += recipient.DRmessage.size();
+		}
+		details<<" new="<<newRecipients<<" output="<<output;
+		write(elapsed_us(m_start, start), "encrypt", status2String(status), details.str());
+	}
+
+	/**
+	 * @brief Record a decryption
+	 *
+	 * @param[in]	start			when the decryption was requested
+	 * @param[in]	localDeviceId		the recipient device
+	 * @param[in]	algo			the recipient base algorithm
+	 * @param[in]	associatedData		the group id
+	 * @param[in]	senderDeviceId		the sender device
+	 * @param[in]	DRmessageSize		size of the DR message
+	 * @param[in]	cipherMessageSize	size of the cipher message, 0 if none
+	 * @param[in]	plaintextSize		size of the decrypted message
+	 * @param[in]	skipped			number of message keys skipped to reach this message
+	 * @param[in]	late			true if this message was decrypted with a skipped message key
+	 * @param[in]	status			the decryption status
+	 */
+	void Capture::decrypt(const time_point start, const std::string &localDeviceId, const lime::CurveId algo, const std::vector<uint8_t> &associatedData, const std::string &senderDeviceId,
+			const size_t DRmessageSize, const size_t cipherMessageSize, const size_t plaintextSize, const uint32_t skipped, const bool late, const lime::PeerDeviceStatus status) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::ostringstream details;
+		const std::string groupId{associatedData.cbegin(), associatedData.cend()};
+		details<<"device="<<devicePseudonym(localDeviceId)<<" curve="<<CurveId2String(algo)
+			<<" group=g"<<m_groups.emplace(groupId, m_groups.size()).first->second
+			<<" sender="<<devicePseudonym(senderDeviceId)
+			<<" dr="<<DRmessageSize<<" cipher="<<cipherMessageSize<<" plaintext="<<plaintextSize
+			<<" skipped="<<skipped<<" late="<<(late?1:0);
+		write(elapsed_us(m_start, start), "decrypt", PeerDeviceStatus2String(status), details.str());
+	}
+
+	namespace capture {
+		Decryption::Decryption() noexcept : m_previous{currentCapturedDecryption}, skipped{0}, late{false} {
+			currentCapturedDecryption = this;
+		}
+		Decryption::~Decryption() {
+			currentCapturedDecryption = m_previous;
+		}
+		Decryption *currentDecryption(void) noexcept {
+			return currentCapturedDecryption;
+		}
+	} // namespace capture
+} // namespace lime
@@ -0,0 +1,99 @@
+/*
+	lime_capture.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef lime_capture_hpp
+#define lime_capture_hpp
+
+#include "lime/lime.hpp"
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+namespace lime {
+	/** @brief Record of the operations run by a LimeManager, started by LimeManager::start_capture
+	 *
+	 * The capture is anonymized: device and group ids are replaced by pseudonyms(d0, d1.. and g0, g1..) given in order of
+	 * appearance, it holds no key material nor message content, only sizes, counts, status and timing.
+	 * It is a text file, a header line then one line per operation:
+	 *
+	 *	# lime capture 1
+	 *	<start us> <operation> <duration us> <status> <key>=<value>...
+	 *
+	 * start is counted from the capture start, operations and their keys are:
+	 *	- create_user, delete_user, update : device, curves
+	 *	- encrypt : device, curves, group, policy, plaintext(bytes), recipients(pseudonyms list), new(recipients met for the first time), output(bytes: cipher message and DR messages)
+	 *	- decrypt : device, curve, group, sender, dr(bytes), cipher(bytes), plaintext(bytes), skipped(message keys skipped by this message), late(1 if decrypted with a skipped message key)
+	 * status is ok or fail, decrypt gives the peer device status(trusted, untrusted, unsafe, unknown or fail)
+	 */
+	class Capture {
+		private:
+			std::mutex m_mutex; /**< protect the file and the pseudonyms maps: operations complete on any thread */
+			std::ofstream m_file;
+			const std::chrono::steady_clock::time_point m_start;
+			std::unordered_map<std::string, size_t> m_devices; /**< device id -> pseudonym index */
+			std::unordered_map<std::string, size_t> m_groups; /**< group id(associated data) -> pseudonym index */
+
+			std::string devicePseudonym(const std::string &deviceId);
+			void write(const uint64_t start, const char *operation, const std::string &status, const std::string &details);
+
+		public:
+			using time_point = std::chrono::steady_clock::time_point;
+			/// @throw BCTBX_EXCEPTION if the file cannot be opened
+			explicit Capture(const std::string &filename);
+			Capture(const Capture &) = delete;
+			Capture &operator=(const Capture &) = delete;
+
+			static time_point now(void) noexcept {return std::chrono::steady_clock::now();}
+			void userOperation(const time_point start, const char *operation, const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const lime::CallbackReturn status);
+			void encrypt(const time_point start, const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const lime::EncryptionContext &encryptionContext, const size_t newRecipients, const lime::CallbackReturn status);
+			void decrypt(const time_point start, const std::string &localDeviceId, const lime::CurveId algo, const std::vector<uint8_t> &associatedData, const std::string &senderDeviceId,
+					const size_t DRmessageSize, const size_t cipherMessageSize, const size_t plaintextSize, const uint32_t skipped, const bool late, const lime::PeerDeviceStatus status);
+	};
+
+	namespace capture {
+		/**
+		 * @brief Collect the skipped messages seen by a decryption running on this thread
+		 *
+		 * Created around a captured decryption, the Double Ratchet reports to it through skippedKeys and lateMessage
+		 */
+		class Decryption {
+			private:
+				Decryption *m_previous;
+			public:
+				uint32_t skipped; /**< message keys skipped to reach the decrypted message */
+				bool late; /**< the message was decrypted with a skipped message key */
+				Decryption() noexcept;
+				Decryption(const Decryption &) = delete;
+				Decryption &operator=(const Decryption &) = delete;
+				~Decryption();
+		};
+
+		/// the decryption collected on this thread, nullptr if none
+		Decryption *currentDecryption(void) noexcept;
+		/// the Double Ratchet skipped message keys
+		inline void skippedKeys(const uint32_t n) noexcept {
+			if (auto decryption = currentDecryption()) decryption->skipped += n;
+		}
+		/// the Double Ratchet used a skipped message key
+		inline void lateMessage(void) noexcept {
+			if (auto decryption = currentDecryption()) decryption->late = true;
+		}
+	} // namespace capture
+} // namespace lime
+
+#endif /* lime_capture_hpp */
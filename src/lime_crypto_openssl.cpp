@@ -0,0 +1,529 @@
+/*
+	lime_crypto_openssl.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_crypto_openssl.hpp"
+#include "bctoolbox/exception.hh"
+
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/bn.h>
+#include <openssl/core_names.h>
+#include <openssl/params.h>
+
+namespace lime {
+namespace openssl {
+
+namespace {
+	/* RAII holders for OpenSSL objects */
+	struct EVP_PKEY_deleter { void operator()(EVP_PKEY *p) const { EVP_PKEY_free(p); } };
+	struct EVP_PKEY_CTX_deleter { void operator()(EVP_PKEY_CTX *p) const { EVP_PKEY_CTX_free(p); } };
+	struct EVP_MD_CTX_deleter { void operator()(EVP_MD_CTX *p) const { EVP_MD_CTX_free(p); } };
+	struct EVP_CIPHER_CTX_deleter { void operator()(EVP_CIPHER_CTX *p) const { EVP_CIPHER_CTX_free(p); } };
+	struct EVP_MAC_CTX_deleter { void operator()(EVP_MAC_CTX *p) const { EVP_MAC_CTX_free(p); } };
+	struct EVP_KDF_CTX_deleter { void operator()(EVP_KDF_CTX *p) const { EVP_KDF_CTX_free(p); } };
+	struct BN_CTX_deleter { void operator()(BN_CTX *p) const { BN_CTX_free(p); } };
+	struct BN_deleter { void operator()(BIGNUM *p) const { BN_clear_free(p); } };
+	using pkey_ptr = std::unique_ptr<EVP_PKEY, EVP_PKEY_deleter>;
+	using pkey_ctx_ptr = std::unique_ptr<EVP_PKEY_CTX, EVP_PKEY_CTX_deleter>;
+	using md_ctx_ptr = std::unique_ptr<EVP_MD_CTX, EVP_MD_CTX_deleter>;
+	using cipher_ctx_ptr = std::unique_ptr<EVP_CIPHER_CTX, EVP_CIPHER_CTX_deleter>;
+	using mac_ctx_ptr = std::unique_ptr<EVP_MAC_CTX, EVP_MAC_CTX_deleter>;
+	using kdf_ctx_ptr = std::unique_ptr<EVP_KDF_CTX, EVP_KDF_CTX_deleter>;
+	using bn_ctx_ptr = std::unique_ptr<BN_CTX, BN_CTX_deleter>;
+	using bn_ptr = std::unique_ptr<BIGNUM, BN_deleter>;
+
+	/* Algorithms are fetched once: implicit fetch performed by EVP_aes_256_gcm() and alike at each init is costly with OpenSSL 3 */
+	struct fetchedAlgorithms {
+		EVP_CIPHER *aes256gcm;
+		EVP_MAC *hmac;
+		EVP_KDF *hkdf;
+		EVP_MD *sha512;
+		EVP_MD *shake256;
+		fetchedAlgorithms() :
+			aes256gcm{EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr)},
+			hmac{EVP_MAC_fetch(nullptr, "HMAC", nullptr)},
+			hkdf{EVP_KDF_fetch(nullptr, "HKDF", nullptr)},
+			sha512{EVP_MD_fetch(nullptr, "SHA512", nullptr)},
+			shake256{EVP_MD_fetch(nullptr, "SHAKE256", nullptr)} {
+			if (aes256gcm == nullptr || hmac == nullptr || hkdf == nullptr || sha512 == nullptr || shake256 == nullptr) {
+				throw BCTBX_EXCEPTION << "OpenSSL crypto provider: unable to fetch algorithms";
+			}
+		}
+		~fetchedAlgorithms() {
+			EVP_CIPHER_free(aes256gcm);
+			EVP_MAC_free(hmac);
+			EVP_KDF_free(hkdf);
+			EVP_MD_free(sha512);
+			EVP_MD_free(shake256);
+		}
+	};
+	const fetchedAlgorithms &algorithms(void) {
+		static const fetchedAlgorithms algos{};
+		return algos;
+	}
+
+	/* OpenSSL key types and Edwards to Montgomery conversion parameters */
+	template <typename Curve> struct curveParam;
+#ifdef EC25519_ENABLED
+	template <> struct curveParam<C255> {
+		static constexpr int ecdh = EVP_PKEY_X25519;
+		static constexpr int eddsa = EVP_PKEY_ED25519;
+		static constexpr const char *p = "7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffed"; // 2^255 - 19
+	};
+#endif //EC25519_ENABLED
+#ifdef EC448_ENABLED
+	template <> struct curveParam<C448> {
+		static constexpr int ecdh = EVP_PKEY_X448;
+		static constexpr int eddsa = EVP_PKEY_ED448;
+		static constexpr const char *p = "fffffffffffffffffffffffffffffffffffffffffffffffffffffffeffffffffffffffffffffffffffffffffffffffffffffffffffffffff"; // 2^448 - 2^224 - 1
+		static constexpr unsigned long d = 39081; // edwards448 d = -39081
+	};
+#endif //EC448_ENABLED
+
+	/**
+	 * @brief Convert an EdDSA private key into a key exchange one
+	 * Hash the EdDSA private key and keep the first bytes of it(SHA512 for 25519, SHAKE256 for 448)
+	 */
+	template <typename Curve>
+	void convertPrivateKey(const DSA<Curve, lime::DSAtype::privateKey> &ed, X<Curve, lime::Xtype::privateKey> &x) {
+		md_ctx_ptr ctx{EVP_MD_CTX_new()};
+		int ret = 0;
+		if constexpr (std::is_same_v<Curve, C448>) {
+			ret = ctx
+				&& EVP_DigestInit_ex(ctx.get(), algorithms().shake256, nullptr) == 1
+				&& EVP_DigestUpdate(ctx.get(), ed.data(), ed.size()) == 1
+				&& EVP_DigestFinalXOF(ctx.get(), x.data(), x.size()) == 1;
+		} else {
+			sBuffer<64> h;
+			ret = ctx
+				&& EVP_DigestInit_ex(ctx.get(), algorithms().sha512, nullptr) == 1
+				&& EVP_DigestUpdate(ctx.get(), ed.data(), ed.size()) == 1
+				&& EVP_DigestFinal_ex(ctx.get(), h.data(), nullptr) == 1;
+			std::copy_n(h.cbegin(), x.size(), x.begin());
+		}
+		if (ret != 1) {
+			throw BCTBX_EXCEPTION << "OpenSSL crypto provider: EdDSA to ECDH private key conversion failed";
+		}
+	}
+
+	/**
+	 * @brief Convert an EdDSA public key into a key exchange one
+	 *	- 25519: u = (1+y)/(1-y)
+	 *	- 448: u = y^2 * (1-dy^2) / (1-y^2)
+	 */
+	template <typename Curve>
+	void convertPublicKey(const DSA<Curve, lime::DSAtype::publicKey> &ed, X<Curve, lime::Xtype::publicKey> &x) {
+		bn_ctx_ptr ctx{BN_CTX_new()};
+		BIGNUM *p = nullptr;
+		if (!ctx || BN_hex2bn(&p, curveParam<Curve>::p) == 0) {
+			BN_free(p);
+			throw BCTBX_EXCEPTION << "OpenSSL crypto provider: EdDSA to ECDH public key conversion failed";
+		}
+		bn_ptr P{p};
+
+		// decode y: little endian, the MSb of the encoding is the sign of x and is ignored
+		std::array<uint8_t, DSA<Curve, lime::DSAtype::publicKey>::ssize()> encodedY{};
+		std::copy_n(ed.cbegin(), encodedY.size(), encodedY.begin());
+		encodedY.back() &= 0x7F;
+		bn_ptr y{BN_lebin2bn(encodedY.data(), static_cast<int>(encodedY.size()), nullptr)};
+		bn_ptr n{BN_new()}, d{BN_new()}, u{BN_new()};
+		bool ok = y && n && d && u && BN_nnmod(y.get(), y.get(), P.get(), ctx.get());
+
+		if constexpr (std::is_same_v<Curve, C448>) {
+			bn_ptr y2{BN_new()}, dy2{BN_new()};
+			ok = ok && y2 && dy2
+				&& BN_mod_sqr(y2.get(), y.get(), P.get(), ctx.get()) // y^2
+				&& BN_mod_sub(d.get(), BN_value_one(), y2.get(), P.get(), ctx.get()) // 1-y^2
+				&& BN_copy(dy2.get(), y2.get()) && BN_mul_word(dy2.get(), curveParam<Curve>::d) // -dy^2
+				&& BN_mod_add(n.get(), BN_value_one(), dy2.get(), P.get(), ctx.get()) // 1-dy^2
+				&& BN_mod_mul(n.get(), n.get(), y2.get(), P.get(), ctx.get()); // y^2 * (1-dy^2)
+		} else {
+			ok = ok
+				&& BN_mod_add(n.get(), BN_value_one(), y.get(), P.get(), ctx.get()) // 1+y
+				&& BN_mod_sub(d.get(), BN_value_one(), y.get(), P.get(), ctx.get()); // 1-y
+		}
+		if (ok) {
+			if (BN_is_zero(d.get())) { // invalid point, the conversion gives 0 as 1/0 is treated as 0
+				BN_zero(u.get());
+			} else {
+				ok = BN_mod_inverse(d.get(), d.get(), P.get(), ctx.get()) != nullptr
+					&& BN_mod_mul(u.get(), n.get(), d.get(), P.get(), ctx.get());
+			}
+		}
+		if (!ok || BN_bn2lebinpad(u.get(), x.data(), static_cast<int>(x.size())) != static_cast<int>(x.size())) {
+			throw BCTBX_EXCEPTION << "OpenSSL crypto provider: EdDSA to ECDH public key conversion failed";
+		}
+	}
+} // anonymous namespace
+
+/***** Key Exchange ******************/
+/**
+ * @brief an OpenSSL implementation of the key exchange interface
+ *
+ * Provides X25519 and X448
+ */
+template <typename Curve>
+class openssl_ECDH : public keyExchange<Curve> {
+	private :
+		X<Curve, lime::Xtype::privateKey> m_secret;
+		X<Curve, lime::Xtype::publicKey> m_selfPublic;
+		X<Curve, lime::Xtype::publicKey> m_peerPublic;
+		X<Curve, lime::Xtype::sharedSecret> m_sharedSecret;
+		bool m_haveSecret, m_haveSelfPublic, m_havePeerPublic, m_haveSharedSecret;
+		pkey_ptr m_secretKey; // parsed secret key, reset when the secret is changed
+
+		EVP_PKEY *secretKey(void) {
+			if (!m_haveSecret) {
+				throw BCTBX_EXCEPTION << "invalid ECDH secret key";
+			}
+			if (!m_secretKey) {
+				m_secretKey.reset(EVP_PKEY_new_raw_private_key(curveParam<Curve>::ecdh, nullptr, m_secret.data(), m_secret.size()));
+				if (!m_secretKey) {
+					throw BCTBX_EXCEPTION << "OpenSSL crypto provider: invalid ECDH secret key";
+				}
+			}
+			return m_secretKey.get();
+		}
+	public :
+		/* accessors */
+		const X<Curve, lime::Xtype::privateKey> get_secret(void) override {
+			if (!m_haveSecret) {
+				throw BCTBX_EXCEPTION << "invalid ECDH secret key";
+			}
+			return m_secret;
+		}
+		const X<Curve, lime::Xtype::publicKey> get_selfPublic(void) override {
+			if (!m_haveSelfPublic) {
+				throw BCTBX_EXCEPTION << "invalid ECDH self public key";
+			}
+			return m_selfPublic;
+		}
+		const X<Curve, lime::Xtype::publicKey> get_peerPublic(void) override {
+			if (!m_havePeerPublic) {
+				throw BCTBX_EXCEPTION << "invalid ECDH peer public key";
+			}
+			return m_peerPublic;
+		}
+		const X<Curve, lime::Xtype::sharedSecret> get_sharedSecret(void) override {
+			if (!m_haveSharedSecret) {
+				throw BCTBX_EXCEPTION << "invalid ECDH shared secret";
+			}
+			return m_sharedSecret;
+		}
+
+		/* Setting keys, accept Signature keys */
+		void set_secret(const X<Curve, lime::Xtype::privateKey> &secret) override {
+			m_secret = secret;
+			m_haveSecret = true;
+			m_secretKey.reset();
+		}
+
+		void set_secret(const DSA<Curve, lime::DSAtype::privateKey> &secret) override {
+			convertPrivateKey<Curve>(secret, m_secret);
+			m_haveSecret = true;
+			m_secretKey.reset();
+		}
+
+		void set_selfPublic(const X<Curve, lime::Xtype::publicKey> &selfPublic) override {
+			m_selfPublic = selfPublic;
+			m_haveSelfPublic = true;
+		}
+
+		void set_selfPublic(const DSA<Curve, lime::DSAtype::publicKey> &selfPublic) override {
+			convertPublicKey<Curve>(selfPublic, m_selfPublic);
+			m_haveSelfPublic = true;
+		}
+
+		void set_peerPublic(const X<Curve, lime::Xtype::publicKey> &peerPublic) override {
+			m_peerPublic = peerPublic;
+			m_havePeerPublic = true;
+		}
+
+		void set_peerPublic(const DSA<Curve, lime::DSAtype::publicKey> &peerPublic) override {
+			convertPublicKey<Curve>(peerPublic, m_peerPublic);
+			m_havePeerPublic = true;
+		}
+
+		void createKeyPair(std::shared_ptr<lime::RNG> rng) override {
+			// Generate a random secret key
+			X<Curve, lime::Xtype::privateKey> secret;
+			rng->randomize(secret.data(), secret.size());
+			// set it in the context
+			set_secret(secret);
+			// and generate the public value
+			deriveSelfPublic();
+		}
+
+		void deriveSelfPublic(void) override {
+			size_t size = m_selfPublic.size();
+			if (EVP_PKEY_get_raw_public_key(secretKey(), m_selfPublic.data(), &size) != 1 || size != m_selfPublic.size()) {
+				throw BCTBX_EXCEPTION << "OpenSSL crypto provider: ECDH public key derivation failed";
+			}
+			m_haveSelfPublic = true;
+		}
+
+		void computeSharedSecret(void) override {
+			if (!m_havePeerPublic) {
+				throw BCTBX_EXCEPTION << "invalid ECDH peer public key";
+			}
+			pkey_ptr peer{EVP_PKEY_new_raw_public_key(curveParam<Curve>::ecdh, nullptr, m_peerPublic.data(), m_peerPublic.size())};
+			pkey_ctx_ptr ctx{EVP_PKEY_CTX_new_from_pkey(nullptr, secretKey(), nullptr)};
+			size_t size = m_sharedSecret.size();
+			if (!peer || !ctx
+				|| EVP_PKEY_derive_init(ctx.get()) != 1
+				|| EVP_PKEY_derive_set_peer_ex(ctx.get(), peer.get(), 0) != 1
+				|| EVP_PKEY_derive(ctx.get(), m_sharedSecret.data(), &size) != 1
+				|| size != m_sharedSecret.size()) {
+				throw BCTBX_EXCEPTION << "OpenSSL crypto provider: ECDH shared secret computation failed";
+			}
+			m_haveSharedSecret = true;
+		}
+
+		openssl_ECDH() : m_secret{}, m_selfPublic{}, m_peerPublic{}, m_sharedSecret{},
+			m_haveSecret{false}, m_haveSelfPublic{false}, m_havePeerPublic{false}, m_haveSharedSecret{false}, m_secretKey{} {}
+}; // class openssl_ECDH
+
+/***** Signature  ********************/
+/**
+ * @brief an OpenSSL implementation of the Signature interface
+ *
+ * Provides EdDSA on curves 25519 and 448(pure EdDSA, empty context)
+ */
+template <typename Curve>
+class openssl_EDDSA : public Signature<Curve> {
+	private :
+		DSA<Curve, lime::DSAtype::privateKey> m_secret;
+		DSA<Curve, lime::DSAtype::publicKey> m_public;
+		bool m_haveSecret, m_havePublic;
+		pkey_ptr m_secretKey; // parsed keys, reset when the matching buffer is changed
+		pkey_ptr m_publicKey;
+
+		EVP_PKEY *secretKey(void) {
+			if (!m_haveSecret) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA secret key";
+			}
+			if (!m_secretKey) {
+				m_secretKey.reset(EVP_PKEY_new_raw_private_key(curveParam<Curve>::eddsa, nullptr, m_secret.data(), m_secret.size()));
+				if (!m_secretKey) {
+					throw BCTBX_EXCEPTION << "OpenSSL crypto provider: invalid EdDSA secret key";
+				}
+			}
+			return m_secretKey.get();
+		}
+
+		void sign(const uint8_t *message, const size_t messageSize, DSA<Curve, lime::DSAtype::signature> &signature) {
+			md_ctx_ptr ctx{EVP_MD_CTX_new()};
+			size_t sigSize = signature.size();
+			if (!ctx
+				|| EVP_DigestSignInit(ctx.get(), nullptr, nullptr, nullptr, secretKey()) != 1
+				|| EVP_DigestSign(ctx.get(), signature.data(), &sigSize, message, messageSize) != 1
+				|| sigSize != signature.size()) {
+				throw BCTBX_EXCEPTION << "OpenSSL crypto provider: EdDSA signature failed";
+			}
+		}
+
+	public :
+		/* accessors */
+		const DSA<Curve, lime::DSAtype::privateKey> get_secret(void) override {
+			if (!m_haveSecret) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA secret key";
+			}
+			return m_secret;
+		}
+		const DSA<Curve, lime::DSAtype::publicKey> get_public(void) override {
+			if (!m_havePublic) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA public key";
+			}
+			return m_public;
+		}
+
+		/* Setting keys */
+		void set_secret(const DSA<Curve, lime::DSAtype::privateKey> &secretKey) override {
+			m_secret = secretKey;
+			m_haveSecret = true;
+			m_secretKey.reset();
+		}
+
+		void set_public(const DSA<Curve, lime::DSAtype::publicKey> &publicKey) override {
+			m_public = publicKey;
+			m_havePublic = true;
+			m_publicKey.reset();
+		}
+
+		void createKeyPair(std::shared_ptr<lime::RNG> rng) override {
+			// Generate a random secret key
+			DSA<Curve, lime::DSAtype::privateKey> secret;
+			rng->randomize(secret.data(), secret.size());
+			// set it in the context
+			set_secret(secret);
+			// and generate the public value
+			derivePublic();
+		}
+
+		void derivePublic(void) override {
+			size_t size = m_public.size();
+			if (EVP_PKEY_get_raw_public_key(secretKey(), m_public.data(), &size) != 1 || size != m_public.size()) {
+				throw BCTBX_EXCEPTION << "OpenSSL crypto provider: EdDSA public key derivation failed";
+			}
+			m_havePublic = true;
+			m_publicKey.reset();
+		}
+
+		void sign(const std::vector<uint8_t> &message, DSA<Curve, lime::DSAtype::signature> &signature) override {
+			sign(message.data(), message.size(), signature);
+		}
+
+		void sign(const X<Curve, lime::Xtype::publicKey> &message, DSA<Curve, lime::DSAtype::signature> &signature) override {
+			sign(message.data(), message.size(), signature);
+		}
+
+		bool verify(const std::vector<uint8_t> &message, const DSA<Curve, lime::DSAtype::signature> &signature) override {
+			return verify(message.data(), message.size(), signature);
+		}
+
+		bool verify(const X<Curve, lime::Xtype::publicKey> &message, const DSA<Curve, lime::DSAtype::signature> &signature) override {
+			return verify(message.data(), message.size(), signature);
+		}
+
+		bool verify(const uint8_t *message, const size_t messageSize, const DSA<Curve, lime::DSAtype::signature> &signature) override {
+			if (!m_havePublic) {
+				throw BCTBX_EXCEPTION << "invalid EdDSA public key";
+			}
+			if (!m_publicKey) {
+				m_publicKey.reset(EVP_PKEY_new_raw_public_key(curveParam<Curve>::eddsa, nullptr, m_public.data(), m_public.size()));
+				if (!m_publicKey) return false;
+			}
+			md_ctx_ptr ctx{EVP_MD_CTX_new()};
+			return (ctx
+				&& EVP_DigestVerifyInit(ctx.get(), nullptr, nullptr, nullptr, m_publicKey.get()) == 1
+				&& EVP_DigestVerify(ctx.get(), signature.data(), signature.size(), message, messageSize) == 1);
+		}
+
+		openssl_EDDSA() : m_secret{}, m_public{}, m_haveSecret{false}, m_havePublic{false}, m_secretKey{}, m_publicKey{} {}
+}; // class openssl_EDDSA
+
+/* Factory functions */
+template <typename Curve>
+std::shared_ptr<keyExchange<Curve>> make_keyExchange() {
+	return std::make_shared<openssl_ECDH<Curve>>();
+}
+
+template <typename Curve>
+std::shared_ptr<Signature<Curve>> make_Signature() {
+	return std::make_shared<openssl_EDDSA<Curve>>();
+}
+
+/***** HMAC and HKDF *****************/
+void HMAC_SHA512(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) {
+	/* each thread keeps an HMAC-SHA512 context with no key, it is duplicated for each computation so the digest is not fetched again */
+	thread_local mac_ctx_ptr hmacSHA512{[]() {
+		mac_ctx_ptr ctx{EVP_MAC_CTX_new(algorithms().hmac)};
+		OSSL_PARAM params[] = {
+			OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char *>("SHA512"), 0),
+			OSSL_PARAM_construct_end()};
+		if (!ctx || EVP_MAC_CTX_set_params(ctx.get(), params) != 1) {
+			throw BCTBX_EXCEPTION << "OpenSSL crypto provider: unable to create HMAC-SHA512 context";
+		}
+		return ctx;
+	}()};
+
+	mac_ctx_ptr ctx{EVP_MAC_CTX_dup(hmacSHA512.get())};
+	// a null key tells OpenSSL to reuse the previous one: always give a valid pointer, even for an empty key
+	const uint8_t emptyKey = 0;
+	sBuffer<64> output;
+	size_t outputSize = 0;
+	if (!ctx
+		|| EVP_MAC_init(ctx.get(), (key != nullptr)?key:&emptyKey, keySize, nullptr) != 1
+		|| EVP_MAC_update(ctx.get(), input, inputSize) != 1
+		|| EVP_MAC_final(ctx.get(), output.data(), &outputSize, output.size()) != 1) {
+		throw BCTBX_EXCEPTION << "OpenSSL crypto provider: HMAC-SHA512 failed";
+	}
+	std::copy_n(output.cbegin(), std::min(outputSize, hashSize), hash);
+}
+
+void HKDF_SHA512(const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize) {
+	kdf_ctx_ptr ctx{EVP_KDF_CTX_new(algorithms().hkdf)};
+	const uint8_t empty = 0;
+	OSSL_PARAM params[] = {
+		OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, const_cast<char *>("SHA512"), 0),
+		OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY, const_cast<uint8_t *>((ikm != nullptr)?ikm:&empty), ikmSize),
+		OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT, const_cast<uint8_t *>((salt != nullptr)?salt:&empty), saltSize),
+		OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO, const_cast<char *>((info != nullptr)?info:reinterpret_cast<const char *>(&empty)), infoSize),
+		OSSL_PARAM_construct_end()};
+	if (!ctx || EVP_KDF_derive(ctx.get(), output, outputSize, params) != 1) {
+		throw BCTBX_EXCEPTION << "OpenSSL crypto provider: HKDF-SHA512 failed";
+	}
+}
+
+/***** AEAD **************************/
+void AES256GCM_encrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+	cipher_ctx_ptr ctx{EVP_CIPHER_CTX_new()};
+	int len = 0;
+	if (!ctx
+		|| EVP_EncryptInit_ex(ctx.get(), algorithms().aes256gcm, nullptr, nullptr, nullptr) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(IVSize), nullptr) != 1
+		|| EVP_EncryptInit_ex(ctx.get(), nullptr, nullptr, key, IV) != 1
+		|| (ADSize > 0 && EVP_EncryptUpdate(ctx.get(), nullptr, &len, AD, static_cast<int>(ADSize)) != 1)
+		|| (plainSize > 0 && EVP_EncryptUpdate(ctx.get(), cipher, &len, plain, static_cast<int>(plainSize)) != 1)
+		|| EVP_EncryptFinal_ex(ctx.get(), cipher + plainSize, &len) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_GET_TAG, static_cast<int>(tagSize), tag) != 1) {
+		throw BCTBX_EXCEPTION << "OpenSSL crypto provider: AES256-GCM encryption failed";
+	}
+}
+
+bool AES256GCM_decrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+	cipher_ctx_ptr ctx{EVP_CIPHER_CTX_new()};
+	int len = 0;
+	if (!ctx
+		|| EVP_DecryptInit_ex(ctx.get(), algorithms().aes256gcm, nullptr, nullptr, nullptr) != 1
+		|| EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(IVSize), nullptr) != 1
+		|| EVP_DecryptInit_ex(ctx.get(), nullptr, nullptr, key, IV) != 1
+		|| (ADSize > 0 && EVP_DecryptUpdate(ctx.get(), nullptr, &len, AD, static_cast<int>(ADSize)) != 1)
+		|| (cipherSize > 0 && EVP_DecryptUpdate(ctx.get(), plain, &len, cipher, static_cast<int>(cipherSize)) != 1)
+		|| EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_TAG, static_cast<int>(tagSize), const_cast<uint8_t *>(tag)) != 1) {
+		throw BCTBX_EXCEPTION << "OpenSSL crypto provider: AES256-GCM decryption failed";
+	}
+	// final checks the tag
+	if (EVP_DecryptFinal_ex(ctx.get(), plain + cipherSize, &len) != 1) {
+		cleanBuffer(plain, cipherSize); // do not leave unauthenticated plain text
+		return false;
+	}
+	return true;
+}
+
+/* template instanciations for Curve 25519 and Curve 448 */
+#ifdef EC25519_ENABLED
+	template class openssl_ECDH<C255>;
+	template class openssl_EDDSA<C255>;
+	template std::shared_ptr<keyExchange<C255>> make_keyExchange();
+	template std::shared_ptr<Signature<C255>> make_Signature();
+#endif //EC25519_ENABLED
+
+#ifdef EC448_ENABLED
+	template class openssl_ECDH<C448>;
+	template class openssl_EDDSA<C448>;
+	template std::shared_ptr<keyExchange<C448>> make_keyExchange();
+	template std::shared_ptr<Signature<C448>> make_Signature();
+#endif //EC448_ENABLED
+
+} // namespace openssl
+} // namespace lime
@@ -0,0 +1,72 @@
+/*
+	lime_crypto_openssl.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef lime_crypto_openssl_hpp
+#define lime_crypto_openssl_hpp
+
+#include "lime_crypto_primitives.hpp"
+
+/* OpenSSL implementation of the crypto primitives, used by lime_crypto_primitives.cpp when the openssl provider is selected
+ * Sizes check is performed by the caller: these functions expect buffers matching the algorithm requirements */
+namespace lime {
+namespace openssl {
+
+template <typename Curve>
+std::shared_ptr<keyExchange<Curve>> make_keyExchange();
+
+template <typename Curve>
+std::shared_ptr<Signature<Curve>> make_Signature();
+
+/**
+ * @brief HMAC-SHA512 with output truncated to hashSize (max 64 bytes)
+ */
+void HMAC_SHA512(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize);
+
+/**
+ * @brief HKDF(RFC5869) using SHA512
+ */
+void HKDF_SHA512(const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize);
+
+/**
+ * @brief AES256-GCM encrypt and tag
+ */
+void AES256GCM_encrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher);
+
+/**
+ * @brief AES256-GCM authenticate and decrypt
+ *
+ * @return true if the tag matches
+ */
+bool AES256GCM_decrypt(const uint8_t *const key, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
+
+#ifdef EC25519_ENABLED
+	extern template std::shared_ptr<keyExchange<C255>> make_keyExchange();
+	extern template std::shared_ptr<Signature<C255>> make_Signature();
+#endif //EC25519_ENABLED
+
+#ifdef EC448_ENABLED
+	extern template std::shared_ptr<keyExchange<C448>> make_keyExchange();
+	extern template std::shared_ptr<Signature<C448>> make_Signature();
+#endif //EC448_ENABLED
+
+} // namespace openssl
+} // namespace lime
+#endif //lime_crypto_openssl_hpp
@@ -17,6 +17,7 @@
 	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "lime_log.hpp"
 #include "lime_crypto_primitives.hpp"
 #include "bctoolbox/crypto.h"
 #include "bctoolbox/crypto.hh"
@@ -24,6 +25,20 @@
 #ifdef HAVE_BCTBXPQ
 #include "postquantumcryptoengine/crypto.hh"
 #endif /* HAVE_BCTBXPQ */
+#ifdef HAVE_OPENSSL_CRYPTO
+#include "lime_crypto_openssl.hpp"
+#endif /* HAVE_OPENSSL_CRYPTO */
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+#include <random>
+#endif
+/* multi-buffer SHA512 kernels use SIMD intrinsics selected at runtime, available with GCC and clang on x86 */
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LIME_SHA512_MULTIBUFFER_X86
+#include <immintrin.h>
+#endif
 
 namespace lime {
 /* template instanciations for Curves 25519 and 448, done  */
@@ -74,21 +89,73 @@ namespace lime {
 class bctbx_RNG : public RNG {
 	private :
 		bctoolbox::RNG m_context; // the bctoolbox RNG context
+		std::mutex m_mutex; // the context is shared by the DR sessions of a user which may be used by several threads
 
 	public:
 		uint32_t randomize() override {
+			std::lock_guard<std::mutex> lock(m_mutex);
 			uint32_t ret = m_context.randomize();
 			// we are on 31 bits: keep the uint32_t MSb set to 0 (see RNG interface definition)
 			return (ret & 0x7FFFFFFF);
 		};
 
 		void randomize(uint8_t *buffer, const size_t size) override {
+			std::lock_guard<std::mutex> lock(m_mutex);
 			m_context.randomize(buffer, size);
 		}
 }; // class bctbx_RNG
 
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+/**
+ * @brief A seeded deterministic generator: same seed, same sequence, on any platform
+ * For reproducible test and benchmark runs only: its output is predictable
+ */
+class deterministic_RNG : public RNG {
+	private :
+		std::mt19937_64 m_engine; // std::mt19937_64 output is fully specified by the standard
+		std::mutex m_mutex; // shared by all the users and sessions
+
+	public:
+		explicit deterministic_RNG(const uint64_t seed) : m_engine{seed} {};
+
+		uint32_t randomize() override {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			// keep the 31 most significant bits (see RNG interface definition)
+			return static_cast<uint32_t>(m_engine()>>33);
+		};
+
+		void randomize(uint8_t *buffer, const size_t size) override {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (size_t i=0; i<size; i+=8) {
+				auto r = m_engine();
+				for (size_t j=i; j<std::min(i+8, size); j++, r>>=8) {
+					buffer[j] = static_cast<uint8_t>(r&0xFF);
+				}
+			}
+		}
+}; // class deterministic_RNG
+
+namespace {
+	std::shared_ptr<RNG> deterministicRNG{nullptr}; // accessed through std::atomic_load/atomic_store only
+}
+
+void set_deterministic_RNG(const uint64_t seed) {
+	LIME_LOGW<<"Random number generator replaced by a deterministic one, seed "<<seed<<": keys are predictable, for test only";
+	std::atomic_store(&deterministicRNG, std::static_pointer_cast<RNG>(std::make_shared<deterministic_RNG>(seed)));
+}
+
+void clear_deterministic_RNG(void) {
+	std::atomic_store(&deterministicRNG, std::shared_ptr<RNG>{nullptr});
+}
+#endif // LIME_DETERMINISTIC_RNG_ENABLED
+
 /* Factory function */
 std::shared_ptr<RNG> make_RNG() {
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+	if (auto rng = std::atomic_load(&deterministicRNG)) {
+		return rng;
+	}
+#endif // LIME_DETERMINISTIC_RNG_ENABLED
 	return std::make_shared<bctbx_RNG>();
 }
 /***** Signature  ********************/
@@ -189,6 +256,10 @@ class bctbx_EDDSA : public Signature<Curve> {
 			return (bctbx_EDDSA_verify(m_context, message.data(), message.ssize(), nullptr, 0, signature.data(), signature.ssize()) == BCTBX_VERIFY_SUCCESS);
 		}
 
+		bool verify(const uint8_t *message, const size_t messageSize, const DSA<Curve, lime::DSAtype::signature> &signature) override {
+			return (bctbx_EDDSA_verify(m_context, message, messageSize, nullptr, 0, signature.data(), signature.size()) == BCTBX_VERIFY_SUCCESS);
+		}
+
 		bctbx_EDDSA() {
 			m_context = bctbx_EDDSAInit<Curve>();
 		}
@@ -417,14 +488,58 @@ class bctbx_KEM : public KEM<Algo> {
 }; // class bctbx_KEM
 #endif //HAVE_BCTBXPQ
 
+/***** Crypto providers **************/
+bool cryptoProviderAvailable(const CryptoProvider provider) noexcept {
+	switch (provider) {
+		case CryptoProvider::bctoolbox:
+			return true;
+		case CryptoProvider::openssl:
+#ifdef HAVE_OPENSSL_CRYPTO
+			return true;
+#else
+			return false;
+#endif
+	}
+	return false;
+}
+
+/* raise an exception when the requested provider is not part of this build */
+static void checkCryptoProvider(const CryptoProvider provider) {
+	if (!cryptoProviderAvailable(provider)) {
+		throw BCTBX_EXCEPTION << "Crypto provider "<<static_cast<int>(provider)<<" is not available in this build";
+	}
+}
+
 /* Factory functions */
 template <typename Curve>
 std::shared_ptr<keyExchange<Curve>> make_keyExchange() {
+	return make_keyExchange<Curve>(defaultCryptoProvider);
+}
+
+template <typename Curve>
+std::shared_ptr<keyExchange<Curve>> make_keyExchange(const CryptoProvider provider) {
+	checkCryptoProvider(provider);
+#ifdef HAVE_OPENSSL_CRYPTO
+	if (provider == CryptoProvider::openssl) {
+		return openssl::make_keyExchange<Curve>();
+	}
+#endif /* HAVE_OPENSSL_CRYPTO */
 	return std::make_shared<bctbx_ECDH<Curve>>();
 }
 
 template <typename Curve>
 std::shared_ptr<Signature<Curve>> make_Signature() {
+	return make_Signature<Curve>(defaultCryptoProvider);
+}
+
+template <typename Curve>
+std::shared_ptr<Signature<Curve>> make_Signature(const CryptoProvider provider) {
+	checkCryptoProvider(provider);
+#ifdef HAVE_OPENSSL_CRYPTO
+	if (provider == CryptoProvider::openssl) {
+		return openssl::make_Signature<Curve>();
+	}
+#endif /* HAVE_OPENSSL_CRYPTO */
 	return std::make_shared<bctbx_EDDSA<Curve>>();
 }
 
@@ -443,18 +558,451 @@ void HMAC(const uint8_t *const key, const size_t keySize, const uint8_t *const i
 	static_assert(sizeof(hashAlgo) != sizeof(hashAlgo), "You must specialize HMAC function template");
 }
 
+template <typename hashAlgo>
+void HMAC(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty Curve type */
+	static_assert(sizeof(hashAlgo) != sizeof(hashAlgo), "You must specialize HMAC function template");
+}
+
 /* HMAC specialized template for SHA512 */
 template <> void HMAC<SHA512>(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) {
+	HMAC<SHA512>(defaultCryptoProvider, key, keySize, input, inputSize, hash, hashSize);
+}
+
+template <> void HMAC<SHA512>(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) {
+	checkCryptoProvider(provider);
+#ifdef HAVE_OPENSSL_CRYPTO
+	if (provider == CryptoProvider::openssl) {
+		openssl::HMAC_SHA512(key, keySize, input, inputSize, hash, hashSize);
+		return;
+	}
+#endif /* HAVE_OPENSSL_CRYPTO */
 	bctbx_hmacSha512(key, keySize, input, inputSize, static_cast<uint8_t>(std::min(SHA512::ssize(),hashSize)), hash);
 }
 
+/* SHA512 block compression as specified in FIPS 180-4, bctoolbox does not give access to the hash internal state
+ * so we need our own to store the HMAC inner and outer states */
+namespace {
+	constexpr size_t SHA512_blockSize = 128;
+
+	constexpr std::array<uint64_t, 80> SHA512_K{{
+		0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL, 0x3956c25bf348b538ULL,
+		0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL, 0xd807aa98a3030242ULL, 0x12835b0145706fbeULL,
+		0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL, 0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL,
+		0xc19bf174cf692694ULL, 0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+		0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL, 0x983e5152ee66dfabULL,
+		0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL, 0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL,
+		0x06ca6351e003826fULL, 0x142929670a0e6e70ULL, 0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL,
+		0x53380d139d95b3dfULL, 0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+		0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL, 0xd192e819d6ef5218ULL,
+		0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL, 0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL,
+		0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL, 0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL,
+		0x682e6ff3d6b2b8a3ULL, 0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+		0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL, 0xca273eceea26619cULL,
+		0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL, 0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL,
+		0x113f9804bef90daeULL, 0x1b710b35131c471bULL, 0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL,
+		0x431d67c49c100d4cULL, 0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL
+	}};
+
+	constexpr std::array<uint64_t, 8> SHA512_IV{{
+		0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+		0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+	}};
+
+	inline uint64_t rotr64(const uint64_t x, const unsigned int n) {
+		return (x>>n) | (x<<(64-n));
+	}
+
+	void SHA512_compress(std::array<uint64_t, 8> &state, const uint8_t *const block) {
+		std::array<uint64_t, 80> W;
+		for (size_t t=0; t<16; t++) {
+			W[t] = 0;
+			for (size_t j=0; j<8; j++) {
+				W[t] = (W[t]<<8) | block[8*t+j];
+			}
+		}
+		for (size_t t=16; t<80; t++) {
+			uint64_t s0 = rotr64(W[t-15], 1) ^ rotr64(W[t-15], 8) ^ (W[t-15]>>7);
+			uint64_t s1 = rotr64(W[t-2], 19) ^ rotr64(W[t-2], 61) ^ (W[t-2]>>6);
+			W[t] = W[t-16] + s0 + W[t-7] + s1;
+		}
+
+		uint64_t a=state[0], b=state[1], c=state[2], d=state[3], e=state[4], f=state[5], g=state[6], h=state[7];
+		for (size_t t=0; t<80; t++) {
+			uint64_t T1 = h + (rotr64(e, 14) ^ rotr64(e, 18) ^ rotr64(e, 41)) + ((e & f) ^ (~e & g)) + SHA512_K[t] + W[t];
+			uint64_t T2 = (rotr64(a, 28) ^ rotr64(a, 34) ^ rotr64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g; g = f; f = e; e = d + T1;
+			d = c; c = b; b = a; a = T1 + T2;
+		}
+		state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+		state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+		cleanBuffer(reinterpret_cast<uint8_t *>(W.data()), W.size()*sizeof(uint64_t));
+	}
+
+	/* process input and padding starting from the given state which already absorbed prefixSize bytes (a multiple of block size)
+	 * digest is written to output (64 bytes) */
+	void SHA512_finish(std::array<uint64_t, 8> &state, const size_t prefixSize, const uint8_t *const input, const size_t inputSize, uint8_t *output) {
+		size_t index = 0;
+		while (inputSize - index >= SHA512_blockSize) {
+			SHA512_compress(state, input + index);
+			index += SHA512_blockSize;
+		}
+		// padding: 0x80 || 0x00... || message length in bits on 128 bits
+		std::array<uint8_t, 2*SHA512_blockSize> lastBlocks{};
+		size_t remaining = inputSize - index;
+		std::copy_n(input + index, remaining, lastBlocks.begin());
+		lastBlocks[remaining] = 0x80;
+		size_t lastBlocksSize = (remaining < SHA512_blockSize - 16)?SHA512_blockSize:2*SHA512_blockSize;
+		uint64_t bitLength = static_cast<uint64_t>(prefixSize + inputSize)<<3; // our inputs never reach 2^61 bytes, the 64 upper bits of length are zeros
+		for (size_t j=0; j<8; j++) {
+			lastBlocks[lastBlocksSize-1-j] = static_cast<uint8_t>(bitLength>>(8*j));
+		}
+		SHA512_compress(state, lastBlocks.data());
+		if (lastBlocksSize == 2*SHA512_blockSize) {
+			SHA512_compress(state, lastBlocks.data() + SHA512_blockSize);
+		}
+		cleanBuffer(lastBlocks.data(), lastBlocks.size());
+
+		for (size_t i=0; i<8; i++) {
+			for (size_t j=0; j<8; j++) {
+				output[8*i+j] = static_cast<uint8_t>(state[i]>>(56-8*j));
+			}
+		}
+	}
+
+	/* Multi-buffer SHA512: compress one block for several independent states, each SIMD lane holds one state */
+	inline uint64_t load_be64(const uint8_t *const p) {
+		uint64_t r = 0;
+		for (size_t j=0; j<8; j++) {
+			r = (r<<8) | p[j];
+		}
+		return r;
+	}
+
+#ifdef LIME_SHA512_MULTIBUFFER_X86
+#define AVX2_ROTR(x,n) _mm256_or_si256(_mm256_srli_epi64((x),(n)), _mm256_slli_epi64((x),64-(n)))
+	__attribute__((target("avx2")))
+	void SHA512_compress_x4(std::array<uint64_t, 8> *const *states, const uint8_t *const *blocks) {
+		__m256i W[80];
+		for (size_t t=0; t<16; t++) {
+			W[t] = _mm256_set_epi64x(static_cast<long long>(load_be64(blocks[3]+8*t)), static_cast<long long>(load_be64(blocks[2]+8*t)),
+						static_cast<long long>(load_be64(blocks[1]+8*t)), static_cast<long long>(load_be64(blocks[0]+8*t)));
+		}
+		for (size_t t=16; t<80; t++) {
+			__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(W[t-15], 1), AVX2_ROTR(W[t-15], 8)), _mm256_srli_epi64(W[t-15], 7));
+			__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(W[t-2], 19), AVX2_ROTR(W[t-2], 61)), _mm256_srli_epi64(W[t-2], 6));
+			W[t] = _mm256_add_epi64(_mm256_add_epi64(W[t-16], s0), _mm256_add_epi64(W[t-7], s1));
+		}
+
+		__m256i v[8];
+		for (size_t k=0; k<8; k++) {
+			v[k] = _mm256_set_epi64x(static_cast<long long>((*states[3])[k]), static_cast<long long>((*states[2])[k]), static_cast<long long>((*states[1])[k]), static_cast<long long>((*states[0])[k]));
+		}
+		__m256i a=v[0], b=v[1], c=v[2], d=v[3], e=v[4], f=v[5], g=v[6], h=v[7];
+		for (size_t t=0; t<80; t++) {
+			__m256i S1 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(e, 14), AVX2_ROTR(e, 18)), AVX2_ROTR(e, 41));
+			__m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+			__m256i T1 = _mm256_add_epi64(_mm256_add_epi64(_mm256_add_epi64(h, S1), _mm256_add_epi64(ch, W[t])), _mm256_set1_epi64x(static_cast<long long>(SHA512_K[t])));
+			__m256i S0 = _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(a, 28), AVX2_ROTR(a, 34)), AVX2_ROTR(a, 39));
+			__m256i maj = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+			__m256i T2 = _mm256_add_epi64(S0, maj);
+			h = g; g = f; f = e; e = _mm256_add_epi64(d, T1);
+			d = c; c = b; b = a; a = _mm256_add_epi64(T1, T2);
+		}
+		v[0] = a; v[1] = b; v[2] = c; v[3] = d; v[4] = e; v[5] = f; v[6] = g; v[7] = h;
+
+		alignas(32) uint64_t lanes[4];
+		for (size_t k=0; k<8; k++) {
+			_mm256_store_si256(reinterpret_cast<__m256i *>(lanes), v[k]);
+			for (size_t l=0; l<4; l++) {
+				(*states[l])[k] += lanes[l];
+			}
+		}
+		// clean the message schedule
+		for (size_t t=0; t<80; t++) {
+			W[t] = _mm256_setzero_si256();
+		}
+	}
+#undef AVX2_ROTR
+
+/* GCC 12 reports false uninitialized warnings from its own AVX-512 intrinsics headers (GCC bug 105593) */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+	__attribute__((target("avx512f")))
+	void SHA512_compress_x8(std::array<uint64_t, 8> *const *states, const uint8_t *const *blocks) {
+		__m512i W[80];
+		for (size_t t=0; t<16; t++) {
+			W[t] = _mm512_set_epi64(static_cast<long long>(load_be64(blocks[7]+8*t)), static_cast<long long>(load_be64(blocks[6]+8*t)),
+						static_cast<long long>(load_be64(blocks[5]+8*t)), static_cast<long long>(load_be64(blocks[4]+8*t)),
+						static_cast<long long>(load_be64(blocks[3]+8*t)), static_cast<long long>(load_be64(blocks[2]+8*t)),
+						static_cast<long long>(load_be64(blocks[1]+8*t)), static_cast<long long>(load_be64(blocks[0]+8*t)));
+		}
+		for (size_t t=16; t<80; t++) {
+			__m512i s0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi64(W[t-15], 1), _mm512_ror_epi64(W[t-15], 8)), _mm512_srli_epi64(W[t-15], 7));
+			__m512i s1 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi64(W[t-2], 19), _mm512_ror_epi64(W[t-2], 61)), _mm512_srli_epi64(W[t-2], 6));
+			W[t] = _mm512_add_epi64(_mm512_add_epi64(W[t-16], s0), _mm512_add_epi64(W[t-7], s1));
+		}
+
+		__m512i v[8];
+		for (size_t k=0; k<8; k++) {
+			v[k] = _mm512_set_epi64(static_cast<long long>((*states[7])[k]), static_cast<long long>((*states[6])[k]),
+						static_cast<long long>((*states[5])[k]), static_cast<long long>((*states[4])[k]),
+						static_cast<long long>((*states[3])[k]), static_cast<long long>((*states[2])[k]),
+						static_cast<long long>((*states[1])[k]), static_cast<long long>((*states[0])[k]));
+		}
+		__m512i a=v[0], b=v[1], c=v[2], d=v[3], e=v[4], f=v[5], g=v[6], h=v[7];
+		for (size_t t=0; t<80; t++) {
+			__m512i S1 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi64(e, 14), _mm512_ror_epi64(e, 18)), _mm512_ror_epi64(e, 41));
+			__m512i ch = _mm512_xor_si512(_mm512_and_si512(e, f), _mm512_andnot_si512(e, g));
+			__m512i T1 = _mm512_add_epi64(_mm512_add_epi64(_mm512_add_epi64(h, S1), _mm512_add_epi64(ch, W[t])), _mm512_set1_epi64(static_cast<long long>(SHA512_K[t])));
+			__m512i S0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi64(a, 28), _mm512_ror_epi64(a, 34)), _mm512_ror_epi64(a, 39));
+			__m512i maj = _mm512_xor_si512(_mm512_xor_si512(_mm512_and_si512(a, b), _mm512_and_si512(a, c)), _mm512_and_si512(b, c));
+			__m512i T2 = _mm512_add_epi64(S0, maj);
+			h = g; g = f; f = e; e = _mm512_add_epi64(d, T1);
+			d = c; c = b; b = a; a = _mm512_add_epi64(T1, T2);
+		}
+		v[0] = a; v[1] = b; v[2] = c; v[3] = d; v[4] = e; v[5] = f; v[6] = g; v[7] = h;
+
+		alignas(64) uint64_t lanes[8];
+		for (size_t k=0; k<8; k++) {
+			_mm512_store_si512(reinterpret_cast<void *>(lanes), v[k]);
+			for (size_t l=0; l<8; l++) {
+				(*states[l])[k] += lanes[l];
+			}
+		}
+		// clean the message schedule
+		for (size_t t=0; t<80; t++) {
+			W[t] = _mm512_setzero_si512();
+		}
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif // x86 with GCC or clang
+
+	/* SIMD width supported by the CPU, detected once */
+	size_t SHA512_detectLanes(void) {
+#ifdef LIME_SHA512_MULTIBUFFER_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f")) return 8;
+		if (__builtin_cpu_supports("avx2")) return 4;
+#endif
+		return 1;
+	}
+	const size_t SHA512_cpuLanes = SHA512_detectLanes();
+	std::atomic<size_t> SHA512_maxLanes{8}; // can be lowered to force a kernel in tests and benchmarks
+
+	size_t SHA512_lanes(void) {
+		return std::min(SHA512_cpuLanes, SHA512_maxLanes.load());
+	}
+
+	/* compress one block per state, dispatching groups of states to the widest kernel available */
+	void SHA512_compress_multi(std::array<uint64_t, 8> *const *states, const uint8_t *const *blocks, const size_t n) {
+		size_t i = 0;
+#ifdef LIME_SHA512_MULTIBUFFER_X86
+		const auto lanes = SHA512_lanes();
+		if (lanes >= 8) {
+			for (; i+8<=n; i+=8) {
+				SHA512_compress_x8(states+i, blocks+i);
+			}
+		}
+		if (lanes >= 4) {
+			for (; i+4<=n; i+=4) {
+				SHA512_compress_x4(states+i, blocks+i);
+			}
+		}
+#endif
+		for (; i<n; i++) {
+			SHA512_compress(*states[i], blocks[i]);
+		}
+	}
+
+	/* multi-buffer version of SHA512_finish: all inputs have the same size so they have the same number of blocks */
+	void SHA512_finish_multi(std::array<uint64_t, 8> *const *states, const size_t n, const size_t prefixSize, const uint8_t *const *inputs, const size_t inputSize, uint8_t *const *outputs) {
+		// pad each message: input || 0x80 || 0x00... || message length in bits on 128 bits
+		const size_t blocksCount = (inputSize + 17 + SHA512_blockSize - 1)/SHA512_blockSize;
+		const size_t paddedSize = blocksCount*SHA512_blockSize;
+		std::vector<uint8_t> padded(n*paddedSize, 0);
+		const uint64_t bitLength = static_cast<uint64_t>(prefixSize + inputSize)<<3;
+		for (size_t i=0; i<n; i++) {
+			uint8_t *message = padded.data() + i*paddedSize;
+			std::copy_n(inputs[i], inputSize, message);
+			message[inputSize] = 0x80;
+			for (size_t j=0; j<8; j++) {
+				message[paddedSize-1-j] = static_cast<uint8_t>(bitLength>>(8*j));
+			}
+		}
+
+		std::vector<const uint8_t *> blocks(n);
+		for (size_t b=0; b<blocksCount; b++) {
+			for (size_t i=0; i<n; i++) {
+				blocks[i] = padded.data() + i*paddedSize + b*SHA512_blockSize;
+			}
+			SHA512_compress_multi(states, blocks.data(), n);
+		}
+		cleanBuffer(padded.data(), padded.size());
+
+		for (size_t i=0; i<n; i++) {
+			for (size_t k=0; k<8; k++) {
+				for (size_t j=0; j<8; j++) {
+					outputs[i][8*k+j] = static_cast<uint8_t>((*states[i])[k]>>(56-8*j));
+				}
+			}
+		}
+	}
+} // anonymous namespace
+
+HMACKeySchedule<SHA512>::HMACKeySchedule(const uint8_t *const key, const size_t keySize) : m_innerState{SHA512_IV}, m_outerState{SHA512_IV} {
+	std::array<uint8_t, SHA512_blockSize> keyBlock{};
+	if (keySize > SHA512_blockSize) { // keys longer than block size are hashed first (RFC2104)
+		std::array<uint64_t, 8> state{SHA512_IV};
+		SHA512_finish(state, 0, key, keySize, keyBlock.data());
+		cleanBuffer(reinterpret_cast<uint8_t *>(state.data()), state.size()*sizeof(uint64_t));
+	} else {
+		std::copy_n(key, keySize, keyBlock.begin());
+	}
+
+	std::array<uint8_t, SHA512_blockSize> pad{};
+	for (size_t i=0; i<SHA512_blockSize; i++) {
+		pad[i] = keyBlock[i]^0x36;
+	}
+	SHA512_compress(m_innerState, pad.data());
+	for (size_t i=0; i<SHA512_blockSize; i++) {
+		pad[i] = keyBlock[i]^0x5c;
+	}
+	SHA512_compress(m_outerState, pad.data());
+
+	cleanBuffer(keyBlock.data(), keyBlock.size());
+	cleanBuffer(pad.data(), pad.size());
+}
+
+void HMACKeySchedule<SHA512>::compute(const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) const {
+	std::array<uint8_t, SHA512::ssize()> digest{};
+	// inner hash: H(key^ipad || input)
+	std::array<uint64_t, 8> state{m_innerState};
+	SHA512_finish(state, SHA512_blockSize, input, inputSize, digest.data());
+	// outer hash: H(key^opad || inner hash)
+	state = m_outerState;
+	SHA512_finish(state, SHA512_blockSize, digest.data(), digest.size(), digest.data());
+	std::copy_n(digest.cbegin(), std::min(SHA512::ssize(),hashSize), hash);
+
+	cleanBuffer(reinterpret_cast<uint8_t *>(state.data()), state.size()*sizeof(uint64_t));
+	cleanBuffer(digest.data(), digest.size());
+}
+
+HMACKeySchedule<SHA512>::~HMACKeySchedule() {
+	cleanBuffer(reinterpret_cast<uint8_t *>(m_innerState.data()), m_innerState.size()*sizeof(uint64_t));
+	cleanBuffer(reinterpret_cast<uint8_t *>(m_outerState.data()), m_outerState.size()*sizeof(uint64_t));
+}
+
+HMACMultiKeySchedule<SHA512>::HMACMultiKeySchedule(const std::vector<const uint8_t *> &keys, const size_t keySize) : m_innerStates(keys.size(), SHA512_IV), m_outerStates(keys.size(), SHA512_IV) {
+	const size_t n = keys.size();
+	std::vector<uint8_t> pads(n*SHA512_blockSize, 0);
+	for (size_t i=0; i<n; i++) {
+		if (keySize > SHA512_blockSize) { // keys longer than block size are hashed first (RFC2104)
+			std::array<uint64_t, 8> state{SHA512_IV};
+			SHA512_finish(state, 0, keys[i], keySize, pads.data() + i*SHA512_blockSize);
+			cleanBuffer(reinterpret_cast<uint8_t *>(state.data()), state.size()*sizeof(uint64_t));
+		} else {
+			std::copy_n(keys[i], keySize, pads.begin() + i*SHA512_blockSize);
+		}
+	}
+
+	std::vector<std::array<uint64_t, 8> *> states(n);
+	std::vector<const uint8_t *> blocks(n);
+	for (size_t i=0; i<n; i++) {
+		blocks[i] = pads.data() + i*SHA512_blockSize;
+	}
+	// key xor ipad
+	for (size_t i=0; i<n*SHA512_blockSize; i++) {
+		pads[i] ^= 0x36;
+	}
+	for (size_t i=0; i<n; i++) {
+		states[i] = &m_innerStates[i];
+	}
+	SHA512_compress_multi(states.data(), blocks.data(), n);
+	// key xor opad
+	for (size_t i=0; i<n*SHA512_blockSize; i++) {
+		pads[i] ^= (0x36^0x5c);
+	}
+	for (size_t i=0; i<n; i++) {
+		states[i] = &m_outerStates[i];
+	}
+	SHA512_compress_multi(states.data(), blocks.data(), n);
+
+	cleanBuffer(pads.data(), pads.size());
+}
+
+void HMACMultiKeySchedule<SHA512>::compute(const std::vector<const uint8_t *> &inputs, const size_t inputSize, const std::vector<uint8_t *> &hashes, size_t hashSize) const {
+	const size_t n = m_innerStates.size();
+	if (inputs.size() != n || hashes.size() != n) {
+		throw BCTBX_EXCEPTION << "HMAC multi key schedule holds "<<n<<" keys but is given "<<inputs.size()<<" inputs and "<<hashes.size()<<" outputs";
+	}
+
+	std::vector<std::array<uint64_t, 8>> states{m_innerStates};
+	std::vector<std::array<uint64_t, 8> *> statesPtr(n);
+	std::vector<uint8_t> digests(n*SHA512::ssize());
+	std::vector<uint8_t *> digestsPtr(n);
+	for (size_t i=0; i<n; i++) {
+		statesPtr[i] = &states[i];
+		digestsPtr[i] = digests.data() + i*SHA512::ssize();
+	}
+	// inner hashes: H(key^ipad || input)
+	SHA512_finish_multi(statesPtr.data(), n, SHA512_blockSize, inputs.data(), inputSize, digestsPtr.data());
+	// outer hashes: H(key^opad || inner hash)
+	states = m_outerStates;
+	std::vector<const uint8_t *> innerDigests(digestsPtr.cbegin(), digestsPtr.cend());
+	SHA512_finish_multi(statesPtr.data(), n, SHA512_blockSize, innerDigests.data(), SHA512::ssize(), digestsPtr.data());
+
+	for (size_t i=0; i<n; i++) {
+		std::copy_n(digestsPtr[i], std::min(SHA512::ssize(),hashSize), hashes[i]);
+		cleanBuffer(reinterpret_cast<uint8_t *>(states[i].data()), states[i].size()*sizeof(uint64_t));
+	}
+	cleanBuffer(digests.data(), digests.size());
+}
+
+HMACMultiKeySchedule<SHA512>::~HMACMultiKeySchedule() {
+	for (auto &state : m_innerStates) {
+		cleanBuffer(reinterpret_cast<uint8_t *>(state.data()), state.size()*sizeof(uint64_t));
+	}
+	for (auto &state : m_outerStates) {
+		cleanBuffer(reinterpret_cast<uint8_t *>(state.data()), state.size()*sizeof(uint64_t));
+	}
+}
+
+size_t HMACMultiKeySchedule<SHA512>::lanes(void) {
+	return SHA512_lanes();
+}
+
+void HMACMultiKeySchedule<SHA512>::limitLanes(const size_t maxLanes) {
+	SHA512_maxLanes.store(std::max(maxLanes, static_cast<size_t>(1)));
+}
+
 /* HMAC must use a specialized template */
 template <typename hashAlgo> void HMAC_KDF(const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize) {
 	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty Curve type */
 	static_assert(sizeof(hashAlgo) != sizeof(hashAlgo), "You must specialize HMAC_KDF function template");
 }
+template <typename hashAlgo> void HMAC_KDF(const CryptoProvider provider, const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize) {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty Curve type */
+	static_assert(sizeof(hashAlgo) != sizeof(hashAlgo), "You must specialize HMAC_KDF function template");
+}
 /* HMAC_KDF specialised template for SHA512 */
 template <> void HMAC_KDF<SHA512>(const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize) {
+	HMAC_KDF<SHA512>(defaultCryptoProvider, salt, saltSize, ikm, ikmSize, info, infoSize, output, outputSize);
+};
+
+template <> void HMAC_KDF<SHA512>(const CryptoProvider provider, const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize) {
+	checkCryptoProvider(provider);
+#ifdef HAVE_OPENSSL_CRYPTO
+	if (provider == CryptoProvider::openssl) {
+		openssl::HKDF_SHA512(salt, saltSize, ikm, ikmSize, info, infoSize, output, outputSize);
+		return;
+	}
+#endif /* HAVE_OPENSSL_CRYPTO */
 	bctoolbox::HKDF<bctoolbox::SHA512>(salt, saltSize, ikm, ikmSize, info, infoSize, output, outputSize);
 };
 
@@ -476,14 +1024,44 @@ bool AEAD_decrypt(const uint8_t *const key, const size_t keySize, const uint8_t
 	return false;
 }
 
+template <typename AEADAlgo>
+void AEAD_encrypt(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty type */
+	static_assert(sizeof(AEADAlgo) != sizeof(AEADAlgo), "You must specialize AEAD_encrypt function template");
+}
+
+template <typename AEADAlgo>
+bool AEAD_decrypt(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+	/* if this template is instanciated the static_assert will fail but will give us an error message with faulty type */
+	static_assert(sizeof(AEADAlgo) != sizeof(AEADAlgo), "You must specialize AEAD_decrypt function template");
+	return false;
+}
+
 /* AEAD scheme specialiazed template with AES256-GCM, 16 bytes auth tag */
 template <> void AEAD_encrypt<AES256GCM>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
 		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
 		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
+	AEAD_encrypt<AES256GCM>(defaultCryptoProvider, key, keySize, IV, IVSize, plain, plainSize, AD, ADSize, tag, tagSize, cipher);
+}
+
+template <> void AEAD_encrypt<AES256GCM>(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher) {
 	/* perforn checks on sizes */
 	if (keySize != AES256GCM::keySize() || tagSize != AES256GCM::tagSize()) {
 		throw BCTBX_EXCEPTION << "invalid arguments for AEAD_encrypt AES256-GCM";
 	}
+	checkCryptoProvider(provider);
+#ifdef HAVE_OPENSSL_CRYPTO
+	if (provider == CryptoProvider::openssl) {
+		openssl::AES256GCM_encrypt(key, IV, IVSize, plain, plainSize, AD, ADSize, tag, tagSize, cipher);
+		return;
+	}
+#endif /* HAVE_OPENSSL_CRYPTO */
 	auto ret = bctbx_aes_gcm_encrypt_and_tag(key, keySize, plain, plainSize, AD, ADSize, IV, IVSize, tag, tagSize, cipher);
 	if (ret != 0) {
 		throw BCTBX_EXCEPTION << "AEAD_encrypt AES256-GCM error: "<<ret;
@@ -493,10 +1071,22 @@ template <> void AEAD_encrypt<AES256GCM>(const uint8_t *const key, const size_t
 template <> bool AEAD_decrypt<AES256GCM>(const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
 		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
 		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
+	return AEAD_decrypt<AES256GCM>(defaultCryptoProvider, key, keySize, IV, IVSize, cipher, cipherSize, AD, ADSize, tag, tagSize, plain);
+}
+
+template <> bool AEAD_decrypt<AES256GCM>(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain) {
 	/* perforn checks on sizes */
 	if (keySize != AES256GCM::keySize() || tagSize != AES256GCM::tagSize()) {
 		throw BCTBX_EXCEPTION << "invalid arguments for AEAD_decrypt AES256-GCM";
 	}
+	checkCryptoProvider(provider);
+#ifdef HAVE_OPENSSL_CRYPTO
+	if (provider == CryptoProvider::openssl) {
+		return openssl::AES256GCM_decrypt(key, IV, IVSize, cipher, cipherSize, AD, ADSize, tag, tagSize, plain);
+	}
+#endif /* HAVE_OPENSSL_CRYPTO */
 	auto ret = bctbx_aes_gcm_decrypt_and_auth(key, keySize, cipher, cipherSize, AD, ADSize, IV, IVSize, tag, tagSize, plain);
 	if (ret == 0) return true;
 	if (ret == BCTBX_ERROR_AUTHENTICATION_FAILED) return false;
@@ -542,6 +1132,8 @@ void cleanBuffer(uint8_t *buffer, size_t size) {
 	template class bctbx_EDDSA<C255>;
 	template std::shared_ptr<keyExchange<C255>> make_keyExchange();
 	template std::shared_ptr<Signature<C255>> make_Signature();
+	template std::shared_ptr<keyExchange<C255>> make_keyExchange(const CryptoProvider provider);
+	template std::shared_ptr<Signature<C255>> make_Signature(const CryptoProvider provider);
 #endif //EC25519_ENABLED
 
 #ifdef EC448_ENABLED
@@ -549,6 +1141,8 @@ void cleanBuffer(uint8_t *buffer, size_t size) {
 	template class bctbx_EDDSA<C448>;
 	template std::shared_ptr<keyExchange<C448>> make_keyExchange();
 	template std::shared_ptr<Signature<C448>> make_Signature();
+	template std::shared_ptr<keyExchange<C448>> make_keyExchange(const CryptoProvider provider);
+	template std::shared_ptr<Signature<C448>> make_Signature(const CryptoProvider provider);
 #endif //EC448_ENAB
 #ifdef HAVE_BCTBXPQ
 	template class bctbx_KEM<K512>;
@@ -370,6 +370,11 @@ class Signature {
 		 * a convenience function to directly verify a key exchange public key
 		 */
 		virtual bool verify(const X<Curve, lime::Xtype::publicKey> &message, const DSA<Curve, lime::DSAtype::signature> &signature) = 0;
+		/**
+		 * @overload virtual bool verify(const uint8_t *message, const size_t messageSize, const DSA<Curve, lime::DSAtype::signature> &signature)
+		 * verify a message given as a buffer view, used to check a signed region directly in a received message
+		 */
+		virtual bool verify(const uint8_t *message, const size_t messageSize, const DSA<Curve, lime::DSAtype::signature> &signature) = 0;
 
 		virtual ~Signature() = default;
 }; //class EdDSA
@@ -392,6 +397,87 @@ void HMAC(const uint8_t *const key, const size_t keySize, const uint8_t *const i
 /* declare template specialisations */
 template <> void HMAC<SHA512>(const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize);
 
+/**
+ * @brief HMAC with a precomputed key schedule
+ *
+ * The hash internal states after processing of the key xor ipad and key xor opad blocks are computed once at construction.
+ * Each HMAC computation then starts from these states and saves two hash block compressions.
+ * Use it when several HMAC are computed with the same key (ie: derive MK and next CK from CK in the symmetric ratchet)
+ *
+ * @tparam	hashAlgo	the hash algorithm used (only SHA512 available for now), only specialisations are defined
+ */
+template <typename hashAlgo>
+class HMACKeySchedule;
+
+template <>
+class HMACKeySchedule<SHA512> {
+	private:
+		std::array<uint64_t, 8> m_innerState; /**< SHA512 state after compression of the key xor ipad block */
+		std::array<uint64_t, 8> m_outerState; /**< SHA512 state after compression of the key xor opad block */
+	public:
+		/**
+		 * @brief compute the inner and outer states for the given key
+		 *
+		 * @param[in]	key		HMAC key
+		 * @param[in]	keySize		previous buffer size
+		 */
+		HMACKeySchedule(const uint8_t *const key, const size_t keySize);
+		/**
+		 * @brief compute HMAC of input with the key given at construction
+		 *
+		 * @param[in]	input		HMAC input
+		 * @param[in]	inputSize	previous buffer size
+		 * @param[out]	hash		pointer to the output, this buffer must be able to hold as much data as requested
+		 * @param[in]	hashSize	amount of expected data, if more than SHA512 can compute, silently ignored and maximum output size is generated
+		 */
+		void compute(const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize) const;
+		~HMACKeySchedule();
+};
+
+/**
+ * @brief HMAC with precomputed key schedules for several independent keys
+ *
+ * Same as HMACKeySchedule but process a batch of keys at once: the hash block compressions of the different keys
+ * are independent and run in parallel SIMD lanes when the CPU supports it(AVX-512: 8 lanes, AVX2: 4 lanes).
+ * The kernel is selected at runtime, a scalar version is used on other architectures.
+ *
+ * @tparam	hashAlgo	the hash algorithm used (only SHA512 available for now), only specialisations are defined
+ */
+template <typename hashAlgo>
+class HMACMultiKeySchedule;
+
+template <>
+class HMACMultiKeySchedule<SHA512> {
+	private:
+		std::vector<std::array<uint64_t, 8>> m_innerStates; /**< SHA512 states after compression of the keys xor ipad block */
+		std::vector<std::array<uint64_t, 8>> m_outerStates; /**< SHA512 states after compression of the keys xor opad block */
+	public:
+		/**
+		 * @brief compute the inner and outer states for all the given keys
+		 *
+		 * @param[in]	keys		HMAC keys
+		 * @param[in]	keySize		size of each key: all keys must have the same size
+		 */
+		HMACMultiKeySchedule(const std::vector<const uint8_t *> &keys, const size_t keySize);
+		/**
+		 * @brief compute HMAC of inputs, each one with the key at the same position given at construction
+		 *
+		 * @param[in]	inputs		HMAC inputs, must hold as many elements as the keys given at construction
+		 * @param[in]	inputSize	size of each input: all inputs must have the same size
+		 * @param[out]	hashes		pointers to the outputs, each buffer must be able to hold as much data as requested
+		 * @param[in]	hashSize	amount of expected data, if more than SHA512 can compute, silently ignored and maximum output size is generated
+		 */
+		void compute(const std::vector<const uint8_t *> &inputs, const size_t inputSize, const std::vector<uint8_t *> &hashes, size_t hashSize) const;
+		/// number of keys in this schedule
+		size_t size(void) const {return m_innerStates.size();}
+		~HMACMultiKeySchedule();
+
+		/// the number of SIMD lanes used by the kernel selected at runtime: 8, 4 or 1 (scalar)
+		static size_t lanes(void);
+		/// restrict the number of SIMD lanes used by the kernel(1 forces the scalar version), for test and benchmark purpose
+		static void limitLanes(const size_t maxLanes);
+};
+
 /**
  * @brief HKDF as described in RFC5869
  *	@par Compute:
@@ -482,17 +568,84 @@ template <> bool AEAD_decrypt<AES256GCM>(const uint8_t *const key, const size_t
 		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
 
 
+/*************************************************************************************************/
+/********************** Crypto providers *********************************************************/
+/*************************************************************************************************/
+/**
+ * @brief The libraries implementing key exchange, signature, HMAC, HKDF and AEAD
+ *
+ * bctoolbox is always available, openssl only when lime is built with ENABLE_OPENSSL_CRYPTO.
+ * RNG and KEM are always provided by bctoolbox.
+ */
+enum class CryptoProvider : uint8_t {
+	bctoolbox,
+	openssl
+};
+
+/// The provider selected at build time, used by the factory functions and templates not given an explicit provider
+#ifdef HAVE_OPENSSL_CRYPTO
+constexpr CryptoProvider defaultCryptoProvider = CryptoProvider::openssl;
+#else
+constexpr CryptoProvider defaultCryptoProvider = CryptoProvider::bctoolbox;
+#endif
+
+/**
+ * @brief Check a provider is part of this build
+ *
+ * @param[in]	provider	the crypto provider
+ *
+ * @return true if the provider can be used
+ */
+bool cryptoProviderAvailable(const CryptoProvider provider) noexcept;
+
+/* Same as the HMAC, HMAC_KDF and AEAD templates above but using the given provider, an exception is raised if it is not available */
+template <typename hashAlgo>
+void HMAC(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize);
+template <> void HMAC<SHA512>(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const input, const size_t inputSize, uint8_t *hash, size_t hashSize);
+
+template <typename hashAlgo>
+void HMAC_KDF(const CryptoProvider provider, const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize);
+template <> void HMAC_KDF<SHA512>(const CryptoProvider provider, const uint8_t *const salt, const size_t saltSize, const uint8_t *const ikm, const size_t ikmSize, const char *info, const size_t infoSize, uint8_t *output, size_t outputSize);
+
+template <typename AEADAlgo>
+void AEAD_encrypt(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher);
+template <> void AEAD_encrypt<AES256GCM>(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const plain, const size_t plainSize, const uint8_t *const AD, const size_t ADSize,
+		uint8_t *tag, const size_t tagSize, uint8_t *cipher);
+
+template <typename AEADAlgo>
+bool AEAD_decrypt(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
+template <> bool AEAD_decrypt<AES256GCM>(const CryptoProvider provider, const uint8_t *const key, const size_t keySize, const uint8_t *const IV, const size_t IVSize,
+		const uint8_t *const cipher, const size_t cipherSize, const uint8_t *const AD, const size_t ADSize,
+		const uint8_t *const tag, const size_t tagSize, uint8_t *plain);
+
 /*************************************************************************************************/
 /********************** Factory Functions ********************************************************/
 /*************************************************************************************************/
 /* Use these to instantiate an object as they will pick the correct underlying implemenation of virtual classes */
 std::shared_ptr<RNG> make_RNG();
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+/// make_RNG returns a deterministic generator seeded with the given value, one instance shared by all callers. Test and benchmark builds only
+void set_deterministic_RNG(const uint64_t seed);
+/// make_RNG returns the system RNG again
+void clear_deterministic_RNG(void);
+#endif // LIME_DETERMINISTIC_RNG_ENABLED
 
 template <typename Curve>
 std::shared_ptr<keyExchange<Curve>> make_keyExchange();
+/// @overload create a key exchange context implemented by the given provider
+template <typename Curve>
+std::shared_ptr<keyExchange<Curve>> make_keyExchange(const CryptoProvider provider);
 
 template <typename Curve>
 std::shared_ptr<Signature<Curve>> make_Signature();
+/// @overload create a signature context implemented by the given provider
+template <typename Curve>
+std::shared_ptr<Signature<Curve>> make_Signature(const CryptoProvider provider);
 
 template <typename Algo>
 std::shared_ptr<KEM<Algo>> make_KEM();
@@ -505,6 +658,8 @@ std::shared_ptr<KEM<Algo>> make_KEM();
 #ifdef EC25519_ENABLED
 	extern template std::shared_ptr<keyExchange<C255>> make_keyExchange();
 	extern template std::shared_ptr<Signature<C255>> make_Signature();
+	extern template std::shared_ptr<keyExchange<C255>> make_keyExchange(const CryptoProvider provider);
+	extern template std::shared_ptr<Signature<C255>> make_Signature(const CryptoProvider provider);
 	extern template class X<C255, lime::Xtype::publicKey>;
 	extern template class X<C255, lime::Xtype::privateKey>;
 	extern template class X<C255, lime::Xtype::sharedSecret>;
@@ -518,6 +673,8 @@ std::shared_ptr<KEM<Algo>> make_KEM();
 #ifdef EC448_ENABLED
 	extern template std::shared_ptr<keyExchange<C448>> make_keyExchange();
 	extern template std::shared_ptr<Signature<C448>> make_Signature();
+	extern template std::shared_ptr<keyExchange<C448>> make_keyExchange(const CryptoProvider provider);
+	extern template std::shared_ptr<Signature<C448>> make_Signature(const CryptoProvider provider);
 	extern template class X<C448, lime::Xtype::publicKey>;
 	extern template class X<C448, lime::Xtype::privateKey>;
 	extern template class X<C448, lime::Xtype::sharedSecret>;
@@ -90,9 +90,9 @@ namespace settings {
 /******************************************************************************/
 	/** define a version number for the DB schema as an integer 0xMMmmpp
 	 *
-	 * current version is 0.3.0
+	 * current version is 0.5.0
 	 */
-	constexpr int DBuserVersion=0x000300;
+	constexpr int DBuserVersion=0x000500;
 	constexpr uint16_t DBInactiveUserBit = 0x0100;
 	constexpr uint16_t DBCurveIdByte = 0x00FF;
 	constexpr uint8_t DBInvalidIk = 0x00;
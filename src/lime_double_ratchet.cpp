@@ -21,11 +21,17 @@
 #include "lime_double_ratchet.hpp"
 #include "lime_double_ratchet_protocol.hpp"
 #include "lime_localStorage.hpp"
+#include "lime_metrics.hpp"
+#include "lime_trace.hpp"
+#include "lime_capture.hpp"
 #include <soci/soci.h>
 
 #include "bctoolbox/exception.hh"
 
 #include <algorithm> //copy_n
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 
 using namespace::std;
@@ -49,23 +55,27 @@ namespace lime {
 		dirty /**< the whole session data must be saved to local storage */
 	};
 
-
-	/** Double Ratchet Message keys : 32 bytes of encryption key followed by 16 bytes of IV */
-	using DRMKey = lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize>;
-
 	/**
 	 * @brief Chain storing the DH and MKs associated with Nr(uint16_t map index)
+	 *
+	 *	Skipped message keys are not derived when skipped: the chain holds a checkpoint, the chain key at index checkpointNr,
+	 *	from which the message keys in [checkpointNr, checkpointEnd[ are derived when needed.
+	 *	Message keys explicitely stored in messageKeys are the ones derived from a checkpoint but still not used.
+	 *
 	 * @tparam Curve	The elliptic curve to use: C255 or C448
 	 */
 	template <typename Curve>
 	struct ReceiverKeyChain {
 		std::vector<uint8_t> DHrIndex; /**< peer public key(or a hash of it) identifying this chain */
 		std::unordered_map<uint16_t, DRMKey> messageKeys; /**< message keys indexed by Nr */
+		uint16_t checkpointNr; /**< index of the first message key derivable from checkpointCK */
+		uint16_t checkpointEnd; /**< index following the last message key derivable from checkpointCK, there is no checkpoint when equal to checkpointNr */
+		DRChainKey checkpointCK; /**< chain key at index checkpointNr */
 		/**
 		 * Start a new empty chain
 		 * @param[in]	key	the peer DH public key used on this chain
 		 */
-		ReceiverKeyChain(const std::vector<uint8_t> &keyIndex) :DHrIndex{keyIndex}, messageKeys{} {};
+		ReceiverKeyChain(const std::vector<uint8_t> &keyIndex) :DHrIndex{keyIndex}, messageKeys{}, checkpointNr{0}, checkpointEnd{0}, checkpointCK{} {};
 	};
 
 	/****************************************************************************/
@@ -163,25 +173,95 @@ namespace lime {
 	 */
 	template <typename Curve>
 	static void KDF_CK(DRChainKey &CK, DRMKey &MK, uint16_t chainIndex, typename std::enable_if_t<!std::is_base_of_v<genericKEM, Curve>, bool> = true) noexcept {
+		// both derivations are keyed by CK: compute the HMAC key schedule only once
+		HMACKeySchedule<SHA512> hmacCK(CK.data(), CK.size());
 		// derive MK and IV from CK and constant
-		HMAC<SHA512>(CK.data(), CK.size(), hkdf_mk_info.data(), hkdf_mk_info.size(), MK.data(), MK.size());
+		hmacCK.compute(hkdf_mk_info.data(), hkdf_mk_info.size(), MK.data(), MK.size());
 
-		// use temporary buffer, not likely that output and key could be the same buffer
-		DRChainKey tmp;
-		HMAC<SHA512>(CK.data(), CK.size(), hkdf_ck_info.data(), hkdf_ck_info.size(), tmp.data(), tmp.size());
-		CK = tmp;
+		// CK is not used anymore as key, the HMAC key schedule holds it, we can write the new CK directly
+		hmacCK.compute(hkdf_ck_info.data(), hkdf_ck_info.size(), CK.data(), CK.size());
 	}
 	template <typename Curve>
 	static void KDF_CK(DRChainKey &CK, DRMKey &MK, uint16_t chainIndex, typename std::enable_if_t<std::is_base_of_v<genericKEM, Curve>, bool> = true) noexcept {
 		// derive MK and IV from CK and constant
+		// both derivations are keyed by CK: compute the HMAC key schedule only once
+		HMACKeySchedule<SHA512> hmacCK(CK.data(), CK.size());
 		std::array<uint8_t,3> label{hkdf_mk_info[0], static_cast<uint8_t>(chainIndex>>8), static_cast<uint8_t>(0xFF&chainIndex)};
-		HMAC<SHA512>(CK.data(), CK.size(), label.data(), label.size(), MK.data(), MK.size());
+		hmacCK.compute(label.data(), label.size(), MK.data(), MK.size());
 
-		// use temporary buffer, not likely that output and key could be the same buffer
-		DRChainKey tmp;
+		// CK is not used anymore as key, the HMAC key schedule holds it, we can write the new CK directly
 		label[0]=hkdf_ck_info[0];
-		HMAC<SHA512>(CK.data(), CK.size(), label.data(), label.size(), tmp.data(), tmp.size());
-		CK = tmp;
+		hmacCK.compute(label.data(), label.size(), CK.data(), CK.size());
+	}
+
+	/**
+	 * @brief Key Derivation Function used in Symmetric key ratchet chain: derive only the next chain key
+	 *
+	 *	Same derivation as KDF_CK but the message key is not computed, used to move forward a receiving chain over skipped messages
+	 *
+	 * @param[in,out]	CK		Input/output buffer used as key to compute the next CK
+	 * @param[in]		chainIndex	index of CK in the chain
+	 */
+	template <typename Curve>
+	static void KDF_CK_next(DRChainKey &CK, uint16_t chainIndex, typename std::enable_if_t<!std::is_base_of_v<genericKEM, Curve>, bool> = true) noexcept {
+		HMACKeySchedule<SHA512> hmacCK(CK.data(), CK.size());
+		hmacCK.compute(hkdf_ck_info.data(), hkdf_ck_info.size(), CK.data(), CK.size());
+	}
+	template <typename Curve>
+	static void KDF_CK_next(DRChainKey &CK, uint16_t chainIndex, typename std::enable_if_t<std::is_base_of_v<genericKEM, Curve>, bool> = true) noexcept {
+		HMACKeySchedule<SHA512> hmacCK(CK.data(), CK.size());
+		std::array<uint8_t,3> label{hkdf_ck_info[0], static_cast<uint8_t>(chainIndex>>8), static_cast<uint8_t>(0xFF&chainIndex)};
+		hmacCK.compute(label.data(), label.size(), CK.data(), CK.size());
+	}
+
+	/**
+	 * @brief Key Derivation Function used in Symmetric key ratchet chain, performed on several sending chains at once
+	 *
+	 *	Same derivation as KDF_CK but the HMAC-SHA512 are computed by the multi-buffer kernel when several chains are given.
+	 *	Chains are grouped according to their label format (with or without the chain index) as all inputs of a batch must have the same size.
+	 *
+	 * @param[in,out]	chains	the sending chains: CK is updated, MK is written
+	 */
+	static void KDF_CK_batch(std::vector<DRSendingChain> &chains) {
+		for (const bool indexed : {false, true}) {
+			std::vector<const uint8_t *> keys{};
+			for (const auto &chain : chains) {
+				if (chain.indexedDerivation == indexed) keys.push_back(chain.CK->data());
+			}
+			if (keys.empty()) continue;
+
+			HMACMultiKeySchedule<SHA512> hmacCK(keys, lime::settings::DRChainKeySize);
+			keys.clear(); // the key schedule holds the keys, CK buffers can be overwritten
+
+			// labels: one per chain when the index is used, otherwise the same constant for all
+			const size_t labelSize = indexed?3:1;
+			std::vector<uint8_t> labels{};
+			std::vector<const uint8_t *> inputs{};
+			std::vector<uint8_t *> MKs{};
+			std::vector<uint8_t *> CKs{};
+			labels.reserve(hmacCK.size()*labelSize);
+			for (const auto &chain : chains) {
+				if (chain.indexedDerivation != indexed) continue;
+				labels.push_back(hkdf_mk_info[0]);
+				if (indexed) {
+					labels.push_back(static_cast<uint8_t>(chain.index>>8));
+					labels.push_back(static_cast<uint8_t>(0xFF&chain.index));
+				}
+				MKs.push_back(chain.MK->data());
+				CKs.push_back(chain.CK->data());
+			}
+			for (size_t i=0; i<hmacCK.size(); i++) {
+				inputs.push_back(labels.data() + i*labelSize);
+			}
+			// derive MK and IV from CK and constant
+			hmacCK.compute(inputs, labelSize, MKs, lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize);
+
+			// then the next CK
+			for (size_t i=0; i<hmacCK.size(); i++) {
+				labels[i*labelSize] = hkdf_ck_info[0];
+			}
+			hmacCK.compute(inputs, labelSize, CKs, lime::settings::DRChainKeySize);
+		}
 	}
 
 	/**
@@ -221,6 +301,8 @@ namespace lime {
 			bool m_valid; /**< is this header valid? */
 			size_t m_size; /**< store the size of parsed header */
 			bool m_payload_direct_encryption; /**< flag to store the message encryption mode: in the double ratchet packet or using a random key to encrypt it separately and encrypt the key in the DR packet */
+			bool m_compression_supported; /**< flag set when the sender advertises it can decompress payloads */
+			bool m_sender_key_supported; /**< flag set when the sender advertises it can process sender key distributions */
 
 		public:
 			/// read-only accessor to Sender Chain index (Ns)
@@ -233,6 +315,10 @@ namespace lime {
 			bool valid(void) const {return m_valid;}
 			/// what encryption mode is advertised in this header
 			bool payloadDirectEncryption(void) const {return m_payload_direct_encryption;}
+			/// does the sender of this message advertise it can decompress payloads
+			bool compressionSupported(void) const {return m_compression_supported;}
+			/// does the sender of this message advertise it can process sender key distributions
+			bool senderKeySupported(void) const {return m_sender_key_supported;}
 			/// is there a KEM public key in this header? Never for EC only.
 			bool havePKIndex(void) const {return false;}
 			/// read-only accessor to the size of parsed header
@@ -256,7 +342,7 @@ namespace lime {
 			}
 			/* ctor/dtor */
 			DRHeader() = delete;
-			DRHeader(const std::vector<uint8_t> header) : m_Ns{0}, m_PN{0}, m_DHr{}, m_valid{false}, m_size{0}{ // init valid to false and check during parsing if all is ok
+			DRHeader(const std::vector<uint8_t> header) : m_Ns{0}, m_PN{0}, m_DHr{}, m_valid{false}, m_size{0}, m_payload_direct_encryption{false}, m_compression_supported{false}, m_sender_key_supported{false}{ // init valid to false and check during parsing if all is ok
 				// make sure we have at least enough data to parse version<1 byte> || message type<1 byte> || curve Id<1 byte> || [x3dh init] || OPk flag without any ulterior checks on size
 				if (header.size()<3 || header.size()<lime::double_ratchet_protocol::headerSize<Curve>(header[1])) {
 					return; // the valid_flag is false
@@ -272,6 +358,8 @@ namespace lime {
 						} else {
 							m_payload_direct_encryption = false;
 						}
+						m_compression_supported = (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::compression_supported_flag)) != 0;
+						m_sender_key_supported = (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_supported_flag)) != 0;
 						m_size = lime::double_ratchet_protocol::headerSize<Curve>(header[1]); // headerSize is the size when no X3DH init is present
 						size_t index = 3;
 						if (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::X3DH_init_flag)) {
@@ -323,6 +411,8 @@ namespace lime {
 			bool m_valid; /**< is this header valid? */
 			size_t m_size; /**< store the size of parsed header */
 			bool m_payload_direct_encryption; /**< flag to store the message encryption mode: in the double ratchet packet or using a random key to encrypt it separately and encrypt the key in the DR packet */
+			bool m_compression_supported; /**< flag set when the sender advertises it can decompress payloads */
+			bool m_sender_key_supported; /**< flag set when the sender advertises it can process sender key distributions */
 			bool m_havePkIndex; /**< The header holds KEM Pk indexes and not the actual PK/CT*/
 
 		public:
@@ -338,6 +428,10 @@ namespace lime {
 			bool valid(void) const {return m_valid;}
 			/// what encryption mode is advertised in this header
 			bool payloadDirectEncryption(void) const {return m_payload_direct_encryption;}
+			/// does the sender of this message advertise it can decompress payloads
+			bool compressionSupported(void) const {return m_compression_supported;}
+			/// does the sender of this message advertise it can process sender key distributions
+			bool senderKeySupported(void) const {return m_sender_key_supported;}
 			/// is there a KEM public key in this header or just an index?
 			bool havePKIndex(void) const {return m_havePkIndex;}
 			/// read-only accessor to the size of parsed header
@@ -385,7 +479,7 @@ namespace lime {
 			}
 			/* ctor/dtor */
 			DRHeader() = delete;
-			DRHeader(const std::vector<uint8_t> header) : m_Ns{0}, m_PN{0}, m_EC_DHr{}, m_valid{false}, m_size{0}{ // init valid to false and check during parsing if all is ok
+			DRHeader(const std::vector<uint8_t> header) : m_Ns{0}, m_PN{0}, m_EC_DHr{}, m_valid{false}, m_size{0}, m_payload_direct_encryption{false}, m_compression_supported{false}, m_sender_key_supported{false}{ // init valid to false and check during parsing if all is ok
 				// make sure we have at least enough data to parse version<1 byte> || message type<1 byte> || curve Id<1 byte> || [x3dh init] || OPk flag without any ulterior checks on size
 				if (header.size()<3 || header.size()<lime::double_ratchet_protocol::headerSize<Algo>(header[1])) {
 					return; // the valid_flag is false
@@ -401,6 +495,8 @@ namespace lime {
 						} else {
 							m_payload_direct_encryption = false;
 						}
+						m_compression_supported = (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::compression_supported_flag)) != 0;
+						m_sender_key_supported = (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_supported_flag)) != 0;
 						if (messageType & static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::KEM_pk_index)) {
 							m_havePkIndex = true;
 						} else {
@@ -505,10 +601,10 @@ namespace lime {
 			DRi(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<Curve> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<Curve, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context)
 			:m_ARKeys{peerPublicKey},
 			m_forceKEMRatchet{false}, m_peerKEMPkAvailable{false},  m_peerHasSelfKEMPk{false},
-			m_peerECPkAvailable{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
+			m_peerECPkAvailable{false}, m_peerSupportsCompression{false}, m_peerSupportsSenderKey{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
 			m_RK(SK),m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD(AD),m_mkskipped{},
-			m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{peerDeviceId},
-			m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{X3DH_initMessage}
+			m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedCheckpoint{}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{peerDeviceId},
+			m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{X3DH_initMessage}, m_sendingCKs{}, m_sendingMK{}, m_sendingMKReady{false}
 			{
 				// generate a new self key pair
 				auto DH = make_keyExchange<Curve>();
@@ -550,10 +646,10 @@ namespace lime {
 			DRi(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<Curve> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<typename Curve::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context)
 			:m_ARKeys{peerPublicKey},
 			m_forceKEMRatchet{false}, m_peerKEMPkAvailable{false},  m_peerHasSelfKEMPk{false},
-			m_peerECPkAvailable{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
+			m_peerECPkAvailable{false}, m_peerSupportsCompression{false}, m_peerSupportsSenderKey{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
 			m_RK(SK),m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD(AD),m_mkskipped{},
-			m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{peerDeviceId},
-			m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{X3DH_initMessage}
+			m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedCheckpoint{}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{peerDeviceId},
+			m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{X3DH_initMessage}, m_sendingCKs{}, m_sendingMK{}, m_sendingMKReady{false}
 			{
 				auto DH = make_keyExchange<typename Curve::EC>();
 				auto KEMengine = make_KEM<typename Curve::KEM>();
@@ -601,10 +697,10 @@ namespace lime {
 			DRi(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<Curve> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<typename Curve::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, std::shared_ptr<RNG> RNG_context)
 			:m_ARKeys{selfKeyPair},
 			m_forceKEMRatchet{true}, m_peerKEMPkAvailable{true},  m_peerHasSelfKEMPk{false},
-			m_peerECPkAvailable{true}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
+			m_peerECPkAvailable{true}, m_peerSupportsCompression{false}, m_peerSupportsSenderKey{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
 			m_RK(SK),m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD(AD),m_mkskipped{},
-			m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{OPk_id}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{peerDeviceId},
-			m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{}
+			m_RNG{RNG_context},m_dbSessionId{0},m_usedNr{0},m_usedDHid{0}, m_usedCheckpoint{}, m_usedOPkId{OPk_id}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::dirty},m_peerDid{peerDid},m_peerDeviceId{peerDeviceId},
+			m_peerIk{},m_db_Uid{selfDid}, m_active_status{true}, m_X3DH_initMessage{}, m_sendingCKs{}, m_sendingMK{}, m_sendingMKReady{false}
 			{
 				// If we have no peerDid, copy peer DeviceId and Ik in the session so we can use them to create the peer device in local storage when first saving the session
 				// If we have no peerDid, copy Ik in the session so we can use it to create the peer device in local storage when first saving the session
@@ -626,10 +722,10 @@ namespace lime {
 			DRi(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context)
 			:m_ARKeys{},
 			m_forceKEMRatchet{false}, m_peerKEMPkAvailable{false},  m_peerHasSelfKEMPk{false},
-			m_peerECPkAvailable{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
+			m_peerECPkAvailable{false}, m_peerSupportsCompression{false}, m_peerSupportsSenderKey{false}, m_KEMRatchetChainSize{0}, m_lastKEMRatchetEpoch(0),
 			m_RK{},m_CKs{},m_CKr{},m_Ns(0),m_Nr(0),m_PN(0),m_sharedAD{},m_mkskipped{},
-			m_RNG{RNG_context},m_dbSessionId{sessionId},m_usedNr{0},m_usedDHid{0}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::clean},m_peerDid{0},m_peerDeviceId{},
-			m_peerIk{},m_db_Uid{0},	m_active_status{false}, m_X3DH_initMessage{}
+			m_RNG{RNG_context},m_dbSessionId{sessionId},m_usedNr{0},m_usedDHid{0}, m_usedCheckpoint{}, m_usedOPkId{0}, m_localStorage{localStorage},m_dirty{DRSessionDbStatus::clean},m_peerDid{0},m_peerDeviceId{},
+			m_peerIk{},m_db_Uid{0},	m_active_status{false}, m_X3DH_initMessage{}, m_sendingCKs{}, m_sendingMK{}, m_sendingMKReady{false}
 			{
 				m_ARKeys.setValid(session_load());
 			}
@@ -640,12 +736,33 @@ namespace lime {
 			~DRi() {};
 
 			/* Implement the DR interface */
-			void ratchetEncrypt(const std::vector<uint8_t> &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption) override;
+			bool prepareSendingChain(DRSendingChain &chain) override;
+			void discardSendingChain(void) override {m_sendingMKReady = false;}
+			void ratchetEncrypt(const std::vector<uint8_t> &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const bool payloadCompressed, const bool senderKeyDistribution) override;
 			bool ratchetDecrypt(const std::vector<uint8_t> &cipherText, const std::vector<uint8_t> &AD, std::vector<uint8_t> &plaintext, const bool payloadDirectEncryption) override;
+			/// return true when the peer device advertised it can decompress payloads
+			bool peerSupportsCompression(void) const override {return m_peerSupportsCompression;}
+			/// return true when the peer device advertised it can process sender key distributions
+			bool peerSupportsSenderKey(void) const override {return m_peerSupportsSenderKey;}
 			/// return the session's local storage id
 			long int dbSessionId(void) const override {return m_dbSessionId;};
 			/// return the current status of session
 			bool isActive(void) const override {return m_active_status;}
+			/// store a newly created session in local storage before any message is encrypted with it
+			bool save(void) override {
+				if (m_dirty != DRSessionDbStatus::dirty || m_dbSessionId != 0) { // only a session never saved can be saved without encrypting or decrypting
+					return false;
+				}
+				if (session_save() == true) {
+					m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
+					return true;
+				}
+				return false;
+			}
+			/// estimate the memory used by this session: the object itself and its dynamically allocated buffers
+			size_t memoryFootprint(void) const override {
+				return sizeof(*this) + m_peerDeviceId.capacity() + m_X3DH_initMessage.capacity() + m_mkskipped.capacity()*sizeof(lime::ReceiverKeyChain<Curve>);
+			}
 
 		private:
 			/* State variables for Double Ratchet, see Double Ratchet spec section 3.2 for details */
@@ -654,6 +771,8 @@ namespace lime {
 			bool m_peerKEMPkAvailable; // true : the KEM peer Public key was not yet consumed to update sending chain
 			bool m_peerHasSelfKEMPk; // true: our correspondant have our current public key
 			bool m_peerECPkAvailable; // true : the EC peer Public key was not yet consumed to update sending chain
+			bool m_peerSupportsCompression; // true : peer advertised it can decompress payloads
+			bool m_peerSupportsSenderKey; // true : peer advertised it can process sender key distributions
 			uint32_t m_KEMRatchetChainSize; // How many messages were exchanged since the last KEM Ratchet
 			int64_t m_lastKEMRatchetEpoch; // timestamp storing the last asymmetric receiving ratchet execution (as unixepoch)
 			DRChainKey m_RK; // 32 bytes root key
@@ -669,6 +788,7 @@ namespace lime {
 			long int m_dbSessionId; // used to store row id from Database Storage
 			uint16_t m_usedNr; // store the index of message key used for decryption if it came from mkskipped db
 			long m_usedDHid; // store the index of DHr message key used for decryption if it came from mkskipped db(not zero only if used)
+			std::unique_ptr<lime::ReceiverKeyChain<Curve>> m_usedCheckpoint; // when the message key used for decryption was derived from a stored checkpoint(m_usedNr is then the checkpoint index): the advanced checkpoint and the message keys derived on the way
 			uint32_t m_usedOPkId; // when the session is created on receiver side, store the OPk id used so we can remove it from local storage when saving session for the first time.
 			std::shared_ptr<lime::Db> m_localStorage; // enable access to the database holding sessions and skipped message keys
 			DRSessionDbStatus m_dirty; // status of the object regarding its instance in local storage, could be: clean, dirty_encrypt, dirty_decrypt or dirty
@@ -678,6 +798,9 @@ namespace lime {
 			long int m_db_Uid; // used to link session to a local device Id
 			bool m_active_status; // current status of this session, true if it is the active one, false if it is stale
 			std::vector<uint8_t> m_X3DH_initMessage; // store the X3DH init message to be able to prepend it to any message until we got a first response from peer so we're sure he was able to init the session on his side
+			DRChainKey m_sendingCKs; // next sending chain key, derived in a batch with other sessions along m_sendingMK. m_CKs is updated only when the message key is used
+			DRMKey m_sendingMK; // message key derived in a batch with other sessions, to be used by the next ratchetEncrypt
+			bool m_sendingMKReady; // true when m_sendingMK and m_sendingCKs hold the derivation of m_CKs at index m_Ns
 
 			/*helpers functions */
 			void skipMessageKeys(const uint16_t until, const int limit); /* check if we skipped some messages in current receiving chain, generate and store in session intermediate message keys */
@@ -743,6 +866,7 @@ namespace lime {
 				// modified the DR session, not in sync anymore with local storage
 				m_dirty = DRSessionDbStatus::dirty_ratchet_sending;
 				m_peerECPkAvailable = false; // make sure we will not make another ratchet with this key
+				m_sendingMKReady = false; // a message key derived in advance belongs to the previous sending chain
 			}
 			/**
 			 * @brief perform an Asymmetric Ratchet with KEM on reception of peer's new public key
@@ -852,6 +976,7 @@ namespace lime {
 				// modified the DR session, not in sync anymore with local storage
 				m_dirty = DRSessionDbStatus::dirty_ratchet_sending;
 				m_peerECPkAvailable = false; // make sure we will not make another ratchet with this key
+				m_sendingMKReady = false; // a message key derived in advance belongs to the previous sending chain
 			}
 
 			/**
@@ -869,14 +994,26 @@ namespace lime {
 			*	DHs<...>
 			*
 			* @param[in]	payloadDirectEncryption		Set the Payload Direct Encryption flag in header
+			* @param[in]	payloadCompressed		Set the Payload Compressed flag in header
+			* @param[in]	senderKeyDistribution		Set the Sender Key Distribution flag in header
 			*/
 			template<typename Curve_ = Curve, std::enable_if_t<!std::is_base_of_v<genericKEM, Curve_>, bool> = true>
-			void writeDRheader(std::vector<uint8_t> &header, const bool payloadDirectEncryption) const noexcept {
+			void writeDRheader(std::vector<uint8_t> &header, const bool payloadDirectEncryption, const bool payloadCompressed, const bool senderKeyDistribution) const noexcept {
 				header.assign(1, static_cast<uint8_t>(double_ratchet_protocol::DR_v01));
 				uint8_t messageType = 0;
 				if (payloadDirectEncryption) { // if requested, turn the payload direct encryption flag on
 					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_direct_encryption_flag); // turn on the flag
 				}
+				if (payloadCompressed) {
+					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_compressed_flag);
+				}
+				if (senderKeyDistribution) {
+					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_distribution_flag);
+				}
+				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_supported_flag); // advertise we can process sender key distributions
+#ifdef HAVE_ZLIB
+				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::compression_supported_flag); // advertise we can decompress payloads
+#endif
 
 				if (m_X3DH_initMessage.size()>0) { // we do have an X3DH init message to insert in the header
 					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::X3DH_init_flag); // turn on the flag
@@ -914,14 +1051,26 @@ namespace lime {
 			*   Self KEM index <12 bytes> || Peer KEM index <12 bytes>
 			*
 			* @param[in]	payloadDirectEncryption		Set the Payload Direct Encryption flag in header
+			* @param[in]	payloadCompressed		Set the Payload Compressed flag in header
+			* @param[in]	senderKeyDistribution		Set the Sender Key Distribution flag in header
 			*/
 			template<typename Curve_ = Curve, std::enable_if_t<std::is_base_of_v<genericKEM, Curve_>, bool> = true>
-			void writeDRheader(std::vector<uint8_t> &header, const bool payloadDirectEncryption) const noexcept {
+			void writeDRheader(std::vector<uint8_t> &header, const bool payloadDirectEncryption, const bool payloadCompressed, const bool senderKeyDistribution) const noexcept {
 				header.assign(1, static_cast<uint8_t>(double_ratchet_protocol::DR_v01));
 				uint8_t messageType = 0;
 				if (payloadDirectEncryption) { // if requested, turn the payload direct encryption flag on
 					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_direct_encryption_flag); // turn on the flag
 				}
+				if (payloadCompressed) {
+					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_compressed_flag);
+				}
+				if (senderKeyDistribution) {
+					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_distribution_flag);
+				}
+				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_supported_flag); // advertise we can process sender key distributions
+#ifdef HAVE_ZLIB
+				messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::compression_supported_flag); // advertise we can decompress payloads
+#endif
 				if (m_peerHasSelfKEMPk) { // peer already get our KEM Pk
 					// No KEM asymmetric ratchet public key but index only
 					messageType |= static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::KEM_pk_index); // turn on the flag
@@ -961,6 +1110,34 @@ namespace lime {
 	/****************************************************************************/
 	/* DRi public member functions - DR interface implementation                */
 	/****************************************************************************/
+	/**
+	 * @brief Perform the pending asymmetric ratchet if any and give access to the sending chain so the message key can be derived by batch
+	 *
+	 * The derivation is written in m_sendingCKs and m_sendingMK, the sending chain itself(m_CKs, m_Ns) is modified only by ratchetEncrypt
+	 * so a failure between this call and ratchetEncrypt leaves the session consistent.
+	 *
+	 * @param[out]	chain	the sending chain of this session
+	 *
+	 * @return false if a message key is already waiting to be used by ratchetEncrypt
+	 */
+	template <typename Curve>
+	bool DRi<Curve>::prepareSendingChain(DRSendingChain &chain) {
+		// Shall we perform an asymmetric ratchet step? If there is at least an EC public key available, yes
+		if (m_peerECPkAvailable) {
+			AsymmetricRatchetSending();
+		}
+		if (m_sendingMKReady) {
+			return false;
+		}
+		m_sendingCKs = m_CKs;
+		chain.CK = &m_sendingCKs;
+		chain.MK = &m_sendingMK;
+		chain.index = m_Ns;
+		chain.indexedDerivation = std::is_base_of_v<genericKEM, Curve>;
+		m_sendingMKReady = true;
+		return true;
+	}
+
 	/**
 	 * @brief Encrypt using the double-ratchet algorithm.
 	 *
@@ -968,21 +1145,34 @@ namespace lime {
 	 * @param[in]	AD				Associated Data, this buffer shall hold: source GRUU<...> || recipient GRUU<...> || [ actual message AEAD auth tag OR recipient User Id]
 	 * @param[out]	ciphertext			buffer holding the header, cipher text and auth tag, shall contain the key and IV used to cipher the actual message, auth tag applies on AD || header
 	 * @param[in]	payloadDirectEncryption		A flag to set in message header: set when having payload in the DR message
+	 * @param[in]	payloadCompressed		A flag to set in message header: set when the payload was compressed before encryption
+	 * @param[in]	senderKeyDistribution		A flag to set in message header: set when the payload is a sender chain distribution
 	 */
 	template <typename Curve>
-	void DRi<Curve>::ratchetEncrypt(const std::vector<uint8_t> &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption) {
-		m_dirty = DRSessionDbStatus::dirty_encrypt; // we're about to modify this session, it won't be in sync anymore with local storage
+	void DRi<Curve>::ratchetEncrypt(const std::vector<uint8_t> &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const bool payloadCompressed, const bool senderKeyDistribution) {
+		LIME_METRICS_TIME(ratchetEncrypt);
+		// we're about to modify this session, it won't be in sync anymore with local storage
+		// keep the status set by an asymmetric ratchet performed in prepareSendingChain: it is not saved yet
+		if (m_dirty != DRSessionDbStatus::dirty_ratchet_sending) {
+			m_dirty = DRSessionDbStatus::dirty_encrypt;
+		}
 		// Shall we perform an asymmetric ratchet step? If there is at least an EC public key available, yes
 		if (m_peerECPkAvailable) {
 			AsymmetricRatchetSending();
 		}
 
-		// chain key derivation(also compute message key)
+		// chain key derivation(also compute message key), unless it was already performed by batch
 		DRMKey MK;
-		KDF_CK<Curve>(m_CKs, MK, m_Ns);
+		if (m_sendingMKReady) {
+			MK = m_sendingMK;
+			m_CKs = m_sendingCKs;
+			m_sendingMKReady = false;
+		} else {
+			KDF_CK<Curve>(m_CKs, MK, m_Ns);
+		}
 
 		ciphertext.clear();
-		writeDRheader(ciphertext, payloadDirectEncryption);
+		writeDRheader(ciphertext, payloadDirectEncryption, payloadCompressed, senderKeyDistribution);
 		auto headerSize = ciphertext.size(); // cipher text holds only the DR header for now
 
 		// increment current sending chain message index
@@ -1025,6 +1215,7 @@ namespace lime {
 	 */
 	template <typename Curve>
 	bool DRi<Curve>::ratchetDecrypt(const std::vector<uint8_t> &ciphertext,const std::vector<uint8_t> &AD, std::vector<uint8_t> &plaintext, const bool payloadDirectEncryption) {
+		LIME_METRICS_TIME(ratchetDecrypt);
 		// parse header
 		DRHeader<Curve> header{ciphertext};
 		if (!header.valid()) { // check it is valid otherwise just stop
@@ -1081,16 +1272,29 @@ namespace lime {
 
 				if (foundSkippedKey) {
 					if (decrypt(MK, ciphertext, header.size(), DRAD, plaintext) == true) {
+						LIME_METRICS_COUNT(skippedKeyConsumed);
+						capture::lateMessage();
+						// the header is authenticated, we can trust its support flags
+						if (header.compressionSupported()) {
+							m_peerSupportsCompression = true;
+						}
+						if (header.senderKeySupported()) {
+							m_peerSupportsSenderKey = true;
+						}
 						//Decrypt went well, we must save the session to DB
 						if (session_save() == true) {
 							m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
 							m_usedDHid=0; // reset variables used to tell the local storage to delete them
 							m_usedNr=0;
+							m_usedCheckpoint.reset();
 							m_X3DH_initMessage.clear(); // just in case we had a valid X3DH init in session, erase it as it's not needed after the first message received from peer
 						}
 						return true;
 					} else {
 						LIME_LOGE<<"Decryption fail: found a matching skipped key in local db but unable to decrypt with it";
+						m_usedDHid=0; // the key was not consumed, it must stay in local storage
+						m_usedNr=0;
+						m_usedCheckpoint.reset();
 						return false;
 					}
 				}
@@ -1114,6 +1318,13 @@ namespace lime {
 
 		//decrypt and save on succes
 		if (decrypt(MK, ciphertext, header.size(), DRAD, plaintext) == true ) {
+			// the header is authenticated, we can trust its support flags
+			if (header.compressionSupported()) {
+				m_peerSupportsCompression = true;
+			}
+			if (header.senderKeySupported()) {
+				m_peerSupportsSenderKey = true;
+			}
 			if (session_save() == true) {
 				m_dirty = DRSessionDbStatus::clean; // this session and local storage are back in sync
 				m_mkskipped.clear(); // potential skipped message keys are now stored in DB, clear the local storage
@@ -1141,6 +1352,8 @@ namespace lime {
 	 * -- 1  KEM peer pk available locally
 	 * -- 2  KEM self pk known by peer
 	 * -- 3  EC peer pk available locally
+	 * -- 4  peer supports compression
+	 * -- 5  peer supports sender key
 	 */
 	namespace{
 		enum class DHrStatusBitMap : uint32_t {
@@ -1148,6 +1361,8 @@ namespace lime {
 			peerKEMPkAvailable = 0x00000002,
 			peerHasSelfKEMPk = 0x00000004,
 			peerECPkAvailable = 0x00000008,
+			peerSupportsCompression = 0x00000010,
+			peerSupportsSenderKey = 0x00000020,
 			KEMRatchetChainSize = 0x7FFFFF00
 		};
 	}
@@ -1158,6 +1373,8 @@ namespace lime {
 		if (m_peerKEMPkAvailable) ret |= static_cast<uint32_t>(DHrStatusBitMap::peerKEMPkAvailable);
 		if (m_peerHasSelfKEMPk) ret |= static_cast<uint32_t>(DHrStatusBitMap::peerHasSelfKEMPk);
 		if (m_peerECPkAvailable) ret |= static_cast<uint32_t>(DHrStatusBitMap::peerECPkAvailable);
+		if (m_peerSupportsCompression) ret |= static_cast<uint32_t>(DHrStatusBitMap::peerSupportsCompression);
+		if (m_peerSupportsSenderKey) ret |= static_cast<uint32_t>(DHrStatusBitMap::peerSupportsSenderKey);
 		ret |= (m_KEMRatchetChainSize<<8)&static_cast<uint32_t>(DHrStatusBitMap::KEMRatchetChainSize);
 		return ret;
 	}
@@ -1167,6 +1384,8 @@ namespace lime {
 		m_peerKEMPkAvailable = (DHrStatus & static_cast<uint32_t>(DHrStatusBitMap::peerKEMPkAvailable)) != 0;
 		m_peerHasSelfKEMPk = (DHrStatus & static_cast<uint32_t>(DHrStatusBitMap::peerHasSelfKEMPk)) != 0;
 		m_peerECPkAvailable = (DHrStatus & static_cast<uint32_t>(DHrStatusBitMap::peerECPkAvailable)) != 0;
+		m_peerSupportsCompression = (DHrStatus & static_cast<uint32_t>(DHrStatusBitMap::peerSupportsCompression)) != 0;
+		m_peerSupportsSenderKey = (DHrStatus & static_cast<uint32_t>(DHrStatusBitMap::peerSupportsSenderKey)) != 0;
 		m_KEMRatchetChainSize = (DHrStatus & static_cast<uint32_t>(DHrStatusBitMap::KEMRatchetChainSize))>>8;
 	}
 
@@ -1178,6 +1397,7 @@ namespace lime {
 	 */
 	template <typename Curve>
 	bool DRi<Curve>::session_save(bool commit) { // commit default to true
+		LIME_METRICS_TIME(sessionSave);
 		std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
 
 		try {
@@ -1342,8 +1562,27 @@ namespace lime {
 
 				// updatesert went well, do we have any mkskipped row to modify
 				if (m_usedDHid !=0 ) { // ok, we consumed a key, remove it from db
-					m_localStorage->sql<<"DELETE from DR_MSk_MK WHERE DHid = :DHid AND Nr = :Nr;", use(m_usedDHid), use(m_usedNr);
-					MSk_DHr_Clean = true; // flag the cleaning needed in DR_MSk_DH table, we may have to remove a row in it if no more row are linked to it in DR_MSk_MK
+					if (m_usedCheckpoint) { // the key was derived from a checkpoint: replace it by the advanced one and store the keys derived on the way
+						m_localStorage->sql<<"DELETE from DR_MSk_CK WHERE DHid = :DHid AND Nr = :Nr;", use(m_usedDHid), use(m_usedNr);
+						if (m_usedCheckpoint->checkpointNr < m_usedCheckpoint->checkpointEnd) {
+							blob CK(m_localStorage->sql);
+							CK.write(0, (char *)(m_usedCheckpoint->checkpointCK.data()), m_usedCheckpoint->checkpointCK.size());
+							m_localStorage->sql<<"INSERT INTO DR_MSk_CK(DHid,Nr,endNr,CK) VALUES(:DHid,:Nr,:endNr,:CK)", use(m_usedDHid), use(m_usedCheckpoint->checkpointNr), use(m_usedCheckpoint->checkpointEnd), use(CK);
+						}
+						if (!m_usedCheckpoint->messageKeys.empty()) {
+							uint16_t Nr;
+							blob MK(m_localStorage->sql);
+							statement st = (m_localStorage->sql.prepare << "INSERT INTO DR_MSk_MK(DHid,Nr,MK) VALUES(:DHid,:Nr,:Mk)", use(m_usedDHid), use(Nr), use(MK));
+							for (const auto &kv : m_usedCheckpoint->messageKeys) {
+								Nr=kv.first;
+								MK.write(0, (char *)kv.second.data(), kv.second.size());
+								st.execute(true);
+							}
+						}
+					} else {
+						m_localStorage->sql<<"DELETE from DR_MSk_MK WHERE DHid = :DHid AND Nr = :Nr;", use(m_usedDHid), use(m_usedNr);
+					}
+					MSk_DHr_Clean = true; // flag the cleaning needed in DR_MSk_DH table, we may have to remove a row in it if no more row are linked to it in DR_MSk_MK or DR_MSk_CK
 				} else { // we did not consume a key
 					if (m_dirty == DRSessionDbStatus::dirty_decrypt || m_dirty == DRSessionDbStatus::dirty_ratchet_receiving) { // if we did a message decrypt :
 						// update the count of posterior messages received in the stored skipped messages keys for this session (all stored chains)
@@ -1366,23 +1605,31 @@ namespace lime {
 				} else { // the chain already exists in storage, just reset its counter of newer message received
 					m_localStorage->sql<<"UPDATE DR_MSk_DHr SET received = 0 WHERE DHid = :DHid", use(DHid);
 				}
+				// insert the checkpoint the skipped keys are derivable from
+				if (rChain.checkpointNr < rChain.checkpointEnd) {
+					blob CK(m_localStorage->sql);
+					CK.write(0, (char *)(rChain.checkpointCK.data()), rChain.checkpointCK.size());
+					m_localStorage->sql<<"INSERT INTO DR_MSk_CK(DHid,Nr,endNr,CK) VALUES(:DHid,:Nr,:endNr,:CK)", use(DHid), use(rChain.checkpointNr), use(rChain.checkpointEnd), use(CK);
+				}
 				// insert all the skipped key in the chain
-				uint16_t Nr;
-				blob MK(m_localStorage->sql);
-				statement st = (m_localStorage->sql.prepare << "INSERT INTO DR_MSk_MK(DHid,Nr,MK) VALUES(:DHid,:Nr,:Mk)", use(DHid), use(Nr), use(MK));
-
-				for (const auto &kv : rChain.messageKeys) { // messageKeys is an unordered map of MK indexed by Nr.
-					Nr=kv.first;
-					MK.write(0, (char *)kv.second.data(), kv.second.size());
-					st.execute(true);
+				if (!rChain.messageKeys.empty()) {
+					uint16_t Nr;
+					blob MK(m_localStorage->sql);
+					statement st = (m_localStorage->sql.prepare << "INSERT INTO DR_MSk_MK(DHid,Nr,MK) VALUES(:DHid,:Nr,:Mk)", use(DHid), use(Nr), use(MK));
+
+					for (const auto &kv : rChain.messageKeys) { // messageKeys is an unordered map of MK indexed by Nr.
+						Nr=kv.first;
+						MK.write(0, (char *)kv.second.data(), kv.second.size());
+						st.execute(true);
+					}
 				}
 			}
 
 			// Now do the cleaning (remove unused row from DR_MKs_DHr table) if needed
 			if (MSk_DHr_Clean == true) {
 				uint16_t Nr;
-				m_localStorage->sql<<"SELECT Nr from DR_MSk_MK WHERE DHid = :DHid LIMIT 1;", into(Nr), use(m_usedDHid);
-				if (!m_localStorage->sql.got_data()) { // no more MK with this DHid, remove it
+				m_localStorage->sql<<"SELECT Nr from DR_MSk_MK WHERE DHid = :DHid UNION ALL SELECT Nr from DR_MSk_CK WHERE DHid = :CKDHid LIMIT 1;", into(Nr), use(m_usedDHid), use(m_usedDHid);
+				if (!m_localStorage->sql.got_data()) { // no more MK nor checkpoint with this DHid, remove it
 					m_localStorage->sql<<"DELETE from DR_MSk_DHr WHERE DHid = :DHid;", use(m_usedDHid);
 				}
 			}
@@ -1408,6 +1655,7 @@ namespace lime {
 	 */
 	template <typename Curve>
 	bool DRi<Curve>::session_load() {
+		LIME_METRICS_TIME(sessionLoad);
 		std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
 
 		// blobs to store DR session data
@@ -1456,7 +1704,8 @@ namespace lime {
 	/**
 	 * @brief Derive chain keys until reaching the requested Id. Handling unordered messages
 	 *
-	 *	Store the derived but not used keys in a list indexed by peer DH and Nr
+	 *	The skipped message keys are not derived: the chain key at the first skipped index is stored as a checkpoint
+	 *	in a list indexed by peer DH, message keys are derived from it only when a skipped message arrives
 	 *
 	 * @param[in]	until	index we must reach in that chain key
 	 * @param[in]	limit	maximum number of allowed derivations
@@ -1477,11 +1726,13 @@ namespace lime {
 		m_mkskipped.push_back(newRChain);
 		auto rChain = &m_mkskipped.back();
 
-		DRMKey MK;
+		rChain->checkpointNr = m_Nr;
+		rChain->checkpointEnd = until;
+		rChain->checkpointCK = m_CKr;
+		LIME_METRICS_COUNT_N(skippedKeyStored, until - m_Nr);
+		capture::skippedKeys(until - m_Nr);
 		while (m_Nr<until) {
-			KDF_CK<Curve>(m_CKr, MK, m_Nr);
-			// insert the nessage key into the list of skipped ones
-			rChain->messageKeys[m_Nr]=MK;
+			KDF_CK_next<Curve>(m_CKr, m_Nr);
 			m_Nr++;
 			m_KEMRatchetChainSize++;
 		}
@@ -1503,22 +1754,99 @@ namespace lime {
 		blob DHr_blob(m_localStorage->sql);
 		DHr_blob.write(0, (char *)(DHrIndex.data()), DHrIndex.size());
 
+		m_usedCheckpoint.reset();
 		indicator ind;
 		m_localStorage->sql<<"SELECT m.MK, m.DHid FROM DR_MSk_MK as m INNER JOIN DR_MSk_DHr as d ON d.DHid=m.DHid WHERE d.sessionId = :sessionId AND d.DHr = :DHr AND m.Nr = :Nr LIMIT 1", into(MK_blob,ind), into(m_usedDHid), use(m_dbSessionId), use(DHr_blob), use(Nr);
+		if (m_localStorage->sql.got_data() && ind == i_ok && MK_blob.get_len()==MK.size()) {
+			// record the Nr of extracted to be able to delete it fron base later (if decrypt ends well)
+			m_usedNr=Nr;
+			MK_blob.read(0, (char *)(MK.data()), MK.size());
+			return true;
+		}
+
+		// no stored key, look for a checkpoint covering this index
+		blob CK_blob(m_localStorage->sql);
+		uint16_t checkpointNr=0;
+		uint16_t checkpointEnd=0;
+		m_localStorage->sql<<"SELECT c.CK, c.Nr, c.endNr, c.DHid FROM DR_MSk_CK as c INNER JOIN DR_MSk_DHr as d ON d.DHid=c.DHid WHERE d.sessionId = :sessionId AND d.DHr = :DHr AND c.Nr <= :Nr AND c.endNr > :endNr LIMIT 1", into(CK_blob,ind), into(checkpointNr), into(checkpointEnd), into(m_usedDHid), use(m_dbSessionId), use(DHr_blob), use(Nr), use(Nr);
 		// we didn't find anything
-		if (!m_localStorage->sql.got_data() || ind != i_ok || MK_blob.get_len()!=MK.size()) {
+		if (!m_localStorage->sql.got_data() || ind != i_ok || CK_blob.get_len()!=lime::settings::DRChainKeySize) {
 			m_usedDHid=0; // make sure the DHid is not set when we didn't find anything as it is later used to remove confirmed used key from DB
 			return false;
 		}
-		// record the Nr of extracted to be able to delete it fron base later (if decrypt ends well)
-		m_usedNr=Nr;
-
-		MK_blob.read(0, (char *)(MK.data()), MK.size());
+		// record the checkpoint index to be able to replace it later (if decrypt ends well)
+		m_usedNr=checkpointNr;
+
+		// derive from the checkpoint up to the requested key. Keys derived on the way are stored so the checkpoint can move past the used one:
+		// a consumed message key must not be derivable from anything left in storage
+		m_usedCheckpoint = std::make_unique<ReceiverKeyChain<Curve>>(DHrIndex);
+		auto &checkpoint = *m_usedCheckpoint;
+		CK_blob.read(0, (char *)(checkpoint.checkpointCK.data()), checkpoint.checkpointCK.size());
+		for (uint16_t i=checkpointNr; i<Nr; i++) {
+			KDF_CK<Curve>(checkpoint.checkpointCK, checkpoint.messageKeys[i], i);
+		}
+		KDF_CK<Curve>(checkpoint.checkpointCK, MK, Nr);
+		checkpoint.checkpointNr = Nr+1;
+		checkpoint.checkpointEnd = checkpointEnd;
 		return true;
 	};
 
 
 
+	/**
+	 * @brief Parse a Double Ratchet message header to retrieve the peer ratchet public key it was produced with
+	 *
+	 *	No DH or KEM operation is performed: this is used to pick the session matching a message before trying to decrypt it
+	 *
+	 * @param[in]	DRmessage	the Double Ratchet message
+	 * @param[out]	ECDHr		peer EC ratchet public key, this is the first part of the DHr stored in DR_sessions
+	 * @param[out]	DHrIndex	index of the peer ratchet key(s), as used in DR_MSk_DHr to store skipped message keys chains
+	 *
+	 * @return false if the header could not be parsed
+	 */
+	template <typename Curve>
+	bool getDRmessageDHr(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex) {
+		DRHeader<Curve> header{DRmessage};
+		if (!header.valid()) {
+			return false;
+		}
+
+		if constexpr (std::is_base_of_v<genericKEM, Curve>) {
+			if (header.havePKIndex()) {
+				ECDHr.assign(header.ECDHr().cbegin(), header.ECDHr().cend());
+			} else { // the whole DHr is in the header: EC pk || KEM pk || KEM ct
+				ECDHr.assign(header.DHr().cbegin(), header.DHr().cbegin() + lime::X<typename Curve::EC, lime::Xtype::publicKey>::ssize());
+			}
+		} else {
+			ECDHr.assign(header.DHr().cbegin(), header.DHr().cend());
+		}
+		DHrIndex = header.getDHrIndex();
+		return true;
+	}
+
+	/**
+	 * @brief Parse a DR message header to get the index of the self KEM ratchet key (public key and cipher text) the sender used
+	 *
+	 * When the sender knows our KEM public key, its header holds this index instead of its whole KEM keys: it identifies the
+	 * session the message belongs to even when the message opens a new receiving chain. EC only headers have no such index.
+	 *
+	 * @param[in]	DRmessage	the DR message
+	 * @param[out]	DHsIndex	index of the self KEM ratchet key, as computed by ARsKey::getKEMIndex
+	 *
+	 * @return false if the header could not be parsed or does not hold this index
+	 */
+	template <typename Curve>
+	bool getDRmessageDHsIndex(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex) {
+		if constexpr (std::is_base_of_v<genericKEM, Curve>) {
+			DRHeader<Curve> header{DRmessage};
+			if (header.valid() && header.havePKIndex()) {
+				DHsIndex = header.getDHsIndex();
+				return true;
+			}
+		}
+		return false;
+	}
+
 	/****************************************************************************/
 	/* factory functions                                                        */
 	/****************************************************************************/
@@ -1540,6 +1868,8 @@ namespace lime {
 	template std::shared_ptr<DR> make_DR_from_localStorage<C255>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C255> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C255::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C255> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C255::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	template bool getDRmessageDHr<C255>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	template bool getDRmessageDHsIndex<C255>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 #endif
 
 #ifdef EC448_ENABLED
@@ -1547,6 +1877,8 @@ namespace lime {
 	template std::shared_ptr<DR> make_DR_from_localStorage<C448>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C448> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C448::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C448> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C448::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	template bool getDRmessageDHr<C448>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	template bool getDRmessageDHsIndex<C448>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 #endif
 #ifdef HAVE_BCTBXPQ
 #ifdef EC25519_ENABLED
@@ -1554,49 +1886,60 @@ namespace lime {
 	template std::shared_ptr<DR> make_DR_from_localStorage<C255K512>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C255K512> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C255K512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C255K512> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C255K512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	template bool getDRmessageDHr<C255K512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	template bool getDRmessageDHsIndex<C255K512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 
 	template class DRi<C255MLK512>;
 	template std::shared_ptr<DR> make_DR_from_localStorage<C255MLK512>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C255MLK512> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C255MLK512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C255MLK512> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C255MLK512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	template bool getDRmessageDHr<C255MLK512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	template bool getDRmessageDHsIndex<C255MLK512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 #endif
 #ifdef EC448_ENABLED
 	template class DRi<C448MLK1024>;
 	template std::shared_ptr<DR> make_DR_from_localStorage<C448MLK1024>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C448MLK1024> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C448MLK1024::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C448MLK1024> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C448MLK1024::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	template bool getDRmessageDHr<C448MLK1024>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	template bool getDRmessageDHsIndex<C448MLK1024>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 #endif
 #endif // HAVE_BCTBXPQ
 
 	/**
-	 * @brief Encrypt a message to all recipients, identified by their device id
+	 * @brief Select where the payload is encrypted: directly in the Double Ratchet messages or in a separate cipher message
 	 *
-	 *	The plaintext is first encrypted by one randomly generated key using aes-gcm
-	 *	The key and IV are then encrypted with DR Session specific to each device
+	 * @param[in]	encryptionPolicy	the requested encryption policy
+	 * @param[in]	plaintextSize		size of the data to encrypt
+	 * @param[in]	recipientsCount		number of recipients the data is encrypted to
+	 * @param[in]	encryptionCost		weights used by the optimizeCost policy
 	 *
-	 * @param[in,out]	recipients	vector of recipients device id(gruu) and linked DR Session, DR Session are modified by the encryption\n
-	 *					The recipients struct also hold after encryption the double ratchet message targeted to that particular recipient
-	 * @param[in]		plaintext	data to be encrypted
-	 * @param[in]		recipientUserId	the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
-	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
-	 * @param[out]		cipherMessage	message encrypted with a random generated key(and IV). May be an empty buffer depending on encryptionPolicy, recipients and plaintext characteristics
-	 * @param[in]		encryptionPolicy	select how to manage the encryption: direct use of Double Ratchet message or encrypt in the cipher message and use the DR message to share the cipher message key\n
-	 * 						default is optimized output size mode.
-	 * @param[in]		localStorage	pointer to the local storage, used to get lock and start transaction on all DR sessions at once
-	 * @param[in]		randomSeedCallback	when provided and encryption policy ends to be cipherMessage, allow to set/get the random seed and cipher text tag
-	 * 						this is needed to encrypt the same message with differents lime users (for multi base algorithm purpose)
+	 * @return	true when the payload shall be encrypted directly in the DR messages
 	 */
-	void encryptMessage(std::vector<RecipientInfos>& recipients, const std::vector<uint8_t>& plaintext, const std::vector<uint8_t>& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback) {
-		// Shall we set the payload in the DR message or in a separate cupher message buffer?
-		bool payloadDirectEncryption;
+	bool isPayloadDirectEncryption(const lime::EncryptionPolicy encryptionPolicy, const size_t plaintextSize, const size_t recipientsCount, const lime::EncryptionCost &encryptionCost) {
 		switch (encryptionPolicy) {
+			case lime::EncryptionPolicy::optimizeCost:
+			{
+				// select the mode with the lowest cost: output size plus the weighted number of bytes encrypted by the AEAD.
+				// The DR headers(including X3DH init and KEM parts) and authentication tags of the DR messages are the same in both modes, they cancel out
+				// - DR message policy:     recipient number * plaintext size, each one encrypted
+				// - cipher message policy: plaintext size + authentication tag size + transport overhead(the cipher message) + recipient number * random seed size, plaintext and random seeds encrypted
+				const size_t directSize = recipientsCount*plaintextSize;
+				const size_t cipherSize = plaintextSize + recipientsCount*lime::settings::DRrandomSeedSize;
+				return ( directSize + (directSize*encryptionCost.encryptionWeight)/1000 <=
+						cipherSize + lime::settings::DRMessageAuthTagSize + encryptionCost.cipherMessageTransportOverhead + (cipherSize*encryptionCost.encryptionWeight)/1000 );
+			}
+
 			case lime::EncryptionPolicy::DRMessage:
-				payloadDirectEncryption = true;
-				break;
+				return true;
 
 			case lime::EncryptionPolicy::cipherMessage:
-				payloadDirectEncryption = false;
-				break;
+				return false;
+
+			case lime::EncryptionPolicy::senderKey:
+				// sender key mode is managed before reaching the DR encryption, we get here only when it is not possible
+				// (several base algorithms in the recipients, or a recipient not supporting it): fallback to the cipher message mode, it is the closest one
+				return false;
 
 			case lime::EncryptionPolicy::optimizeGlobalBandwidth:
 				// optimize the global bandwith consumption: upload size to server + donwload size from server to recipient
@@ -1605,28 +1948,160 @@ namespace lime {
 				// - cipher message policy : 	up is <plaintext size + authentication tag size>(cipher message size) + recipient number * random seed size
 				// 				down is recipient number * (random seed size + <plaintext size + authentication tag size>(the cipher message))
 				// Note: We are not taking in consideration the fact that being multipart, the message gets an extra multipart boundary when using cipher message mode
-				if ( 2*recipients.size()*plaintext.size() <=
-						(plaintext.size() + lime::settings::DRMessageAuthTagSize + (2*lime::settings::DRrandomSeedSize + plaintext.size() + lime::settings::DRMessageAuthTagSize)*recipients.size()) )  {
-					payloadDirectEncryption = true;
-				} else {
-					payloadDirectEncryption = false;
-				}
-				break;
+				return ( 2*recipientsCount*plaintextSize <=
+						(plaintextSize + lime::settings::DRMessageAuthTagSize + (2*lime::settings::DRrandomSeedSize + plaintextSize + lime::settings::DRMessageAuthTagSize)*recipientsCount) );
 
-				break;
 			case lime::EncryptionPolicy::optimizeUploadSize:
 			default: // to make compiler happy but it shall not be necessary
 				// Default encryption policy : go for the optimal upload size. All other parts being equal, size of output data is
 				// - DR message policy:     recipients number * plaintext size (plaintext is present encrypted in each recipient message)
 				// - cipher message policy: plaintext size + authentication tag size (the cipher message) + recipients number * random seed size (each DR message holds the random seed as encrypted data)
 				// Note: We are not taking in consideration the fact that being multipart, the message gets an extra multipart boundary when using cipher message mode
-				if ( recipients.size()*plaintext.size() <= (plaintext.size() + lime::settings::DRMessageAuthTagSize + (lime::settings::DRrandomSeedSize*recipients.size())) ) {
-					payloadDirectEncryption = true;
-				} else {
-					payloadDirectEncryption = false;
-				}
-				break;
+				return ( recipientsCount*plaintextSize <= (plaintextSize + lime::settings::DRMessageAuthTagSize + (lime::settings::DRrandomSeedSize*recipientsCount)) );
 		}
+	}
+
+	/**
+	 * @brief Generate a random seed and use it to encrypt a payload in a cipher message
+	 *
+	 *	The random seed is expanded in a key and IV used to encrypt the plaintext with aes-gcm, Associated Data are : sourceDeviceId || recipientUserId
+	 *
+	 * @param[in]		plaintext	data to be encrypted
+	 * @param[in]		recipientUserId	the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
+	 * @param[out]		cipherMessage	the encrypted plaintext followed by the authentication tag
+	 *
+	 * @return	the random seed, to be encrypted by the DR session of each recipient
+	 */
+	std::shared_ptr<std::vector<uint8_t>> encryptCipherMessage(const std::vector<uint8_t>& plaintext, const std::vector<uint8_t>& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage) {
+		// generate the random seed
+		auto randomSeed = make_shared<std::vector<uint8_t>>(lime::settings::DRrandomSeedSize);
+		auto RNG_context = make_RNG();
+		RNG_context->randomize(randomSeed->data(), lime::settings::DRrandomSeedSize);
+
+		// expansion of randomSeed to 48 bytes: 32 bytes random key + 16 bytes nonce, use HKDF with empty salt
+		std::vector<uint8_t> emptySalt{};
+		lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize> randomKey;
+		HMAC_KDF<SHA512>(emptySalt.data(), emptySalt.size(), randomSeed->data(), randomSeed->size(), lime::settings::hkdf_randomSeed_info.data(), lime::settings::hkdf_randomSeed_info.size(), randomKey.data(), randomKey.size());
+
+		// resize cipherMessage vector as it is adressed directly by C library: same as plain message + room for the authentication tag
+		cipherMessage.resize(plaintext.size()+lime::settings::DRMessageAuthTagSize);
+
+		// AD is source deviceId(gruu) || recipientUserId(sip uri)
+		std::vector<uint8_t> AD{sourceDeviceId.cbegin(),sourceDeviceId.cend()};
+		AD.insert(AD.end(), recipientUserId.cbegin(), recipientUserId.cend());
+
+		// encrypt to cipherMessage buffer
+		AEAD_encrypt<AES256GCM>(randomKey.data(), lime::settings::DRMessageKeySize, // key buffer also hold the IV
+			randomKey.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize, // IV is stored in the same buffer as key, after it
+			plaintext.data(), plaintext.size(),
+			AD.data(), AD.size(),
+			cipherMessage.data()+plaintext.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
+			cipherMessage.data());
+		return randomSeed;
+	}
+
+#ifdef HAVE_ZLIB
+	/**
+	 * @brief Compress a payload using raw deflate(no zlib header nor checksum, the AEAD authenticates it)
+	 *
+	 * @param[in]	payload		the data to compress
+	 * @param[out]	compressed	the compressed data
+	 *
+	 * @return	true if the payload was compressed and the output is shorter than the input
+	 */
+	static bool compressPayload(const std::vector<uint8_t> &payload, std::vector<uint8_t> &compressed) {
+		z_stream stream{};
+		if (deflateInit2(&stream, lime::settings::compression_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			return false;
+		}
+		compressed.resize(deflateBound(&stream, static_cast<uLong>(payload.size())));
+		stream.next_in = const_cast<Bytef *>(payload.data());
+		stream.avail_in = static_cast<uInt>(payload.size());
+		stream.next_out = compressed.data();
+		stream.avail_out = static_cast<uInt>(compressed.size());
+		auto ret = deflate(&stream, Z_FINISH);
+		compressed.resize(stream.total_out);
+		deflateEnd(&stream);
+		return (ret == Z_STREAM_END && compressed.size() < payload.size());
+	}
+
+	/**
+	 * @brief Decompress a payload compressed by compressPayload
+	 *
+	 * The output is bounded by settings::compression_maxPayloadSize: a payload inflating beyond it is rejected
+	 *
+	 * @param[in,out]	payload		the compressed data, replaced by the decompressed one
+	 */
+	static void decompressPayload(std::vector<uint8_t> &payload) {
+		constexpr size_t maxSize = lime::settings::compression_maxPayloadSize;
+		z_stream stream{};
+		if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+			throw BCTBX_EXCEPTION << "Payload decompression failed: cannot initialise inflate";
+		}
+		std::vector<uint8_t> decompressed{};
+		size_t decompressedSize = std::min(std::max<size_t>(4*payload.size(), 1024), maxSize + 1); // start with a 4x ratio, double it when needed
+		stream.next_in = payload.data();
+		stream.avail_in = static_cast<uInt>(payload.size());
+		int ret = Z_OK;
+		while (ret == Z_OK && stream.total_out <= maxSize) {
+			decompressed.resize(decompressedSize);
+			stream.next_out = decompressed.data() + stream.total_out;
+			stream.avail_out = static_cast<uInt>(decompressedSize - stream.total_out);
+			ret = inflate(&stream, Z_NO_FLUSH);
+			decompressedSize = std::min(2*decompressedSize, maxSize + 1);
+		}
+		size_t totalOut = stream.total_out;
+		bool trailingData = (stream.avail_in != 0);
+		inflateEnd(&stream);
+		if (ret != Z_STREAM_END || trailingData || totalOut > maxSize) {
+			throw BCTBX_EXCEPTION << "Payload decompression failed: invalid or too large("<<totalOut<<" bytes) compressed payload";
+		}
+		decompressed.resize(totalOut);
+		payload = std::move(decompressed);
+	}
+#endif // HAVE_ZLIB
+
+	/**
+	 * @brief Encrypt a message to all recipients, identified by their device id
+	 *
+	 *	The plaintext is first encrypted by one randomly generated key using aes-gcm
+	 *	The key and IV are then encrypted with DR Session specific to each device
+	 *
+	 * @param[in,out]	recipients	vector of recipients device id(gruu) and linked DR Session, DR Session are modified by the encryption\n
+	 *					The recipients struct also hold after encryption the double ratchet message targeted to that particular recipient
+	 * @param[in]		plaintext	data to be encrypted
+	 * @param[in]		recipientUserId	the recipient ID, not specific to a device(could be a sip-uri) or a user(could be a group sip-uri)
+	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
+	 * @param[out]		cipherMessage	message encrypted with a random generated key(and IV). May be an empty buffer depending on encryptionPolicy, recipients and plaintext characteristics
+	 * @param[in]		encryptionPolicy	select how to manage the encryption: direct use of Double Ratchet message or encrypt in the cipher message and use the DR message to share the cipher message key\n
+	 * 						default is optimized output size mode.
+	 * @param[in]		localStorage	pointer to the local storage, used to get lock and start transaction on all DR sessions at once
+	 * @param[in]		randomSeedCallback	when provided and encryption policy ends to be cipherMessage, allow to set/get the random seed and cipher text tag
+	 * 						this is needed to encrypt the same message with differents lime users (for multi base algorithm purpose)
+	 * @param[in]		encryptionCost	weights used by the optimizeCost encryption policy
+	 * @param[in]		senderKeyDistribution	the plaintext is a sender chain distribution: flag it in the DR messages headers, the payload is then always in the DR messages
+	 */
+	void encryptMessage(std::vector<RecipientInfos>& recipients, const std::vector<uint8_t>& plaintext, const std::vector<uint8_t>& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback, const lime::EncryptionCost &encryptionCost, const bool senderKeyDistribution) {
+		trace::ScopedSpan span("lime.dr.encryptMessage");
+		span.setAttribute("lime.recipients", recipients.size());
+		span.setAttribute("lime.plaintext_bytes", plaintext.size());
+		bool hasRandomSeedCallback = (randomSeedCallback && *randomSeedCallback);
+
+		// Compress the payload when all the recipients can decompress it. Not when a random seed callback is given: the cipher message
+		// may then be shared with recipients using another base algorithm, their sessions are not known here
+		bool payloadCompressed = false;
+		std::vector<uint8_t> compressedPayload{};
+#ifdef HAVE_ZLIB
+		if (!hasRandomSeedCallback && plaintext.size() >= lime::settings::compression_threshold
+				&& std::all_of(recipients.cbegin(), recipients.cend(), [](const RecipientInfos &recipient){return recipient.DRSession->peerSupportsCompression();})) {
+			payloadCompressed = compressPayload(plaintext, compressedPayload);
+		}
+#endif // HAVE_ZLIB
+		const std::vector<uint8_t> &payload = payloadCompressed ? compressedPayload : plaintext;
+
+		// Shall we set the payload in the DR message or in a separate cipher message buffer?
+		bool payloadDirectEncryption = senderKeyDistribution || isPayloadDirectEncryption(encryptionPolicy, payload.size(), recipients.size(), encryptionCost);
 
 		/* associated data authenticated by the AEAD scheme used by double ratchet encrypt/decrypt
 		 * - Payload in the cipherMessage: auth tag from cipherMessage || source Device Id || recipient Device Id
@@ -1638,39 +2113,13 @@ namespace lime {
 		// used only when payload is not in the DR message
 		std::shared_ptr<std::vector<uint8_t>> randomSeed = nullptr; // this seed is sent in DR message and used to derivate random key + IV to encrypt the actual message
 
-
-		bool hasRandomSeedCallback = (randomSeedCallback && *randomSeedCallback);
 		if (!payloadDirectEncryption) { // Payload is encrypted in a separate cipher message buffer while the key used to encrypt it is in the DR message
 			bool hasRandomSeed = false;
 			if (hasRandomSeedCallback) { // check if we already have a random seed, in this case, it means the cipherMessage buffer is already holding the actual cipherMessage
 				hasRandomSeed = (*randomSeedCallback)(true, randomSeed);
 			}
 			if (!hasRandomSeed) { // We must generate the random seed and ciphermessage
-				// First generate a key and IV, use it to encrypt the given message, Associated Data are : sourceDeviceId || recipientUserId
-				// generate the random seed
-				randomSeed = make_shared<std::vector<uint8_t>>(lime::settings::DRrandomSeedSize);
-				auto RNG_context = make_RNG();
-				RNG_context->randomize(randomSeed->data(), lime::settings::DRrandomSeedSize);
-
-				// expansion of randomSeed to 48 bytes: 32 bytes random key + 16 bytes nonce, use HKDF with empty salt
-				std::vector<uint8_t> emptySalt{};
-				lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize> randomKey;
-				HMAC_KDF<SHA512>(emptySalt.data(), emptySalt.size(), randomSeed->data(), randomSeed->size(), lime::settings::hkdf_randomSeed_info.data(), lime::settings::hkdf_randomSeed_info.size(), randomKey.data(), randomKey.size());
-
-				// resize cipherMessage vector as it is adressed directly by C library: same as plain message + room for the authentication tag
-				cipherMessage.resize(plaintext.size()+lime::settings::DRMessageAuthTagSize);
-
-				// AD is source deviceId(gruu) || recipientUserId(sip uri)
-				AD.assign(sourceDeviceId.cbegin(),sourceDeviceId.cend());
-				AD.insert(AD.end(), recipientUserId.cbegin(), recipientUserId.cend());
-
-				// encrypt to cipherMessage buffer
-				AEAD_encrypt<AES256GCM>(randomKey.data(), lime::settings::DRMessageKeySize, // key buffer also hold the IV
-					randomKey.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize, // IV is stored in the same buffer as key, after it
-					plaintext.data(), plaintext.size(),
-					AD.data(), AD.size(),
-					cipherMessage.data()+plaintext.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
-					cipherMessage.data());
+				randomSeed = encryptCipherMessage(payload, recipientUserId, sourceDeviceId, cipherMessage);
 				if (hasRandomSeedCallback) { // Store the random seed, if possibly needed
 					(*randomSeedCallback)(false, randomSeed);
 				}
@@ -1678,7 +2127,7 @@ namespace lime {
 
 			// Associated Data to Double Ratchet encryption is: auth tag of cipherMessage AEAD || sourceDeviceId || recipient device Id(gruu)
 			// build the common part to AD given to DR Session encryption
-			AD.assign(cipherMessage.cbegin()+plaintext.size(), cipherMessage.cend());
+			AD.assign(cipherMessage.cbegin()+payload.size(), cipherMessage.cend());
 		} else { // Payload is directly encrypted in the DR message
 			AD.assign(recipientUserId.cbegin(), recipientUserId.cend());
 		}
@@ -1687,6 +2136,36 @@ namespace lime {
 		 * - Payload in the DR message: recipient User Id || source Device Id
 		 */
 		AD.insert(AD.end(), sourceDeviceId.cbegin(), sourceDeviceId.cend());
+		span.setAttribute("lime.payload_direct", payloadDirectEncryption);
+		span.setAttribute("lime.payload_compressed", payloadCompressed);
+
+		// perform the asymmetric ratchet steps and derive the message keys of all recipients sessions in one batch so the HMAC-SHA512
+		// computations use the multi-buffer kernel. It does not access the local storage: it runs before taking the database lock so
+		// encryptions to different peer devices, protected by their own locks, are not serialized on it.
+		// The derived keys are used only by ratchetEncrypt, a later failure leaves the sessions sending chains unchanged.
+		{
+			trace::ScopedSpan prepareSpan("lime.dr.prepareSendingChains");
+			std::vector<DRSendingChain> chains{};
+			std::vector<std::shared_ptr<DR>> preparedSessions{};
+			chains.reserve(recipients.size());
+			preparedSessions.reserve(recipients.size());
+			try {
+				for (auto &recipient : recipients) {
+					DRSendingChain chain{};
+					if (recipient.DRSession->prepareSendingChain(chain)) {
+						chains.push_back(chain);
+						preparedSessions.push_back(recipient.DRSession);
+					}
+				}
+				KDF_CK_batch(chains);
+			} catch (BctbxException const &e) { // the message keys prepared so far were not derived: drop them
+				for (auto &session : preparedSessions) session->discardSendingChain();
+				throw BCTBX_EXCEPTION << "Encryption to recipients failed : "<<e.str();
+			} catch (exception const &e) {
+				for (auto &session : preparedSessions) session->discardSendingChain();
+				throw BCTBX_EXCEPTION << "Encryption to recipients failed : "<<e.what();
+			}
+		}
 
 		// ratchet encrypt write to the db, to avoid a serie of transaction, manage it outside of the loop
 		// acquire lock and open a transaction
@@ -1699,9 +2178,9 @@ namespace lime {
 				recipientAD.insert(recipientAD.end(), recipients[i].deviceId.cbegin(), recipients[i].deviceId.cend()); //insert recipient device id(gruu)
 
 				if (payloadDirectEncryption) {
-					recipients[i].DRSession->ratchetEncrypt(plaintext, std::move(recipientAD), recipients[i].DRmessage, true);
+					recipients[i].DRSession->ratchetEncrypt(payload, std::move(recipientAD), recipients[i].DRmessage, true, payloadCompressed, senderKeyDistribution);
 				} else {
-					recipients[i].DRSession->ratchetEncrypt(*randomSeed, std::move(recipientAD), recipients[i].DRmessage, false);
+					recipients[i].DRSession->ratchetEncrypt(*randomSeed, std::move(recipientAD), recipients[i].DRmessage, false, payloadCompressed, false);
 				}
 			}
 			if (!payloadDirectEncryption && !hasRandomSeedCallback) {
@@ -1735,6 +2214,10 @@ namespace lime {
 	 * @return a shared pointer towards the session used to decrypt, nullptr if we couldn't find one to do it
 	 */
 	std::shared_ptr<DR> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::vector<uint8_t>& recipientUserId, std::vector<std::shared_ptr<DR>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext) {
+		trace::ScopedSpan span("lime.dr.decryptMessage");
+		span.setAttribute("lime.sessions", DRSessions.size());
+		span.setAttribute("lime.dr_message_bytes", DRmessage.size());
+		span.setAttribute("lime.cipher_message_bytes", cipherMessage.size());
 		bool payloadDirectEncryption = (cipherMessage.size() == 0); // if we do not have any cipher message, then we must be in payload direct encryption mode: the payload is in the DR message
 		std::vector<uint8_t> AD; // the Associated Data authenticated by the AEAD scheme used in DR encrypt/decrypt
 
@@ -1772,7 +2255,19 @@ namespace lime {
 			}
 
 			if (decryptStatus == true) { // we got the DR message correctly deciphered
+				// the DR message header is authenticated: its payload compressed flag can be trusted
+				const bool payloadCompressed = double_ratchet_protocol::parseMessage_isPayloadCompressed(DRmessage);
+#ifndef HAVE_ZLIB
+				if (payloadCompressed) { // we never advertise compression support, the sender should not have compressed the payload
+					throw BCTBX_EXCEPTION << "Received a compressed payload but this build does not support compression";
+				}
+#endif // HAVE_ZLIB
 				if (payloadDirectEncryption) { // we're done, payload was in the DR message
+#ifdef HAVE_ZLIB
+					if (payloadCompressed) {
+						decompressPayload(plaintext);
+					}
+#endif // HAVE_ZLIB
 					return DRSession;
 				}
 				// recompute the AD used for this encryption: source Device Id || recipient User Id
@@ -1797,12 +2292,18 @@ namespace lime {
 						localAD.data(), localAD.size(),
 						cipherMessage.data()+cipherMessage.size()-lime::settings::DRMessageAuthTagSize, lime::settings::DRMessageAuthTagSize, // tag is in the last 16 bytes of buffer
 						plaintext.data())) {
+#ifdef HAVE_ZLIB
+					if (payloadCompressed) {
+						decompressPayload(plaintext);
+					}
+#endif // HAVE_ZLIB
 					return DRSession;
 				} else {
 					throw BCTBX_EXCEPTION << "Message key correctly deciphered but then failed to decipher message itself";
 				}
 			}
 		}
+		span.setStatus(false);
 		return nullptr; // no session correctly deciphered
 	}
 }
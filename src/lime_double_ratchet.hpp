@@ -38,6 +38,9 @@ namespace lime {
 	/** Double Rachet chain keys: Root key, Sender and receiver keys are 32 bytes arrays */
 	using DRChainKey = lime::sBuffer<lime::settings::DRChainKeySize>;
 
+	/** Double Ratchet Message keys : 32 bytes of encryption key followed by 16 bytes of IV */
+	using DRMKey = lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize>;
+
 	/** Shared Associated Data : stored at session initialisation, given by upper level(X3DH), shall be derived from Identity and Identity keys of sender and recipient, fixed size for storage convenience */
 	using SharedADBuffer = std::array<uint8_t, lime::settings::DRSessionSharedADSize>;
 
@@ -305,17 +308,53 @@ namespace lime {
 			const std::vector<uint8_t> serializePublicDHs(void) const { return m_DHs.serializePublic();};
 	};
 
+	/**
+	 * @brief Access to a DR session sending chain, used to derive the next message key of several sessions in one batch
+	 */
+	struct DRSendingChain {
+		DRChainKey *CK; /**< the sending chain key, updated by the derivation */
+		DRMKey *MK; /**< where to store the message key used by the next ratchetEncrypt */
+		uint16_t index; /**< the sending chain index */
+		bool indexedDerivation; /**< when true, the chain index is part of the derivation labels (EC/KEM sessions) */
+	};
+
 	/**
 	 * @brief A virtual class to define the Double Ratchet interface
 	 */
 	class DR {
 		public:
-			virtual void ratchetEncrypt(const std::vector<uint8_t> &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption) = 0;
+			/**
+			 * @brief Perform the pending asymmetric ratchet if any and give access to the sending chain
+			 * The caller must then derive the message key and next chain key, the next ratchetEncrypt will use this message key.
+			 *
+			 * @param[out]	chain	the sending chain of this session
+			 *
+			 * @return false if a message key is already waiting to be used by ratchetEncrypt, chain is then not set
+			 */
+			virtual bool prepareSendingChain(DRSendingChain &chain) = 0;
+			/**
+			 * @brief Drop the message key prepared by prepareSendingChain when the batch derivation could not complete
+			 * The sending chain itself is untouched, the next encryption derives its message key again.
+			 */
+			virtual void discardSendingChain(void) = 0;
+			virtual void ratchetEncrypt(const std::vector<uint8_t> &plaintext, std::vector<uint8_t> &&AD, std::vector<uint8_t> &ciphertext, const bool payloadDirectEncryption, const bool payloadCompressed, const bool senderKeyDistribution) = 0;
 			virtual bool ratchetDecrypt(const std::vector<uint8_t> &cipherText, const std::vector<uint8_t> &AD, std::vector<uint8_t> &plaintext, const bool payloadDirectEncryption) = 0;
+			/// return true when the peer device advertised it can decompress payloads
+			virtual bool peerSupportsCompression(void) const = 0;
+			/// return true when the peer device advertised it can process sender key distributions
+			virtual bool peerSupportsSenderKey(void) const = 0;
 			/// return the session's local storage id
 			virtual long int dbSessionId(void) const = 0;
 			/// return the current status of session
 			virtual bool isActive(void) const = 0;
+			/**
+			 * @brief Store in local storage a session which was never saved, used when the session is built ahead of its first use
+			 *
+			 * @return true if the session was stored
+			 */
+			virtual bool save(void) = 0;
+			/// return an estimate of the memory used by this session, in bytes
+			virtual size_t memoryFootprint(void) const = 0;
 			virtual ~DR() = default;
 	};
 	template <typename Algo> std::shared_ptr<DR> make_DR_from_localStorage(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
@@ -346,21 +385,32 @@ namespace lime {
 	};
 
 	// helpers function wich are the one to be used to encrypt/decrypt messages
-	void encryptMessage(std::vector<RecipientInfos>& recipients, const std::vector<uint8_t>& plaintext, const std::vector<uint8_t>& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback = nullptr);
+	bool isPayloadDirectEncryption(const lime::EncryptionPolicy encryptionPolicy, const size_t plaintextSize, const size_t recipientsCount, const lime::EncryptionCost &encryptionCost = lime::EncryptionCost{});
+	std::shared_ptr<std::vector<uint8_t>> encryptCipherMessage(const std::vector<uint8_t>& plaintext, const std::vector<uint8_t>& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage);
+	void encryptMessage(std::vector<RecipientInfos>& recipients, const std::vector<uint8_t>& plaintext, const std::vector<uint8_t>& recipientUserId, const std::string& sourceDeviceId, std::vector<uint8_t>& cipherMessage, const lime::EncryptionPolicy encryptionPolicy, std::shared_ptr<lime::Db> localStorage, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback = nullptr, const lime::EncryptionCost &encryptionCost = lime::EncryptionCost{}, const bool senderKeyDistribution = false);
 
 	std::shared_ptr<DR> decryptMessage(const std::string& sourceDeviceId, const std::string& recipientDeviceId, const std::vector<uint8_t>& recipientUserId, std::vector<std::shared_ptr<DR>>& DRSessions, const std::vector<uint8_t>& DRmessage, const std::vector<uint8_t>& cipherMessage, std::vector<uint8_t>& plaintext);
 
+	// parse a DR message header to get the peer ratchet key it was produced with, used to select the matching session without any crypto operation
+	template <typename Curve> bool getDRmessageDHr(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	// parse a DR message header to get the index of the self KEM ratchet key the sender used, KEM based curves only
+	template <typename Curve> bool getDRmessageDHsIndex(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
+
 	/* this templates are instanciated once in the lime_double_ratchet.cpp file, explicitly tell anyone including this header that there is no need to re-instanciate them */
 #ifdef EC25519_ENABLED
 	extern template std::shared_ptr<DR> make_DR_from_localStorage<C255>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C255> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C255::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C255> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C255::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	extern template bool getDRmessageDHr<C255>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	extern template bool getDRmessageDHsIndex<C255>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 
 #endif
 #ifdef EC448_ENABLED
 	extern template std::shared_ptr<DR> make_DR_from_localStorage<C448>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C448> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C448::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C448> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C448::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	extern template bool getDRmessageDHr<C448>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	extern template bool getDRmessageDHsIndex<C448>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 
 #endif
 #ifdef HAVE_BCTBXPQ
@@ -368,15 +418,21 @@ namespace lime {
 	extern template std::shared_ptr<DR> make_DR_from_localStorage<C255K512>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C255K512> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C255K512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C255K512> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C255K512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	extern template bool getDRmessageDHr<C255K512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	extern template bool getDRmessageDHsIndex<C255K512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 
 	extern template std::shared_ptr<DR> make_DR_from_localStorage<C255MLK512>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C255MLK512> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C255MLK512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C255MLK512> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C255MLK512::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	extern template bool getDRmessageDHr<C255MLK512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	extern template bool getDRmessageDHsIndex<C255MLK512>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 #endif
 #ifdef EC448_ENABLED
 	extern template std::shared_ptr<DR> make_DR_from_localStorage<C448MLK1024>(std::shared_ptr<lime::Db> localStorage, long sessionId, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_sender(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARrKey<C448MLK1024> &peerPublicKey, long int peerDid, const std::string &peerDeviceId, const DSA<C448MLK1024::EC, lime::DSAtype::publicKey> &peerIk, long int selfDid, const std::vector<uint8_t> &X3DH_initMessage, std::shared_ptr<RNG> RNG_context);
 	extern template std::shared_ptr<DR> make_DR_for_receiver(std::shared_ptr<lime::Db> localStorage, const DRChainKey &SK, const SharedADBuffer &AD, const ARsKey<C448MLK1024> &selfKeyPair, long int peerDid, const std::string &peerDeviceId, const uint32_t OPk_id, const DSA<C448MLK1024::EC, lime::DSAtype::publicKey> &peerIk, long int selfDeviceId, std::shared_ptr<RNG> RNG_context);
+	extern template bool getDRmessageDHr<C448MLK1024>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &ECDHr, std::vector<uint8_t> &DHrIndex);
+	extern template bool getDRmessageDHsIndex<C448MLK1024>(const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &DHsIndex);
 #endif
 #endif // HAVE_BCTBXPQ
 
@@ -277,6 +277,48 @@ namespace lime {
 		}
 
 
+		/**
+		 * @brief check the message type flag for direct encryption of the payload
+		 *
+		 * @param[in]	message		A buffer holding the message, it shall be DR header || DR message
+		 *
+		 * @return true if the DR message holds the payload, false otherwise (also in case of invalid packet)
+		 */
+		bool parseMessage_isPayloadDirectEncryption(const std::vector<uint8_t> &message) noexcept {
+			if (message.size()<3 || message[0] != double_ratchet_protocol::DR_v01) {
+				return false;
+			}
+			return (message[1]&static_cast<uint8_t>(DR_message_type::payload_direct_encryption_flag)) != 0;
+		}
+
+		/**
+		 * @brief check the message type flag for payload compression
+		 *
+		 * @param[in]	message		A buffer holding the message, it shall be DR header || DR message
+		 *
+		 * @return true if the payload was compressed before encryption, false otherwise (also in case of invalid packet)
+		 */
+		bool parseMessage_isPayloadCompressed(const std::vector<uint8_t> &message) noexcept {
+			if (message.size()<3 || message[0] != double_ratchet_protocol::DR_v01) {
+				return false;
+			}
+			return (message[1]&static_cast<uint8_t>(DR_message_type::payload_compressed_flag)) != 0;
+		}
+
+		/**
+		 * @brief check the message type flag for sender key distribution
+		 *
+		 * @param[in]	message		A buffer holding the message, it shall be DR header || DR message
+		 *
+		 * @return true if the DR message payload is a sender chain distribution, false otherwise (also in case of invalid packet)
+		 */
+		bool parseMessage_isSenderKeyDistribution(const std::vector<uint8_t> &message) noexcept {
+			if (message.size()<3 || message[0] != double_ratchet_protocol::DR_v01) {
+				return false;
+			}
+			return (message[1]&static_cast<uint8_t>(DR_message_type::sender_key_distribution_flag)) != 0;
+		}
+
 
 		/* Instanciate templated functions */
 #ifdef EC25519_ENABLED
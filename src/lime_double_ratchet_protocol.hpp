@@ -31,10 +31,23 @@ namespace lime {
 
 		/** @brief DR message type byte bit mapping
 		 * @code{.unparsed}
-		 * | 7  6  5  4  3         2                      1                          0         |
-		 * | <  Unused    >    KEM Pk Flag   Payload_Direct_Encryption_Flag    X3DH_Init_Flag  |
+		 * |   7                  6                         5                              4                          3                  2                      1                          0         |
+		 * | Unused  Sender_Key_Supported_Flag  Sender_Key_Distribution_Flag  Compression_Supported_Flag  Payload_Compressed_Flag   KEM Pk Flag   Payload_Direct_Encryption_Flag    X3DH_Init_Flag  |
 		 * @endcode
 		 *
+		 * Sender_Key_Supported_Flag (bit 6):
+		 *      - set  : the sender can process sender key distributions, it is set in all messages
+		 *      - unset: the sender would deliver a distribution to its application as plaintext, do not send it any
+		 * Sender_Key_Distribution_Flag (bit 5):
+		 *      - set  : the payload, directly encrypted in the DR message, is the sender's chain for the group in sender key mode. The message comes with the group cipher message
+		 *      - unset: the payload is the user plaintext or the random seed encrypting it
+		 * Compression_Supported_Flag (bit 4):
+		 *      - set  : the sender can decompress payloads, it is set in all messages by devices built with compression support
+		 *      - unset: the sender cannot decompress payloads, do not send it any compressed payload
+		 * Payload_Compressed_Flag (bit 3):
+		 *      - set  : the payload(in the DR message or in the cipher message) was deflated before encryption
+		 *      - unset: the payload is not compressed
+		 * Versions not knowing these two flags ignore them: they never get a compressed payload as they do not advertise the support.
 		 * KEM Pk index Flag (bit 2):
 		 *      - set   : This header holds two KEM Pk indexes (local and peer one
 		 *      - unset : This header holds a KEM public key
@@ -48,7 +61,11 @@ namespace lime {
 		enum class DR_message_type : uint8_t{
 			X3DH_init_flag = 0x01, /**< bit 0 */
 			payload_direct_encryption_flag = 0x02, /**< bit 1 */
-			KEM_pk_index = 0x04 /**< bit 2 */
+			KEM_pk_index = 0x04, /**< bit 2 */
+			payload_compressed_flag = 0x08, /**< bit 3 */
+			compression_supported_flag = 0x10, /**< bit 4 */
+			sender_key_distribution_flag = 0x20, /**< bit 5 */
+			sender_key_supported_flag = 0x40 /**< bit 6 */
 		};
 
 		/** @brief haveOPk byte from X3DH init message mapping
@@ -117,6 +134,10 @@ namespace lime {
 		template <typename Curve>
 		bool parseMessage_get_X3DHinit(const std::vector<uint8_t> &message, std::vector<uint8_t> &X3DH_initMessage) noexcept;
 
+		bool parseMessage_isPayloadDirectEncryption(const std::vector<uint8_t> &message) noexcept;
+		bool parseMessage_isPayloadCompressed(const std::vector<uint8_t> &message) noexcept;
+		bool parseMessage_isSenderKeyDistribution(const std::vector<uint8_t> &message) noexcept;
+
 
 		/* this templates are intanciated in lime_double_ratchet_procotocol.cpp, do not re-instanciate it anywhere else */
 #ifdef EC25519_ENABLED
@@ -23,15 +23,19 @@
 #include <vector>
 #include <unordered_map>
 #include <queue>
+#include <algorithm>
 #include <mutex>
 
 #include "lime/lime.hpp"
 #include "lime_lime.hpp"
+#include "lime_settings.hpp"
 #include "lime_crypto_primitives.hpp"
 #include "lime_localStorage.hpp"
 #include "lime_double_ratchet.hpp"
 #include "lime_x3dh.hpp"
 #include "lime_x3dh_protocol.hpp"
+#include "lime_sender_key.hpp"
+#include "lime_trace.hpp"
 
 namespace lime {
 	// an enum used by network state engine to manage sequence packet sending(at user creation)
@@ -39,6 +43,54 @@ namespace lime {
 
 	struct callbackUserData;
 
+	/**
+	 * @brief Locks held on a set of peer devices, released when this object is destroyed
+	 */
+	struct PeerDevicesLock {
+		std::vector<std::shared_ptr<std::mutex>> mutexes; /**< keep the mutexes alive while they are locked, declared first so it is destroyed after the locks */
+		std::vector<std::unique_lock<std::mutex>> locks; /**< the locks held */
+		/// release all the locks before the object destruction
+		void unlock(void) {
+			locks.clear();
+			mutexes.clear();
+		}
+		/// @return true if the locks are held
+		bool owns_lock(void) const {return !locks.empty();}
+	};
+
+	/**
+	 * @brief Provide a mutex per peer device
+	 *
+	 * Operations on the DR sessions are serialized per peer device: encryption to or decryption from a peer device
+	 * must hold its lock while operations involving other peer devices run concurrently
+	 */
+	class PeerDeviceLocks {
+		private:
+			std::mutex m_mutex; // protect the map
+			std::unordered_map<std::string, std::weak_ptr<std::mutex>> m_locks; // a mutex lives only while someone holds it
+			/// remove the expired entries so the map size stays close to the number of peer devices currently locked, m_mutex must be held
+			void prune(void);
+		public:
+			/**
+			 * @brief Lock the given peer devices
+			 *
+			 * Mutexes are locked in device Id order so concurrent calls on overlapping lists cannot deadlock
+			 *
+			 * @param[in]	deviceIds	the peer devices to lock, duplicates are ignored
+			 *
+			 * @return the locks, released when the returned object is destroyed
+			 */
+			PeerDevicesLock lock(std::vector<std::string> deviceIds);
+			/**
+			 * @brief Lock the given peer device if no one else holds its lock
+			 *
+			 * @param[in]	deviceId	the peer device to lock
+			 *
+			 * @return the lock, check owns_lock() to know if it was acquired
+			 */
+			PeerDevicesLock try_lock(const std::string &deviceId);
+	};
+
 	/** @brief Implement the abstract class LimeGeneric
 	 *  @tparam Curve	The elliptic curve to use: C255 or C448
 	 */
@@ -49,7 +101,9 @@ namespace lime {
 			/* general purpose */
 			std::shared_ptr<RNG> m_RNG; // Random Number Generator context
 			std::string m_selfDeviceId; // self device Id, shall be the GRUU
-			std::mutex m_mutex; // a mutex to lock own thread sensitive ressources (m_DR_sessions_cache, encryption_queue)
+			std::mutex m_mutex; // a mutex to lock own thread sensitive ressources (m_DR_sessions_cache, encryption_queue), it is held only for short critical sections
+			PeerDeviceLocks m_peerDeviceLocks; // serialize the operations on DR sessions per peer device
+			PeerDeviceLocks m_senderChainLocks; // serialize the encryptions in sender key mode per group, they use the same sending chain
 
 			/* X3DH engine */
 			std::shared_ptr<X3DH> m_X3DH; // manage X3DH operations
@@ -67,7 +121,8 @@ namespace lime {
 
 			/*** Private functions ***/
 			void cache_DR_sessions(std::vector<RecipientInfos> &internal_recipients, std::vector<std::string> &missing_devices); // loop on internal recipient an try to load in DR session cache the one which have no session attached 
-			void get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDRSessionId, std::vector<std::shared_ptr<DR>> &DRSessions); // load from local storage in DRSessions all DR session matching the peerDeviceId, ignore the one picked by id in 2nd arg
+			void get_DRSessions(const std::string &senderDeviceId, const long int ignoreThisDRSessionId, const std::vector<uint8_t> &DRmessage, std::vector<std::shared_ptr<DR>> &DRSessions); // load from local storage in DRSessions all DR session matching the peerDeviceId and the DRmessage header key, ignore the one picked by id in 2nd arg
+			bool decrypt_DRmessage(const std::vector<uint8_t> &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage); // decrypt with a DR session: cached, from local storage or created from the X3DH init, the sender device must be locked
 
 		public: /* Implement API defined in lime_lime.hpp in LimeGeneric abstract class */
 			Lime(std::shared_ptr<lime::Db> localStorage, const std::string &deviceId, const std::string &url, const limeX3DHServerPostData &X3DH_post_data, const long int Uid = 0);
@@ -80,6 +135,7 @@ namespace lime {
 			void delete_peerDevice(const std::string &peerDeviceId) override;
 			void update_SPk(const std::shared_ptr<limeCallback> callback) override;
 			void update_OPk(const std::shared_ptr<limeCallback> callback, uint16_t OPkServerLowLimit, uint16_t OPkBatchSize) override;
+			void prefetch_sessions(const std::vector<std::string> &peerDeviceIds, const std::shared_ptr<limeCallback> callback, uint16_t OPkBudget) override;
 			void get_Ik(std::vector<uint8_t> &Ik) override;
 			void encrypt(std::shared_ptr<lime::EncryptionContext> encryptionContext, const std::shared_ptr<limeCallback> callback, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback) override;
 			lime::PeerDeviceStatus decrypt(const std::vector<uint8_t> &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) override;
@@ -89,10 +145,53 @@ namespace lime {
 			void processEncryptionQueue(void) override;
 			void DRcache_delete(const std::string &deviceId) override;
 			void DRcache_insert(const std::string &deviceId, std::shared_ptr<DR> DRsession) override;
+			bool store_prefetchedSession(const std::string &deviceId, std::shared_ptr<DR> DRsession) override;
+			size_t DRcache_warm(const std::string &deviceId, const long int sessionId) override;
 			std::shared_ptr<X3DH> get_X3DH(void) override {return m_X3DH;}
 			std::unique_lock<std::mutex> lock(void) override {return std::unique_lock<std::mutex>(m_mutex);}
 	};
 
+	/**
+	 * @brief State of a sessions prefetch: peer devices key bundles are requested by chunks, one request at a time
+	 */
+	struct PrefetchContext {
+		std::vector<std::string> peerDeviceIds; /**< all the peer devices to build a session with */
+		size_t next; /**< index in peerDeviceIds of the first device of the next chunk */
+		size_t sessionsCount; /**< number of sessions built so far */
+		size_t skippedCount; /**< number of peer devices ignored because they are over the OPk budget */
+
+		PrefetchContext(std::vector<std::string> &&peerDeviceIds, size_t skippedCount) : peerDeviceIds{std::move(peerDeviceIds)}, next{0}, sessionsCount{0}, skippedCount{skippedCount} {};
+
+		/// @return a summary of the prefetch given to the callback
+		std::string report(void) const {
+			std::string message{std::to_string(sessionsCount)};
+			message.append(" sessions prefetched");
+			if (skippedCount > 0) {
+				message.append(", ").append(std::to_string(skippedCount)).append(" peer devices over the OPk budget");
+			}
+			return message;
+		}
+
+		/// @return the next chunk of peer devices to request, empty when all of them were requested
+		std::vector<std::string> nextChunk(void) {
+			auto end = std::min(peerDeviceIds.size(), next + lime::settings::prefetch_chunkSize);
+			std::vector<std::string> chunk(peerDeviceIds.cbegin() + next, peerDeviceIds.cbegin() + end);
+			next = end;
+			return chunk;
+		}
+	};
+
+	/**
+	 * @brief Peer bundles requested by chunks for an encryption
+	 * Chunks are sent concurrently and processed as they arrive, the encryption resumes once the last one is processed
+	 */
+	struct PeerBundlesFetch {
+		std::mutex mutex; /**< protect the pending chunks counter and the recipients status */
+		size_t pendingChunks; /**< number of chunks not processed yet */
+
+		PeerBundlesFetch(size_t chunksCount) : mutex{}, pendingChunks{chunksCount} {};
+	};
+
 	/**
 	 * @brief structure holding user data while waiting for callback from X3DH server response processing
 	 */
@@ -109,22 +208,42 @@ namespace lime {
 		uint16_t OPkServerLowLimit;
 		/// Used when fetching from server self OPk : how many will we upload if needed
 		uint16_t OPkBatchSize;
+		/// Sessions prefetch state, when set the peer bundles received are used to build sessions without encrypting anything
+		std::shared_ptr<PrefetchContext> prefetchContext;
+		/// Shared by all the chunks of a peer bundles request split for an encryption
+		std::shared_ptr<PeerBundlesFetch> bundlesFetch;
+		/// The peer devices requested in this chunk
+		std::vector<std::string> requestedDevices;
+		/// The span current when this operation started, the parent of the spans of its asynchronous continuation(ie: a queued encryption)
+		trace::SpanId traceParent{trace::currentSpan()};
 
 		/// created at user create/delete and keys Post. EncryptionPolicy is not used, set it to the default value anyway
 		callbackUserData(std::weak_ptr<LimeGeneric> thiz, const std::shared_ptr<limeCallback> callback, uint16_t OPkInitialBatchSize=lime::settings::OPk_initialBatchSize)
 			: limeObj{thiz}, callback{callback}, randomSeedCallback{nullptr},
-			encryptionContext{nullptr}, OPkServerLowLimit(0), OPkBatchSize(OPkInitialBatchSize) {};
+			encryptionContext{nullptr}, OPkServerLowLimit(0), OPkBatchSize(OPkInitialBatchSize), prefetchContext{nullptr}, bundlesFetch{nullptr}, requestedDevices{} {};
 
 		/// created at update: getSelfOPks. EncryptionPolicy is not used, set it to the default value anyway
 		callbackUserData(std::weak_ptr<LimeGeneric> thiz, const std::shared_ptr<limeCallback> callback, uint16_t OPkServerLowLimit, uint16_t OPkBatchSize)
 			: limeObj{thiz}, callback{callback}, randomSeedCallback{nullptr},
-			encryptionContext{nullptr}, OPkServerLowLimit{OPkServerLowLimit}, OPkBatchSize{OPkBatchSize} {};
+			encryptionContext{nullptr}, OPkServerLowLimit{OPkServerLowLimit}, OPkBatchSize{OPkBatchSize}, prefetchContext{nullptr}, bundlesFetch{nullptr}, requestedDevices{} {};
 
 		/// created at encrypt(getPeerBundle)
 		callbackUserData(std::weak_ptr<LimeGeneric> thiz, const std::shared_ptr<limeCallback> callback, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback,
 				std::shared_ptr<lime::EncryptionContext> encryptionContext)
 			: limeObj{thiz}, callback{callback}, randomSeedCallback{randomSeedCallback},
-			encryptionContext{encryptionContext}, OPkServerLowLimit(0), OPkBatchSize(0) {};
+			encryptionContext{encryptionContext}, OPkServerLowLimit(0), OPkBatchSize(0), prefetchContext{nullptr}, bundlesFetch{nullptr}, requestedDevices{} {};
+
+		/// created at encrypt for each chunk of a split getPeerBundle
+		callbackUserData(std::weak_ptr<LimeGeneric> thiz, const std::shared_ptr<limeCallback> callback, const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback,
+				std::shared_ptr<lime::EncryptionContext> encryptionContext, std::shared_ptr<PeerBundlesFetch> bundlesFetch, std::vector<std::string> &&requestedDevices)
+			: limeObj{thiz}, callback{callback}, randomSeedCallback{randomSeedCallback},
+			encryptionContext{encryptionContext}, OPkServerLowLimit(0), OPkBatchSize(0), prefetchContext{nullptr},
+			bundlesFetch{bundlesFetch}, requestedDevices{std::move(requestedDevices)} {};
+
+		/// created at sessions prefetch(getPeerBundle)
+		callbackUserData(std::weak_ptr<LimeGeneric> thiz, const std::shared_ptr<limeCallback> callback, std::shared_ptr<PrefetchContext> prefetchContext)
+			: limeObj{thiz}, callback{callback}, randomSeedCallback{nullptr},
+			encryptionContext{nullptr}, OPkServerLowLimit(0), OPkBatchSize(0), prefetchContext{prefetchContext}, bundlesFetch{nullptr}, requestedDevices{} {};
 
 		/// do not copy callback data, force passing the pointer around after creation
 		callbackUserData(callbackUserData &a) = delete;
@@ -128,6 +128,28 @@ namespace lime {
 		 */
 		virtual	void DRcache_insert(const std::string &deviceId, std::shared_ptr<DR> DRsession) = 0;
 
+		/**
+		 * @brief store in local storage a session built by a prefetch
+		 * the session is dropped if the peer device got an active session since the prefetch started
+		 *
+		 * @param[in]	deviceId	the peer device Id
+		 * @param[in]	DRsession	the DR session to store
+		 *
+		 * @return true if the session was stored
+		 */
+		virtual bool store_prefetchedSession(const std::string &deviceId, std::shared_ptr<DR> DRsession) = 0;
+
+		/**
+		 * @brief load from local storage a DR session in cache, used to warm the cache ahead of the first message
+		 * the session is not loaded if the cache already holds one for this peer device or if the peer device is busy
+		 *
+		 * @param[in]	deviceId	the peer device Id
+		 * @param[in]	sessionId	the session id in local storage
+		 *
+		 * @return the estimated memory used by the loaded session, 0 if it was not loaded
+		 */
+		virtual size_t DRcache_warm(const std::string &deviceId, const long int sessionId) = 0;
+
 		/**
 		 * @brief accessor to the internal X3DH engine
 		 *
@@ -180,6 +202,17 @@ namespace lime {
 		*/
 		virtual void update_OPk(const std::shared_ptr<limeCallback> callback, uint16_t OPkServerLowLimit, uint16_t OPkBatchSize) = 0;
 
+		/**
+		 * @brief build and store sessions with the given peer devices, ignoring the one we already share an active session with
+		 * - fetch their key bundles from the X3DH server, by chunks
+		 * - build the sessions and store them in local storage
+		 *
+		 * @param[in]	peerDeviceIds	the peer devices to build a session with
+		 * @param[in]	callback 	Called with success or failure when operation is completed.
+		 * @param[in]	OPkBudget	Maximum number of peer devices we request a key bundle for
+		*/
+		virtual void prefetch_sessions(const std::vector<std::string> &peerDeviceIds, const std::shared_ptr<limeCallback> callback, uint16_t OPkBudget) = 0;
+
 		/**
 		 * @brief Retrieve self public Identity key
 		 *
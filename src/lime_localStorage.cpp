@@ -21,6 +21,13 @@
 #include <soci/soci.h>
 #include <set>
 #include <mutex>
+#include <algorithm>
+#ifdef LIME_DB_PROFILER_ENABLED
+#include <soci/sqlite3/soci-sqlite3.h>
+#include <regex>
+#include <cmath>
+#include <unordered_map>
+#endif
 
 #include "lime_log.hpp"
 #include "lime/lime.hpp"
@@ -99,6 +106,42 @@ Db::Db(const std::string &filename) {
 					sql<<"UPDATE lime_PeerDevices SET curveId = :curveId", use(curveId);
 				}
 			}
+			if (userVersion <= 0x000300) { // From 00.03.00 to 00.04.00
+				// Skipped message keys can be stored as chain key checkpoints, message keys are derived from it on demand (2026/10/18)
+				sql<<"CREATE TABLE DR_MSk_CK( \
+							DHid INTEGER NOT NULL, \
+							Nr INTEGER NOT NULL, \
+							endNr INTEGER NOT NULL, \
+							CK BLOB NOT NULL, \
+							PRIMARY KEY( DHid , Nr ), \
+							FOREIGN KEY(DHid) REFERENCES DR_MSk_DHr(DHid) ON UPDATE CASCADE ON DELETE CASCADE);";
+			}
+			if (userVersion <= 0x000400) { // From 00.04.00 to 00.05.00
+				// Sender key tables: group messages can be encrypted once with a per group sending chain (2026/10/18)
+				sql<<"CREATE TABLE lime_SenderKeys( \
+							skId INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, \
+							Uid INTEGER NOT NULL, \
+							Did INTEGER DEFAULT NULL, \
+							groupId TEXT NOT NULL, \
+							chainId UNSIGNED INTEGER NOT NULL, \
+							N UNSIGNED INTEGER NOT NULL, \
+							CK BLOB NOT NULL, \
+							timeStamp DATETIME DEFAULT CURRENT_TIMESTAMP, \
+							FOREIGN KEY(Uid) REFERENCES lime_LocalUsers(Uid) ON UPDATE CASCADE ON DELETE CASCADE, \
+							FOREIGN KEY(Did) REFERENCES lime_PeerDevices(Did) ON UPDATE CASCADE ON DELETE CASCADE);";
+				sql<<"CREATE TABLE lime_SenderKeyRecipients( \
+							skId INTEGER NOT NULL, \
+							Did INTEGER NOT NULL, \
+							PRIMARY KEY( skId , Did ), \
+							FOREIGN KEY(skId) REFERENCES lime_SenderKeys(skId) ON UPDATE CASCADE ON DELETE CASCADE, \
+							FOREIGN KEY(Did) REFERENCES lime_PeerDevices(Did) ON UPDATE CASCADE ON DELETE CASCADE);";
+				sql<<"CREATE TABLE lime_SenderKeyMSk( \
+							skId INTEGER NOT NULL, \
+							N UNSIGNED INTEGER NOT NULL, \
+							MK BLOB NOT NULL, \
+							PRIMARY KEY( skId , N ), \
+							FOREIGN KEY(skId) REFERENCES lime_SenderKeys(skId) ON UPDATE CASCADE ON DELETE CASCADE);";
+			}
 			// update version number
 			sql<<"UPDATE db_module_version SET version = :DbVersion WHERE name='lime'", use(lime::settings::DBuserVersion);
 			tr.commit(); // commit all the previous queries
@@ -176,6 +219,21 @@ Db::Db(const std::string &filename) {
 					MK BLOB NOT NULL, \
 					PRIMARY KEY( DHid , Nr ), \
 					FOREIGN KEY(DHid) REFERENCES DR_MSk_DHr(DHid) ON UPDATE CASCADE ON DELETE CASCADE);";
+
+		/* DR Message Skipped CK : Store chains of skipped message keys as chain key checkpoints, message keys are derived from it when needed
+		*  - DHid : foreign key, link to the key chain table: DR_Message_Skipped_DH
+		*  - Nr : the id in the key chain of the first message key derivable from the checkpoint
+		*  - endNr : the id following the last message key derivable from the checkpoint
+		*  - CK : the chain key at index Nr
+		*  primary key is [DHid,Nr]
+		*/
+		sql<<"CREATE TABLE DR_MSk_CK( \
+					DHid INTEGER NOT NULL, \
+					Nr INTEGER NOT NULL, \
+					endNr INTEGER NOT NULL, \
+					CK BLOB NOT NULL, \
+					PRIMARY KEY( DHid , Nr ), \
+					FOREIGN KEY(DHid) REFERENCES DR_MSk_DHr(DHid) ON UPDATE CASCADE ON DELETE CASCADE);";
 	
 		/*** Lime tables : local user identities, peer devices identities ***/
 		/* List each self account enable on device :
@@ -252,7 +310,55 @@ Db::Db(const std::string &filename) {
 					Status INTEGER NOT NULL DEFAULT 1, \
 					timeStamp DATETIME DEFAULT CURRENT_TIMESTAMP, \
 					FOREIGN KEY(Uid) REFERENCES lime_LocalUsers(Uid) ON UPDATE CASCADE ON DELETE CASCADE);";
-	
+
+		/*** Sender key tables ***/
+		/* Sender key chains : one sending chain per local user and group, one receiving chain per local user, group and peer device
+		* - skId : primary key, used to make link with the recipients and skipped message keys tables
+		* - Uid : link to lime_LocalUsers table, identify which local device is associated to this chain
+		* - Did : link to lime_PeerDevices table, identify the peer device sending on this chain. NULL for our own sending chain
+		* - groupId : the group (the recipientUserId given at encryption) using this chain
+		* - chainId : random Id of the chain, set in the sender key message header
+		* - N : index of the next message key in the chain
+		* - CK : the chain key at index N
+		* - timeStamp : last usage of the chain, receiving chains not used for more than senderKey_limboTime_days are deleted
+		*/
+		sql<<"CREATE TABLE lime_SenderKeys( \
+					skId INTEGER PRIMARY KEY AUTOINCREMENT NOT NULL, \
+					Uid INTEGER NOT NULL, \
+					Did INTEGER DEFAULT NULL, \
+					groupId TEXT NOT NULL, \
+					chainId UNSIGNED INTEGER NOT NULL, \
+					N UNSIGNED INTEGER NOT NULL, \
+					CK BLOB NOT NULL, \
+					timeStamp DATETIME DEFAULT CURRENT_TIMESTAMP, \
+					FOREIGN KEY(Uid) REFERENCES lime_LocalUsers(Uid) ON UPDATE CASCADE ON DELETE CASCADE, \
+					FOREIGN KEY(Did) REFERENCES lime_PeerDevices(Did) ON UPDATE CASCADE ON DELETE CASCADE);";
+
+		/* Sender key recipients : the peer devices our sending chain was distributed to
+		* - skId : link to lime_SenderKeys table, our sending chain
+		* - Did : link to lime_PeerDevices table, the peer device holding the chain
+		* primary key is [skId,Did]
+		*/
+		sql<<"CREATE TABLE lime_SenderKeyRecipients( \
+					skId INTEGER NOT NULL, \
+					Did INTEGER NOT NULL, \
+					PRIMARY KEY( skId , Did ), \
+					FOREIGN KEY(skId) REFERENCES lime_SenderKeys(skId) ON UPDATE CASCADE ON DELETE CASCADE, \
+					FOREIGN KEY(Did) REFERENCES lime_PeerDevices(Did) ON UPDATE CASCADE ON DELETE CASCADE);";
+
+		/* Sender key skipped message keys : message keys of a receiving chain derived but not used yet
+		* - skId : link to lime_SenderKeys table, the receiving chain
+		* - N : the index of the message key in the chain
+		* - MK : the message key
+		* primary key is [skId,N]
+		*/
+		sql<<"CREATE TABLE lime_SenderKeyMSk( \
+					skId INTEGER NOT NULL, \
+					N UNSIGNED INTEGER NOT NULL, \
+					MK BLOB NOT NULL, \
+					PRIMARY KEY( skId , N ), \
+					FOREIGN KEY(skId) REFERENCES lime_SenderKeys(skId) ON UPDATE CASCADE ON DELETE CASCADE);";
+
 		tr.commit(); // commit all the previous queries
 	} catch (BctbxException const &e) {
 		throw BCTBX_EXCEPTION << "Db instanciation on file "<<filename<<" check failed: "<<e.str();
@@ -298,7 +404,9 @@ void Db::load_LimeUser(const DeviceId &deviceId, long int &Uid, std::string &url
  * @brief Delete old stale sessions and old stored message key. Apply to all users in localStorage
  *
  * 	- DR Session in stale status for more than DRSession_limboTime are deleted
+ * 	- DR Session prefetched but never used for more than prefetch_sessionLifeTime are deleted
  * 	- MessageKey stored linked to a session who received more than maxMessagesReceivedAfterSkip are deleted
+ * 	- Sender key receiving chains not used for more than senderKey_limboTime are deleted
  *
  * @note : The messagekeys count is on a chain, so if we have in a chain\n
  * 	Received1 Skip1 Skip2 Received2 Received3 Skip3 Received4\n
@@ -311,8 +419,14 @@ void Db::clean_DRSessions() {
 	// delete stale sessions considered to old
 	sql<<"DELETE FROM DR_sessions WHERE Status=0 AND timeStamp < date('now', '-"<<lime::settings::DRSession_limboTime_days<<" day');";
 
-	// clean Message keys (MK will be cascade deleted when the DHr is deleted )
+	// delete prefetched sessions never used: they hold an X3DH init message but did not send or receive any message
+	sql<<"DELETE FROM DR_sessions WHERE Status=1 AND Ns=0 AND Nr=0 AND X3DHInit IS NOT NULL AND timeStamp < date('now', '-"<<lime::settings::prefetch_sessionLifeTime_days<<" day');";
+
+	// clean Message keys (MK and CK checkpoints will be cascade deleted when the DHr is deleted )
 	sql<<"DELETE FROM DR_MSk_DHr WHERE received > "<<lime::settings::maxMessagesReceivedAfterSkip<<";";
+
+	// delete the sender key receiving chains not used anymore (skipped message keys will be cascade deleted)
+	sql<<"DELETE FROM lime_SenderKeys WHERE Did IS NOT NULL AND timeStamp < date('now', '-"<<lime::settings::senderKey_limboTime_days<<" day');";
 }
 
 /**
@@ -324,7 +438,11 @@ void Db::clean_SPk() {
 	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
 	// WARNING: not sure this code is portable it may work with sqlite3 only
 	// delete stale sessions considered to old
-	sql<<"DELETE FROM X3DH_SPK WHERE Status=0 AND timeStamp < date('now', '-"<<lime::settings::SPK_limboTime_days<<" day');";
+	statement st = (sql.prepare << "DELETE FROM X3DH_SPK WHERE Status=0 AND timeStamp < date('now', '-"<<lime::settings::SPK_limboTime_days<<" day');");
+	st.execute(true);
+	if (st.get_affected_rows() > 0) {
+		m_SPkCleanCount++; // the X3DH SPk caches may hold some of the deleted ones
+	}
 }
 
 /**
@@ -506,6 +624,193 @@ lime::PeerDeviceStatus Db::get_peerDeviceStatus(const std::string &peerDeviceId)
 	return lime::PeerDeviceStatus::unknown;
 }
 
+/**
+ * @brief load a list of device Ids in the lime_tmpDeviceIds temporary table
+ * The table lives in the connection temporary schema: it is not part of the lime DB file and is emptied before each use.
+ * Device Ids are bound to a prepared statement so any list length can be queried without building the SQL string from it.
+ * Duplicates in the given list are silently ignored.
+ *
+ * @param[in]	deviceIds	A list of devices Id, shall be their GRUUs
+ */
+void Db::load_tmpDeviceIds(const std::list<std::string> &deviceIds) {
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	sql<<"CREATE TEMP TABLE IF NOT EXISTS lime_tmpDeviceIds(DeviceId TEXT PRIMARY KEY);";
+	sql<<"DELETE FROM lime_tmpDeviceIds;";
+
+	std::string deviceId{};
+	statement st = (sql.prepare << "INSERT OR IGNORE INTO lime_tmpDeviceIds(DeviceId) VALUES(:deviceId);", use(deviceId));
+	for (const auto &id : deviceIds) {
+		deviceId = id;
+		st.execute(true);
+	}
+}
+
+/**
+ * @brief load a list of OPk Ids in the lime_tmpOPkIds temporary table
+ * The table lives in the connection temporary schema, OPKid being its primary key it is indexed and can be joined
+ * efficiently against X3DH_OPK whatever the number of Ids loaded.
+ *
+ * @param[in]	OPkIds	A list of OPk Ids, the table is just emptied when it is empty
+ */
+void Db::load_tmpOPkIds(const std::vector<uint32_t> &OPkIds) {
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	sql<<"CREATE TEMP TABLE IF NOT EXISTS lime_tmpOPkIds(OPKid INTEGER PRIMARY KEY);";
+	sql<<"DELETE FROM lime_tmpOPkIds;";
+
+	uint32_t OPkId = 0;
+	statement st = (sql.prepare << "INSERT OR IGNORE INTO lime_tmpOPkIds(OPKid) VALUES(:OPkId);", use(OPkId));
+	for (const auto id : OPkIds) {
+		OPkId = id;
+		st.execute(true);
+	}
+}
+
+/**
+ * @brief get the devices of a list not sharing an active DR session with the given local user
+ *
+ * @param[in]	Uid		the local user Id in local storage
+ * @param[in]	peerDeviceIds	A list of devices Id, shall be their GRUUs
+ * @param[out]	missingDevices	the devices from the list without active session, in the list order, duplicates removed
+ */
+void Db::get_devicesWithoutSession(const long int Uid, const std::list<std::string> &peerDeviceIds, std::vector<std::string> &missingDevices) {
+	missingDevices.clear();
+	if (peerDeviceIds.empty()) return;
+
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	transaction tr(sql);
+	load_tmpDeviceIds(peerDeviceIds);
+
+	{ // scope the statement so it is released before the commit
+		std::string deviceId{};
+		statement st = (sql.prepare << "SELECT t.DeviceId FROM lime_tmpDeviceIds as t WHERE NOT EXISTS( \
+						SELECT 1 FROM DR_sessions as s INNER JOIN lime_PeerDevices as d ON s.Did = d.Did \
+						WHERE d.DeviceId = t.DeviceId AND s.Uid = :Uid AND s.Status = 1) ORDER BY t.rowid;",
+						into(deviceId), use(Uid));
+		st.execute();
+		while (st.fetch()) {
+			missingDevices.push_back(deviceId);
+		}
+	}
+	tr.commit();
+}
+
+/**
+ * @brief get the base algorithm a list of devices is known to use
+ * A peer device is known on a base algorithm when we hold its identity key on it: it is in lime_PeerDevices with this curveId and not the invalid Ik
+ *
+ * @param[in]	peerDeviceIds		A list of devices Id, shall be their GRUUs
+ * @param[in]	algos			The base algorithms to look for, in preference order
+ * @param[out]	peerDevicesAlgo		The preferred algorithm each device is known on, indexed by device Id. Devices not known on any of the given algorithms are not in the map
+ */
+void Db::get_peerDevicesAlgo(const std::list<std::string> &peerDeviceIds, const std::vector<lime::CurveId> &algos, std::map<std::string, lime::CurveId> &peerDevicesAlgo) {
+	peerDevicesAlgo.clear();
+	if (peerDeviceIds.empty()) return;
+
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	transaction tr(sql);
+	load_tmpDeviceIds(peerDeviceIds);
+
+	{ // scope the statement so it is released before the commit
+		std::string deviceId{};
+		int curveId = 0;
+		statement st = (sql.prepare << "SELECT d.DeviceId, d.curveId FROM lime_PeerDevices as d INNER JOIN lime_tmpDeviceIds as t ON d.DeviceId = t.DeviceId WHERE length(d.Ik) > 1;",
+						into(deviceId), into(curveId));
+		st.execute();
+		while (st.fetch()) {
+			// keep the first one in the algos list the device is known on
+			auto algo = std::find_if(algos.cbegin(), algos.cend(), [curveId](const lime::CurveId a){return static_cast<int>(a) == curveId;});
+			if (algo == algos.cend()) continue;
+			auto known = peerDevicesAlgo.find(deviceId);
+			if (known == peerDevicesAlgo.end()) {
+				peerDevicesAlgo.emplace(deviceId, *algo);
+			} else if (algo < std::find(algos.cbegin(), algos.cend(), known->second)) {
+				known->second = *algo;
+			}
+		}
+	}
+	tr.commit();
+}
+
+/**
+ * @brief get the most recently active DR sessions of the active local users, most recent first
+ * Only the active session of each peer device is listed
+ *
+ * @param[in]	maxSessions	maximum number of sessions to retrieve
+ * @param[out]	sessions	the sessions, ordered by decreasing timestamp
+ */
+void Db::get_recentSessions(const uint16_t maxSessions, std::vector<RecentSession> &sessions) {
+	sessions.clear();
+	if (maxSessions == 0) return;
+	sessions.reserve(maxSessions);
+
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	std::string username{};
+	int curveId = 0;
+	std::string peerDeviceId{};
+	int sessionId = 0;
+	const int inactiveBit = lime::settings::DBInactiveUserBit;
+	const int limit = maxSessions;
+	statement st = (sql.prepare << "SELECT u.UserId, u.curveId, d.DeviceId, s.sessionId FROM DR_sessions as s \
+						INNER JOIN lime_LocalUsers as u ON s.Uid = u.Uid INNER JOIN lime_PeerDevices as d ON s.Did = d.Did \
+						WHERE s.Status = 1 AND (u.curveId & :inactiveBit) = 0 ORDER BY s.timeStamp DESC LIMIT :limit;",
+					into(username), into(curveId), into(peerDeviceId), into(sessionId), use(inactiveBit), use(limit));
+	st.execute();
+	while (st.fetch()) {
+		sessions.emplace_back(username, static_cast<lime::CurveId>(curveId), peerDeviceId, sessionId);
+	}
+}
+
+/**
+ * @brief get the status of each device in a list: unknown, untrusted, trusted, unsafe
+ * device's Id matching a local account are always considered as trusted
+ *
+ * @param[in]	peerDeviceIds		A list of devices Id, shall be their GRUUs
+ * @param[out]	peerDeviceStatuses	A map of the status of each requested device indexed by device Id, devices not in localStorage are set to unknown
+ */
+void Db::get_peerDeviceStatus(const std::list<std::string> &peerDeviceIds, std::map<std::string, lime::PeerDeviceStatus> &peerDeviceStatuses) {
+	peerDeviceStatuses.clear();
+	if (peerDeviceIds.empty()) return;
+
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	transaction tr(sql);
+	load_tmpDeviceIds(peerDeviceIds);
+
+	{ // scope the statement so it is released before the commit
+		std::string deviceId{};
+		int isLocal = 0;
+		int status = 0;
+		indicator statusIndicator = i_ok;
+		// Flag local users and get the status of the active peer device, if any
+		// A device may have several active rows(one per base algorithm): they are ordered most recent first and the first one wins
+		statement st = (sql.prepare << "SELECT t.DeviceId, EXISTS(SELECT 1 FROM lime_LocalUsers as l WHERE l.UserId = t.DeviceId), d.Status \
+						FROM lime_tmpDeviceIds as t LEFT JOIN lime_PeerDevices as d ON d.DeviceId = t.DeviceId AND d.Active = 1 \
+						ORDER BY t.rowid, d.Did DESC;",
+						into(deviceId), into(isLocal), into(status, statusIndicator));
+		st.execute();
+		while (st.fetch()) {
+			if (peerDeviceStatuses.count(deviceId) != 0) continue; // an older row of a device already set
+			if (isLocal != 0) { // local devices are always trusted
+				peerDeviceStatuses.emplace(deviceId, lime::PeerDeviceStatus::trusted);
+				continue;
+			}
+			if (statusIndicator == i_null) { // not found in local storage
+				peerDeviceStatuses.emplace(deviceId, lime::PeerDeviceStatus::unknown);
+				continue;
+			}
+			switch (status) {
+				case static_cast<uint8_t>(lime::PeerDeviceStatus::untrusted) :
+				case static_cast<uint8_t>(lime::PeerDeviceStatus::trusted) :
+				case static_cast<uint8_t>(lime::PeerDeviceStatus::unsafe) :
+					peerDeviceStatuses.emplace(deviceId, static_cast<lime::PeerDeviceStatus>(status));
+					break;
+				default : // something is wrong with the local storage
+					throw BCTBX_EXCEPTION << "Trying to get the status for peer device "<<deviceId<<" but get an unexpected value "<<status<<" from local storage";
+			}
+		}
+	}
+	tr.commit();
+}
+
 /**
  * @brief get the status of a list of peer device: unknown, untrusted, trusted, unsafe
  * and return the lowest found, crescent order being unsafe, unknown, untrusted, trusted
@@ -520,65 +825,27 @@ lime::PeerDeviceStatus Db::get_peerDeviceStatus(const std::list<std::string> &pe
 	// If there is nothing to search, just return unknown
 	if (peerDeviceIds.empty()) return lime::PeerDeviceStatus::unknown;
 
-	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
-	bool have_untrusted=false;
-	size_t found_devices_count =  0;
-
-	// create a comma separated list of device id for the IN parameter in the SQL query as SOCI does not handle a list of it
-	std::string sqlString_allDevicesId{""};
-	for (const auto &peerDeviceId : peerDeviceIds) {
-		sqlString_allDevicesId.append("'").append(peerDeviceId).append("',");
-	}
-	sqlString_allDevicesId.pop_back(); // remove the last ','
-	// Get local devices among the list, group by user id as the same one may be present multiple times (with differents curveId)
-	// but we do not want to count it several times and we do not care about its curveId
-	rowset<std::string> rs_localDevices = (sql.prepare << "SELECT l.UserId FROM lime_LocalUsers as l WHERE l.UserId IN ("<<sqlString_allDevicesId<<") GROUP BY l.UserId;");
-	std::string sqlString_peerDeviceQuery{"SELECT d.Status FROM lime_PeerDevices as d WHERE d.Active = 1 AND d.DeviceId IN ("};
-
-	std::list<std::string> nolocalDevices = peerDeviceIds; // copy original list
-	// remove local users from the list: they are all considered as trusted
-	for (const std::string &localDevice : rs_localDevices) {
-		nolocalDevices.remove(localDevice);
-		found_devices_count++;
-	}
-
-	if (found_devices_count > 0) {
-		// there are local devices, we must use the list without local ones as they can be present both in localUser and PeerDevices
-		// but in that case they must be ignored in the second list as they always are considered as trusted
-		std::string sqlString_peerDevicesId{""};
-		for (const auto &peerDeviceId : nolocalDevices) {
-			sqlString_peerDevicesId.append("'").append(peerDeviceId).append("',");
-		}
-		if (!sqlString_peerDevicesId.empty()) {
-			sqlString_peerDevicesId.pop_back(); // remove the last ','
-		}
-		sqlString_peerDeviceQuery.append(sqlString_peerDevicesId);
-	} else {
-		// there is no local device in the list, fetch using the whole list
-		sqlString_peerDeviceQuery.append(sqlString_allDevicesId);
-	}
+	std::map<std::string, lime::PeerDeviceStatus> peerDeviceStatuses{};
+	get_peerDeviceStatus(peerDeviceIds, peerDeviceStatuses);
 
-	rowset<int> rs_devicesStatus = (sql.prepare << sqlString_peerDeviceQuery << ");");
-	for (const int status : rs_devicesStatus) {
-		found_devices_count++;
-		switch (status) {
-			case static_cast<uint8_t>(lime::PeerDeviceStatus::trusted) :
-				// Do nothing for trusted as it is the higher status we can get
+	bool have_untrusted=false;
+	bool have_unknown=false;
+	for (const auto &peerDeviceStatus : peerDeviceStatuses) {
+		switch (peerDeviceStatus.second) {
+			case lime::PeerDeviceStatus::unsafe :
+				return lime::PeerDeviceStatus::unsafe; // if unsafe is found, it can't get worse, return it
+			case lime::PeerDeviceStatus::unknown :
+				have_unknown=true;
 				break;
-			case static_cast<uint8_t>(lime::PeerDeviceStatus::untrusted) :
+			case lime::PeerDeviceStatus::untrusted :
 				have_untrusted=true;
 				break;
-			case static_cast<uint8_t>(lime::PeerDeviceStatus::unsafe) :
-				return lime::PeerDeviceStatus::unsafe; // if unsafe is found, it can't get worse, return it
-			default : // something is wrong with the local storage
-				throw BCTBX_EXCEPTION << "Trying to get the status for peer devices "<<sqlString_allDevicesId<<" but get an unexpected value "<<status<<" from local storage";
+			default : // trusted is the higher status we can get
+				break;
 		}
 	}
 
-	if (found_devices_count != peerDeviceIds.size()) {
-		return lime::PeerDeviceStatus::unknown; // we are missing some, return unknown
-	}
-
+	if (have_unknown) return lime::PeerDeviceStatus::unknown; // we are missing some, return unknown
 	if (have_untrusted) return lime::PeerDeviceStatus::untrusted;
 	return lime::PeerDeviceStatus::trusted;
 }
@@ -623,10 +890,16 @@ void Db::set_updateTs(const DeviceId &deviceId) {
  * @param[in]	peerDeviceId	The device Id to be removed from local storage, shall be its GRUU
  *
  * Call is silently ignored if the device is not found in local storage
+ * Our sender key sending chains this device holds are deleted too: its holder rows are cascade deleted with it, the chains would
+ * not be renewed while the device can still decrypt them. They are renewed at next encryption to the group.
  */
 void Db::delete_peerDevice(const std::string &peerDeviceId) {
 	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	transaction tr(sql);
+	sql<<"DELETE FROM lime_SenderKeys WHERE Did IS NULL AND skId IN ( \
+		SELECT r.skId FROM lime_SenderKeyRecipients as r INNER JOIN lime_PeerDevices as d ON r.Did = d.Did WHERE d.DeviceId = :peerDeviceId);", use(peerDeviceId);
 	sql<<"DELETE FROM lime_peerDevices WHERE DeviceId = :peerDeviceId;", use(peerDeviceId);
+	tr.commit();
 }
 
 /**
@@ -753,6 +1026,9 @@ void Db::delete_LimeUser(const DeviceId &deviceId)
  */
 void Db::start_transaction()
 {
+	if (trace::active()) {
+		m_transactionSpan = std::make_unique<trace::Span>("lime.db.transaction", trace::currentSpan());
+	}
 	sql.begin();
 }
 
@@ -763,6 +1039,10 @@ void Db::start_transaction()
 void Db::commit_transaction()
 {
 	sql.commit();
+	if (m_transactionSpan) {
+		m_transactionSpan->end(true);
+		m_transactionSpan.reset();
+	}
 }
 
 /**
@@ -776,6 +1056,167 @@ void Db::rollback_transaction()
 	} catch (exception const &e) {
 		LIME_LOGE<<"Lime session save transaction rollback failed, backend says: "<<e.what();
 	}
+	m_transactionSpan.reset(); // ends as failed
+}
+
+Db::~Db() {
+	stop_profiler();
+	sql.close();
+}
+
+/******************************************************************************/
+/*                                                                            */
+/* Db profiler                                                                */
+/*                                                                            */
+/******************************************************************************/
+/**
+ * @brief Statements statistics collected through the sqlite trace callback
+ */
+struct DbProfiler {
+#ifdef LIME_DB_PROFILER_ENABLED
+	/// statistics of one normalized statement
+	struct Statement {
+		uint64_t count = 0;
+		uint64_t total_ns = 0;
+		uint64_t rows = 0;
+		std::vector<uint64_t> samples{}; /**< the last execution times, circular buffer */
+		size_t nextSample = 0;
+	};
+	std::mutex mutex; /**< the callback runs in the thread using the Db connection, the report may be requested from another */
+	std::unordered_map<std::string, Statement> statements{};
+	std::unordered_map<const void *, uint64_t> pendingRows{}; /**< rows produced by the running statements */
+	sqlite_api::sqlite3 *connection = nullptr;
+#endif // LIME_DB_PROFILER_ENABLED
+};
+
+#ifdef LIME_DB_PROFILER_ENABLED
+namespace {
+	/**
+	 * @brief normalize a statement text: statements differing only by their literals, parameters or the length of a parameters list are aggregated
+	 */
+	std::string normalizeStatement(const std::string &statement) {
+		static const std::regex whitespaces{"\\s+"};
+		static const std::regex literals{"'(?:[^']|'')*'|\\?[0-9]*|[:@$][A-Za-z_][A-Za-z0-9_]*|(^|[^\\w.])[0-9]+(?:\\.[0-9]+)?\\b"};
+		static const std::regex lists{"\\(\\s*\\?(?:\\s*,\\s*\\?)*\\s*\\)"};
+		auto normalized = std::regex_replace(statement, whitespaces, " ");
+		normalized = std::regex_replace(normalized, literals, "$1?");
+		normalized = std::regex_replace(normalized, lists, "(?...)");
+		// trim
+		const auto first = normalized.find_first_not_of(' ');
+		if (first == std::string::npos) return std::string{};
+		return normalized.substr(first, normalized.find_last_not_of(' ') - first + 1);
+	}
+
+	/**
+	 * @brief sqlite trace callback(see sqlite3_trace_v2): count the rows produced by a statement and record its statistics when it completes
+	 */
+	int profilerCallback(unsigned type, void *context, void *P, void *X) {
+		auto profiler = static_cast<DbProfiler *>(context);
+		std::lock_guard<std::mutex> lock(profiler->mutex);
+		if (type == SQLITE_TRACE_ROW) {
+			profiler->pendingRows[P]++;
+			return 0;
+		}
+		if (type != SQLITE_TRACE_PROFILE) return 0;
+
+		auto stmt = static_cast<sqlite_api::sqlite3_stmt *>(P);
+		uint64_t rows = 0;
+		auto pending = profiler->pendingRows.find(P);
+		if (pending != profiler->pendingRows.end()) {
+			rows = pending->second;
+			profiler->pendingRows.erase(pending);
+		}
+		const auto sqlText = sqlite_api::sqlite3_sql(stmt);
+		if (sqlText == nullptr) return 0;
+		// sqlite3_changes is set by INSERT, UPDATE and DELETE only: other statements(DDL, BEGIN, COMMIT...) would get the count of the previous one
+		static const std::regex rowsModifying{"^\\s*(?:INSERT|UPDATE|DELETE|REPLACE)\\b", std::regex::icase};
+		if (!sqlite_api::sqlite3_stmt_readonly(stmt) && std::regex_search(sqlText, rowsModifying)) {
+			rows += static_cast<uint64_t>(sqlite_api::sqlite3_changes(profiler->connection));
+		}
+
+		const auto duration = *static_cast<int64_t *>(X); // nanoseconds
+		auto &statement = profiler->statements[normalizeStatement(sqlText)];
+		statement.count++;
+		statement.total_ns += static_cast<uint64_t>(duration);
+		statement.rows += rows;
+		if (statement.samples.size() < lime::settings::DbProfiler_maxSamples) {
+			statement.samples.push_back(static_cast<uint64_t>(duration));
+		} else {
+			statement.samples[statement.nextSample] = static_cast<uint64_t>(duration);
+			statement.nextSample = (statement.nextSample + 1) % lime::settings::DbProfiler_maxSamples;
+		}
+		return 0;
+	}
+
+	/// nearest rank percentile of sorted samples
+	uint64_t percentile(const std::vector<uint64_t> &sortedSamples, const double p) {
+		if (sortedSamples.empty()) return 0;
+		size_t rank = static_cast<size_t>(std::ceil(p*static_cast<double>(sortedSamples.size())));
+		return sortedSamples[std::max<size_t>(rank, 1) - 1];
+	}
+}
+#endif // LIME_DB_PROFILER_ENABLED
+
+/**
+ * @brief Start the SQL statements profiler, the statistics previously collected are reset
+ *
+ * The profiler hooks the sqlite trace callback: each statement execution time and rows count is aggregated by normalized statement text.
+ *
+ * @return false if the library is not built with ENABLE_DB_PROFILER or the backend is not sqlite3
+ */
+bool Db::start_profiler() {
+#ifdef LIME_DB_PROFILER_ENABLED
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	if (sql.get_backend_name() != "sqlite3") {
+		LIME_LOGW<<"Local storage profiler is available on sqlite3 backend only";
+		return false;
+	}
+	auto backend = static_cast<soci::sqlite3_session_backend *>(sql.get_backend());
+	m_profiler = std::make_shared<DbProfiler>();
+	m_profiler->connection = backend->conn_;
+	sqlite_api::sqlite3_trace_v2(backend->conn_, SQLITE_TRACE_PROFILE|SQLITE_TRACE_ROW, profilerCallback, m_profiler.get());
+	return true;
+#else // LIME_DB_PROFILER_ENABLED
+	LIME_LOGW<<"Local storage profiler is not available: lime is not built with ENABLE_DB_PROFILER";
+	return false;
+#endif // LIME_DB_PROFILER_ENABLED
+}
+
+/**
+ * @brief Stop the SQL statements profiler, the statistics collected are kept until the next start
+ */
+void Db::stop_profiler() {
+#ifdef LIME_DB_PROFILER_ENABLED
+	std::lock_guard<std::recursive_mutex> lock(m_db_mutex);
+	if (m_profiler && m_profiler->connection) {
+		sqlite_api::sqlite3_trace_v2(m_profiler->connection, 0, nullptr, nullptr);
+		m_profiler->connection = nullptr;
+	}
+#endif // LIME_DB_PROFILER_ENABLED
+}
+
+/**
+ * @brief Get the statistics collected by the SQL statements profiler
+ *
+ * @param[out]	profile	one entry per normalized statement, sorted by decreasing total execution time. Empty if the profiler never ran
+ */
+void Db::get_profile(std::vector<DbStatementProfile> &profile) {
+	profile.clear();
+#ifdef LIME_DB_PROFILER_ENABLED
+	std::shared_ptr<DbProfiler> profiler{};
+	{ // start_profiler may replace the profiler
+		std::lock_guard<std::recursive_mutex> dbLock(m_db_mutex);
+		profiler = m_profiler;
+	}
+	if (!profiler) return;
+	std::lock_guard<std::mutex> lock(profiler->mutex);
+	for (const auto &statement : profiler->statements) {
+		auto samples = statement.second.samples;
+		std::sort(samples.begin(), samples.end());
+		profile.push_back(DbStatementProfile{statement.first, statement.second.count, statement.second.total_ns, percentile(samples, 0.5), percentile(samples, 0.99), statement.second.rows});
+	}
+	std::sort(profile.begin(), profile.end(), [](const DbStatementProfile &a, const DbStatementProfile &b) {return a.total_ns > b.total_ns;});
+#endif // LIME_DB_PROFILER_ENABLED
 }
 
 /* template instanciations for Curves 25519 and 448 */
@@ -22,10 +22,38 @@
 
 #include "soci/soci.h"
 #include "lime_crypto_primitives.hpp"
+#include "lime_trace.hpp"
 #include <mutex>
+#include <map>
+#include <list>
 
 namespace lime {
 
+	/**
+	 * @brief An active DR session as listed to warm the cache
+	 */
+	struct RecentSession {
+		DeviceId localDeviceId; /**< the local user holding the session */
+		std::string peerDeviceId; /**< the peer device, shall be its GRUU */
+		long int sessionId; /**< the session id in local storage */
+		RecentSession(const std::string &localUsername, const lime::CurveId algo, const std::string &peerDeviceId, const long int sessionId) :
+			localDeviceId(localUsername, algo), peerDeviceId{peerDeviceId}, sessionId{sessionId} {};
+	};
+
+	/**
+	 * @brief Statistics of a SQL statement collected by the local storage profiler
+	 */
+	struct DbStatementProfile {
+		std::string statement; /**< normalized statement: literals and parameters replaced by ?, lists of parameters collapsed to (?...) */
+		uint64_t count; /**< number of executions */
+		uint64_t total_ns; /**< cumulated execution time, in nanoseconds */
+		uint64_t p50_ns; /**< median execution time, in nanoseconds */
+		uint64_t p99_ns; /**< 99th percentile of the execution time, in nanoseconds */
+		uint64_t rows; /**< rows returned by a read or modified by a write, cumulated on all executions */
+	};
+
+	struct DbProfiler;
+
 	/**
 	 * @brief Database access class
 	 *
@@ -37,6 +65,8 @@ namespace lime {
 		soci::session	sql;
 		/// mutex on database access
 		std::recursive_mutex m_db_mutex;
+		/// incremented each time clean_SPk deletes SPks: the X3DH objects drop them from their SPk cache when it changes. Accessed under m_db_mutex only
+		uint64_t m_SPkCleanCount{0};
 
 		Db()=delete; // we can't create a new DB holder without DB filename
 
@@ -46,7 +76,7 @@ namespace lime {
 		 * @param[in]	filename	The path to DB file
 		 */
 		Db(const std::string &filename);
-		~Db(){sql.close();};
+		~Db();
 
 		void load_LimeUser(const DeviceId &deviceId, long int &Uid, std::string &url, const bool allStatus=false);
 		void delete_LimeUser(const DeviceId &deviceId);
@@ -58,6 +88,12 @@ namespace lime {
 		void set_peerDeviceStatus(const DeviceId &peerDeviceId, lime::PeerDeviceStatus status);
 		lime::PeerDeviceStatus get_peerDeviceStatus(const std::string &peerDeviceId);
 		lime::PeerDeviceStatus get_peerDeviceStatus(const std::list<std::string> &peerDeviceIds);
+		void get_peerDeviceStatus(const std::list<std::string> &peerDeviceIds, std::map<std::string, lime::PeerDeviceStatus> &peerDeviceStatuses);
+		void load_tmpDeviceIds(const std::list<std::string> &deviceIds);
+		void load_tmpOPkIds(const std::vector<uint32_t> &OPkIds);
+		void get_devicesWithoutSession(const long int Uid, const std::list<std::string> &peerDeviceIds, std::vector<std::string> &missingDevices);
+		void get_peerDevicesAlgo(const std::list<std::string> &peerDeviceIds, const std::vector<lime::CurveId> &algos, std::map<std::string, lime::CurveId> &peerDevicesAlgo);
+		void get_recentSessions(const uint16_t maxSessions, std::vector<RecentSession> &sessions);
 		void delete_peerDevice(const std::string &peerDeviceId);
 		template <typename Curve>
 		long int check_peerDevice(const std::string &peerDeviceId, const DSA<typename Curve::EC, lime::DSAtype::publicKey> &peerIk, const bool updateInvalid=false);
@@ -66,6 +102,14 @@ namespace lime {
 		void start_transaction();
 		void commit_transaction();
 		void rollback_transaction();
+		bool start_profiler();
+		void stop_profiler();
+		void get_profile(std::vector<DbStatementProfile> &profile);
+	private:
+		/// span of the ongoing transaction, set only when tracing
+		std::unique_ptr<trace::Span> m_transactionSpan;
+		/// statements statistics, set once the profiler was started
+		std::shared_ptr<DbProfiler> m_profiler;
 	};
 
 	/* this templates are instanciated once in the lime_localStorage.cpp file, explicitly tell anyone including this header that there is no need to re-instanciate them */
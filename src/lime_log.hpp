@@ -20,16 +20,47 @@
 #define lime_log_hpp
 
 #include <string>
+#include <ostream>
 
 #define BCTBX_LOG_DOMAIN "lime"
 #include <bctoolbox/logging.h>
 
-#define LIME_LOGD BCTBX_SLOGD
-#define LIME_LOGI BCTBX_SLOGI
-#define LIME_LOGW BCTBX_SLOGW
-#define LIME_LOGE BCTBX_SLOGE
+/* Log levels, LIME_LOG_MIN_LEVEL is set at build time(LOG_MIN_LEVEL cmake option):
+ * log statements under this level are removed by the compiler */
+#define LIME_LOG_LEVEL_DEBUG 0
+#define LIME_LOG_LEVEL_INFO 1
+#define LIME_LOG_LEVEL_WARNING 2
+#define LIME_LOG_LEVEL_ERROR 3
+#ifndef LIME_LOG_MIN_LEVEL
+#define LIME_LOG_MIN_LEVEL LIME_LOG_LEVEL_DEBUG
+#endif
+
+/* bctoolbox log level matching each lime log level */
+#define LIME_LOG_BCTBX_DEBUG BCTBX_LOG_DEBUG
+#define LIME_LOG_BCTBX_INFO BCTBX_LOG_MESSAGE
+#define LIME_LOG_BCTBX_WARNING BCTBX_LOG_WARNING
+#define LIME_LOG_BCTBX_ERROR BCTBX_LOG_ERROR
+
+/**
+ * true when the given level(DEBUG, INFO, WARNING or ERROR) is built in and enabled at runtime
+ * use it to guard the building of a log message done out of a log statement
+ */
+#define LIME_LOG_ENABLED(level) (LIME_LOG_LEVEL_##level >= LIME_LOG_MIN_LEVEL && bctbx_log_level_enabled(BCTBX_LOG_DOMAIN, LIME_LOG_BCTBX_##level))
+
+/* The log statements check the level before evaluating their arguments: a disabled log statement costs a level check and formats nothing
+ * They are used as a stream: LIME_LOGI<<"message"; and are expressions so they are safe in an unbraced if/else */
+#define LIME_LOG(level) !LIME_LOG_ENABLED(level) ? (void)0 : lime::LogVoidify{} & BCTBX_SLOG(BCTBX_LOG_DOMAIN, LIME_LOG_BCTBX_##level)
+#define LIME_LOGD LIME_LOG(DEBUG)
+#define LIME_LOGI LIME_LOG(INFO)
+#define LIME_LOGW LIME_LOG(WARNING)
+#define LIME_LOGE LIME_LOG(ERROR)
 
 namespace lime {
+	/// turns a log stream into a void expression, lower precedence than << so it applies to the whole log statement
+	struct LogVoidify {
+		void operator&(const std::ostream &) const noexcept {}
+	};
+
 	/**
 	 * convert a byte buffer into hexadecimal string
 	 * if digest is > 0, only print the first and last digest bytes
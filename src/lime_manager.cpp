@@ -23,15 +23,66 @@
 #include "lime_lime.hpp"
 #include "lime_localStorage.hpp"
 #include "lime_settings.hpp"
+#include "lime_double_ratchet.hpp"
+#include "lime_sender_key.hpp"
+#include "lime_metrics.hpp"
+#include "lime_trace.hpp"
+#include "lime_capture.hpp"
 #include <mutex>
 #include <unordered_set>
+#include <algorithm>
 #include "bctoolbox/exception.hh"
 
 using namespace::std;
 
 namespace lime {
+	/**
+	 * @brief Shared by the encryptions of recipients partitioned by base algorithm, running concurrently
+	 */
+	struct PartitionedEncryption {
+		std::mutex mutex; /**< protect the counter and the copy of the partitions results in the encryption context */
+		size_t pendingPartitions; /**< number of partitions not done yet */
+		PartitionedEncryption() : pendingPartitions{0} {};
+	};
+
+	namespace {
+		/**
+		 * @brief Wrap a user management operation callback so the operation is recorded in the capture when it completes
+		 */
+		limeCallback captureUserOperation(std::shared_ptr<Capture> capture, const char *operation, const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, limeCallback callback) {
+			return [capture, operation, localDeviceId, algos, start=Capture::now(), userCallback=std::move(callback)](const lime::CallbackReturn status, const std::string message) {
+				capture->userOperation(start, operation, localDeviceId, algos, status);
+				if (userCallback) userCallback(status, message);
+			};
+		}
+	}
+
 	LimeManager::LimeManager(const std::string &db_access, const limeX3DHServerPostData &X3DH_post_data)
-		: m_users_cache(0, DeviceId::hash), m_localStorage{std::make_shared<lime::Db>(db_access)}, m_X3DH_post_data{X3DH_post_data} { }
+		: m_users_cache(0, DeviceId::hash), m_localStorage{std::make_shared<lime::Db>(db_access)}, m_X3DH_post_data{X3DH_post_data},
+		m_cacheWarmer{}, m_cacheWarmerRunning{false}, m_cacheWarmerStop{false} { }
+
+	LimeManager::LimeManager(const std::string &db_access, const limeX3DHServerPostData &X3DH_post_data, const bool warmCache)
+		: LimeManager(db_access, X3DH_post_data) {
+		if (warmCache) {
+			warm_cache(nullptr);
+		}
+	}
+
+	LimeManager::~LimeManager() {
+		m_cacheWarmerStop = true;
+		std::thread cacheWarmer{};
+		{ // do not join holding the lock: the warmer callback may call warm_cache
+			std::lock_guard<std::mutex> lock(m_cacheWarmer_mutex);
+			cacheWarmer = std::move(m_cacheWarmer);
+		}
+		if (cacheWarmer.joinable()) {
+			if (cacheWarmer.get_id() == std::this_thread::get_id()) { // destroyed from the warmer callback: the thread ends right after it
+				cacheWarmer.detach();
+			} else {
+				cacheWarmer.join();
+			}
+		}
+	}
 
 	/** Set a user in the LimeManager cache if not already present
 	 *
@@ -41,11 +92,20 @@ namespace lime {
 	 * @return false if the user could not be loaded
 	 */
 	std::shared_ptr<LimeGeneric> LimeManager::load_user_noexcept(const DeviceId &localDeviceId) noexcept {
-		// get the Lime manager lock
-		std::lock_guard<std::mutex> lock(m_users_mutex);
+		{ // most calls find the user in cache: look it up sharing the Lime manager lock
+			std::shared_lock<std::shared_mutex> lock(m_users_mutex);
+			auto userElem = m_users_cache.find(localDeviceId);
+			if (userElem != m_users_cache.end()) {
+				LIME_METRICS_COUNT(usersCacheHit);
+				return userElem->second;
+			}
+		}
+		// get the Lime manager lock and check again as another thread may have loaded it in the meantime
+		std::lock_guard<std::shared_mutex> lock(m_users_mutex);
 		// Load user object
 		auto userElem = m_users_cache.find(localDeviceId);
 		if (userElem == m_users_cache.end()) { // not in cache, load it from DB
+			LIME_METRICS_COUNT(usersCacheMiss);
 			try {
 				auto user = load_LimeUser(m_localStorage, localDeviceId, m_X3DH_post_data);
 				m_users_cache[localDeviceId]=user;
@@ -55,6 +115,7 @@ namespace lime {
 				return nullptr;
 			}
 		} else {
+			LIME_METRICS_COUNT(usersCacheHit);
 			return userElem->second;
 		}
 	}
@@ -67,15 +128,25 @@ namespace lime {
 	 * @throw bctbx exception when the user is not found in DB
 	 */
 	std::shared_ptr<LimeGeneric> LimeManager::load_user(const DeviceId &localDeviceId, bool allStatus) {
-		// get the Lime manager lock
-		std::lock_guard<std::mutex> lock(m_users_mutex);
+		{ // most calls find the user in cache: look it up sharing the Lime manager lock
+			std::shared_lock<std::shared_mutex> lock(m_users_mutex);
+			auto userElem = m_users_cache.find(localDeviceId);
+			if (userElem != m_users_cache.end()) {
+				LIME_METRICS_COUNT(usersCacheHit);
+				return userElem->second;
+			}
+		}
+		// get the Lime manager lock and check again as another thread may have loaded it in the meantime
+		std::lock_guard<std::shared_mutex> lock(m_users_mutex);
 		// Load user object
 		auto userElem = m_users_cache.find(localDeviceId);
 		if (userElem == m_users_cache.end()) { // not in cache, load it from DB
+			LIME_METRICS_COUNT(usersCacheMiss);
 			auto user = load_LimeUser(m_localStorage, localDeviceId, m_X3DH_post_data, allStatus);
 			m_users_cache[localDeviceId]=user;
 			return user;
 		} else {
+			LIME_METRICS_COUNT(usersCacheHit);
 			return userElem->second;
 		}
 	}
@@ -90,6 +161,9 @@ namespace lime {
 		create_user(localDeviceId, algos, x3dhServerUrl, lime::settings::OPk_initialBatchSize, std::move(callback));
 	}
 	void LimeManager::create_user(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const std::string &x3dhServerUrl, const uint16_t OPkInitialBatchSize, limeCallback callback) {
+		if (auto capture = std::atomic_load(&m_capture)) {
+			callback = captureUserOperation(std::move(capture), "create_user", localDeviceId, algos, std::move(callback));
+		}
 		auto sharedCallback = make_shared<lime::limeCallback>(std::move(callback)); // need to store the callback into a shared_ptr as any we don't know which instance will be calling it
 		auto callbackCount = make_shared<size_t>(algos.size());
 		auto globalReturnCode = make_shared<lime::CallbackReturn>(lime::CallbackReturn::success);
@@ -124,8 +198,9 @@ namespace lime {
 
 						// Failure can occur only on X3DH server response(local failure generate an exception so we would never
 						// arrive in this callback)), so the lock acquired by create_user has already expired when we arrive here
-						std::lock_guard<std::mutex> lock(thiz->m_users_mutex);
+						std::lock_guard<std::shared_mutex> lock(thiz->m_users_mutex);
 						thiz->m_users_cache.erase(deviceId);
+						thiz->m_usersErasedCount++;
 					}
 					if (!errorMessage.empty()) {
 						globalReturnMessage->append(CurveId2String(algo)).append(" : ").append(errorMessage);
@@ -137,13 +212,16 @@ namespace lime {
 					}
 				});
 
-				std::lock_guard<std::mutex> lock(m_users_mutex);
+				std::lock_guard<std::shared_mutex> lock(m_users_mutex);
 				m_users_cache.insert({deviceId, insert_LimeUser(m_localStorage, deviceId, x3dhServerUrl, OPkInitialBatchSize, m_X3DH_post_data, managerCreateCallback)});
 			}
 		}
 	}
 
 	void LimeManager::delete_user(const DeviceId &localDeviceId, limeCallback callback) {
+		if (auto capture = std::atomic_load(&m_capture)) {
+			callback = captureUserOperation(std::move(capture), "delete_user", localDeviceId.getUsername(), {localDeviceId.getAlgo()}, std::move(callback));
+		}
 		auto thiz = this;
 		auto managerDeleteCallback = make_shared<limeCallback>([thiz, localDeviceId, cb=std::move(callback)](lime::CallbackReturn returnCode, std::string errorMessage) {
 			// first forward the callback
@@ -151,7 +229,9 @@ namespace lime {
 
 			// then remove the user from cache(it will trigger destruction of the lime generic object so do it last
 			// as it will also destroy the instance of this callback)
+			std::lock_guard<std::shared_mutex> lock(thiz->m_users_mutex);
 			thiz->m_users_cache.erase(localDeviceId);
+			thiz->m_usersErasedCount++;
 		});
 
 		// load also inactive sessions as we must be able to delete inactive ones
@@ -171,6 +251,34 @@ namespace lime {
 	}
 
 	void LimeManager::encrypt(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, std::shared_ptr<lime::EncryptionContext> encryptionContext, limeCallback callback) {
+		LIME_METRICS_COUNT(encrypt);
+		// the encryption span lasts until the user callback is called, it is the current span while the encryption runs on this thread
+		std::shared_ptr<trace::Span> span{nullptr};
+		if (trace::active()) {
+			span = std::make_shared<trace::Span>("lime.manager.encrypt", trace::currentSpan());
+			span->setAttribute("lime.recipients", encryptionContext->m_recipients.size());
+			span->setAttribute("lime.curves", algos.size());
+			span->setAttribute("lime.plaintext_bytes", encryptionContext->m_plainMessage.size());
+			callback = [span, userCallback=std::move(callback)](const lime::CallbackReturn status, const std::string message) {
+				span->end(status == lime::CallbackReturn::success);
+				if (userCallback) userCallback(status, message);
+			};
+		}
+		trace::Scope traceScope(span?span->id():0);
+		if (auto capture = std::atomic_load(&m_capture)) {
+			// count the recipients we never met before encrypting: they are the ones needing a new session
+			std::list<std::string> recipientDeviceIds{};
+			for (const auto &recipient : encryptionContext->m_recipients) {
+				recipientDeviceIds.push_back(recipient.deviceId);
+			}
+			std::map<std::string, lime::CurveId> knownDevices{};
+			m_localStorage->get_peerDevicesAlgo(recipientDeviceIds, algos, knownDevices);
+			const size_t newRecipients = recipientDeviceIds.size() - knownDevices.size();
+			callback = [capture, localDeviceId, algos, encryptionContext, newRecipients, start=Capture::now(), userCallback=std::move(callback)](const lime::CallbackReturn status, const std::string message) {
+				capture->encrypt(start, localDeviceId, algos, *encryptionContext, newRecipients, status);
+				if (userCallback) userCallback(status, message);
+			};
+		}
 		// prevent duplicate entries to make a mess -> just tag the duplicate as fail so it is ignored
 		std::unordered_set<std::string> seenIds;
 		for (auto& recipient : encryptionContext->m_recipients) {
@@ -186,17 +294,63 @@ namespace lime {
 		if (algos.size() == 1) { // main case: there is only one base algorithm
 			// Load user object and call the encryption function
 			LimeManager::load_user(DeviceId(localDeviceId, algos[0]))->encrypt(encryptionContext, std::make_shared<limeCallback>(std::move(callback)));
-		} else { //We have several base algorithms, encrypt, in given order, with the different users until all recipients are satisfied or no more local user to try
+		} else { // We have several base algorithms: partition the recipients by the base algorithm they are known to use and encrypt the partitions concurrently.
+			// Recipients not known on any of our base algorithms go with the first one. When all partitions are done, the recipients not served yet
+			// are retried with each base algorithm, in given order, until all recipients are satisfied or no more local user to try
+
+			// get the local users for all base algorithms, ignore the missing ones
+			std::vector<lime::CurveId> userAlgos{};
+			std::vector<std::shared_ptr<LimeGeneric>> users{};
+			for (const auto algo : algos) {
+				auto user = LimeManager::load_user_noexcept(DeviceId(localDeviceId, algo));
+				if (user != nullptr) {
+					userAlgos.push_back(algo);
+					users.push_back(user);
+				}
+			}
+			if (users.empty()) { // no local user at all: let the load throw the usual exception
+				LimeManager::load_user(DeviceId(localDeviceId, algos[0]));
+				return;
+			}
+
+			// partition the recipients
+			std::list<std::string> recipientDeviceIds{};
+			for (const auto &recipient : encryptionContext->m_recipients) {
+				if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
+					recipientDeviceIds.push_back(recipient.deviceId);
+				}
+			}
+			std::map<std::string, lime::CurveId> peerDevicesAlgo{};
+			m_localStorage->get_peerDevicesAlgo(recipientDeviceIds, userAlgos, peerDevicesAlgo);
+			std::vector<std::vector<size_t>> partitions(userAlgos.size()); // indexes in encryptionContext recipients, one partition per user
+			for (size_t i=0; i<encryptionContext->m_recipients.size(); i++) {
+				const auto &recipient = encryptionContext->m_recipients[i];
+				if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
+					auto knownAlgo = peerDevicesAlgo.find(recipient.deviceId);
+					size_t partitionIndex = 0;
+					if (knownAlgo != peerDevicesAlgo.end()) {
+						partitionIndex = std::find(userAlgos.cbegin(), userAlgos.cend(), knownAlgo->second) - userAlgos.cbegin();
+					}
+					partitions[partitionIndex].push_back(i);
+				}
+			}
+
 			// In case we might encrypt with several lime users (same GRUU but different base algo) and using the cipher message policy (actually not forcing DRMessage policy)
 			// we must produce only one cipher message (or it looses its purpose of efficiency).
-			// In order for the second lime user to be able to produce cipher messages able to decrypt the randomseed, we must store here:
-			// - the random seed
-			// These must bet set/get via a callback
-			// Note: the cipherMessage is generated and stored in the cipherMessage buffer during the first call. It will then stay there untouched until we're done with all the algos
-			auto randomSeedStore = make_shared<std::vector<uint8_t>>();
+			// The partitions are encrypted concurrently so the policy is selected here, on all recipients, and when the payload goes in a cipher message
+			// the cipher message and random seed are produced before encrypting the partitions which all use them.
 			encryptionContext->m_cipherMessage.clear(); // make sure the cipherMessage is empty so we know when it was already computed
+			auto randomSeedStore = make_shared<std::vector<uint8_t>>();
+			auto partitionPolicy = lime::EncryptionPolicy::DRMessage;
+			if (!isPayloadDirectEncryption(encryptionContext->m_encryptionPolicy, encryptionContext->m_plainMessage.size(), recipientDeviceIds.size(), encryptionContext->m_encryptionCost)) {
+				auto randomSeed = encryptCipherMessage(encryptionContext->m_plainMessage, encryptionContext->m_associatedData, localDeviceId, encryptionContext->m_cipherMessage);
+				*randomSeedStore = *randomSeed;
+				cleanBuffer(randomSeed->data(), randomSeed->size());
+				partitionPolicy = lime::EncryptionPolicy::cipherMessage;
+			}
+
 			auto thiz = this;
-			auto algosIndex = make_shared<size_t>(0); // Keep the current index on the algos vector
+			auto algosIndex = make_shared<size_t>(0); // Keep the current index on the userAlgos vector
 			auto globalReturnStatus = make_shared<lime::CallbackReturn>(lime::CallbackReturn::fail);
 			auto globalReturnMessage = make_shared<std::string>();
 
@@ -219,28 +373,25 @@ namespace lime {
 					}
 				};
 			}
-			// This one is called when we finish the encryption for one lime user
+			// This one is called when we finish the encryption for one lime user, in the rounds following the concurrent encryption of the partitions
 			auto managerEncryptCallback = make_shared<limeCallback>(); // declare and define in two step so the lambda can capture itself to be used inside its own body
 			std::weak_ptr<limeCallback> managerEncryptCallbackWkptr(managerEncryptCallback); // we must capture a weak pointer otherwise the closure self references and is never destroyed. The shared_ptr is anyway copied in the userData internal structure if needed
-			*managerEncryptCallback = [thiz, localDeviceId, algos, algosIndex, randomSeedStore, encryptionContext, cb = std::move(callback), globalReturnStatus, globalReturnMessage, managerEncryptCallbackWkptr, managerRandomSeedCallback](lime::CallbackReturn returnCode, std::string errorMessage) {
+			auto sharedCallback = make_shared<limeCallback>(std::move(callback));
+			*managerEncryptCallback = [thiz, localDeviceId, userAlgos, algosIndex, randomSeedStore, encryptionContext, sharedCallback, globalReturnStatus, globalReturnMessage, managerEncryptCallbackWkptr, managerRandomSeedCallback](lime::CallbackReturn returnCode, std::string errorMessage) {
 					// retrieve status and message
 					// if at least one returns success, return success too
 					if ((*globalReturnStatus == lime::CallbackReturn::success) || (returnCode == lime::CallbackReturn::success)) {
 						*globalReturnStatus = lime::CallbackReturn::success;
 					}
 					if (!errorMessage.empty()) {
-						globalReturnMessage->append(CurveId2String(algos[*algosIndex])).append(" : ").append(errorMessage);
+						globalReturnMessage->append(CurveId2String(userAlgos[*algosIndex])).append(" : ").append(errorMessage);
 					}
 
 					// Do we have more algorithms to try?
-					if (*algosIndex > 0) {
-						if (*algosIndex == algos.size() - 1) { // we ran out of base algorithm to try
-							if (randomSeedStore) {
-								cleanBuffer(randomSeedStore->data(), randomSeedStore->size());
-							}
-							cb(*globalReturnStatus, *globalReturnMessage);
-							return;
-						}
+					if (*algosIndex == userAlgos.size() - 1) { // we ran out of base algorithm to try
+						cleanBuffer(randomSeedStore->data(), randomSeedStore->size());
+						(*sharedCallback)(*globalReturnStatus, *globalReturnMessage);
+						return;
 					}
 
 					// Did we encrypt for all our targets?
@@ -255,49 +406,134 @@ namespace lime {
 					}
 					// we have everyone
 					if (allDone) {
-						if (randomSeedStore) {
-							cleanBuffer(randomSeedStore->data(), randomSeedStore->size());
-						}
-						cb(*globalReturnStatus, *globalReturnMessage);
+						cleanBuffer(randomSeedStore->data(), randomSeedStore->size());
+						(*sharedCallback)(*globalReturnStatus, *globalReturnMessage);
 						return;
 					} else { // load the next user and encrypt again
 						(*algosIndex)++;
-						auto  user = thiz->load_user(DeviceId(localDeviceId, algos[*algosIndex]));
+						auto  user = thiz->load_user(DeviceId(localDeviceId, userAlgos[*algosIndex]));
 						// make a new call using the laterRoundRecipients (the one failed from first round)
 						if (auto managerEncryptCallback = managerEncryptCallbackWkptr.lock()) {
 							user->encrypt(encryptionContext, managerEncryptCallback, managerRandomSeedCallback);
 						} else {
-							LIME_LOGE<<"encryption failed: trying to get an other round on device "<<static_cast<std::string>(DeviceId(localDeviceId, algos[*algosIndex]));
-							cb(lime::CallbackReturn::fail, "Fail to encrypt as we lost track of the manager encryption lambda closure");
+							LIME_LOGE<<"encryption failed: trying to get an other round on device "<<static_cast<std::string>(DeviceId(localDeviceId, userAlgos[*algosIndex]));
+							(*sharedCallback)(lime::CallbackReturn::fail, "Fail to encrypt as we lost track of the manager encryption lambda closure");
 							return;
 						}
 					}
 			};
 
-			// Start with the first lime user in the algo list
-			// Encrypt for the first user, when done it will call the manager callback (and it may call the randomSeedCallback to store the random seed if we may need it
-			LimeManager::load_user(DeviceId(localDeviceId, algos[0]))->encrypt(encryptionContext, managerEncryptCallback, managerRandomSeedCallback);
+			// Count the partitions to encrypt concurrently
+			auto partitionsState = make_shared<PartitionedEncryption>();
+			for (const auto &partition : partitions) {
+				if (!partition.empty()) partitionsState->pendingPartitions++;
+			}
+			if (partitionsState->pendingPartitions == 0) { // nothing to encrypt, just let the first user do it so the callback is called the usual way
+				*algosIndex = userAlgos.size() - 1;
+				users[0]->encrypt(encryptionContext, managerEncryptCallback, managerRandomSeedCallback);
+				return;
+			}
+
+			// Called when a partition is done: copy its results to the encryption context, when it is the last one, start the next rounds with
+			// the recipients not done yet using the first user. That round may retry some recipients with the user which just failed them, but it
+			// occurs only on failure(peer device not on the X3DH server) and keeps the usual algorithm order.
+			auto partitionDone = [partitionsState, encryptionContext, globalReturnStatus, globalReturnMessage, users, managerEncryptCallback, managerRandomSeedCallback, randomSeedStore, sharedCallback, userAlgos]
+					(const lime::CurveId algo, const std::vector<size_t> &partition, std::shared_ptr<lime::EncryptionContext> partitionContext, lime::CallbackReturn returnCode, const std::string &errorMessage) {
+				std::unique_lock<std::mutex> lock(partitionsState->mutex);
+				for (size_t i=0; i<partition.size(); i++) {
+					auto &recipient = encryptionContext->m_recipients[partition[i]];
+					auto &partitionRecipient = partitionContext->m_recipients[i];
+					recipient.DRmessage = std::move(partitionRecipient.DRmessage);
+					recipient.peerStatus = partitionRecipient.peerStatus;
+					recipient.done = partitionRecipient.done;
+				}
+				if (returnCode == lime::CallbackReturn::success) {
+					*globalReturnStatus = lime::CallbackReturn::success;
+				}
+				if (!errorMessage.empty()) {
+					globalReturnMessage->append(CurveId2String(algo)).append(" : ").append(errorMessage);
+				}
+				if (--(partitionsState->pendingPartitions) > 0) {
+					return;
+				}
+				lock.unlock();
+
+				// all partitions are done, are all the recipients served?
+				bool allDone = true;
+				for (auto &recipient:encryptionContext->m_recipients) {
+					if (!recipient.done) {
+						recipient.peerStatus = lime::PeerDeviceStatus::unknown;
+						allDone = false;
+					}
+				}
+				if (allDone || userAlgos.size() == 1) {
+					cleanBuffer(randomSeedStore->data(), randomSeedStore->size());
+					(*sharedCallback)(*globalReturnStatus, *globalReturnMessage);
+					return;
+				}
+				users[0]->encrypt(encryptionContext, managerEncryptCallback, managerRandomSeedCallback);
+			};
+
+			// Encrypt all partitions, each one with its own context holding its recipients, the cipher message and the policy selected for all recipients
+			for (size_t k=0; k<partitions.size(); k++) {
+				if (partitions[k].empty()) continue;
+				auto partitionContext = make_shared<lime::EncryptionContext>(encryptionContext->m_associatedData, encryptionContext->m_plainMessage, partitionPolicy);
+				for (const auto i : partitions[k]) {
+					partitionContext->addRecipient(encryptionContext->m_recipients[i].deviceId);
+				}
+				partitionContext->m_cipherMessage = encryptionContext->m_cipherMessage;
+				const auto algo = userAlgos[k];
+				const auto &partition = partitions[k];
+				auto partitionCallback = make_shared<limeCallback>([partitionDone, algo, partition, partitionContext](lime::CallbackReturn returnCode, std::string errorMessage) {
+					partitionDone(algo, partition, partitionContext, returnCode, errorMessage);
+				});
+				try {
+					users[k]->encrypt(partitionContext, partitionCallback, (partitionPolicy == lime::EncryptionPolicy::cipherMessage) ? managerRandomSeedCallback : nullptr);
+				} catch (BctbxException const &e) { // other partitions may be already running: report this one as failed
+					LIME_LOGE<<"Encryption of "<<partition.size()<<" recipients with "<<CurveId2String(algo)<<" failed: "<<e.str();
+					partitionDone(algo, partition, partitionContext, lime::CallbackReturn::fail, e.str());
+				}
+			}
 		}
 	}
 
 	lime::PeerDeviceStatus LimeManager::decrypt(const std::string &localDeviceId, const std::vector<uint8_t> &associatedData, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) {
+		LIME_METRICS_COUNT(decrypt);
+		auto activeCapture = std::atomic_load(&m_capture);
+		const auto start = activeCapture?Capture::now():Capture::time_point{};
+		capture::Decryption capturedDecryption; // collects from the Double Ratchet the messages skipped by this decryption
 		// First we must retrieve in the DRmessage the algo base id used by sender
-		if (DRmessage.size()<3) return lime::PeerDeviceStatus::fail;
-		lime::CurveId algo = static_cast<lime::CurveId>(DRmessage[2]);
-		// Load user object and call the decryption function
-		return LimeManager::load_user(DeviceId(localDeviceId, algo))->decrypt(associatedData, senderDeviceId, DRmessage, cipherMessage, plainMessage);
+		// in sender key mode, there may be no DRmessage: the algo base id is then in the cipherMessage header
+		lime::CurveId algo = lime::CurveId::unset;
+		bool algoFound = false;
+		if (DRmessage.empty()) {
+			algoFound = sender_key_protocol::parseMessage_get_curveId(cipherMessage, algo);
+		} else if (DRmessage.size()>=3) {
+			algo = static_cast<lime::CurveId>(DRmessage[2]);
+			algoFound = true;
+		}
+		auto status = lime::PeerDeviceStatus::fail;
+		if (algoFound) {
+			// Load user object and call the decryption function
+			status = LimeManager::load_user(DeviceId(localDeviceId, algo))->decrypt(associatedData, senderDeviceId, DRmessage, cipherMessage, plainMessage);
+		}
+		if (activeCapture) {
+			activeCapture->decrypt(start, localDeviceId, algo, associatedData, senderDeviceId, DRmessage.size(), cipherMessage.size(),
+					(status == lime::PeerDeviceStatus::fail)?0:plainMessage.size(), capturedDecryption.skipped, capturedDecryption.late, status);
+		}
+		return status;
 	}
 
 	// convenience definition, have a decrypt without cipherMessage input for the case we don't have it(DR message encryption policy)
 	// just create an empty cipherMessage to be able to call Lime::decrypt which needs the cipherMessage even if empty for code simplicity
 	lime::PeerDeviceStatus LimeManager::decrypt(const std::string &localDeviceId, const std::vector<uint8_t> &associatedData, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, std::vector<uint8_t> &plainMessage) {
-		// First we must retrieve in the DRmessage the algo base id used by sender
-		if (DRmessage.size()<3) return lime::PeerDeviceStatus::fail;
-		lime::CurveId algo = static_cast<lime::CurveId>(DRmessage[2]);
+		// without cipherMessage, the algo base id must be in the DRmessage
+		if (DRmessage.size()<3) {
+			LIME_METRICS_COUNT(decrypt);
+			return lime::PeerDeviceStatus::fail;
+		}
 		const std::vector<uint8_t> emptyCipherMessage(0);
-
-		// Load user object and call the decryption function
-		return LimeManager::load_user(DeviceId(localDeviceId, algo))->decrypt(associatedData, senderDeviceId, DRmessage, emptyCipherMessage, plainMessage);
+		return decrypt(localDeviceId, associatedData, senderDeviceId, DRmessage, emptyCipherMessage, plainMessage);
 	}
 	lime::PeerDeviceStatus LimeManager::decrypt(const std::string &localDeviceId, const std::string &recipientUserId, const std::string &senderDeviceId, const std::vector<uint8_t> &DRmessage, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plainMessage) {
 		std::vector<uint8_t> associatedData(recipientUserId.cbegin(), recipientUserId.cend());
@@ -314,6 +550,9 @@ namespace lime {
 		update(localDeviceId, algos, std::move(callback), lime::settings::OPk_serverLowLimit, lime::settings::OPk_batchSize);
 	}
 	void LimeManager::update(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, limeCallback callback, uint16_t OPkServerLowLimit, uint16_t OPkBatchSize) {
+		if (auto capture = std::atomic_load(&m_capture)) {
+			callback = captureUserOperation(std::move(capture), "update", localDeviceId, algos, std::move(callback));
+		}
 		auto userCount = make_shared<size_t>(0);
 		std::vector<DeviceId> devicesUpdate{};
 		// Check if the last update was performed more than OPk_updatePeriod seconds ago
@@ -373,6 +612,166 @@ namespace lime {
 		}
 	}
 
+	void LimeManager::prefetch_sessions(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const std::vector<std::string> &peerDeviceIds, limeCallback callback) {
+		prefetch_sessions(localDeviceId, algos, peerDeviceIds, std::move(callback), lime::settings::prefetch_OPkBudget);
+	}
+	void LimeManager::prefetch_sessions(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, const std::vector<std::string> &peerDeviceIds, limeCallback callback, uint16_t OPkBudget) {
+		if (algos.empty()) {
+			throw BCTBX_EXCEPTION << "Cannot prefetch sessions for user "<<localDeviceId<<" without specifying algorithms";
+		}
+		// load all the users first so an unknown one throws before anything is sent to the X3DH server
+		std::vector<std::shared_ptr<LimeGeneric>> users{};
+		for (const auto algo:algos) {
+			users.push_back(LimeManager::load_user(DeviceId(localDeviceId, algo)));
+		}
+
+		auto userCount = make_shared<size_t>(users.size());
+		auto globalReturnCode = make_shared<lime::CallbackReturn>(lime::CallbackReturn::success);
+		auto globalMessage = make_shared<std::string>();
+		auto sharedCallback = make_shared<lime::limeCallback>(std::move(callback)); // need to store the callback into a shared_ptr as any we don't know which instance will be calling it
+
+		// this callback will get the callbacks from all users, when everyone is done, call the callback given to LimeManager::prefetch_sessions
+		auto managerPrefetchCallback = make_shared<limeCallback>([userCount, globalReturnCode, globalMessage, sharedCallback](lime::CallbackReturn returnCode, std::string message) {
+			(*userCount)--;
+			if (returnCode == lime::CallbackReturn::fail) {
+				*globalReturnCode = lime::CallbackReturn::fail; // if one fail, return fail at the end of it
+			}
+			if (!message.empty()) {
+				if (!globalMessage->empty()) globalMessage->append(" - ");
+				globalMessage->append(message);
+			}
+
+			// When all users are done
+			if (*userCount == 0) {
+				(*sharedCallback)(*globalReturnCode, *globalMessage);
+			}
+		});
+
+		for (const auto &user:users) {
+			user->prefetch_sessions(peerDeviceIds, managerPrefetchCallback, OPkBudget);
+		}
+	}
+
+	/** Get a user from the LimeManager cache or load it from local storage and set it in cache
+	 * Unlike load_user_noexcept, the users cache lock is not held while loading so the foreground look ups are not delayed
+	 *
+	 * @param[in]	localDeviceId	the string and algo identifying the device
+	 * @param[out]	loaded		true if the user was loaded from local storage, false if it was already in cache
+	 *
+	 * @return	a pointer to the user, nullptr if it could not be loaded
+	 */
+	std::shared_ptr<LimeGeneric> LimeManager::cacheWarmer_loadUser(const DeviceId &localDeviceId, bool &loaded) {
+		loaded = false;
+		uint64_t usersErasedCount = 0;
+		{
+			std::shared_lock<std::shared_mutex> lock(m_users_mutex);
+			auto userElem = m_users_cache.find(localDeviceId);
+			if (userElem != m_users_cache.end()) {
+				return userElem->second;
+			}
+			usersErasedCount = m_usersErasedCount;
+		}
+
+		try {
+			auto user = load_LimeUser(m_localStorage, localDeviceId, m_X3DH_post_data);
+			// the user may have been deleted while we were loading it: check it is still in local storage, before taking the exclusive lock
+			long int Uid = 0;
+			std::string url{};
+			m_localStorage->load_LimeUser(localDeviceId, Uid, url);
+
+			std::lock_guard<std::shared_mutex> lock(m_users_mutex);
+			auto userElem = m_users_cache.find(localDeviceId);
+			if (userElem != m_users_cache.end()) { // loaded by a foreground call in the meantime
+				return userElem->second;
+			}
+			if (usersErasedCount != m_usersErasedCount) { // a user was erased since we started, it may be this one: do not risk caching it
+				return nullptr;
+			}
+			m_users_cache[localDeviceId] = user;
+			loaded = true;
+			return user;
+		} catch (BctbxException const &) { // the user is not in local storage anymore
+			return nullptr;
+		}
+	}
+
+	void LimeManager::cacheWarmer_run(const uint16_t maxSessions, const size_t memoryBudget, const limeCallback callback) {
+		size_t usedMemory = 0;
+		size_t usersCount = 0;
+		size_t sessionsCount = 0;
+		auto returnCode = lime::CallbackReturn::success;
+		std::string message{};
+		try {
+			std::vector<RecentSession> sessions{};
+			m_localStorage->get_recentSessions(maxSessions, sessions);
+
+			std::unordered_map<lime::DeviceId, std::shared_ptr<LimeGeneric>, decltype(&lime::DeviceId::hash)> users(0, DeviceId::hash); // users met so far, nullptr when they could not be loaded
+			for (const auto &session : sessions) {
+				if (m_cacheWarmerStop || usedMemory >= memoryBudget) break;
+
+				auto userElem = users.find(session.localDeviceId);
+				if (userElem == users.end()) {
+					bool loaded = false;
+					userElem = users.emplace(session.localDeviceId, cacheWarmer_loadUser(session.localDeviceId, loaded)).first;
+					if (loaded) {
+						usersCount++;
+						usedMemory += lime::settings::cacheWarmer_userFootprint;
+					}
+				}
+				if (userElem->second == nullptr) continue;
+
+				auto sessionFootprint = userElem->second->DRcache_warm(session.peerDeviceId, session.sessionId);
+				if (sessionFootprint > 0) {
+					sessionsCount++;
+					usedMemory += sessionFootprint;
+				}
+			}
+		} catch (BctbxException const &e) {
+			returnCode = lime::CallbackReturn::fail;
+			message.append("Cache warmer failed: ").append(e.str()).append(" - ");
+		} catch (std::exception const &e) { // local storage errors must not escape the thread
+			returnCode = lime::CallbackReturn::fail;
+			message.append("Cache warmer failed: ").append(e.what()).append(" - ");
+		}
+		if (m_cacheWarmerStop) {
+			returnCode = lime::CallbackReturn::fail;
+			message.append("Cache warmer interrupted - ");
+		}
+		message.append(std::to_string(usersCount)).append(" users and ").append(std::to_string(sessionsCount)).append(" sessions loaded in cache");
+		LIME_LOGI<<message<<", estimated memory used "<<usedMemory<<" bytes";
+
+		m_cacheWarmerRunning = false;
+		// the run is over and its state settled, the callback is the last thing this thread does
+		if (callback) {
+			callback(returnCode, message);
+		}
+	}
+
+	void LimeManager::warm_cache(limeCallback callback) {
+		warm_cache(lime::settings::cacheWarmer_maxSessions, lime::settings::cacheWarmer_memoryBudget, std::move(callback));
+	}
+	void LimeManager::warm_cache(const uint16_t maxSessions, const size_t memoryBudget, limeCallback callback) {
+		std::thread previousWarmer{};
+		bool started = false;
+		{
+			std::lock_guard<std::mutex> lock(m_cacheWarmer_mutex);
+			// called from the warmer own callback, the thread is still running it and can be neither joined nor replaced
+			const bool fromWarmer = (m_cacheWarmer.get_id() == std::this_thread::get_id());
+			if (!m_cacheWarmerRunning && !m_cacheWarmerStop && !fromWarmer) {
+				previousWarmer = std::move(m_cacheWarmer);
+				m_cacheWarmerRunning = true;
+				m_cacheWarmer = std::thread(&LimeManager::cacheWarmer_run, this, maxSessions, memoryBudget, std::move(callback));
+				started = true;
+			}
+		}
+		if (previousWarmer.joinable()) { // a previous run is over, it may still be in its callback: join it out of the lock
+			previousWarmer.join();
+		}
+		if (!started && callback) {
+			callback(lime::CallbackReturn::fail, "Cache warmer is already running");
+		}
+	}
+
 	void LimeManager::get_selfIdentityKey(const std::string &localDeviceId, const std::vector<lime::CurveId> &algos, std::map<lime::CurveId, std::vector<uint8_t>> &Iks) {
 		for (const auto &algo:algos) {
 			std::vector<uint8_t> Ik;
@@ -399,8 +798,12 @@ namespace lime {
 		return m_localStorage->get_peerDeviceStatus(peerDeviceIds);
 	}
 
+	void LimeManager::get_peerDeviceStatus(const std::list<std::string> &peerDeviceIds, std::map<std::string, lime::PeerDeviceStatus> &peerDeviceStatuses) {
+		m_localStorage->get_peerDeviceStatus(peerDeviceIds, peerDeviceStatuses);
+	}
+
 	void LimeManager::delete_peerDevice(const std::string &peerDeviceId) {
-		std::lock_guard<std::mutex> lock(m_users_mutex);
+		std::shared_lock<std::shared_mutex> lock(m_users_mutex); // users are not added or removed from cache, sharing the lock is enough
 		// loop on all local users in cache to destroy any cached session linked to that user
 		for (auto userElem : m_users_cache) {
 			userElem.second->delete_peerDevice(peerDeviceId);
@@ -433,6 +836,44 @@ namespace lime {
 		return LimeManager::load_user(localDeviceId)->get_x3dhServerUrl();
 	}
 
+	void LimeManager::set_tracer(std::shared_ptr<lime::Tracer> tracer) {
+		trace::setTracer(std::move(tracer));
+	}
+
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+	void LimeManager::set_deterministic_RNG(const uint64_t seed) {
+		lime::set_deterministic_RNG(seed);
+	}
+
+	void LimeManager::clear_deterministic_RNG(void) {
+		lime::clear_deterministic_RNG();
+	}
+#endif // LIME_DETERMINISTIC_RNG_ENABLED
+
+	bool LimeManager::start_capture(const std::string &filename) {
+		try {
+			std::atomic_store(&m_capture, std::make_shared<Capture>(filename));
+		} catch (BctbxException const &e) {
+			LIME_LOGE<<"Cannot start capture: "<<e.str();
+			return false;
+		}
+		LIME_LOGI<<"Start operations capture in "<<filename;
+		return true;
+	}
+
+	void LimeManager::stop_capture(void) {
+		// operations in progress hold the capture until they complete
+		std::atomic_store(&m_capture, std::shared_ptr<Capture>{nullptr});
+	}
+
+	std::string LimeManager::get_metrics(void) {
+#ifdef LIME_METRICS_ENABLED
+		return metrics::exportPrometheus();
+#else
+		return std::string{};
+#endif
+	}
+
 	/****************************************************************************/
 	/*                                                                          */
 	/* Lime utils functions                                                     */
@@ -0,0 +1,152 @@
+/*
+	lime_metrics.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_metrics.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <iomanip>
+#include <sstream>
+
+namespace lime {
+namespace metrics {
+	namespace {
+		/// Upper bounds of the histograms buckets in nanoseconds: 10us to 10s, the last bucket(+Inf) is implicit
+		constexpr std::array<uint64_t, 16> bucketsBound{
+			10000, 50000, 100000, 250000, 500000,
+			1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+			100000000, 250000000, 1000000000, 2500000000, 10000000000
+		};
+
+		/// a histogram: count per bucket(not cumulative, the export cumulates them) and sum of observed durations
+		struct HistogramData {
+			std::array<std::atomic<uint64_t>, bucketsBound.size()+1> buckets;
+			std::atomic<uint64_t> sum_ns;
+		};
+
+		// static storage: zero initialised
+		std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::size)> counters;
+		std::array<HistogramData, static_cast<size_t>(Histogram::size)> histograms;
+
+		/// exported name and help of each counter, in the Counter enum order
+		constexpr std::array<std::pair<const char *, const char *>, static_cast<size_t>(Counter::size)> countersDescription{{
+			{"lime_encrypt_total", "Number of encrypt calls"},
+			{"lime_decrypt_total", "Number of decrypt calls"},
+			{"lime_x3dh_sessions_created_total", "Number of DR sessions created by a X3DH key agreement"},
+			{"lime_skipped_keys_stored_total", "Number of skipped message keys stored"},
+			{"lime_skipped_keys_consumed_total", "Number of stored skipped message keys used to decrypt a message"},
+			{"lime_users_cache_hits_total", "Number of local users found in cache"},
+			{"lime_users_cache_misses_total", "Number of local users loaded from local storage"},
+			{"lime_sessions_cache_hits_total", "Number of DR sessions found in cache"},
+			{"lime_sessions_cache_misses_total", "Number of DR sessions not found in cache"},
+			{"lime_opk_uploaded_total", "Number of OPks uploaded to the X3DH server"}
+		}};
+
+		/// exported name and help of each histogram, in the Histogram enum order
+		constexpr std::array<std::pair<const char *, const char *>, static_cast<size_t>(Histogram::size)> histogramsDescription{{
+			{"lime_ratchet_encrypt_seconds", "Double Ratchet encryption latency"},
+			{"lime_ratchet_decrypt_seconds", "Double Ratchet decryption latency"},
+			{"lime_session_save_seconds", "DR session save latency"},
+			{"lime_session_load_seconds", "DR session load latency"},
+			{"lime_fetch_peer_bundles_seconds", "Peer bundles request round trip time"},
+			{"lime_init_sender_session_seconds", "Sender DR sessions creation latency"},
+			{"lime_init_receiver_session_seconds", "Receiver DR session creation latency"}
+		}};
+
+		/// write a duration given in nanoseconds in seconds
+		void writeSeconds(std::ostringstream &os, const uint64_t ns) {
+			os<<ns/1000000000<<"."<<std::setw(9)<<std::setfill('0')<<ns%1000000000;
+		}
+	}
+
+	/**
+	 * @brief Increment a counter
+	 *
+	 * @param[in]	counter	the counter to increment
+	 * @param[in]	n	the increment
+	 */
+	void count(const Counter counter, const uint64_t n) noexcept {
+		counters[static_cast<size_t>(counter)].fetch_add(n, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Record a duration in a histogram
+	 *
+	 * @param[in]	histogram	the histogram to update
+	 * @param[in]	duration	the observed duration
+	 */
+	void observe(const Histogram histogram, const std::chrono::steady_clock::duration duration) noexcept {
+		const auto ns = static_cast<uint64_t>(std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), 0));
+		auto &h = histograms[static_cast<size_t>(histogram)];
+		size_t bucket = 0;
+		while (bucket < bucketsBound.size() && ns > bucketsBound[bucket]) {
+			bucket++;
+		}
+		h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		h.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	/**
+	 * @brief Export all counters and histograms in Prometheus text exposition format
+	 *
+	 * @return	the metrics, ready to be served to a Prometheus scraper
+	 */
+	std::string exportPrometheus(void) {
+		std::ostringstream os;
+		for (size_t i=0; i<counters.size(); i++) {
+			os<<"# HELP "<<countersDescription[i].first<<" "<<countersDescription[i].second<<"\n";
+			os<<"# TYPE "<<countersDescription[i].first<<" counter\n";
+			os<<countersDescription[i].first<<" "<<counters[i].load(std::memory_order_relaxed)<<"\n";
+		}
+		for (size_t i=0; i<histograms.size(); i++) {
+			const auto name = histogramsDescription[i].first;
+			os<<"# HELP "<<name<<" "<<histogramsDescription[i].second<<"\n";
+			os<<"# TYPE "<<name<<" histogram\n";
+			uint64_t cumulative = 0;
+			for (size_t b=0; b<bucketsBound.size(); b++) {
+				cumulative += histograms[i].buckets[b].load(std::memory_order_relaxed);
+				os<<name<<"_bucket{le=\"";
+				writeSeconds(os, bucketsBound[b]);
+				os<<"\"} "<<cumulative<<"\n";
+			}
+			cumulative += histograms[i].buckets[bucketsBound.size()].load(std::memory_order_relaxed);
+			os<<name<<"_bucket{le=\"+Inf\"} "<<cumulative<<"\n";
+			os<<name<<"_sum ";
+			writeSeconds(os, histograms[i].sum_ns.load(std::memory_order_relaxed));
+			os<<"\n";
+			os<<name<<"_count "<<cumulative<<"\n";
+		}
+		return os.str();
+	}
+
+	/**
+	 * @brief Reset all counters and histograms to zero
+	 */
+	void reset(void) noexcept {
+		for (auto &counter : counters) {
+			counter.store(0, std::memory_order_relaxed);
+		}
+		for (auto &h : histograms) {
+			for (auto &bucket : h.buckets) {
+				bucket.store(0, std::memory_order_relaxed);
+			}
+			h.sum_ns.store(0, std::memory_order_relaxed);
+		}
+	}
+} // namespace metrics
+} // namespace lime
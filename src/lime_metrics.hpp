@@ -0,0 +1,99 @@
+/*
+	lime_metrics.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef lime_metrics_hpp
+#define lime_metrics_hpp
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace lime {
+	/** @brief Process wide registry of counters and latency histograms
+	 *
+	 * All the updates are lock-free(relaxed atomics), the export reads each value independently: it is not a consistent snapshot.
+	 * The library instruments itself through the LIME_METRICS_* macros, they compile to nothing unless the library is built with ENABLE_METRICS
+	 */
+	namespace metrics {
+		/// Counted events
+		enum class Counter : uint8_t {
+			encrypt, /**< LimeManager encrypt calls */
+			decrypt, /**< LimeManager decrypt calls */
+			X3DHsessionCreated, /**< DR sessions created by a X3DH key agreement, as sender or receiver */
+			skippedKeyStored, /**< message keys skipped and stored(as a chain checkpoint) to decrypt out of order messages */
+			skippedKeyConsumed, /**< stored skipped message keys used to decrypt a message */
+			usersCacheHit, /**< local users found in the LimeManager cache */
+			usersCacheMiss, /**< local users loaded from local storage */
+			sessionsCacheHit, /**< DR sessions found in the Lime cache */
+			sessionsCacheMiss, /**< DR sessions not in the Lime cache */
+			OPkUploaded, /**< OPks uploaded to the X3DH server */
+			size /**< number of counters, keep it last */
+		};
+
+		/// Timed operations
+		enum class Histogram : uint8_t {
+			ratchetEncrypt, /**< DR encryption of one message */
+			ratchetDecrypt, /**< DR decryption of one message */
+			sessionSave, /**< DR session write to local storage */
+			sessionLoad, /**< DR session read from local storage */
+			fetchPeerBundles, /**< round trip of a getPeerBundles request to the X3DH server */
+			initSenderSession, /**< DR sessions creation from a peer bundles response */
+			initReceiverSession, /**< DR session creation from a X3DH init message */
+			size /**< number of histograms, keep it last */
+		};
+
+		void count(const Counter counter, const uint64_t n=1) noexcept;
+		void observe(const Histogram histogram, const std::chrono::steady_clock::duration duration) noexcept;
+		std::string exportPrometheus(void);
+		void reset(void) noexcept;
+
+		/**
+		 * @brief Time its own lifespan and record it in a histogram at destruction
+		 */
+		class ScopedTimer {
+			private:
+				const Histogram m_histogram;
+				const std::chrono::steady_clock::time_point m_start;
+			public:
+				explicit ScopedTimer(const Histogram histogram) noexcept : m_histogram{histogram}, m_start{std::chrono::steady_clock::now()} {};
+				ScopedTimer(const ScopedTimer &) = delete;
+				ScopedTimer &operator=(const ScopedTimer &) = delete;
+				~ScopedTimer() {observe(m_histogram, std::chrono::steady_clock::now() - m_start);};
+		};
+	} // namespace metrics
+} // namespace lime
+
+#ifdef LIME_METRICS_ENABLED
+/// count one event
+#define LIME_METRICS_COUNT(counter) lime::metrics::count(lime::metrics::Counter::counter)
+/// count n events
+#define LIME_METRICS_COUNT_N(counter, n) lime::metrics::count(lime::metrics::Counter::counter, static_cast<uint64_t>(n))
+/// time the enclosing scope
+#define LIME_METRICS_TIME(histogram) lime::metrics::ScopedTimer limeMetricsTimer_##histogram{lime::metrics::Histogram::histogram}
+/// record a duration measured by the caller
+#define LIME_METRICS_OBSERVE(histogram, duration) lime::metrics::observe(lime::metrics::Histogram::histogram, duration)
+/// get a time point for LIME_METRICS_OBSERVE
+#define LIME_METRICS_NOW() std::chrono::steady_clock::now()
+#else
+#define LIME_METRICS_COUNT(counter)
+#define LIME_METRICS_COUNT_N(counter, n)
+#define LIME_METRICS_TIME(histogram)
+#define LIME_METRICS_OBSERVE(histogram, duration)
+#define LIME_METRICS_NOW() std::chrono::steady_clock::time_point{}
+#endif // LIME_METRICS_ENABLED
+
+#endif /* lime_metrics_hpp */
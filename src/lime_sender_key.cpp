@@ -0,0 +1,501 @@
+/*
+	lime_sender_key.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime_sender_key.hpp"
+#include "lime_x3dh.hpp"
+#include <soci/soci.h>
+
+#include "bctoolbox/exception.hh"
+
+#include <algorithm> //copy_n
+
+using namespace::std;
+using namespace::soci;
+using namespace::lime;
+
+namespace lime {
+	/** @brief Group in this namespace all the functions related to building or parsing sender key packets
+	 *
+	 * @par Version 0x01:
+	 *
+	 *	Sender key message is: Protocol Version Number<1 byte> || curveId <1 byte> || chain Id<4 bytes> || message index<4 bytes>
+	 *	                       || cipherText<...> || Message auth tag<16 bytes> || Signature<DSA signature size>
+	 *
+	 *	The message is sent as cipher message, with no DR message or, to the recipients not holding the sender chain yet, with a DR message
+	 *	encrypting the chain distribution payload: Protocol Version Number<1 byte> || chain Id<4 bytes> || chain index<4 bytes> || chain key<32 bytes>
+	 *
+	 *	Associated Data of the message AEAD are: message header<10 bytes> || source Device Id || group Id
+	 *	The signature is computed with the sender identity key on: message header || cipherText || Message auth tag
+	 */
+	namespace sender_key_protocol {
+		/**
+		 * @brief get the base algorithm of a sender key message
+		 *
+		 * @param[in]	message		A buffer holding the sender key message
+		 * @param[out]	curveId		The base algorithm the message was encrypted with
+		 *
+		 * @return true if the message holds a valid sender key header, false otherwise
+		 */
+		bool parseMessage_get_curveId(const std::vector<uint8_t> &message, lime::CurveId &curveId) noexcept {
+			if (message.size() < headerSize() || message[0] != SK_v01) {
+				return false;
+			}
+			curveId = static_cast<lime::CurveId>(message[1]);
+			return true;
+		}
+	} // namespace sender_key_protocol
+
+	namespace {// anonymous namespace for local functions/classes
+	/** constant used as input of HKDF like function, label of the message key derivation */
+	const std::array<uint8_t,1> hkdf_sk_mk_info{{0x01}};
+	/** constant used as input of HKDF like function, label of the chain key derivation */
+	const std::array<uint8_t,1> hkdf_sk_ck_info{{0x02}};
+
+	/**
+	 * @brief Key Derivation Function used in the sender chain
+	 *
+	 *      Same construction than the double ratchet symmetric chain, the index in the chain is appended to the labels
+	 *      @code{.unparsed}
+	 *		MK = HMAC-SHA512(CK, hkdf_sk_mk_info || index) // get 48 bytes of it: first 32 to be key and last 16 to be IV
+	 *		CK = HMAC-SHA512(CK, hkdf_sk_ck_info || index)
+	 *      @endcode
+	 *
+	 * @param[in,out]	CK	Input/output buffer used as key to compute MK and then next CK
+	 * @param[out]		MK	Message Key(32 bytes) and IV(16 bytes) computed from HMAC_SHA512 keyed with CK
+	 * @param[in]		index	index of CK in the chain
+	 */
+	void KDF_SCK(DRChainKey &CK, DRMKey &MK, const uint32_t index) noexcept {
+		// both derivations are keyed by CK: compute the HMAC key schedule only once
+		HMACKeySchedule<SHA512> hmacCK(CK.data(), CK.size());
+		std::array<uint8_t,5> label{hkdf_sk_mk_info[0], static_cast<uint8_t>(index>>24), static_cast<uint8_t>((index>>16)&0xFF), static_cast<uint8_t>((index>>8)&0xFF), static_cast<uint8_t>(index&0xFF)};
+		hmacCK.compute(label.data(), label.size(), MK.data(), MK.size());
+
+		// CK is not used anymore as key, the HMAC key schedule holds it, we can write the new CK directly
+		label[0]=hkdf_sk_ck_info[0];
+		hmacCK.compute(label.data(), label.size(), CK.data(), CK.size());
+	}
+
+	void write_uint32(std::vector<uint8_t> &buffer, const uint32_t value) {
+		buffer.push_back(static_cast<uint8_t>((value>>24)&0xFF));
+		buffer.push_back(static_cast<uint8_t>((value>>16)&0xFF));
+		buffer.push_back(static_cast<uint8_t>((value>>8)&0xFF));
+		buffer.push_back(static_cast<uint8_t>(value&0xFF));
+	}
+
+	uint32_t read_uint32(const std::vector<uint8_t>::const_iterator s) {
+		return static_cast<uint32_t>(s[0])<<24 |
+			static_cast<uint32_t>(s[1])<<16 |
+			static_cast<uint32_t>(s[2])<<8 |
+			static_cast<uint32_t>(s[3]);
+	}
+
+	/* AD of the message AEAD: header || source Device Id || group Id */
+	std::vector<uint8_t> messageAD(const std::vector<uint8_t> &message, const std::string &sourceDeviceId, const std::string &groupId) {
+		std::vector<uint8_t> AD{message.cbegin(), message.cbegin()+sender_key_protocol::headerSize()};
+		AD.insert(AD.end(), sourceDeviceId.cbegin(), sourceDeviceId.cend());
+		AD.insert(AD.end(), groupId.cbegin(), groupId.cend());
+		return AD;
+	}
+	} // anonymous namespace
+
+	/****************************************************************************/
+	/*                                                                          */
+	/* Sending chain                                                            */
+	/*                                                                          */
+	/****************************************************************************/
+	/**
+	 * @brief Load our sending chain for the group from local storage, generate a new one if it is missing or must be renewed
+	 *
+	 * The chain is renewed when it reaches senderKey_maxSendingChain or when a device holding it is not in the recipients anymore:
+	 * it shall not decrypt any new message. The new chain is saved in local storage, replacing the old one, only at first encryption.
+	 *
+	 * @param[in]	localStorage	Local storage accessor
+	 * @param[in]	dbUid		the local user Id in local storage
+	 * @param[in]	groupId		the group Id: the recipientUserId given to encrypt, shall be the group sip:uri
+	 * @param[in]	recipients	the recipients of the message to encrypt, the one with peerStatus set to fail and the ones done are ignored
+	 */
+	template <typename Curve>
+	SenderKeySendingChain<Curve>::SenderKeySendingChain(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &groupId, const std::vector<RecipientData> &recipients)
+	: m_localStorage{localStorage}, m_dbUid{dbUid}, m_groupId{groupId}, m_dbId{0}, m_chainId{0}, m_index{0}, m_CK{}, m_recipients{}
+	{
+		std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+		long int dbId = 0;
+		int chainId = 0;
+		int index = 0;
+		blob CK_blob(m_localStorage->sql);
+		m_localStorage->sql<<"SELECT skId, chainId, N, CK FROM lime_SenderKeys WHERE Uid = :Uid AND Did IS NULL AND groupId = :groupId LIMIT 1;", into(dbId), into(chainId), into(index), into(CK_blob), use(m_dbUid), use(m_groupId);
+		if (m_localStorage->sql.got_data()) {
+			std::unordered_set<std::string> recipientIds{};
+			for (const auto &recipient : recipients) {
+				if (recipient.peerStatus != lime::PeerDeviceStatus::fail && !recipient.done) {
+					recipientIds.insert(recipient.deviceId);
+				}
+			}
+
+			bool removedRecipient = false;
+			std::unordered_set<std::string> holders{};
+			std::string deviceId{};
+			statement st = (m_localStorage->sql.prepare << "SELECT d.DeviceId FROM lime_SenderKeyRecipients as r INNER JOIN lime_PeerDevices as d ON r.Did = d.Did WHERE r.skId = :skId;", into(deviceId), use(dbId));
+			st.execute();
+			while (st.fetch()) {
+				if (recipientIds.count(deviceId) == 0) {
+					removedRecipient = true;
+				}
+				holders.insert(deviceId);
+			}
+
+			if (!removedRecipient && static_cast<uint32_t>(index) < lime::settings::senderKey_maxSendingChain) {
+				m_dbId = dbId;
+				m_chainId = static_cast<uint32_t>(chainId);
+				m_index = static_cast<uint32_t>(index);
+				CK_blob.read(0, (char *)(m_CK.data()), m_CK.size());
+				m_recipients = std::move(holders);
+				return;
+			}
+			LIME_LOGI<<"Renew sender chain for group "<<m_groupId<<((removedRecipient)?" : a recipient left the group":" : maximum chain length reached");
+		}
+
+		// generate a new chain. The chain Id is public, its MSbit is set to 0 by the randomize function so it is safely stored in sqlite
+		auto RNG_context = make_RNG();
+		m_chainId = RNG_context->randomize();
+		RNG_context->randomize(m_CK.data(), m_CK.size());
+	}
+
+	/**
+	 * @brief Encrypt a message with the sending chain and distribute it to the recipients not holding it yet
+	 *
+	 * The chain is moved forward and saved in local storage before the message is encrypted: a failure afterward cannot lead to
+	 * a message key reuse.
+	 *
+	 * @param[in]		plaintext	data to be encrypted
+	 * @param[in]		sourceDeviceId	the Id of sender device(gruu)
+	 * @param[in]		X3DHengine	the X3DH engine of the local user, used to sign the message with its identity key
+	 * @param[out]		cipherMessage	the sender key message, same for all the recipients
+	 * @param[in,out]	newRecipients	the recipients not holding the chain yet with their DR session, they get the chain in their DR message
+	 */
+	template <typename Curve>
+	void SenderKeySendingChain<Curve>::encrypt(const std::vector<uint8_t> &plaintext, const std::string &sourceDeviceId, std::shared_ptr<X3DH> X3DHengine, std::vector<uint8_t> &cipherMessage, std::vector<RecipientInfos> &newRecipients) {
+		// the distribution payload holds the chain state before the derivation so the new recipients can decrypt this message
+		std::vector<uint8_t> distribution{};
+		if (!newRecipients.empty()) {
+			distribution.reserve(sender_key_protocol::distributionSize());
+			distribution.push_back(sender_key_protocol::SK_v01);
+			write_uint32(distribution, m_chainId);
+			write_uint32(distribution, m_index);
+			distribution.insert(distribution.end(), m_CK.cbegin(), m_CK.cend());
+		}
+
+		// build the message header
+		cipherMessage.clear();
+		cipherMessage.reserve(plaintext.size() + sender_key_protocol::messageOverhead<Curve>());
+		cipherMessage.push_back(sender_key_protocol::SK_v01);
+		cipherMessage.push_back(static_cast<uint8_t>(Curve::curveId()));
+		write_uint32(cipherMessage, m_chainId);
+		write_uint32(cipherMessage, m_index);
+
+		DRMKey MK;
+		KDF_SCK(m_CK, MK, m_index);
+		m_index++;
+
+		// save the chain state
+		try {
+			std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+			transaction tr(m_localStorage->sql);
+			blob CK(m_localStorage->sql);
+			CK.write(0, (char *)(m_CK.data()), m_CK.size());
+			int chainId = static_cast<int>(m_chainId);
+			int index = static_cast<int>(m_index);
+			if (m_dbId == 0) { // a new chain: it replaces the previous one, if any, and the list of devices holding it
+				m_localStorage->sql<<"DELETE FROM lime_SenderKeys WHERE Uid = :Uid AND Did IS NULL AND groupId = :groupId;", use(m_dbUid), use(m_groupId);
+				m_localStorage->sql<<"INSERT INTO lime_SenderKeys(Uid, groupId, chainId, N, CK) VALUES(:Uid, :groupId, :chainId, :N, :CK);", use(m_dbUid), use(m_groupId), use(chainId), use(index), use(CK);
+				m_localStorage->sql<<"select last_insert_rowid()",into(m_dbId); // WARNING: unportable code, sqlite3 only
+			} else {
+				m_localStorage->sql<<"UPDATE lime_SenderKeys SET N = :N, CK = :CK WHERE skId = :skId;", use(index), use(CK), use(m_dbId);
+			}
+			tr.commit();
+		} catch (exception const &e) {
+			cleanBuffer(distribution.data(), distribution.size());
+			throw BCTBX_EXCEPTION << "Cannot save sender chain for group "<<m_groupId<<". DB backend says : "<<e.what();
+		}
+
+		// encrypt the message: ciphertext and tag are written after the header
+		auto AD = messageAD(cipherMessage, sourceDeviceId, m_groupId);
+		cipherMessage.resize(sender_key_protocol::headerSize() + plaintext.size() + lime::settings::DRMessageAuthTagSize);
+		AEAD_encrypt<AES256GCM>(MK.data(), lime::settings::DRMessageKeySize, // MK buffer also hold the IV
+			MK.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize, // IV is stored in the same buffer as key, after it
+			plaintext.data(), plaintext.size(),
+			AD.data(), AD.size(),
+			cipherMessage.data()+sender_key_protocol::headerSize()+plaintext.size(), lime::settings::DRMessageAuthTagSize, // directly store tag after cipher text in the output buffer
+			cipherMessage.data()+sender_key_protocol::headerSize());
+
+		// any recipient holds the chain key: sign the message so they can authenticate the sender
+		std::vector<uint8_t> signature{};
+		X3DHengine->sign(cipherMessage, signature);
+		cipherMessage.insert(cipherMessage.end(), signature.cbegin(), signature.cend());
+
+		if (newRecipients.empty()) {
+			return;
+		}
+
+		// distribute the chain: payload is encrypted directly in the DR messages, flagged as a distribution in their header, the AD binds it to the group
+		std::vector<uint8_t> groupId{m_groupId.cbegin(), m_groupId.cend()};
+		std::vector<uint8_t> unusedCipherMessage{};
+		try {
+			encryptMessage(newRecipients, distribution, groupId, sourceDeviceId, unusedCipherMessage, lime::EncryptionPolicy::DRMessage, m_localStorage, nullptr, lime::EncryptionCost{}, true);
+		} catch (BctbxException const &e) {
+			cleanBuffer(distribution.data(), distribution.size());
+			throw;
+		}
+		cleanBuffer(distribution.data(), distribution.size());
+
+		// the recipients peer devices are in local storage now, their DR session is saved
+		try {
+			std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+			transaction tr(m_localStorage->sql);
+			int curveId = static_cast<uint8_t>(Curve::curveId());
+			std::string deviceId{};
+			statement st = (m_localStorage->sql.prepare << "INSERT OR IGNORE INTO lime_SenderKeyRecipients(skId, Did) \
+						SELECT :skId, Did FROM lime_PeerDevices WHERE DeviceId = :deviceId AND curveId = :curveId AND Active = 1 LIMIT 1;", use(m_dbId), use(deviceId), use(curveId));
+			for (const auto &recipient : newRecipients) {
+				deviceId = recipient.deviceId;
+				st.execute(true);
+				m_recipients.insert(recipient.deviceId);
+			}
+			tr.commit();
+		} catch (exception const &e) {
+			throw BCTBX_EXCEPTION << "Cannot save sender chain recipients for group "<<m_groupId<<". DB backend says : "<<e.what();
+		}
+	}
+
+	/****************************************************************************/
+	/*                                                                          */
+	/* Receiving chains                                                         */
+	/*                                                                          */
+	/****************************************************************************/
+	/**
+	 * @brief Store a sender chain received from a peer device
+	 *
+	 * A chain already stored is not modified: its state may be ahead of the distributed one.
+	 *
+	 * @param[in]		localStorage	Local storage accessor
+	 * @param[in]		dbUid		the local user Id in local storage
+	 * @param[in]		senderDeviceId	the peer device Id(gruu), it shall already be in local storage as the distribution payload was decrypted by a DR session with it
+	 * @param[in]		groupId		the group Id the chain is used for
+	 * @param[in,out]	distribution	the distribution payload, it is cleaned
+	 *
+	 * @return false if the distribution payload is invalid
+	 */
+	template <typename Curve>
+	bool senderKey_storeReceivingChain(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution) {
+		if (distribution.size() != sender_key_protocol::distributionSize() || distribution[0] != sender_key_protocol::SK_v01) {
+			cleanBuffer(distribution.data(), distribution.size());
+			LIME_LOGE<<"Invalid sender chain distribution from "<<senderDeviceId;
+			return false;
+		}
+		int chainId = static_cast<int>(read_uint32(distribution.cbegin()+1));
+		int index = static_cast<int>(read_uint32(distribution.cbegin()+5));
+
+		std::lock_guard<std::recursive_mutex> lock(localStorage->m_db_mutex);
+		try {
+			transaction tr(localStorage->sql);
+			int curveId = static_cast<uint8_t>(Curve::curveId());
+			long int Did = 0;
+			localStorage->sql<<"SELECT Did FROM lime_PeerDevices WHERE DeviceId = :deviceId AND curveId = :curveId AND Active = 1 LIMIT 1;", into(Did), use(senderDeviceId), use(curveId);
+			if (!localStorage->sql.got_data()) {
+				cleanBuffer(distribution.data(), distribution.size());
+				LIME_LOGE<<"Sender chain distribution from unknown device "<<senderDeviceId;
+				return false;
+			}
+
+			long int skId = 0;
+			localStorage->sql<<"SELECT skId FROM lime_SenderKeys WHERE Uid = :Uid AND Did = :Did AND groupId = :groupId AND chainId = :chainId LIMIT 1;", into(skId), use(dbUid), use(Did), use(groupId), use(chainId);
+			if (!localStorage->sql.got_data()) {
+				blob CK(localStorage->sql);
+				CK.write(0, (char *)(distribution.data()+9), lime::settings::DRChainKeySize);
+				localStorage->sql<<"INSERT INTO lime_SenderKeys(Uid, Did, groupId, chainId, N, CK) VALUES(:Uid, :Did, :groupId, :chainId, :N, :CK);", use(dbUid), use(Did), use(groupId), use(chainId), use(index), use(CK);
+			}
+			tr.commit();
+		} catch (exception const &e) {
+			cleanBuffer(distribution.data(), distribution.size());
+			throw BCTBX_EXCEPTION << "Cannot store sender chain from "<<senderDeviceId<<" for group "<<groupId<<". DB backend says : "<<e.what();
+		}
+		cleanBuffer(distribution.data(), distribution.size());
+		return true;
+	}
+
+	/**
+	 * @brief Decrypt a sender key message
+	 *
+	 * The chain moves forward at most maxMessageSkip messages at once, keys of skipped messages are stored.
+	 * The sender key message with an index older than the chain one is decrypted only if its key was stored when skipped.
+	 *
+	 * @param[in]	localStorage	Local storage accessor
+	 * @param[in]	dbUid		the local user Id in local storage
+	 * @param[in]	senderDeviceId	the sender device Id(gruu)
+	 * @param[in]	groupId		the group Id: the recipientUserId given to decrypt
+	 * @param[in]	cipherMessage	the sender key message
+	 * @param[out]	plaintext	the decrypted message
+	 *
+	 * @return true on success, false if the message cannot be authenticated or no matching chain is found
+	 */
+	template <typename Curve>
+	bool senderKey_decrypt(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext) {
+		using Signature_t = DSA<typename Curve::EC, lime::DSAtype::signature>;
+		using Ik_t = DSA<typename Curve::EC, lime::DSAtype::publicKey>;
+		if (cipherMessage.size() < sender_key_protocol::messageOverhead<Curve>() || cipherMessage[0] != sender_key_protocol::SK_v01 || cipherMessage[1] != static_cast<uint8_t>(Curve::curveId())) {
+			LIME_LOGE<<"Invalid sender key message from "<<senderDeviceId;
+			return false;
+		}
+		int chainId = static_cast<int>(read_uint32(cipherMessage.cbegin()+2));
+		uint32_t index = read_uint32(cipherMessage.cbegin()+6);
+		const size_t signedSize = cipherMessage.size() - Signature_t::ssize();
+		const size_t plaintextSize = signedSize - sender_key_protocol::headerSize() - lime::settings::DRMessageAuthTagSize;
+
+		std::lock_guard<std::recursive_mutex> lock(localStorage->m_db_mutex);
+		// load the chain and the sender identity key
+		long int skId = 0;
+		int N = 0;
+		int curveId = static_cast<uint8_t>(Curve::curveId());
+		blob CK_blob(localStorage->sql);
+		blob Ik_blob(localStorage->sql);
+		localStorage->sql<<"SELECT s.skId, s.N, s.CK, d.Ik FROM lime_SenderKeys as s INNER JOIN lime_PeerDevices as d ON s.Did = d.Did \
+					WHERE s.Uid = :Uid AND s.groupId = :groupId AND s.chainId = :chainId AND d.DeviceId = :deviceId AND d.curveId = :curveId LIMIT 1;",
+				into(skId), into(N), into(CK_blob), into(Ik_blob), use(dbUid), use(groupId), use(chainId), use(senderDeviceId), use(curveId);
+		if (!localStorage->sql.got_data()) {
+			LIME_LOGE<<"Fail to decrypt: No sender chain "<<std::hex<<chainId<<" from "<<senderDeviceId<<" in group "<<groupId;
+			return false;
+		}
+
+		// authenticate the sender first, it does not need any key derivation
+		if (Ik_blob.get_len() != Ik_t::ssize()) {
+			LIME_LOGE<<"Fail to decrypt: invalid identity key for "<<senderDeviceId;
+			return false;
+		}
+		Ik_t peerIk{};
+		Ik_blob.read(0, (char *)(peerIk.data()), peerIk.size());
+		auto IkVerify = make_Signature<typename Curve::EC>();
+		IkVerify->set_public(peerIk);
+		if (!IkVerify->verify(cipherMessage.data(), signedSize, Signature_t(cipherMessage.cbegin()+signedSize))) {
+			LIME_LOGE<<"Fail to decrypt: invalid signature on sender key message from "<<senderDeviceId;
+			return false;
+		}
+
+		// get the message key: derive it from the chain or get it from the skipped ones
+		DRMKey MK;
+		DRChainKey CK;
+		std::vector<std::pair<uint32_t, DRMKey>> skippedMK{};
+		const uint32_t chainIndex = static_cast<uint32_t>(N);
+		if (index >= chainIndex) {
+			if (index - chainIndex > lime::settings::maxMessageSkip) {
+				LIME_LOGE<<"Fail to decrypt: too many skipped messages on sender chain from "<<senderDeviceId;
+				return false;
+			}
+			CK_blob.read(0, (char *)(CK.data()), CK.size());
+			skippedMK.reserve(index - chainIndex);
+			for (uint32_t i = chainIndex; i < index; i++) {
+				skippedMK.emplace_back(i, DRMKey{});
+				KDF_SCK(CK, skippedMK.back().second, i);
+			}
+			KDF_SCK(CK, MK, index);
+		} else {
+			blob MK_blob(localStorage->sql);
+			int skippedIndex = static_cast<int>(index);
+			localStorage->sql<<"SELECT MK FROM lime_SenderKeyMSk WHERE skId = :skId AND N = :N LIMIT 1;", into(MK_blob), use(skId), use(skippedIndex);
+			if (!localStorage->sql.got_data()) {
+				LIME_LOGE<<"Fail to decrypt: sender key message "<<index<<" from "<<senderDeviceId<<" already decrypted or too old";
+				return false;
+			}
+			MK_blob.read(0, (char *)(MK.data()), MK.size());
+		}
+
+		auto AD = messageAD(cipherMessage, senderDeviceId, groupId);
+		plaintext.resize(plaintextSize);
+		bool decrypted = AEAD_decrypt<AES256GCM>(MK.data(), lime::settings::DRMessageKeySize, // MK buffer hold key<DRMessageKeySize bytes> || IV<DRMessageIVSize bytes>
+				MK.data()+lime::settings::DRMessageKeySize, lime::settings::DRMessageIVSize,
+				cipherMessage.data()+sender_key_protocol::headerSize(), plaintextSize,
+				AD.data(), AD.size(),
+				cipherMessage.data()+sender_key_protocol::headerSize()+plaintextSize, lime::settings::DRMessageAuthTagSize,
+				plaintext.data());
+		if (!decrypted) {
+			plaintext.clear();
+			LIME_LOGE<<"Fail to decrypt: sender key message from "<<senderDeviceId<<" authentication failed";
+			return false;
+		}
+
+		// the message is authentic, update the chain
+		try {
+			transaction tr(localStorage->sql);
+			if (index >= chainIndex) {
+				blob newCK(localStorage->sql);
+				newCK.write(0, (char *)(CK.data()), CK.size());
+				int newN = static_cast<int>(index + 1);
+				localStorage->sql<<"UPDATE lime_SenderKeys SET N = :N, CK = :CK, timeStamp = CURRENT_TIMESTAMP WHERE skId = :skId;", use(newN), use(newCK), use(skId);
+				if (!skippedMK.empty()) {
+					int skippedIndex = 0;
+					blob MK_blob(localStorage->sql);
+					statement st = (localStorage->sql.prepare << "INSERT INTO lime_SenderKeyMSk(skId, N, MK) VALUES(:skId, :N, :MK);", use(skId), use(skippedIndex), use(MK_blob));
+					for (auto &skipped : skippedMK) {
+						skippedIndex = static_cast<int>(skipped.first);
+						MK_blob.write(0, (char *)(skipped.second.data()), skipped.second.size());
+						st.execute(true);
+					}
+				}
+				// keep only the keys of the last maxMessageSkip messages
+				int oldestN = newN - static_cast<int>(lime::settings::maxMessageSkip);
+				localStorage->sql<<"DELETE FROM lime_SenderKeyMSk WHERE skId = :skId AND N < :oldestN;", use(skId), use(oldestN);
+			} else {
+				int skippedIndex = static_cast<int>(index);
+				localStorage->sql<<"DELETE FROM lime_SenderKeyMSk WHERE skId = :skId AND N = :N;", use(skId), use(skippedIndex);
+				localStorage->sql<<"UPDATE lime_SenderKeys SET timeStamp = CURRENT_TIMESTAMP WHERE skId = :skId;", use(skId);
+			}
+			tr.commit();
+		} catch (exception const &e) {
+			plaintext.clear();
+			throw BCTBX_EXCEPTION << "Cannot update sender chain from "<<senderDeviceId<<" for group "<<groupId<<". DB backend says : "<<e.what();
+		}
+		return true;
+	}
+
+	/* Instanciate templated classes and functions */
+#ifdef EC25519_ENABLED
+	template class SenderKeySendingChain<C255>;
+	template bool senderKey_storeReceivingChain<C255>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	template bool senderKey_decrypt<C255>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#ifdef EC448_ENABLED
+	template class SenderKeySendingChain<C448>;
+	template bool senderKey_storeReceivingChain<C448>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	template bool senderKey_decrypt<C448>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	template class SenderKeySendingChain<C255K512>;
+	template bool senderKey_storeReceivingChain<C255K512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	template bool senderKey_decrypt<C255K512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+	template class SenderKeySendingChain<C255MLK512>;
+	template bool senderKey_storeReceivingChain<C255MLK512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	template bool senderKey_decrypt<C255MLK512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#ifdef EC448_ENABLED
+	template class SenderKeySendingChain<C448MLK1024>;
+	template bool senderKey_storeReceivingChain<C448MLK1024>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	template bool senderKey_decrypt<C448MLK1024>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#endif //HAVE_BCTBXPQ
+}
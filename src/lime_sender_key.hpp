@@ -0,0 +1,131 @@
+/*
+	lime_sender_key.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef lime_sender_key_hpp
+#define lime_sender_key_hpp
+
+#include <unordered_set>
+#include "lime_crypto_primitives.hpp"
+#include "lime_localStorage.hpp"
+#include "lime_double_ratchet.hpp"
+
+namespace lime {
+	class X3DH;
+
+	namespace sender_key_protocol {
+		/** Sender key protocol version number */
+		constexpr uint8_t SK_v01=0x01;
+
+		/**
+		 * @brief return the size of the sender key message header
+		 *
+		 * header is: Protocol Version Number<1 byte> || curveId <1 byte> || chain Id<4 bytes> || message index<4 bytes>
+		 *
+		 * @return	the header size
+		 */
+		constexpr size_t headerSize(void) noexcept {return 10;}
+
+		/**
+		 * @brief return the size of the sender chain distribution payload, sent to each new recipient encrypted in a DR message
+		 *
+		 * payload is: Protocol Version Number<1 byte> || chain Id<4 bytes> || chain index<4 bytes> || chain key<DRChainKeySize bytes>
+		 *
+		 * @return	the distribution payload size
+		 */
+		constexpr size_t distributionSize(void) noexcept {return 9 + lime::settings::DRChainKeySize;}
+
+		/**
+		 * @brief return the size of the sender key message without the payload
+		 *
+		 * message is: header || encrypted payload || authentication tag<DRMessageAuthTagSize bytes> || signature by the sender identity key
+		 *
+		 * @return	the sender key message overhead
+		 */
+		template <typename Curve>
+		constexpr size_t messageOverhead(void) noexcept {return headerSize() + lime::settings::DRMessageAuthTagSize + DSA<typename Curve::EC, lime::DSAtype::signature>::ssize();}
+
+		bool parseMessage_get_curveId(const std::vector<uint8_t> &message, lime::CurveId &curveId) noexcept;
+	} // namespace sender_key_protocol
+
+	/**
+	 * @brief Our sending chain for a group in sender key mode
+	 *
+	 * The group messages are encrypted once with a message key derived from the chain. The chain state is distributed, encrypted by the
+	 * pairwise DR sessions, to recipients not holding it yet. A new chain is generated when a device holding the current one is not a
+	 * recipient anymore or when the current one reaches the maximum sending chain length.
+	 * The DR message carrying the chain is flagged in its header. A recipient missing it fails to decrypt the group messages: it recovers
+	 * when the sender generates a new chain, which is distributed again to all the recipients.
+	 * Messages are signed with the sender identity key: the chain key is shared by all the recipients, it does not authenticate the sender.
+	 *
+	 * @tparam Curve	The base algorithm in use, its elliptic curve identity key signs the messages
+	 */
+	template <typename Curve>
+	class SenderKeySendingChain {
+		private:
+			std::shared_ptr<lime::Db> m_localStorage; // local storage holding the chain
+			long int m_dbUid; // the local user in local storage
+			std::string m_groupId; // the group using this chain
+			long int m_dbId; // the chain Id in local storage, 0 when the chain was generated and not saved yet
+			uint32_t m_chainId; // public random Id of the chain
+			uint32_t m_index; // index of the next message key
+			DRChainKey m_CK; // chain key at index m_index
+			std::unordered_set<std::string> m_recipients; // the peer devices holding this chain
+
+		public:
+			SenderKeySendingChain(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &groupId, const std::vector<RecipientData> &recipients);
+			SenderKeySendingChain(SenderKeySendingChain<Curve> &a) = delete; // can't copy a chain
+			SenderKeySendingChain<Curve> &operator=(SenderKeySendingChain<Curve> &a) = delete; // can't copy a chain
+
+			/// @return true if the given peer device already holds this chain
+			bool isDistributed(const std::string &deviceId) const {return m_recipients.count(deviceId) > 0;}
+			void encrypt(const std::vector<uint8_t> &plaintext, const std::string &sourceDeviceId, std::shared_ptr<X3DH> X3DHengine, std::vector<uint8_t> &cipherMessage, std::vector<RecipientInfos> &newRecipients);
+	};
+
+	template <typename Curve>
+	bool senderKey_storeReceivingChain(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	template <typename Curve>
+	bool senderKey_decrypt(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+
+	/* this templates are instanciated once in the lime_sender_key.cpp file, explicitly tell anyone including this header that there is no need to re-instanciate them */
+#ifdef EC25519_ENABLED
+	extern template class SenderKeySendingChain<C255>;
+	extern template bool senderKey_storeReceivingChain<C255>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	extern template bool senderKey_decrypt<C255>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#ifdef EC448_ENABLED
+	extern template class SenderKeySendingChain<C448>;
+	extern template bool senderKey_storeReceivingChain<C448>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	extern template bool senderKey_decrypt<C448>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	extern template class SenderKeySendingChain<C255K512>;
+	extern template bool senderKey_storeReceivingChain<C255K512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	extern template bool senderKey_decrypt<C255K512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+	extern template class SenderKeySendingChain<C255MLK512>;
+	extern template bool senderKey_storeReceivingChain<C255MLK512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	extern template bool senderKey_decrypt<C255MLK512>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#ifdef EC448_ENABLED
+	extern template class SenderKeySendingChain<C448MLK1024>;
+	extern template bool senderKey_storeReceivingChain<C448MLK1024>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, std::vector<uint8_t> &distribution);
+	extern template bool senderKey_decrypt<C448MLK1024>(std::shared_ptr<lime::Db> localStorage, const long int dbUid, const std::string &senderDeviceId, const std::string &groupId, const std::vector<uint8_t> &cipherMessage, std::vector<uint8_t> &plaintext);
+#endif
+#endif //HAVE_BCTBXPQ
+}
+
+#endif /* lime_sender_key_hpp */
@@ -73,6 +73,20 @@ namespace settings {
 	/** Lifetime of a session once not active anymore, unit is day */
 	constexpr unsigned int DRSession_limboTime_days=30;
 
+	/** @brief Payload compression settings, used only when the library is built with ENABLE_COMPRESSION
+	 *
+	 * The payload is compressed(raw deflate) before encryption when all the recipients advertised they can decompress it
+	 * and when it actually gets shorter.
+	 * @note : the compressed size depends on the plaintext content. When an attacker can inject chosen data in a payload also holding
+	 * a secret and observe the encrypted size, it may guess the secret(CRIME/BREACH like attacks). Do not enable it in this case.
+	 * - compression_threshold : in bytes, shorter payloads are not compressed
+	 * - compression_level : zlib compression level, 1(fast) to 9(best)
+	 * - compression_maxPayloadSize : in bytes, a received payload decompressing into more than this is rejected(decompression bomb)
+	 */
+	constexpr size_t compression_threshold=128;
+	constexpr int compression_level=6;
+	constexpr size_t compression_maxPayloadSize=1024*1024; // 1 MB
+
 /******************************************************************************/
 /*                                                                            */
 /* X3DH related definitions                                                   */
@@ -95,6 +109,56 @@ namespace settings {
 	/// in seconds, how often should we perform an update (check if we should publish new OPk, cleaning DB routine etc...)
 	constexpr unsigned int OPk_updatePeriod=86400; // 1 day
 
+	/// maximum number of peer devices requested in one getPeerBundles message at encryption, bigger requests are split in chunks sent concurrently
+	constexpr uint16_t X3DH_peerBundlesChunkSize = 100;
+	static_assert(X3DH_peerBundlesChunkSize > 0, "Peer bundles requests cannot be split in empty chunks");
+
+	/// default maximum number of peer devices a session prefetch requests a key bundle for: each of them may consume one of the peer device OPks on the X3DH server
+	/// Note: can be overriden by call parameter when prefetching
+	constexpr uint16_t prefetch_OPkBudget = 100;
+	/// number of peer devices requested in one getPeerBundles message when prefetching sessions
+	constexpr uint16_t prefetch_chunkSize = 25;
+	/// in days, how long shall we keep a prefetched session never used to encrypt a message
+	constexpr unsigned int prefetch_sessionLifeTime_days=14;
+
+	static_assert(prefetch_sessionLifeTime_days < OPk_limboTime_days, "A prefetched session must expire before the peer device deletes the pre-keys used to build it");
+	static_assert(prefetch_chunkSize > 0, "Sessions prefetch cannot request empty chunks of peer devices");
+
+/******************************************************************************/
+/*                                                                            */
+/* Cache warmer related definitions                                           */
+/*                                                                            */
+/******************************************************************************/
+	// Note: the two following values can be overriden by call parameters when warming the cache
+	/// default maximum number of DR sessions, the most recently active ones, loaded in cache by the cache warmer
+	constexpr uint16_t cacheWarmer_maxSessions = 500;
+	/// in bytes, default memory budget of the cache warmer: it stops once the users and sessions it loaded reach it
+	constexpr size_t cacheWarmer_memoryBudget = 4*1024*1024; // 4 MB
+	/// in bytes, estimated memory used by a local user in cache: Lime and X3DH engine objects, identity key and a few signed pre-keys
+	constexpr size_t cacheWarmer_userFootprint = 4096;
+
+/******************************************************************************/
+/*                                                                            */
+/* Sender key related definitions                                             */
+/*                                                                            */
+/******************************************************************************/
+	/** @brief Maximum length of a sender key sending chain
+	 *
+	 * when this count is reached, a new sending chain is generated and distributed to all the group members
+	 * it bounds the number of messages exposed by a leaked chain key
+	 */
+	constexpr uint32_t senderKey_maxSendingChain=1000;
+	/// in days, how long shall we keep a sender key receiving chain not used to decrypt any message
+	constexpr unsigned int senderKey_limboTime_days=30;
+
+/******************************************************************************/
+/*                                                                            */
+/* Local storage related definitions                                          */
+/*                                                                            */
+/******************************************************************************/
+	/// number of execution times kept per SQL statement by the local storage profiler to compute the percentiles: the most recent ones
+	constexpr size_t DbProfiler_maxSamples = 1024;
+
 } // namespace settings
 
 } // namespace lime
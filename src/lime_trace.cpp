@@ -0,0 +1,116 @@
+/*
+	lime_trace.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime_trace.hpp"
+#include <exception>
+
+namespace lime {
+namespace trace {
+	std::atomic<bool> tracerInstalled{false};
+
+	namespace {
+		std::shared_ptr<Tracer> installedTracer{nullptr}; // accessed through std::atomic_load/atomic_store only
+		thread_local SpanId current{0};
+	}
+
+	/**
+	 * @brief Install the tracer
+	 *
+	 * @param[in]	tracer	the tracer, nullptr to remove the current one
+	 */
+	void setTracer(std::shared_ptr<Tracer> tracer) {
+		const bool installed = (tracer != nullptr);
+		std::atomic_store(&installedTracer, std::move(tracer));
+		tracerInstalled.store(installed, std::memory_order_relaxed);
+	}
+
+	SpanId currentSpan(void) noexcept {
+		return current;
+	}
+
+	/* Span: the tracer is user code, its failures are logged and ignored, they shall not fail the traced operation */
+	Span::Span(const char *name, const SpanId parent) noexcept : m_tracer{nullptr}, m_id{0} {
+		if (!active()) return;
+		auto tracer = std::atomic_load(&installedTracer);
+		if (tracer == nullptr) return;
+		try {
+			m_id = tracer->startSpan(name, parent);
+		} catch (std::exception const &e) {
+			LIME_LOGW<<"Tracer failed to start span "<<name<<": "<<e.what();
+		}
+		if (m_id != 0) {
+			m_tracer = std::move(tracer);
+		}
+	}
+
+	Span::~Span() {
+		end(false); // does nothing when already ended
+	}
+
+	void Span::setAttributeValue(const char *key, Tracer::AttributeValue &&value) noexcept {
+		try {
+			m_tracer->setAttribute(m_id, key, value);
+		} catch (std::exception const &e) {
+			LIME_LOGW<<"Tracer failed to set attribute "<<key<<": "<<e.what();
+		}
+	}
+
+	/**
+	 * @brief End the span, it is not traced anymore afterward
+	 *
+	 * @param[in]	success	false if the operation failed
+	 */
+	void Span::end(const bool success) noexcept {
+		if (m_tracer == nullptr) return;
+		try {
+			m_tracer->endSpan(m_id, success);
+		} catch (std::exception const &e) {
+			LIME_LOGW<<"Tracer failed to end span: "<<e.what();
+		}
+		m_tracer = nullptr;
+	}
+
+	/* ScopedSpan */
+	ScopedSpan::ScopedSpan(const char *name, const SpanId parent) noexcept : Span(name, parent), m_previous{current}, m_uncaughtExceptions{std::uncaught_exceptions()}, m_success{true} {
+		if (m_tracer) {
+			current = m_id;
+		}
+	}
+
+	ScopedSpan::~ScopedSpan() {
+		if (m_tracer) {
+			current = m_previous;
+			end(m_success && std::uncaught_exceptions() == m_uncaughtExceptions);
+		}
+	}
+
+	/* Scope */
+	Scope::Scope(const SpanId span) noexcept : m_previous{current}, m_set{span != 0} {
+		if (m_set) {
+			current = span;
+		}
+	}
+
+	Scope::~Scope() {
+		if (m_set) {
+			current = m_previous;
+		}
+	}
+} // namespace trace
+} // namespace lime
@@ -0,0 +1,112 @@
+/*
+	lime_trace.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef lime_trace_hpp
+#define lime_trace_hpp
+
+#include "lime/lime.hpp"
+#include <atomic>
+#include <type_traits>
+
+namespace lime {
+	/** @brief Spans forwarded to the tracer installed by LimeManager::set_tracer
+	 *
+	 * Each thread holds a current span: the parent of the spans started on this thread.
+	 * When no tracer is installed, a span is a relaxed atomic load: attributes costly to compute shall be guarded by a test on the span.
+	 */
+	namespace trace {
+		using SpanId = Tracer::SpanId;
+
+		extern std::atomic<bool> tracerInstalled;
+		/// @return true when a tracer is installed
+		inline bool active(void) noexcept {return tracerInstalled.load(std::memory_order_relaxed);}
+		void setTracer(std::shared_ptr<Tracer> tracer);
+		/// @return the current span on this thread, 0 if none
+		SpanId currentSpan(void) noexcept;
+
+		/// @cond Attributes values conversion
+		inline Tracer::AttributeValue attributeValue(const bool value) {return value;}
+		inline Tracer::AttributeValue attributeValue(const std::string &value) {return value;}
+		inline Tracer::AttributeValue attributeValue(const char *value) {return std::string{value};}
+		template <typename T, std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>, bool> = true>
+		Tracer::AttributeValue attributeValue(const T value) {return static_cast<int64_t>(value);}
+		/// @endcond
+
+		/**
+		 * @brief A span ended explicitly, used for asynchronous operations: it is not the current span of any thread
+		 *
+		 * If it is destroyed before being ended, it ends as failed
+		 */
+		class Span {
+			protected:
+				std::shared_ptr<Tracer> m_tracer; /**< the tracer installed when the span started, nullptr if none or when the span has ended */
+				SpanId m_id; /**< given by the tracer */
+				void setAttributeValue(const char *key, Tracer::AttributeValue &&value) noexcept;
+			public:
+				Span(const char *name, const SpanId parent) noexcept;
+				Span(const Span &) = delete;
+				Span &operator=(const Span &) = delete;
+				virtual ~Span();
+
+				/// @return this span identifier, 0 when not traced
+				SpanId id(void) const noexcept {return m_tracer?m_id:0;}
+				/// @return true if this span is traced
+				explicit operator bool() const noexcept {return m_tracer != nullptr;}
+				/// set an attribute, does nothing if this span is not traced
+				template <typename T>
+				void setAttribute(const char *key, const T &value) noexcept {
+					if (m_tracer) setAttributeValue(key, attributeValue(value));
+				}
+				void end(const bool success) noexcept;
+		};
+
+		/**
+		 * @brief A span living in a scope: it is the current span of the thread creating it until its destruction
+		 *
+		 * It ends at destruction, as failed if an exception is propagating or setStatus(false) was called
+		 */
+		class ScopedSpan : public Span {
+			private:
+				SpanId m_previous; /**< the current span when this one started, restored at destruction */
+				int m_uncaughtExceptions;
+				bool m_success;
+			public:
+				explicit ScopedSpan(const char *name) noexcept : ScopedSpan(name, currentSpan()) {};
+				ScopedSpan(const char *name, const SpanId parent) noexcept;
+				~ScopedSpan();
+				void setStatus(const bool success) noexcept {m_success = success;}
+		};
+
+		/**
+		 * @brief Make a span the current one on this thread during a scope, without starting a new one
+		 *
+		 * Used to resume an asynchronous operation: the spans started in the scope are its children
+		 */
+		class Scope {
+			private:
+				SpanId m_previous;
+				bool m_set;
+			public:
+				explicit Scope(const SpanId span) noexcept;
+				Scope(const Scope &) = delete;
+				Scope &operator=(const Scope &) = delete;
+				~Scope();
+		};
+	} // namespace trace
+} // namespace lime
+
+#endif /* lime_trace_hpp */
@@ -27,7 +27,10 @@
 #include "lime_x3dh_protocol.hpp"
 #include "bctoolbox/exception.hh"
 #include "lime_crypto_primitives.hpp"
+#include "lime_metrics.hpp"
+#include "lime_trace.hpp"
 #include <set>
+#include <map>
 
 using namespace::std;
 using namespace::soci;
@@ -57,9 +60,18 @@ namespace lime {
 			/* X3DH keys */
 			DSApair<typename Curve::EC> m_Ik; // our identity key pair, is loaded from DB only if requested(to sign a SPK or to perform X3DH init)
 			bool m_Ik_loaded; // did we load the Ik yet?
+			// our active and limbo SPks, indexed by SPk Id. Filled when they are generated or first read from storage, so X3DH init messages do
+			// not need to read them again. Reset to the new active SPk on rotation. SPks are deleted from storage only by Db::clean_SPk, the cache
+			// drops them when the storage clean count differs from m_SPkCacheCleanCount. Accessed under the localStorage mutex only
+			std::map<uint32_t, SignedPreKey<Curve>> m_SPkCache;
+			uint64_t m_SPkCacheCleanCount;
+			// OPk look up prepared statement and its bound variables, built on first use and executed for each X3DH init message holding an OPk id
+			std::unique_ptr<blob> m_OPkLookup_blob;
+			uint32_t m_OPkLookup_id;
+			std::unique_ptr<statement> m_OPkLookup;
 			void load_SelfIdentityKey(void) {
+				std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex); // lock before checking the flag: concurrent decryptions may need it
 				if (m_Ik_loaded == false) {
-					std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
 					blob Ik_blob(m_localStorage->sql);
 					m_localStorage->sql<<"SELECT Ik FROM lime_LocalUsers WHERE Uid = :UserId LIMIT 1;", into(Ik_blob), use(m_db_Uid);
 					if (m_localStorage->sql.got_data()) { // Found it, it is stored in one buffer Public || Private
@@ -93,6 +105,7 @@ namespace lime {
 						sBuffer<SignedPreKey<Curve>::serializedSize()> serializedSPk{};
 						SPk_blob.read(0, (char *)(serializedSPk.data()), SignedPreKey<Curve>::serializedSize());
 						SignedPreKey<Curve> s(serializedSPk, SPkId);
+						m_SPkCache.emplace(SPkId, s);
 						// Sign the public key with our identity key
 						auto SPkSign = make_Signature<Curve>();
 						SPkSign->set_public(m_Ik.cpublicKey());
@@ -145,6 +158,9 @@ namespace lime {
 				} catch (exception const &e) {
 					throw BCTBX_EXCEPTION << "SPK insertion in DB failed. DB backend says : "<<e.what();
 				}
+				// previous SPk is now in limbo: drop it from cache, it is read again from storage if a peer still uses it
+				m_SPkCache.clear();
+				m_SPkCache.emplace(SPkId, s);
 				return s;
 			}
 			template<typename Curve_ = Curve, std::enable_if_t<std::is_base_of_v<genericKEM, Curve_>, bool> = true>
@@ -161,6 +177,7 @@ namespace lime {
 						sBuffer<SignedPreKey<Curve>::serializedSize()> serializedSPk{};
 						SPk_blob.read(0, (char *)(serializedSPk.data()), SignedPreKey<Curve>::serializedSize());
 						SignedPreKey<Curve> s(serializedSPk, SPkId);
+						m_SPkCache.emplace(SPkId, s);
 						// Sign the public key with our identity key
 						auto SPkSign = make_Signature<typename Curve::EC>();
 						SPkSign->set_public(m_Ik.cpublicKey());
@@ -217,6 +234,9 @@ namespace lime {
 				} catch (exception const &e) {
 					throw BCTBX_EXCEPTION << "SPK insertion in DB failed. DB backend says : "<<e.what();
 				}
+				// previous SPk is now in limbo: drop it from cache, it is read again from storage if a peer still uses it
+				m_SPkCache.clear();
+				m_SPkCache.emplace(SPkId, s);
 				return s;
 			}
 
@@ -403,23 +423,18 @@ namespace lime {
 			*/
 			void updateOPkStatus(const std::vector<uint32_t> &OPkIds) {
 				std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
-				if (OPkIds.size()>0) { /* we have keys on server */
-					// build a comma-separated list of OPk id on server
-					std::string sqlString_OPkIds{""};
-					for (const auto &OPkId : OPkIds) {
-						sqlString_OPkIds.append(to_string(OPkId)).append(",");
-					}
+				transaction tr(m_localStorage->sql);
 
-					sqlString_OPkIds.pop_back(); // remove the last ','
+				// load the OPk ids found on server in an indexed temporary table (it may be empty if we have no keys on server)
+				m_localStorage->load_tmpOPkIds(OPkIds);
 
-					// Update Status and timeStamp in DB for keys we own and are not anymore on server
-					m_localStorage->sql << "UPDATE X3DH_OPK SET Status = 0, timeStamp=CURRENT_TIMESTAMP WHERE Status = 1 AND Uid = :Uid AND OPKid NOT IN ("<<sqlString_OPkIds<<");", use(m_db_Uid);
-				} else { /* we have no keys on server */
-					m_localStorage->sql << "UPDATE X3DH_OPK SET Status = 0, timeStamp=CURRENT_TIMESTAMP WHERE Status = 1 AND Uid = :Uid;", use(m_db_Uid);
-				}
+				// Update Status and timeStamp in DB for keys we own and are not anymore on server
+				m_localStorage->sql << "UPDATE X3DH_OPK SET Status = 0, timeStamp=CURRENT_TIMESTAMP WHERE Status = 1 AND Uid = :Uid \
+							AND NOT EXISTS (SELECT 1 FROM lime_tmpOPkIds as t WHERE t.OPKid = X3DH_OPK.OPKid);", use(m_db_Uid);
 
 				// Delete keys not anymore on server since too long
 				m_localStorage->sql << "DELETE FROM X3DH_OPK WHERE Uid = :Uid AND Status = 0 AND timeStamp < date('now', '-"<<lime::settings::OPk_limboTime_days<<" day');", use(m_db_Uid);
+				tr.commit();
 			}
 
 			/**
@@ -480,6 +495,11 @@ namespace lime {
 			* @param[in]		responseBody	a vector holding the actual response from server to be processed
 			*/
 			void process_response(std::shared_ptr<Lime<Curve>> limeObj, std::shared_ptr<callbackUserData> userData, int responseCode, const std::vector<uint8_t> &responseBody) {
+				if (userData->bundlesFetch != nullptr) { // this is one chunk of a peer bundles request, it has its own failure management
+					process_peerBundlesChunk(limeObj, userData, responseCode, responseBody);
+					return;
+				}
+
 				auto callback = userData->callback; // get callback
 				bool hasCallback = (callback != nullptr && *callback != nullptr);
 
@@ -532,6 +552,32 @@ namespace lime {
 								return;
 							}
 
+							// this is a sessions prefetch: build and store the sessions then request the next chunk of peer devices, if any
+							if (userData->prefetchContext != nullptr) {
+								auto prefetchContext = userData->prefetchContext;
+								try {
+									init_sender_session(limeObj, peersBundle, prefetchContext);
+								} catch (BctbxException &e) {
+									if (hasCallback) (*callback)(lime::CallbackReturn::fail, std::string{"Error during the peer Bundle processing : "}.append(e.str()));
+									cleanUserData(limeObj, userData);
+									return;
+								} catch (exception const &e) {
+									if (hasCallback) (*callback)(lime::CallbackReturn::fail, std::string{"Error during the peer Bundle processing : "}.append(e.what()));
+									cleanUserData(limeObj, userData);
+									return;
+								}
+
+								auto chunk = prefetchContext->nextChunk();
+								if (chunk.empty()) {
+									LIME_LOGI<<"User "<<m_selfDeviceId<<" prefetch completed: "<<prefetchContext->report();
+									if (hasCallback) (*callback)(lime::CallbackReturn::success, prefetchContext->report());
+									cleanUserData(limeObj, userData);
+								} else {
+									fetch_peerBundles(userData, chunk);
+								}
+								return;
+							}
+
 							// generate X3DH init packets, create a store DR Sessions(in Lime obj cache, they'll be stored in DB when the first encryption will occurs)
 							try {
 								//Note: if while we were waiting for the peer bundle we did get an init message from him and created a session
@@ -602,6 +648,7 @@ namespace lime {
 								generate_OPks(OPks, std::max(userData->OPkBatchSize, static_cast<uint16_t>(userData->OPkServerLowLimit - selfOPkIds.size())) );
 								std::vector<uint8_t> X3DHmessage{};
 								x3dh_protocol::buildMessage_publishOPks(X3DHmessage, OPks);
+								LIME_METRICS_COUNT_N(OPkUploaded, OPks.size());
 								postToX3DHServer(userData, std::move(X3DHmessage));
 							} else { /* nothing to do, just call the callback */
 								if (hasCallback) (*callback)(lime::CallbackReturn::success, "");
@@ -651,6 +698,100 @@ namespace lime {
 				}
 			}
 
+			/**
+			* @brief process the response to one chunk of a peer bundles request issued by an encryption
+			*
+			* A failing chunk does not fail the encryption: the peer devices requested in it are set to fail and the others are processed.
+			* Sessions are built as soon as the chunk arrives, the encryption is resumed when the last chunk is processed.
+			*
+			* @param[in]		limeObj		The lime object linked to this reponse
+			* @param[in,out]	userData	the structure holding this chunk data
+			* @param[in]		reponseCode	response from X3DH server, we expect a 200
+			* @param[in]		responseBody	a vector holding the actual response from server to be processed
+			*/
+			void process_peerBundlesChunk(std::shared_ptr<Lime<Curve>> limeObj, std::shared_ptr<callbackUserData> userData, int responseCode, const std::vector<uint8_t> &responseBody) {
+				std::vector<X3DH_peerBundle<Curve>> peersBundle;
+				bool chunkFailed = true;
+				if (responseCode == 200) {
+					lime::x3dh_protocol::x3dh_message_type message_type{x3dh_protocol::x3dh_message_type::error};
+					lime::x3dh_protocol::x3dh_error_code error_code{x3dh_protocol::x3dh_error_code::unset_error_code};
+					// do not give the callback to the parser: a chunk failure must not end the encryption
+					if (x3dh_protocol::parseMessage_getType<Curve>(responseBody, message_type, error_code, nullptr)
+							&& message_type == x3dh_protocol::x3dh_message_type::peerBundle
+							&& x3dh_protocol::parseMessage_getPeerBundles(responseBody, peersBundle)) {
+						try {
+							init_sender_session(limeObj, peersBundle);
+							chunkFailed = false;
+						} catch (BctbxException &e) {
+							LIME_LOGE<<"Error during the peer Bundle processing : "<<e.str();
+						} catch (exception const &e) {
+							LIME_LOGE<<"Error during the peer Bundle processing : "<<e.what();
+						}
+					}
+				} else {
+					LIME_LOGE<<"Got a non Ok response from server : "<<responseCode;
+				}
+
+				// set to fail the recipients we could not get a session with: all the chunk if it failed, the ones without key bundle on server otherwise
+				std::set<std::string> failedDevices{};
+				if (chunkFailed) {
+					LIME_LOGE<<"User "<<m_selfDeviceId<<" failed to get key bundles for "<<userData->requestedDevices.size()<<" peer devices";
+					failedDevices.insert(userData->requestedDevices.cbegin(), userData->requestedDevices.cend());
+				} else {
+					for (const auto &peerBundle:peersBundle) {
+						if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::noBundle) {
+							failedDevices.insert(peerBundle.deviceId);
+						}
+					}
+				}
+
+				std::unique_lock<std::mutex> lock(userData->bundlesFetch->mutex);
+				for (auto &recipient:userData->encryptionContext->m_recipients) {
+					if (failedDevices.count(recipient.deviceId) > 0) {
+						recipient.peerStatus = lime::PeerDeviceStatus::fail;
+					}
+				}
+				if (--(userData->bundlesFetch->pendingChunks) > 0) { // other chunks are still expected, the last one will resume the encryption
+					return;
+				}
+				lock.unlock();
+
+				// call the encrypt function again, it will call the callback when done
+				auto callback = userData->callback;
+				bool hasCallback = (callback != nullptr && *callback != nullptr);
+				try {
+					limeObj->encrypt(userData->encryptionContext, callback, userData->randomSeedCallback);
+				} catch (BctbxException &e) { // something went wrong, go for callback as this function may be called by code not supporting exceptions
+					if (hasCallback) (*callback)(lime::CallbackReturn::fail, std::string{"Error during the encryption after the peer Bundle processing : "}.append(e.str()));
+				} catch (exception const &e) {
+					if (hasCallback) (*callback)(lime::CallbackReturn::fail, std::string{"Error during the encryption after the peer Bundle processing : "}.append(e.what()));
+				}
+
+				// now we can safely delete the user data, note that this may trigger an other encryption if there is one in queue
+				cleanUserData(limeObj, userData);
+			}
+
+			/**
+			* @brief drop from the SPk cache the SPks deleted from localStorage by Db::clean_SPk
+			*/
+			void sync_SPkCache(void) {
+				std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+				m_SPkCacheCleanCount = m_localStorage->m_SPkCleanCount;
+				if (m_SPkCache.empty()) return;
+				std::set<uint32_t> storedSPkIds{};
+				rowset<row> rs = (m_localStorage->sql.prepare << "SELECT SPKid FROM X3DH_SPK WHERE Uid = :Uid;", use(m_db_Uid));
+				for (const auto &r : rs) {
+					storedSPkIds.insert(static_cast<uint32_t>(r.get<int>(0)));
+				}
+				for (auto it = m_SPkCache.begin(); it != m_SPkCache.end();) {
+					if (storedSPkIds.count(it->first) == 0) {
+						it = m_SPkCache.erase(it);
+					} else {
+						++it;
+					}
+				}
+			}
+
 			/**
 			* @brief retrieve matching SPk from localStorage, throw an exception if not found
 			*
@@ -659,12 +800,19 @@ namespace lime {
 			*/
 			SignedPreKey<Curve> get_SPk(uint32_t SPk_id) {
 				std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
+				if (m_SPkCacheCleanCount != m_localStorage->m_SPkCleanCount) { // Db::clean_SPk deleted some SPks since the cache was checked
+					sync_SPkCache();
+				}
+				auto cachedSPk = m_SPkCache.find(SPk_id);
+				if (cachedSPk != m_SPkCache.end()) {
+					return cachedSPk->second;
+				}
 				blob SPk_blob(m_localStorage->sql);
 				m_localStorage->sql<<"SELECT SPk FROM X3DH_SPk WHERE Uid = :Uid AND SPKid = :SPk_id LIMIT 1;", into(SPk_blob), use(m_db_Uid), use(SPk_id);
 				if (m_localStorage->sql.got_data()) { // Found it, it is stored in one buffer Public || Private
 					sBuffer<SignedPreKey<Curve>::serializedSize()> serializedSPk{};
 					SPk_blob.read(0, (char *)(serializedSPk.data()), SignedPreKey<Curve>::serializedSize());
-					return SignedPreKey<Curve>(serializedSPk, SPk_id);
+					return m_SPkCache.emplace(SPk_id, SignedPreKey<Curve>(serializedSPk, SPk_id)).first->second;
 				} else {
 					throw BCTBX_EXCEPTION << "X3DH "<<m_selfDeviceId<<" look up for SPk id "<<std::hex<<SPk_id<<" failed";
 				}
@@ -679,11 +827,16 @@ namespace lime {
 			*/
 			OneTimePreKey<Curve> get_OPk(uint32_t OPk_id) {
 				std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
-				blob OPk_blob(m_localStorage->sql);
-				m_localStorage->sql<<"SELECT OPk FROM X3DH_OPK WHERE Uid = :Uid AND OPKid = :OPk_id LIMIT 1;", into(OPk_blob), use(m_db_Uid), use(OPk_id);
-				if (m_localStorage->sql.got_data()) { // Found it, it is stored in one buffer Public || Private
+				if (m_OPkLookup == nullptr) { // OPKid is the primary key: the look up is indexed, prepare it once
+					m_OPkLookup_blob = std::make_unique<blob>(m_localStorage->sql);
+					m_OPkLookup = std::make_unique<statement>((m_localStorage->sql.prepare << "SELECT OPk FROM X3DH_OPK WHERE Uid = :Uid AND OPKid = :OPk_id LIMIT 1;", into(*m_OPkLookup_blob), use(m_db_Uid), use(m_OPkLookup_id)));
+				}
+				m_OPkLookup_id = OPk_id;
+				if (m_OPkLookup->execute(true)) { // Found it, it is stored in one buffer Public || Private
 					sBuffer<OneTimePreKey<Curve>::serializedSize()> serializedOPk{};
-					OPk_blob.read(0, (char *)(serializedOPk.data()), OneTimePreKey<Curve>::serializedSize());
+					m_OPkLookup_blob->read(0, (char *)(serializedOPk.data()), OneTimePreKey<Curve>::serializedSize());
+					// step past the single row so the statement is done and does not hold a read lock on the database until its next use
+					m_OPkLookup->fetch();
 					return OneTimePreKey<Curve>(serializedOPk, OPk_id);
 				} else {
 					throw BCTBX_EXCEPTION << "X3DH "<<m_selfDeviceId<<" look up for OPk id "<<std::hex<<OPk_id<<" failed";
@@ -701,8 +854,35 @@ namespace lime {
 			void postToX3DHServer(std::shared_ptr<callbackUserData> userData, std::vector<uint8_t> &&message) {
 				LIME_LOGI<<"Post outgoing X3DH message from user "<<this->m_selfDeviceId;
 
+				// time the peer bundles requests round trip, the time point stays unset otherwise(or when the metrics are disabled)
+				auto fetchStart = std::chrono::steady_clock::time_point{};
+				if (message.size()>1 && message[1] == static_cast<uint8_t>(x3dh_protocol::x3dh_message_type::getPeerBundle)) {
+					fetchStart = LIME_METRICS_NOW();
+				}
+
+				// the request span lasts until the response arrives: it measures the server round trip, the response processing is its child
+				std::shared_ptr<trace::Span> requestSpan{nullptr};
+				if (trace::active()) {
+					requestSpan = std::make_shared<trace::Span>("lime.x3dh.request", trace::currentSpan());
+					if (message.size()>1) {
+						requestSpan->setAttribute("lime.x3dh.message_type", static_cast<unsigned int>(message[1]));
+					}
+					requestSpan->setAttribute("lime.x3dh.request_bytes", message.size());
+				}
+
 				// copy capture the shared_ptr to userData
-				m_post_data(m_server_url, m_selfDeviceId, std::move(message), [userData](int responseCode, const std::vector<uint8_t> &responseBody) {
+				m_post_data(m_server_url, m_selfDeviceId, std::move(message), [userData, fetchStart, requestSpan](int responseCode, const std::vector<uint8_t> &responseBody) {
+						if (fetchStart != std::chrono::steady_clock::time_point{}) {
+							LIME_METRICS_OBSERVE(fetchPeerBundles, std::chrono::steady_clock::now() - fetchStart);
+						}
+						trace::SpanId responseSpanParent = userData->traceParent;
+						if (requestSpan) {
+							responseSpanParent = requestSpan->id();
+							requestSpan->setAttribute("lime.x3dh.response_code", responseCode);
+							requestSpan->setAttribute("lime.x3dh.response_bytes", responseBody.size());
+							requestSpan->end(responseCode == 200);
+						}
+						trace::ScopedSpan responseSpan("lime.x3dh.process_response", responseSpanParent);
 						auto thiz = userData->limeObj.lock(); // get a shared pointer to Lime Object from the weak pointer stored in userData
 						// check it is valid (lock() returns nullptr)
 						if (!thiz) { // our Lime caller object doesn't exists anymore
@@ -720,7 +900,10 @@ namespace lime {
 			*  as decribed in X3DH reference section 3.3
 			*/
 			template<typename Curve_ = Curve, std::enable_if_t<!std::is_base_of_v<genericKEM, Curve_>, bool> = true>
-			void init_sender_session(std::shared_ptr<Lime<Curve>> limeObj, const std::vector<X3DH_peerBundle<Curve>> &peersBundle) {
+			void init_sender_session(std::shared_ptr<Lime<Curve>> limeObj, const std::vector<X3DH_peerBundle<Curve>> &peersBundle, std::shared_ptr<PrefetchContext> prefetchContext=nullptr) {
+				LIME_METRICS_TIME(initSenderSession);
+				trace::ScopedSpan span("lime.x3dh.init_sender_session");
+				span.setAttribute("lime.peer_bundles", peersBundle.size());
 				load_SelfIdentityKey(); // make sure Ik is in context
 				for (const auto &peerBundle : peersBundle) {
 					// do we have a key bundle to build this message from ?
@@ -731,7 +914,7 @@ namespace lime {
 					auto SPkVerify = make_Signature<Curve>();
 					SPkVerify->set_public(peerBundle.Ik);
 
-					if (!SPkVerify->verify(peerBundle.SPk.serializePublic(true), peerBundle.SPk.csignature())) {
+					if (!SPkVerify->verify(peerBundle.SPkSignedMessage, SignedPreKey<Curve>::signedMessageSize(), peerBundle.SPk.csignature())) {
 						LIME_LOGE<<"X3DH: SPk signature verification failed for device "<<peerBundle.deviceId;
 						throw BCTBX_EXCEPTION << "Verify signature on SPk failed for deviceId "<<peerBundle.deviceId;
 					}
@@ -805,18 +988,31 @@ namespace lime {
 					// in that case just keep on building our new session so the peer device knows it must get rid of the OPk, sessions will eventually converge into only one when messages
 					// stop crossing themselves on the network.
 					// If the fetch bundle doesn't hold OPk, just ignore our newly built session, and use existing one
+					auto DRSession = std::static_pointer_cast<DR>(make_DR_for_sender<Curve>(m_localStorage, SK, AD, peerBundle.SPk, peerDid, peerBundle.deviceId, peerBundle.Ik, m_db_Uid, X3DH_initMessage, m_RNG));
+					LIME_METRICS_COUNT(X3DHsessionCreated);
+					if (prefetchContext != nullptr) { // prefetched session goes directly to local storage, unless the peer device got one in the meantime
+						if (limeObj->store_prefetchedSession(peerBundle.deviceId, DRSession)) {
+							prefetchContext->sessionsCount++;
+							LIME_LOGI<<"X3DH prefetched session with device "<<peerBundle.deviceId;
+						}
+						continue;
+					}
+
 					auto lock = limeObj->lock(); // get lock on the lime Obj before modifying the DR cache
 					if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk) {
 						limeObj->DRcache_delete(peerBundle.deviceId); // will just do nothing if this peerDeviceId is not in cache
 					}
 
-					limeObj->DRcache_insert(peerBundle.deviceId, std::static_pointer_cast<DR>(make_DR_for_sender<Curve>(m_localStorage, SK, AD, peerBundle.SPk, peerDid, peerBundle.deviceId, peerBundle.Ik, m_db_Uid, X3DH_initMessage, m_RNG))); // will just do nothing if this peerDeviceId is already in cache
+					limeObj->DRcache_insert(peerBundle.deviceId, DRSession); // will just do nothing if this peerDeviceId is already in cache
 
 					LIME_LOGI<<"X3DH created session with device "<<peerBundle.deviceId;
 				}
 			}
 			template<typename Curve_ = Curve, std::enable_if_t<std::is_base_of_v<genericKEM, Curve_>, bool> = true>
-			void init_sender_session(std::shared_ptr<Lime<Curve>> limeObj, const std::vector<X3DH_peerBundle<Curve>> &peersBundle) {
+			void init_sender_session(std::shared_ptr<Lime<Curve>> limeObj, const std::vector<X3DH_peerBundle<Curve>> &peersBundle, std::shared_ptr<PrefetchContext> prefetchContext=nullptr) {
+				LIME_METRICS_TIME(initSenderSession);
+				trace::ScopedSpan span("lime.x3dh.init_sender_session");
+				span.setAttribute("lime.peer_bundles", peersBundle.size());
 
 				load_SelfIdentityKey(); // make sure Ik is in context
 				for (const auto &peerBundle : peersBundle) {
@@ -828,7 +1024,7 @@ namespace lime {
 					auto peerIkVerify = make_Signature<typename Curve::EC>();
 					peerIkVerify->set_public(peerBundle.Ik);
 
-					if (!peerIkVerify->verify(peerBundle.SPk.serializePublic(true), peerBundle.SPk.csignature())) {
+					if (!peerIkVerify->verify(peerBundle.SPkSignedMessage, SignedPreKey<Curve>::signedMessageSize(), peerBundle.SPk.csignature())) {
 						LIME_LOGE<<"X3DH: SPk signature verification failed for device "<<peerBundle.deviceId;
 						throw BCTBX_EXCEPTION << "Verify signature on SPk failed for deviceId "<<peerBundle.deviceId;
 					}
@@ -943,12 +1139,22 @@ namespace lime {
 					// in that case just keep on building our new session so the peer device knows it must get rid of the OPk, sessions will eventually converge into only one when messages
 					// stop crossing themselves on the network.
 					// If the fetch bundle doesn't hold OPk, just ignore our newly built session, and use existing one
+					auto DRSession = std::static_pointer_cast<DR>(make_DR_for_sender<Curve>(m_localStorage, SK, AD, peerBundle.SPk, peerDid, peerBundle.deviceId, peerBundle.Ik, m_db_Uid, X3DH_initMessage, m_RNG));
+					LIME_METRICS_COUNT(X3DHsessionCreated);
+					if (prefetchContext != nullptr) { // prefetched session goes directly to local storage, unless the peer device got one in the meantime
+						if (limeObj->store_prefetchedSession(peerBundle.deviceId, DRSession)) {
+							prefetchContext->sessionsCount++;
+							LIME_LOGI<<"X3DH prefetched session with device "<<peerBundle.deviceId;
+						}
+						continue;
+					}
+
 					auto lock = limeObj->lock(); // get lock on the lime Obj before modifying the DR cache
 					if (peerBundle.bundleFlag == lime::X3DHKeyBundleFlag::OPk) {
 						limeObj->DRcache_delete(peerBundle.deviceId); // will just do nothing if this peerDeviceId is not in cache
 					}
 
-					limeObj->DRcache_insert(peerBundle.deviceId, std::static_pointer_cast<DR>(make_DR_for_sender<Curve>(m_localStorage, SK, AD, peerBundle.SPk, peerDid, peerBundle.deviceId, peerBundle.Ik, m_db_Uid, X3DH_initMessage, m_RNG))); // will just do nothing if this peerDeviceId is already in cache
+					limeObj->DRcache_insert(peerBundle.deviceId, DRSession); // will just do nothing if this peerDeviceId is already in cache
 
 					LIME_LOGI<<"X3DH created session with device "<<peerBundle.deviceId;
 				}
@@ -1150,7 +1356,7 @@ namespace lime {
 			X3DHi(std::shared_ptr< lime::Db > localStorage, const std::string &selfDeviceId, const std::string &X3DHServerURL,  const limeX3DHServerPostData &X3DH_post_data, std::shared_ptr< lime::RNG > RNG_context, const long int Uid) :
 			m_RNG{RNG_context}, m_selfDeviceId{selfDeviceId}, m_localStorage{localStorage}, m_db_Uid{Uid},
 			m_server_url{X3DHServerURL}, m_post_data{X3DH_post_data},
-			m_Ik_loaded{false} {
+			m_Ik_loaded{false}, m_SPkCache{}, m_SPkCacheCleanCount{0}, m_OPkLookup_blob{nullptr}, m_OPkLookup_id{0}, m_OPkLookup{nullptr} {
 				if (Uid == 0) { // When the given user id is 0: we must create the user
 					std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
 					int dbUid;
@@ -1214,7 +1420,7 @@ namespace lime {
 			X3DHi(std::shared_ptr< lime::Db > localStorage, const std::string &selfDeviceId, const std::string &X3DHServerURL,  const limeX3DHServerPostData &X3DH_post_data, std::shared_ptr< lime::RNG > RNG_context, const long int Uid) :
 			m_RNG{RNG_context}, m_selfDeviceId{selfDeviceId}, m_localStorage{localStorage}, m_db_Uid{Uid},
 			m_server_url{X3DHServerURL}, m_post_data{X3DH_post_data},
-			m_Ik_loaded{false} {
+			m_Ik_loaded{false}, m_SPkCache{}, m_SPkCacheCleanCount{0}, m_OPkLookup_blob{nullptr}, m_OPkLookup_id{0}, m_OPkLookup{nullptr} {
 				if (Uid == 0) { // When the given user id is 0: we must create the user
 					std::lock_guard<std::recursive_mutex> lock(m_localStorage->m_db_mutex);
 					int dbUid;
@@ -1310,6 +1516,16 @@ namespace lime {
 				Ik.assign(m_Ik.publicKey().cbegin(), m_Ik.publicKey().cend());
 			}
 
+			void sign(const std::vector<uint8_t> &message, std::vector<uint8_t> &signature) override {
+				load_SelfIdentityKey(); // make sure we have the key
+				auto IkSign = make_Signature<typename Curve::EC>();
+				IkSign->set_public(m_Ik.cpublicKey());
+				IkSign->set_secret(m_Ik.cprivateKey());
+				DSA<typename Curve::EC, lime::DSAtype::signature> s;
+				IkSign->sign(message, s);
+				signature.assign(s.cbegin(), s.cend());
+			}
+
 			long int get_dbUid(void) const noexcept override {return m_db_Uid;} // the Uid in database, retrieved at creation/load, used for faster access
 			void publish_user(std::shared_ptr<callbackUserData> userData, uint16_t OPkInitialBatchSize) override{
 				// Generate (or load if they already are in base when publishing an inactive user) the SPk
@@ -1322,6 +1538,7 @@ namespace lime {
 				// Build and post the message to server
 				std::vector<uint8_t> X3DHmessage{};
 				x3dh_protocol::buildMessage_registerUser<Curve>(X3DHmessage, m_Ik.publicKey(), SPk, OPks);
+				LIME_METRICS_COUNT_N(OPkUploaded, OPks.size());
 				postToX3DHServer(userData, std::move(X3DHmessage));
 			}
 
@@ -1336,11 +1553,7 @@ namespace lime {
 				// Do we have an active SPk for this user which is younger than SPK_lifeTime_days
 				int dummy;
 				m_localStorage->sql<<"SELECT SPKid FROM X3DH_SPk WHERE Uid = :Uid AND Status = 1 AND timeStamp > date('now', '-"<<lime::settings::SPK_lifeTime_days<<" day') LIMIT 1;", into(dummy), use(m_db_Uid);
-				if (m_localStorage->sql.got_data()) {
-					return true;
-				} else {
-					return false;
-				}
+				return m_localStorage->sql.got_data();
 			}
 
 			void update_SPk(std::shared_ptr<callbackUserData> userData) override {
@@ -1358,12 +1571,32 @@ namespace lime {
 			}
 
 			void fetch_peerBundles(std::shared_ptr<callbackUserData> userData, std::vector<std::string> &peerDeviceIds) override {
+				trace::ScopedSpan span("lime.x3dh.fetch_peerBundles");
+				span.setAttribute("lime.peer_devices", peerDeviceIds.size());
+				// split large requests issued by an encryption in chunks sent concurrently, a prefetch already requests its devices by chunks
+				if (userData->encryptionContext != nullptr && peerDeviceIds.size() > lime::settings::X3DH_peerBundlesChunkSize) {
+					const size_t chunkSize = lime::settings::X3DH_peerBundlesChunkSize;
+					auto bundlesFetch = std::make_shared<PeerBundlesFetch>((peerDeviceIds.size() + chunkSize - 1)/chunkSize);
+					LIME_LOGI<<"User "<<m_selfDeviceId<<" requests key bundles for "<<peerDeviceIds.size()<<" peer devices in "<<bundlesFetch->pendingChunks<<" chunks";
+					span.setAttribute("lime.chunks", bundlesFetch->pendingChunks);
+					for (size_t i=0; i<peerDeviceIds.size(); i+=chunkSize) {
+						std::vector<std::string> chunk(peerDeviceIds.cbegin()+i, peerDeviceIds.cbegin()+std::min(i+chunkSize, peerDeviceIds.size()));
+						auto chunkUserData = make_shared<callbackUserData>(userData->limeObj, userData->callback, userData->randomSeedCallback, userData->encryptionContext, bundlesFetch, std::move(chunk));
+						std::vector<uint8_t> X3DHmessage{};
+						x3dh_protocol::buildMessage_getPeerBundles<Curve>(X3DHmessage, chunkUserData->requestedDevices);
+						postToX3DHServer(chunkUserData, std::move(X3DHmessage));
+					}
+					return;
+				}
+
 				std::vector<uint8_t> X3DHmessage{};
 				x3dh_protocol::buildMessage_getPeerBundles<Curve>(X3DHmessage, peerDeviceIds);
 				postToX3DHServer(userData, std::move(X3DHmessage));
 			}
 
 			std::shared_ptr<DR> init_receiver_session(const std::vector<uint8_t> X3DH_initMessage, const std::string &senderDeviceId) override {
+				LIME_METRICS_TIME(initReceiverSession);
+				trace::ScopedSpan span("lime.x3dh.init_receiver_session");
 				DSA<typename Curve::EC, lime::DSAtype::publicKey> peerIk{};
 				SignedPreKey<Curve> SPk{};
 				uint32_t OPk_id=0;
@@ -1383,6 +1616,7 @@ namespace lime {
 				// check the new peer device Id in Storage, if it is not found, the DR session will add it when it saves itself after successful decryption
 				auto peerDid = m_localStorage->check_peerDevice<Curve>(senderDeviceId, peerIk);
 				auto DRSession = make_DR_for_receiver<Curve>(m_localStorage, SK, AD, SPk, peerDid, senderDeviceId, OPk_id, peerIk, m_db_Uid, m_RNG);
+				LIME_METRICS_COUNT(X3DHsessionCreated);
 
 				return std::static_pointer_cast<DR>(DRSession);
 			}
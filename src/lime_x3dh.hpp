@@ -42,6 +42,8 @@ namespace lime {
 			///  - public is publicKey || signature || Id (4bytes) -> used to publish
 			///  - storage publicKey || privateKey -> used to store in DB, Id is stored separately
 			static constexpr size_t serializedPublicSize(void) {return X<Curve, lime::Xtype::publicKey>::ssize() + DSA<Curve, lime::DSAtype::signature>::ssize() + 4;};
+			/// the signed message is the public key, found at the begining of the serialized public form
+			static constexpr size_t signedMessageSize(void) {return X<Curve, lime::Xtype::publicKey>::ssize();};
 			static constexpr size_t serializedSize(void) {return X<Curve, lime::Xtype::publicKey>::ssize() + X<Curve, lime::Xtype::privateKey>::ssize();};
 			using serializedBuffer = sBuffer<X<Curve, lime::Xtype::publicKey>::ssize() + X<Curve, lime::Xtype::privateKey>::ssize()>;
 
@@ -123,6 +125,8 @@ namespace lime {
 				X<Algo, lime::Xtype::publicKey>::ssize()
 				+ K<Algo, lime::Ktype::publicKey>::ssize()
 				+ DSA<Algo, lime::DSAtype::signature>::ssize() + 4;};
+			/// the signed message is EC public key || KEM public key, found at the begining of the serialized public form
+			static constexpr size_t signedMessageSize(void) {return X<Algo, lime::Xtype::publicKey>::ssize() + K<Algo, lime::Ktype::publicKey>::ssize();};
 
 			static constexpr size_t serializedSize(void) {return
 				X<Algo, lime::Xtype::publicKey>::ssize() + X<Algo, lime::Xtype::privateKey>::ssize()
@@ -386,6 +390,7 @@ namespace lime {
 		virtual void update_SPk(std::shared_ptr<callbackUserData> userData) = 0;
 		virtual void update_OPk(std::shared_ptr<callbackUserData> userData) = 0;
 		virtual void get_Ik(std::vector<uint8_t> &Ik) = 0;
+		virtual void sign(const std::vector<uint8_t> &message, std::vector<uint8_t> &signature) = 0; /**< sign a message with our identity key */
 		virtual ~X3DH() = default;
 	};
 
@@ -163,22 +163,25 @@ namespace lime {
 			message.push_back(static_cast<uint8_t>(((OPkCount)>>8)&0xFF));
 			message.push_back(static_cast<uint8_t>((OPkCount)&0xFF));
 
-			// debug trace
+			// debug trace, hex encoding the keys is built only when it is logged
+			const bool trace = LIME_LOG_ENABLED(INFO);
 			ostringstream message_trace;
-			message_trace << hex << setfill('0') << "Outgoing X3DH registerUser message holds:"<<endl<<"    Ik: ";
-			hexStr(message_trace, Ik.data(), DSA<Curve, lime::DSAtype::publicKey>::ssize());
+			if (trace) {
+				message_trace << hex << setfill('0') << "Outgoing X3DH registerUser message holds:"<<endl<<"    Ik: ";
+				hexStr(message_trace, Ik.data(), DSA<Curve, lime::DSAtype::publicKey>::ssize());
 
-			SPk.dump(message_trace, "    ");
-			message_trace << endl << dec << setfill('0') << "    " << static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
+				SPk.dump(message_trace, "    ");
+				message_trace << endl << dec << setfill('0') << "    " << static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
+			}
 
 			for (const auto &OPk : OPks) {
 				auto serializedOPk = OPk.serializePublic();
 				message.insert(message.end(), serializedOPk.cbegin(), serializedOPk.cend());
 				// debug trace
-				OPk.dump(message_trace);
+				if (trace) OPk.dump(message_trace);
 			}
 
-			LIME_LOGI<<message_trace.str();
+			if (trace) LIME_LOGI<<message_trace.str();
 		}
 
 		/**
@@ -214,10 +217,12 @@ namespace lime {
 			message.insert(message.end(), serialSPk.cbegin(), serialSPk.cend());
 
 			// debug trace
-			ostringstream message_trace;
-			message_trace << hex << setfill('0') << "Outgoing X3DH postSPk message holds:";
-			SPk.dump(message_trace);
-			LIME_LOGI<<message_trace.str();
+			if (LIME_LOG_ENABLED(INFO)) {
+				ostringstream message_trace;
+				message_trace << hex << setfill('0') << "Outgoing X3DH postSPk message holds:";
+				SPk.dump(message_trace);
+				LIME_LOGI<<message_trace.str();
+			}
 		}
 
 		/**
@@ -248,19 +253,20 @@ namespace lime {
 			message.push_back(static_cast<uint8_t>((OPkCount)&0xFF));
 
 			// debug trace
+			const bool trace = LIME_LOG_ENABLED(INFO);
 			ostringstream message_trace;
-			message_trace << dec << setfill('0') << "Outgoing X3DH postOPks message holds "<< static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
+			if (trace) message_trace << dec << setfill('0') << "Outgoing X3DH postOPks message holds "<< static_cast<unsigned int>(OPkCount)<<" OPks."<< hex;
 
 			for (const auto &OPk : OPks) {
 				auto serializedOPk = OPk.serializePublic();
 				message.insert(message.end(), serializedOPk.cbegin(), serializedOPk.cend());
 
 				// debug trace
-				OPk.dump(message_trace);
+				if (trace) OPk.dump(message_trace);
 			}
 
 			//debug trace
-			LIME_LOGI<<message_trace.str();
+			if (trace) LIME_LOGI<<message_trace.str();
 		}
 
 		/**
@@ -288,8 +294,9 @@ namespace lime {
 			}
 
 			// debug trace
+			const bool trace = LIME_LOG_ENABLED(INFO);
 			ostringstream message_trace;
-			message_trace << dec << setfill('0') << "Outgoing X3DH getPeerBundles message holds "<< static_cast<unsigned int>(peer_device_ids.size())<<" devices id."<< hex;
+			if (trace) message_trace << dec << setfill('0') << "Outgoing X3DH getPeerBundles message holds "<< static_cast<unsigned int>(peer_device_ids.size())<<" devices id."<< hex;
 
 			// append a sequence of peer device Id size(on 2 bytes) || device id
 			for (const auto &peer_device_id : peer_device_ids) {
@@ -299,14 +306,16 @@ namespace lime {
 				LIME_LOGI<<"Request X3DH keys for device "<<peer_device_id;
 
 				// debug trace
-				message_trace << endl << dec <<"    Device id("<< static_cast<unsigned int>(peer_device_id.size())<<"bytes): "<<peer_device_id<<" HEX:"<<hex;
-				std::for_each(peer_device_id.cbegin(), peer_device_id.cend(), [&message_trace] (unsigned int i) {
-					message_trace << setw(2) << i << ", ";
-				});
+				if (trace) {
+					message_trace << endl << dec <<"    Device id("<< static_cast<unsigned int>(peer_device_id.size())<<"bytes): "<<peer_device_id<<" HEX:"<<hex;
+					std::for_each(peer_device_id.cbegin(), peer_device_id.cend(), [&message_trace] (unsigned int i) {
+						message_trace << setw(2) << i << ", ";
+					});
+				}
 			}
 
 			//debug trace
-			LIME_LOGI<<message_trace.str();
+			if (trace) LIME_LOGI<<message_trace.str();
 		}
 
 		/**
@@ -488,6 +497,8 @@ namespace lime {
 		 * @param[in]	body		a buffer holding the message
 		 * @param[out]	peersBundle	a vector to be populated from message content, is empty if none found
 		 *
+		 * @note	the bundles keep a view on their SPk signed message in body, so body must outlive peersBundle
+		 *
 		 * @return true if all went ok, false and empty peersBundle otherwise
 		 */
 		template <typename Curve>
@@ -500,85 +511,85 @@ namespace lime {
 
 			uint16_t peersBundleCount = (static_cast<uint16_t>(body[X3DH_headerSize]))<<8|body[X3DH_headerSize+1];
 
+			// First pass: validate the whole message layout without copying anything
+			// so the second pass can reserve the exact output size and parse without any check
 			size_t index = X3DH_headerSize+2;
-
-			// message trace, display the incoming peer bundles in human readable format:
-			// - number of key bundles in the message
-			// -     device id
-			// -        Ik
-			// -        SPkid, SPk, SPk signature
-			// -        OPkid OPk if any
-			ostringstream message_trace;
-			message_trace << dec << "X3DH Peer Bundles message holds "<<static_cast<unsigned int>(peersBundleCount)<<" key bundles"<<setfill('0');
-
-			// loop on all expected bundles
 			for (auto i=0; i<peersBundleCount; i++) {
 				if (body.size() < index + 2) { // check we have at least a device size to read
-					peersBundle.clear();
-					LIME_LOGE<<"Invalid message: size is not what expected, cannot read device size, discard without parsing";
-					LIME_LOGD<<"message_trace so far: "<<message_trace.str();
+					LIME_LOGE<<"Invalid message: size is not what expected, cannot read device size of bundle "<<i<<", discard without parsing";
 					return false;
 				}
-
-				// get device id (ASCII string)
 				uint16_t deviceIdSize = (static_cast<uint16_t>(body[index]))<<8|body[index+1];
 				index += 2;
 
 				if (body.size() < index + deviceIdSize + 1) { // check we have at enough data to read: device size and the following flag
-					peersBundle.clear();
-					LIME_LOGE<<"Invalid message: size is not what expected, cannot read device id(size is"<<int(deviceIdSize)<<"), discard without parsing";
-					LIME_LOGD<<"message_trace so far: "<<message_trace.str();
+					LIME_LOGE<<"Invalid message: size is not what expected, cannot read device id(size is"<<int(deviceIdSize)<<") of bundle "<<i<<", discard without parsing";
 					return false;
 				}
-				std::string deviceId{body.cbegin()+index, body.cbegin()+index+deviceIdSize};
 				index += deviceIdSize;
 
-				// check if we have a key bundle and an OPk. Possible flag values: 0 no OPk, 1 OPk, 2 no key bundle at all
-				// parse the key bundle flag
-				lime::X3DHKeyBundleFlag keyBundleFlag = lime::X3DHKeyBundleFlag::noBundle;
+				// check the key bundle flag. Possible flag values: 0 no OPk, 1 OPk, 2 no key bundle at all
 				switch (body[index]) {
 					case static_cast<uint8_t>(lime::X3DHKeyBundleFlag::noBundle):
-						keyBundleFlag = lime::X3DHKeyBundleFlag::noBundle;
+						index += 1;
 						break;
 					case static_cast<uint8_t>(lime::X3DHKeyBundleFlag::noOPk):
-						keyBundleFlag = lime::X3DHKeyBundleFlag::noOPk;
-						break;
 					case static_cast<uint8_t>(lime::X3DHKeyBundleFlag::OPk):
-						keyBundleFlag = lime::X3DHKeyBundleFlag::OPk;
+					{
+						bool haveOPk = (body[index] == static_cast<uint8_t>(lime::X3DHKeyBundleFlag::OPk));
+						index += 1;
+						if (body.size() < index + X3DH_peerBundle<Curve>::ssize(haveOPk)) {
+							LIME_LOGE<<"Invalid message: size is not what expected, not enough buffer to hold keys bundle "<<i<<", discard without parsing";
+							return false;
+						}
+						index += X3DH_peerBundle<Curve>::ssize(haveOPk);
+					}
 						break;
 					default:
-						LIME_LOGE<<"Invalid X3DH message: unexpected flag value "<<body[index]<<" in "<<deviceId<<" key bundle";
-						LIME_LOGD<<"message_trace so far: "<<message_trace.str();
-						peersBundle.clear();
+						LIME_LOGE<<"Invalid X3DH message: unexpected flag value "<<static_cast<unsigned int>(body[index])<<" in key bundle "<<i;
 						return false;
 				}
+			}
+
+			// message trace, display the incoming peer bundles in human readable format:
+			// - number of key bundles in the message
+			// -     device id
+			// -        Ik
+			// -        SPkid, SPk, SPk signature
+			// -        OPkid OPk if any
+			const bool trace = LIME_LOG_ENABLED(INFO);
+			ostringstream message_trace;
+			if (trace) message_trace << dec << "X3DH Peer Bundles message holds "<<static_cast<unsigned int>(peersBundleCount)<<" key bundles"<<setfill('0');
+
+			// Second pass: the layout is valid, build the bundles in place
+			peersBundle.reserve(peersBundleCount);
+			index = X3DH_headerSize+2;
+			for (auto i=0; i<peersBundleCount; i++) {
+				// get device id (ASCII string)
+				uint16_t deviceIdSize = (static_cast<uint16_t>(body[index]))<<8|body[index+1];
+				index += 2;
+				std::string deviceId{body.cbegin()+index, body.cbegin()+index+deviceIdSize};
+				index += deviceIdSize;
 
 				// if there is no bundle, just skip to the next one
-				if (keyBundleFlag == lime::X3DHKeyBundleFlag::noBundle) {
+				if (body[index] == static_cast<uint8_t>(lime::X3DHKeyBundleFlag::noBundle)) {
 					// add device Id (and its size) to the trace
-					message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(deviceIdSize)<<" bytes): "<<deviceId<<" has no key bundle"<<endl;
+					if (trace) message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(deviceIdSize)<<" bytes): "<<deviceId<<" has no key bundle"<<endl;
 					peersBundle.emplace_back(std::move(deviceId));
 					index += 1;
 					continue; // skip to next one
 				}
 
-				bool haveOPk = (keyBundleFlag == lime::X3DHKeyBundleFlag::OPk);
+				bool haveOPk = (body[index] == static_cast<uint8_t>(lime::X3DHKeyBundleFlag::OPk));
 				index += 1;
 
 				// add device Id (and its size) and flag to the trace
-				message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(deviceIdSize)<<" bytes): "<<deviceId<<(haveOPk?" has ":" does not have ")<<"OPk";
-
-				if (body.size() < index + X3DH_peerBundle<Curve>::ssize(haveOPk)) {
-					peersBundle.clear();
-					LIME_LOGE<<"Invalid message: size is not what expected, not enough buffer to hold keys bundle, discard without parsing";
-					LIME_LOGD<<"message_trace so far: "<<message_trace.str();
-					return false;
-				}
+				if (trace) message_trace << endl << dec << "    Device Id ("<<static_cast<unsigned int>(deviceIdSize)<<" bytes): "<<deviceId<<(haveOPk?" has ":" does not have ")<<"OPk";
 
-				peersBundle.emplace_back(std::move(deviceId), body.cbegin()+index, haveOPk, message_trace);
+				peersBundle.emplace_back(std::move(deviceId), body.cbegin()+index, haveOPk, trace?&message_trace:nullptr);
 				index += X3DH_peerBundle<Curve>::ssize(haveOPk);
 			}
-			LIME_LOGI<<message_trace.str();
+			if (trace) LIME_LOGI<<message_trace.str();
 			return true;
 		}
 
@@ -612,9 +623,9 @@ namespace lime {
 			// message trace, display the incoming self OPks in human readable format:
 			// - number of OPks in the message
 			// -        OPkid
+			const bool trace = LIME_LOG_ENABLED(INFO);
 			ostringstream message_trace;
-			message_trace << dec << "X3DH self OPks message holds "<<static_cast<unsigned int>(selfOPkIdsCount)<<" OPk Ids"<<endl;
-			message_trace << hex;
+			if (trace) message_trace << dec << "X3DH self OPks message holds "<<static_cast<unsigned int>(selfOPkIdsCount)<<" OPk Ids"<<endl << hex;
 
 			// loop on all OPk Ids
 			for (auto i=0; i<selfOPkIdsCount; i++) { // they are in big endian
@@ -624,9 +635,9 @@ namespace lime {
 						static_cast<uint32_t>(body[index+3]);
 				index+=4;
 				selfOPkIds.push_back(OPk_id);
-				message_trace <<"    OPk Id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_id)<<endl;
+				if (trace) message_trace <<"    OPk Id: 0x"<< setw(8) << static_cast<unsigned int>(OPk_id)<<endl;
 			}
-			LIME_LOGI<<message_trace.str();
+			if (trace) LIME_LOGI<<message_trace.str();
 			return true;
 		}
 
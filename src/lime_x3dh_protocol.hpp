@@ -48,6 +48,12 @@ namespace lime {
 		const SignedPreKey<Curve> SPk; /**< peer device current public pre-signed key */
 		OneTimePreKey<Curve> OPk; /**< peer device One Time preKey */
 		const lime::X3DHKeyBundleFlag bundleFlag; /**< Flag this bundle as empty and if not if it holds an OPk, possible values : noOPk, OPk, noBundle */
+		/**
+		 * View on the SPk signed message(SignedPreKey<Curve>::signedMessageSize() bytes) in the parsed server response,
+		 * so the signature is verified without re-serializing the SPk.
+		 * It points into the buffer given to parseMessage_getPeerBundles and is valid only while this buffer is, nullptr when there is no bundle
+		 */
+		const uint8_t *const SPkSignedMessage;
 
 		/**
 		 * Constructor gets vector<uint8_t> iterators to the bundle begining
@@ -55,21 +61,24 @@ namespace lime {
 		 * @param[in]	deviceId	peer Device Id providing this key bundle
 		 * @param[in]	bundle		iterator pointing to the begining of the key bundle - Ik begin
 		 * @param[in]	haveOPk		true when there is an OPk to parse
-		 * @param[in/out]	message_trace	Debug information to accumulate
+		 * @param[in/out]	message_trace	Debug information to accumulate, nullptr when not traced
 		 */
-		X3DH_peerBundle(std::string &&deviceId, const std::vector<uint8_t>::const_iterator bundle, bool haveOPk, std::ostringstream &message_trace) :
-		deviceId{deviceId},
+		X3DH_peerBundle(std::string &&deviceId, const std::vector<uint8_t>::const_iterator bundle, bool haveOPk, std::ostringstream *message_trace) :
+		deviceId{std::move(deviceId)},
 		Ik{bundle},
 		SPk{bundle + DSA<Curve, lime::DSAtype::publicKey>::ssize()},
-		bundleFlag(haveOPk?lime::X3DHKeyBundleFlag::OPk : lime::X3DHKeyBundleFlag::noOPk) {
-			// add Ik to message trace
-			message_trace << "        Ik: "<<std::hex << std::setfill('0');
-			hexStr(message_trace, Ik.data(), DSA<Curve, lime::DSAtype::publicKey>::ssize());
-			// add SPk Id, SPk and SPk signature to the trace
-			SPk.dump(message_trace);
+		bundleFlag(haveOPk?lime::X3DHKeyBundleFlag::OPk : lime::X3DHKeyBundleFlag::noOPk),
+		SPkSignedMessage{&*(bundle + DSA<Curve, lime::DSAtype::publicKey>::ssize())} {
+			if (message_trace) {
+				// add Ik to message trace
+				*message_trace << "        Ik: "<<std::hex << std::setfill('0');
+				hexStr(*message_trace, Ik.data(), DSA<Curve, lime::DSAtype::publicKey>::ssize());
+				// add SPk Id, SPk and SPk signature to the trace
+				SPk.dump(*message_trace);
+			}
 			if (haveOPk) {
 				OPk = OneTimePreKey<Curve>(bundle + DSA<Curve, lime::DSAtype::publicKey>::ssize() + SignedPreKey<Curve>::serializedPublicSize());
-				OPk.dump(message_trace); // add OPk Id and OPk to the trace
+				if (message_trace) OPk.dump(*message_trace); // add OPk Id and OPk to the trace
 			}
 		};
 		/**
@@ -77,7 +86,7 @@ namespace lime {
 		 * construct without bundle when not present in the parsed server response
 		 */
 		X3DH_peerBundle(std::string &&deviceId) :
-		deviceId{deviceId}, Ik{}, SPk{}, OPk{}, bundleFlag{lime::X3DHKeyBundleFlag::noBundle} {};
+		deviceId{std::move(deviceId)}, Ik{}, SPk{}, OPk{}, bundleFlag{lime::X3DHKeyBundleFlag::noBundle}, SPkSignedMessage{nullptr} {};
 	};
 
 	namespace x3dh_protocol {
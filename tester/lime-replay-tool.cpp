@@ -0,0 +1,109 @@
+/*
+	lime-replay-tool.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* lime-replay: replay a capture produced by LimeManager::start_capture and report throughput and latencies per operation.
+ * Run the same capture with lime-replay built from two versions of the library to compare them. */
+
+#include "lime_log.hpp"
+#include "lime-replay.hpp"
+#include "bctoolbox/exception.hh"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+static void usage(const char *name) {
+	std::cerr<<"Usage: "<<name<<" [options] <capture file>\n"
+		<<"\t--realtime\t\tpace the operations as they were captured, default is back to back\n"
+		<<"\t--curves <c1,c2..>\tbase algorithms of the devices not created in the capture, default is the first one available in c25519, c448\n"
+		<<"\t--db-prefix <path>\tprefix of the local storage files, default is lime-replay\n"
+		<<"\t--keep-db\t\tdo not remove the local storage files at the end of the replay\n"
+		<<"\t--verbose\t\tdisplay the lime logs\n";
+}
+
+int main(int argc, char *argv[]) {
+	bool realtime = false;
+	bool keepDb = false;
+	std::string dbPrefix{"lime-replay"};
+	std::string captureFile{};
+	std::vector<lime::CurveId> curves{};
+#ifdef EC25519_ENABLED
+	curves.push_back(lime::CurveId::c25519);
+#elif defined(EC448_ENABLED)
+	curves.push_back(lime::CurveId::c448);
+#endif
+
+	bctbx_set_log_level(BCTBX_LOG_DOMAIN, BCTBX_LOG_FATAL);
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--realtime") == 0) {
+			realtime = true;
+		} else if (strcmp(argv[i], "--keep-db") == 0) {
+			keepDb = true;
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			bctbx_set_log_level(BCTBX_LOG_DOMAIN, BCTBX_LOG_DEBUG);
+		} else if (strcmp(argv[i], "--db-prefix") == 0 && i+1 < argc) {
+			dbPrefix = argv[++i];
+		} else if (strcmp(argv[i], "--curves") == 0 && i+1 < argc) {
+			curves.clear();
+			std::string list{argv[++i]};
+			size_t begin = 0;
+			while (begin <= list.size()) {
+				auto end = std::min(list.find(',', begin), list.size());
+				auto curve = lime::string2CurveId(list.substr(begin, end - begin));
+				if (curve == lime::CurveId::unset) {
+					std::cerr<<"Unknown curve in "<<list<<"\n";
+					return 1;
+				}
+				curves.push_back(curve);
+				begin = end + 1;
+			}
+		} else if (argv[i][0] != '-' && captureFile.empty()) {
+			captureFile = argv[i];
+		} else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (captureFile.empty()) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const std::string replayedDb = dbPrefix + ".replayed.sqlite3";
+	const std::string peersDb = dbPrefix + ".peers.sqlite3";
+	remove(replayedDb.data());
+	remove(peersDb.data());
+
+	int ret = 0;
+	try {
+		auto operations = lime_tester::replay::parseCapture(captureFile);
+		std::cout<<"Replay "<<operations.size()<<" operations from "<<captureFile<<(realtime?" in real time":"")<<std::endl;
+		lime_tester::replay::Replayer replayer(replayedDb, peersDb, curves);
+		replayer.run(operations, realtime);
+		std::cout<<replayer.report();
+	} catch (BctbxException const &e) {
+		std::cerr<<"Replay failed: "<<e.str()<<"\n";
+		ret = 1;
+	}
+
+	if (!keepDb) {
+		remove(replayedDb.data());
+		remove(peersDb.data());
+	}
+	return ret;
+}
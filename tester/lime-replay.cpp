@@ -0,0 +1,372 @@
+/*
+	lime-replay.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime-replay.hpp"
+#include "bctoolbox/exception.hh"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+using namespace::lime;
+
+namespace lime_tester {
+namespace replay {
+
+namespace {
+	std::vector<std::string> split(const std::string &list) {
+		std::vector<std::string> items{};
+		std::istringstream stream(list);
+		std::string item;
+		while (std::getline(stream, item, ',')) {
+			if (!item.empty()) items.push_back(item);
+		}
+		return items;
+	}
+
+	uint64_t toUint(const std::string &value, const size_t lineNumber) {
+		try {
+			size_t parsed = 0;
+			auto ret = std::stoull(value, &parsed);
+			if (parsed == value.size()) return ret;
+		} catch (std::exception const &) {}
+		throw BCTBX_EXCEPTION << "Invalid capture line "<<lineNumber<<": "<<value<<" is not a number";
+	}
+
+	lime::CurveId toCurve(const std::string &value, const size_t lineNumber) {
+		auto curve = lime::string2CurveId(value);
+		if (curve == lime::CurveId::unset) {
+			throw BCTBX_EXCEPTION << "Invalid capture line "<<lineNumber<<": unknown curve "<<value;
+		}
+		return curve;
+	}
+
+	uint64_t elapsed_us(const std::chrono::steady_clock::time_point start) {
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+} // anonymous namespace
+
+std::vector<Operation> parseCapture(const std::string &filename) {
+	std::ifstream file(filename);
+	if (!file) {
+		throw BCTBX_EXCEPTION << "Cannot open capture file "<<filename;
+	}
+	std::string line;
+	if (!std::getline(file, line) || line != "# lime capture 1") {
+		throw BCTBX_EXCEPTION << filename<<" is not a lime capture";
+	}
+
+	std::vector<Operation> operations{};
+	size_t lineNumber = 1;
+	while (std::getline(file, line)) {
+		lineNumber++;
+		if (line.empty() || line[0] == '#') continue;
+
+		std::istringstream fields(line);
+		std::string start, duration;
+		Operation operation{};
+		if (!(fields>>start>>operation.type>>duration>>operation.status)) {
+			throw BCTBX_EXCEPTION << "Invalid capture line "<<lineNumber<<": "<<line;
+		}
+		operation.start = toUint(start, lineNumber);
+		operation.duration = toUint(duration, lineNumber);
+
+		std::string field;
+		while (fields>>field) {
+			const auto separator = field.find('=');
+			if (separator == std::string::npos) {
+				throw BCTBX_EXCEPTION << "Invalid capture line "<<lineNumber<<": "<<field<<" is not a key=value";
+			}
+			const auto key = field.substr(0, separator);
+			const auto value = field.substr(separator+1);
+			if (key == "device") {
+				operation.device = value;
+			} else if (key == "curves") {
+				for (const auto &curve : split(value)) operation.curves.push_back(toCurve(curve, lineNumber));
+			} else if (key == "curve") {
+				operation.curves.push_back(toCurve(value, lineNumber));
+			} else if (key == "group") {
+				operation.group = value;
+			} else if (key == "policy") {
+				auto policy = toUint(value, lineNumber);
+				if (policy > static_cast<uint64_t>(lime::EncryptionPolicy::optimizeCost)) {
+					throw BCTBX_EXCEPTION << "Invalid capture line "<<lineNumber<<": unknown encryption policy "<<value;
+				}
+				operation.policy = static_cast<lime::EncryptionPolicy>(policy);
+			} else if (key == "plaintext") {
+				operation.plaintext = toUint(value, lineNumber);
+			} else if (key == "recipients") {
+				operation.recipients = split(value);
+			} else if (key == "sender") {
+				operation.sender = value;
+			} else if (key == "dr") {
+				operation.DRmessage = toUint(value, lineNumber);
+			} else if (key == "cipher") {
+				operation.cipherMessage = toUint(value, lineNumber);
+			} else if (key == "skipped") {
+				operation.skipped = static_cast<uint32_t>(toUint(value, lineNumber));
+			} else if (key == "late") {
+				operation.late = (value == "1");
+			} // ignore the other keys: they are not needed to replay the operation
+		}
+		if (operation.device.empty() || operation.curves.empty() || (operation.type == "decrypt" && operation.sender.empty())) {
+			throw BCTBX_EXCEPTION << "Invalid capture line "<<lineNumber<<": missing device, curve or sender";
+		}
+		operations.push_back(std::move(operation));
+	}
+	return operations;
+}
+
+uint64_t OperationStats::percentile(const double p) const {
+	if (latencies.empty()) return 0;
+	auto sorted = latencies;
+	std::sort(sorted.begin(), sorted.end());
+	auto rank = static_cast<size_t>(std::ceil(p/100.0*static_cast<double>(sorted.size())));
+	return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+Replayer::Replayer(const std::string &replayedDb, const std::string &peersDb, const std::vector<lime::CurveId> &defaultCurves)
+	: m_server{}, m_replayed{std::make_unique<LimeManager>(replayedDb, m_server.postData())}, m_peers{std::make_unique<LimeManager>(peersDb, m_server.postData())},
+	m_defaultCurves{defaultCurves}, m_rng{}, m_elapsed{0} {
+	if (m_defaultCurves.empty()) {
+		throw BCTBX_EXCEPTION << "Replay needs at least one default base algorithm";
+	}
+}
+
+std::string Replayer::deviceId(const std::string &pseudonym) {
+	return std::string{"sip:"}.append(pseudonym).append("@replay.lime");
+}
+
+LimeManager &Replayer::managerOf(const std::string &pseudonym) {
+	return (m_localDevices.count(pseudonym) > 0) ? *m_replayed : *m_peers;
+}
+
+limeCallback Replayer::completionCallback(const std::shared_ptr<Completion> &completion) {
+	return [completion](const lime::CallbackReturn status, const std::string message) {
+		completion->done = true;
+		completion->status = status;
+	};
+}
+
+/**
+ * @brief Answer the X3DH requests until the operation completes
+ * @return true if the operation completed with success
+ */
+bool Replayer::wait(const std::shared_ptr<Completion> &completion) {
+	while (!completion->done) {
+		if (m_server.process() == 0 && !completion->done) {
+			LIME_LOGE<<"Replayed operation is stuck: no more X3DH request to answer";
+			return false;
+		}
+	}
+	return completion->status == lime::CallbackReturn::success;
+}
+
+/* Create the user if it was not created yet, this is not measured */
+void Replayer::ensureUser(const std::string &pseudonym, const std::vector<lime::CurveId> &curves) {
+	if (m_users.count(pseudonym) > 0) return;
+	const auto &userCurves = curves.empty() ? m_defaultCurves : curves;
+	auto completion = std::make_shared<Completion>();
+	managerOf(pseudonym).create_user(deviceId(pseudonym), userCurves, "https://replay.lime", completionCallback(completion));
+	if (!wait(completion)) {
+		throw BCTBX_EXCEPTION << "Replay cannot create user "<<pseudonym;
+	}
+	m_users[pseudonym] = userCurves;
+}
+
+std::vector<uint8_t> Replayer::randomPlaintext(const size_t size) {
+	std::uniform_int_distribution<int> byte(0, 255);
+	std::vector<uint8_t> plaintext(size);
+	for (auto &b : plaintext) b = static_cast<uint8_t>(byte(m_rng));
+	return plaintext;
+}
+
+void Replayer::record(const std::string &type, const std::chrono::steady_clock::time_point start, const bool success) {
+	auto &stats = m_stats[type];
+	stats.latencies.push_back(elapsed_us(start));
+	if (!success) stats.failed++;
+}
+
+/* Encrypt a message from sender to recipient only, this is not measured */
+bool Replayer::peerEncrypt(const std::string &sender, const std::string &recipient, const std::string &group, const size_t plaintextSize, const lime::EncryptionPolicy policy, HeldMessage &message) {
+	auto context = std::make_shared<EncryptionContext>(group, randomPlaintext(plaintextSize), policy);
+	context->addRecipient(deviceId(recipient));
+	auto completion = std::make_shared<Completion>();
+	managerOf(sender).encrypt(deviceId(sender), m_users[sender], context, completionCallback(completion));
+	if (!wait(completion) || context->m_recipients[0].peerStatus == lime::PeerDeviceStatus::fail) {
+		return false;
+	}
+	message.associatedData.assign(group.cbegin(), group.cend());
+	message.DRmessage = std::move(context->m_recipients[0].DRmessage);
+	message.cipherMessage = std::move(context->m_cipherMessage);
+	return true;
+}
+
+bool Replayer::replayUserOperation(const Operation &operation) {
+	auto completion = std::make_shared<Completion>();
+	if (operation.type == "create_user") {
+		auto start = std::chrono::steady_clock::now();
+		m_replayed->create_user(deviceId(operation.device), operation.curves, "https://replay.lime", completionCallback(completion));
+		const bool success = wait(completion);
+		record(operation.type, start, success);
+		if (success) m_users[operation.device] = operation.curves;
+		return success;
+	}
+
+	ensureUser(operation.device, operation.curves);
+	auto start = std::chrono::steady_clock::now();
+	if (operation.type == "update") {
+		m_replayed->update(deviceId(operation.device), operation.curves, completionCallback(completion));
+		const bool success = wait(completion);
+		record(operation.type, start, success);
+		return success;
+	}
+
+	// delete_user: captured on one base algorithm per call
+	m_replayed->delete_user(DeviceId(deviceId(operation.device), operation.curves[0]), completionCallback(completion));
+	const bool success = wait(completion);
+	record(operation.type, start, success);
+	auto &userCurves = m_users[operation.device];
+	userCurves.erase(std::remove(userCurves.begin(), userCurves.end(), operation.curves[0]), userCurves.end());
+	if (userCurves.empty()) m_users.erase(operation.device);
+	return success;
+}
+
+bool Replayer::replayEncrypt(const Operation &operation) {
+	ensureUser(operation.device, operation.curves);
+	for (const auto &recipient : operation.recipients) {
+		ensureUser(recipient, operation.curves);
+	}
+	auto context = std::make_shared<EncryptionContext>(operation.group, randomPlaintext(operation.plaintext), operation.policy);
+	for (const auto &recipient : operation.recipients) {
+		context->addRecipient(deviceId(recipient));
+	}
+
+	auto completion = std::make_shared<Completion>();
+	auto start = std::chrono::steady_clock::now();
+	m_replayed->encrypt(deviceId(operation.device), operation.curves, context, completionCallback(completion));
+	const bool success = wait(completion);
+	record(operation.type, start, success);
+
+	// deliver to the peers so the sessions evolve as they do when the recipients read their messages, this is not measured
+	std::vector<uint8_t> plaintext{};
+	for (size_t i=0; i<operation.recipients.size(); i++) {
+		const auto &recipient = context->m_recipients[i];
+		if (m_localDevices.count(operation.recipients[i]) > 0 || recipient.peerStatus == lime::PeerDeviceStatus::fail) continue;
+		m_peers->decrypt(recipient.deviceId, context->m_associatedData, deviceId(operation.device), recipient.DRmessage, context->m_cipherMessage, plaintext);
+	}
+	return success;
+}
+
+bool Replayer::replayDecrypt(const Operation &operation) {
+	ensureUser(operation.sender, operation.curves);
+	ensureUser(operation.device, operation.curves);
+
+	// the sender policy is deduced from the captured message: no DR message in sender key mode, a cipher message holds the payload otherwise
+	auto policy = lime::EncryptionPolicy::DRMessage;
+	if (operation.DRmessage == 0) {
+		policy = lime::EncryptionPolicy::senderKey;
+	} else if (operation.cipherMessage > 0) {
+		policy = lime::EncryptionPolicy::cipherMessage;
+	}
+
+	auto &held = m_heldMessages[std::make_pair(operation.sender, operation.device)];
+	HeldMessage message{};
+	if (operation.late && !held.empty()) { // deliver the oldest message held back
+		message = std::move(held.front());
+		held.pop_front();
+	} else {
+		// the sender encrypts the messages this one skips and hold them back
+		for (uint32_t i=0; i<operation.skipped; i++) {
+			HeldMessage skipped{};
+			if (peerEncrypt(operation.sender, operation.device, operation.group, operation.plaintext, policy, skipped)) {
+				held.push_back(std::move(skipped));
+			}
+		}
+		if (!peerEncrypt(operation.sender, operation.device, operation.group, operation.plaintext, policy, message)) {
+			LIME_LOGE<<"Replay cannot encrypt from "<<operation.sender<<" to "<<operation.device;
+			record(operation.type, std::chrono::steady_clock::now(), false);
+			return false;
+		}
+	}
+
+	std::vector<uint8_t> plaintext{};
+	auto start = std::chrono::steady_clock::now();
+	auto status = m_replayed->decrypt(deviceId(operation.device), message.associatedData, deviceId(operation.sender), message.DRmessage, message.cipherMessage, plaintext);
+	const bool success = (status != lime::PeerDeviceStatus::fail);
+	record(operation.type, start, success);
+	return success;
+}
+
+void Replayer::run(const std::vector<Operation> &operations, const bool realtime) {
+	for (const auto &operation : operations) {
+		m_localDevices.insert(operation.device);
+	}
+
+	const auto replayStart = std::chrono::steady_clock::now();
+	for (const auto &operation : operations) {
+		if (realtime) {
+			std::this_thread::sleep_until(replayStart + std::chrono::microseconds(operation.start));
+		}
+		try {
+			if (operation.type == "encrypt") {
+				replayEncrypt(operation);
+			} else if (operation.type == "decrypt") {
+				replayDecrypt(operation);
+			} else if (operation.type == "create_user" || operation.type == "delete_user" || operation.type == "update") {
+				replayUserOperation(operation);
+			} else {
+				LIME_LOGW<<"Replay ignores unknown operation "<<operation.type;
+			}
+		} catch (BctbxException const &e) {
+			LIME_LOGE<<"Replay of "<<operation.type<<" on "<<operation.device<<" failed: "<<e.str();
+			m_stats[operation.type].failed++;
+		}
+	}
+	m_elapsed += elapsed_us(replayStart);
+}
+
+std::string Replayer::report(void) const {
+	std::ostringstream report;
+	size_t total = 0;
+	for (const auto &stats : m_stats) {
+		total += stats.second.latencies.size();
+	}
+	report<<std::fixed<<std::setprecision(1);
+	report<<total<<" operations replayed in "<<static_cast<double>(m_elapsed)/1000.0<<" ms";
+	if (m_elapsed > 0) report<<", "<<static_cast<double>(total)*1e6/static_cast<double>(m_elapsed)<<" ops/s";
+	report<<"\n";
+	for (const auto &stats : m_stats) {
+		const auto &latencies = stats.second.latencies;
+		uint64_t busy = 0;
+		for (const auto latency : latencies) busy += latency;
+		report<<std::left<<std::setw(12)<<stats.first<<std::right
+			<<" count "<<std::setw(8)<<latencies.size()
+			<<" failed "<<std::setw(6)<<stats.second.failed
+			<<" p50 "<<std::setw(8)<<stats.second.percentile(50)<<" us"
+			<<" p99 "<<std::setw(8)<<stats.second.percentile(99)<<" us"
+			<<" throughput "<<std::setw(10)<<((busy > 0)?static_cast<double>(latencies.size())*1e6/static_cast<double>(busy):0.0)<<" ops/s\n";
+	}
+	return report.str();
+}
+
+} // namespace replay
+} // namespace lime_tester
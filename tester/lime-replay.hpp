@@ -0,0 +1,146 @@
+/*
+	lime-replay.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef lime_replay_hpp
+#define lime_replay_hpp
+
+#include "lime/lime.hpp"
+#include "lime-x3dh-standin.hpp"
+#include <chrono>
+#include <map>
+#include <random>
+#include <set>
+
+namespace lime_tester {
+namespace replay {
+
+/**
+ * @brief One operation read from a capture produced by LimeManager::start_capture
+ */
+struct Operation {
+	uint64_t start; /**< microseconds since the capture start */
+	std::string type; /**< create_user, delete_user, update, encrypt or decrypt */
+	uint64_t duration; /**< captured duration in microseconds */
+	std::string status; /**< captured status */
+	std::string device; /**< pseudonym of the local device */
+	std::vector<lime::CurveId> curves; /**< local device base algorithms, only one for decrypt */
+	std::string group; /**< pseudonym of the associated data, encrypt and decrypt only */
+	lime::EncryptionPolicy policy; /**< encrypt only */
+	size_t plaintext; /**< plaintext size, encrypt and decrypt only */
+	std::vector<std::string> recipients; /**< pseudonyms of the recipients, encrypt only */
+	std::string sender; /**< pseudonym of the sender, decrypt only */
+	size_t DRmessage; /**< DR message size, decrypt only */
+	size_t cipherMessage; /**< cipher message size, decrypt only */
+	uint32_t skipped; /**< message keys skipped by the decryption */
+	bool late; /**< the decryption used a skipped message key */
+	Operation() : start{0}, duration{0}, policy{lime::EncryptionPolicy::optimizeUploadSize}, plaintext{0}, DRmessage{0}, cipherMessage{0}, skipped{0}, late{false} {};
+};
+
+/**
+ * @brief Read a capture file
+ *
+ * @param[in]	filename	the capture file
+ *
+ * @return the operations, in capture order
+ * @throw BCTBX_EXCEPTION if the file cannot be read or is not a lime capture
+ */
+std::vector<Operation> parseCapture(const std::string &filename);
+
+/**
+ * @brief Latencies measured for one operation type
+ */
+struct OperationStats {
+	size_t failed; /**< operations failing in the replay */
+	std::vector<uint64_t> latencies; /**< microseconds, one per replayed operation */
+	OperationStats() : failed{0} {};
+	/// @return the latency at the given percentile(0 to 100), in microseconds
+	uint64_t percentile(const double p) const;
+};
+
+/**
+ * @brief Replay a capture against an in-process X3DH server stand-in
+ *
+ * The local devices of the capture live in a replayed LimeManager, the only one measured. Their peers live in a second manager.
+ * Users are created on first use when the capture does not hold their creation, plaintexts are random of the captured size.
+ * Decryptions replay the skipped messages: the sender encrypts and holds back the skipped ones, late decryptions are fed from
+ * these held back messages.
+ */
+class Replayer {
+	private:
+		/// a message encrypted by a peer and not delivered yet
+		struct HeldMessage {
+			std::vector<uint8_t> associatedData;
+			std::vector<uint8_t> DRmessage;
+			std::vector<uint8_t> cipherMessage;
+		};
+		/// completion of an asynchronous operation
+		struct Completion {
+			bool done;
+			lime::CallbackReturn status;
+			Completion() : done{false}, status{lime::CallbackReturn::fail} {};
+		};
+
+		X3DHServerStandIn m_server; // declared first: it must outlive the managers
+		std::unique_ptr<lime::LimeManager> m_replayed; // holds the local devices, the measured one
+		std::unique_ptr<lime::LimeManager> m_peers; // holds the peer devices
+		const std::vector<lime::CurveId> m_defaultCurves;
+		std::set<std::string> m_localDevices; // pseudonyms of the local devices
+		std::map<std::string, std::vector<lime::CurveId>> m_users; // pseudonym -> base algorithms of the users created
+		std::map<std::pair<std::string, std::string>, std::deque<HeldMessage>> m_heldMessages; // indexed by sender and recipient pseudonyms
+		std::map<std::string, OperationStats> m_stats; // indexed by operation type
+		std::mt19937 m_rng;
+		uint64_t m_elapsed; // wall clock time of the replay, microseconds
+
+		static std::string deviceId(const std::string &pseudonym);
+		lime::LimeManager &managerOf(const std::string &pseudonym);
+		void ensureUser(const std::string &pseudonym, const std::vector<lime::CurveId> &curves);
+		lime::limeCallback completionCallback(const std::shared_ptr<Completion> &completion);
+		bool wait(const std::shared_ptr<Completion> &completion);
+		std::vector<uint8_t> randomPlaintext(const size_t size);
+		bool peerEncrypt(const std::string &sender, const std::string &recipient, const std::string &group, const size_t plaintextSize, const lime::EncryptionPolicy policy, HeldMessage &message);
+		bool replayUserOperation(const Operation &operation);
+		bool replayEncrypt(const Operation &operation);
+		bool replayDecrypt(const Operation &operation);
+		void record(const std::string &type, const std::chrono::steady_clock::time_point start, const bool success);
+
+	public:
+		/**
+		 * @param[in]	replayedDb	local storage of the replayed manager, it shall not exist
+		 * @param[in]	peersDb		local storage of the peers manager, it shall not exist
+		 * @param[in]	defaultCurves	base algorithms of the devices whose creation is not in the capture
+		 */
+		Replayer(const std::string &replayedDb, const std::string &peersDb, const std::vector<lime::CurveId> &defaultCurves);
+
+		/**
+		 * @brief Replay operations, each one waits for the previous one completion
+		 *
+		 * @param[in]	operations	as read from a capture
+		 * @param[in]	realtime	when true, pace the operations as they were captured, otherwise run them back to back
+		 */
+		void run(const std::vector<Operation> &operations, const bool realtime);
+
+		/// @return the statistics per operation type
+		const std::map<std::string, OperationStats> &stats(void) const {return m_stats;}
+		/// @return a human readable report: count, failures, throughput and latencies per operation type
+		std::string report(void) const;
+};
+
+} // namespace replay
+} // namespace lime_tester
+
+#endif //lime_replay_hpp
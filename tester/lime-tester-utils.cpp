@@ -21,6 +21,8 @@
 #include <vector>
 #include <string>
 #include <mutex>
+#include <sstream>
+#include <iomanip>
 #include "lime_settings.hpp"
 #include "lime/lime.hpp"
 #include "lime_keys.hpp"
@@ -50,9 +52,16 @@ std::string test_x3dh_domainC_server_port{"25523"};
 // for testing purpose RNG, no need to be a good one
 std::random_device rd;
 std::uniform_int_distribution<int> uniform_dist(0,255);
+// used instead of rd once seeded, so the runs are reproducible
+std::mt19937_64 seededEngine;
+bool randomSeeded = false;
+uint64_t randomSeed = 0;
 
 // default value for the timeout
 int wait_for_timeout=4000;
+// soak benchmark default: 8 devices for about 6 months
+int soak_devices=8;
+int soak_days=180;
 // bundle request restriction timespan (as configured on stop on request limit server). 20s (in ms)
 int bundle_request_limit_timespan=20000;
 
@@ -178,13 +187,19 @@ std::vector<std::vector<uint8_t>> messages_pattern = {
 
 /**
  * @brief Simple RNG function, used to generate random values for testing purpose, they do not need to be real random
- * so use directly std::random_device
+ * so use directly std::random_device, or a seeded generator when seedRandom was called
  */
 void randomize(uint8_t *buffer, const size_t size) {
 	for (size_t i=0; i<size; i++) {
-		buffer[i] = (uint8_t)lime_tester::uniform_dist(rd);
+		buffer[i] = randomSeeded ? static_cast<uint8_t>(seededEngine()>>56) : (uint8_t)lime_tester::uniform_dist(rd);
 	}
 }
+
+void seedRandom(const uint64_t seed) {
+	seededEngine.seed(seed);
+	randomSeed = seed;
+	randomSeeded = true;
+}
 /**
  * @brief Create and initialise the two sessions given in parameter. Alice as sender session and Bob as receiver one
  *	Alice must then send the first message, once bob got it, sessions are fully initialised
@@ -344,6 +359,20 @@ bool DR_message_payloadDirectEncrypt(const std::vector<uint8_t> &message) {
 	if (message[0] != static_cast<uint8_t>(lime::double_ratchet_protocol::DR_v01)) return false;
 	return !!(message[1]&static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_direct_encryption_flag));
 }
+bool DR_message_payloadCompressed(const std::vector<uint8_t> &message) {
+	// checks on length to at least perform more checks
+	if (message.size()<4) return false;
+	// check protocol version
+	if (message[0] != static_cast<uint8_t>(lime::double_ratchet_protocol::DR_v01)) return false;
+	return !!(message[1]&static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::payload_compressed_flag));
+}
+bool DR_message_senderKeyDistribution(const std::vector<uint8_t> &message) {
+	// checks on length to at least perform more checks
+	if (message.size()<4) return false;
+	// check protocol version
+	if (message[0] != static_cast<uint8_t>(lime::double_ratchet_protocol::DR_v01)) return false;
+	return !!(message[1]&static_cast<uint8_t>(lime::double_ratchet_protocol::DR_message_type::sender_key_distribution_flag));
+}
 bool DR_message_holdsAsymmetricKeys(const std::vector<uint8_t> &message) {
 	// checks on length to at least perform more checks
 	if (message.size()<4) return false;
@@ -547,6 +576,12 @@ uint16_t DR_message_get_Ns(const std::vector<uint8_t> &message) {
 	return static_cast<uint16_t>(message[3+X3DHInitSize])<<8 | static_cast<uint16_t>(message[4+X3DHInitSize]);
 }
 
+/* return the base algorithm header field */
+lime::CurveId DR_message_get_curveId(const std::vector<uint8_t> &message) {
+	if (message.size()<4) return lime::CurveId::unset;
+	return static_cast<lime::CurveId>(message[2]);
+}
+
 /* Open provided DB and look for DRSessions established between selfDevice and peerDevice
  * Populate the sessionsId vector with the Ids of sessions found
  * return the id of the active session if one is found, 0 otherwise */
@@ -580,6 +615,7 @@ long int get_DRsessionsId(const std::string &dbFilename, const std::string &self
 }
 
 /* Open provided DB, look for DRSessions established between selfDevice and peerDevice, count the stored message keys in all these sessions
+ * message keys derivable from a stored chain key checkpoint are counted too
  * return 0 if no sessions found or no user found
  */
 unsigned int get_StoredMessageKeyCount(const std::string &dbFilename, const std::string &selfDeviceId, const std::string &peerDeviceId, const lime::CurveId algo) noexcept{
@@ -588,11 +624,16 @@ unsigned int get_StoredMessageKeyCount(const std::string &dbFilename, const std:
 		unsigned int mkCount=0;
 		int algoId = static_cast<uint8_t>(algo);
 		sql<< "SELECT count(m.MK) FROM DR_sessions as s INNER JOIN lime_PeerDevices as d on s.Did = d.Did INNER JOIN lime_LocalUsers as u on u.Uid = s.Uid INNER JOIN DR_MSk_DHr as c on c.sessionId = s.sessionId INNER JOIN DR_MSk_Mk as m ON m.DHid=c.DHid WHERE u.UserId = :selfId AND u.curveId = :algoId1 AND d.DeviceId = :peerId AND d.curveId = :algoId2 ORDER BY s.Status DESC, s.Did;", into(mkCount), use(selfDeviceId), use(algoId), use(peerDeviceId), use(algoId);
-		if (sql.got_data()) {
-			return mkCount;
-		} else {
+		if (!sql.got_data()) {
 			return 0;
 		}
+		unsigned int ckCount=0;
+		indicator ind;
+		sql<< "SELECT sum(k.endNr - k.Nr) FROM DR_sessions as s INNER JOIN lime_PeerDevices as d on s.Did = d.Did INNER JOIN lime_LocalUsers as u on u.Uid = s.Uid INNER JOIN DR_MSk_DHr as c on c.sessionId = s.sessionId INNER JOIN DR_MSk_CK as k ON k.DHid=c.DHid WHERE u.UserId = :selfId AND u.curveId = :algoId1 AND d.DeviceId = :peerId AND d.curveId = :algoId2;", into(ckCount, ind), use(selfDeviceId), use(algoId), use(peerDeviceId), use(algoId);
+		if (sql.got_data() && ind == i_ok) {
+			mkCount += ckCount;
+		}
+		return mkCount;
 
 	} catch (exception &e) { // swallow any error on DB
 		LIME_LOGE<<"Got an error while getting the MK count in DB: "<<e.what();
@@ -646,6 +687,23 @@ size_t get_OPks(const std::string &dbFilename, const std::string &selfDeviceId,
 
 }
 
+size_t get_OPks(const std::string &dbFilename, const std::string &selfDeviceId, const lime::CurveId algo, const int status) noexcept {
+	try {
+		soci::session sql("sqlite3", dbFilename); // open the DB
+		auto count=0;
+		int algoId = static_cast<uint8_t>(algo);
+		sql<< "SELECT count(OPKid) FROM X3DH_OPK as o INNER JOIN lime_LocalUsers as u on u.Uid = o.Uid WHERE u.UserId = :selfId AND curveId = :algo AND o.Status = :status;", into(count), use(selfDeviceId), use(algoId), use(status);
+		if (sql.got_data()) {
+			return count;
+		} else {
+			return 0;
+		}
+	} catch (exception &e) { // swallow any error on DB
+		LIME_LOGE<<"Got an error while getting the OPk count in DB: "<<e.what();
+		return 0;
+	}
+}
+
 /* Move back in time all timeStamps by the given amout of days
  * DB holds timeStamps in DR_sessions and X3DH_SPK tables
  */
@@ -658,11 +716,50 @@ void forwardTime(const std::string &dbFilename, int days) noexcept {
 		sql<<"UPDATE X3DH_SPK SET timeStamp = date (timeStamp, '-"<<days<<" day');";
 		sql<<"UPDATE X3DH_OPK SET timeStamp = date (timeStamp, '-"<<days<<" day');";
 		sql<<"UPDATE Lime_LocalUsers SET updateTs = date (updateTs, '-"<<days<<" day');";
+		sql<<"UPDATE lime_SenderKeys SET timeStamp = date (timeStamp, '-"<<days<<" day');";
 	} catch (exception &e) { // swallow any error on DB
 		LIME_LOGE<<"Got an error forwarding time in DB: "<<e.what();
 	}
 }
 
+/* Count the rows of every table in the given DB
+ * return false if the DB could not be read
+ */
+bool get_tablesRowCount(const std::string &dbFilename, std::map<std::string, size_t> &rowCounts) noexcept {
+	try {
+		soci::session sql("sqlite3", dbFilename); // open the DB
+		std::vector<std::string> tables{};
+		soci::rowset<std::string> rs = (sql.prepare << "SELECT name FROM sqlite_master WHERE type='table' AND name NOT LIKE 'sqlite_%';");
+		for (const auto &table : rs) {
+			tables.push_back(table);
+		}
+		for (const auto &table : tables) {
+			int count=0;
+			sql<<"SELECT count(*) FROM "<<table<<";", into(count);
+			rowCounts[table] = static_cast<size_t>(count);
+		}
+		return true;
+	} catch (exception &e) { // swallow any error on DB
+		LIME_LOGE<<"Got an error while counting the rows in DB: "<<e.what();
+		return false;
+	}
+}
+
+/* Log the statements profile collected on a local storage since its profiler started
+ * return the number of profiled statements
+ */
+size_t dumpDbProfile(std::shared_ptr<lime::Db> localStorage) noexcept {
+	std::vector<lime::DbStatementProfile> profile{};
+	localStorage->get_profile(profile);
+	std::ostringstream os;
+	os<<"Local storage profile, "<<profile.size()<<" statements (count, total/p50/p99 in us, rows):";
+	for (const auto &statement : profile) {
+		os<<std::endl<<std::setw(6)<<statement.count<<std::setw(10)<<statement.total_ns/1000<<std::setw(8)<<statement.p50_ns/1000<<std::setw(8)<<statement.p99_ns/1000<<std::setw(7)<<statement.rows<<"  "<<statement.statement;
+	}
+	LIME_LOGI<<os.str();
+	return profile.size();
+}
+
 const char charset[] =
         "0123456789"
         "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -53,6 +53,14 @@ extern std::vector<std::vector<uint8_t>> messages_pattern;
 // default value for the timeout
 extern int wait_for_timeout;
 
+// soak benchmark: number of simulated devices and days
+extern int soak_devices;
+extern int soak_days;
+
+// set by seedRandom, the seed given with --rng-seed
+extern bool randomSeeded;
+extern uint64_t randomSeed;
+
 // bundle request limit as configured on test server
 extern int bundle_request_limit;
 // bundle request restriction timespan (as configured on stop on request limit server)
@@ -70,6 +78,13 @@ extern uint16_t OPkInitialBatchSize;
  */
 void randomize(uint8_t *buffer, const size_t size);
 
+/**
+ * @brief Make randomize, and so the random device names, reproducible: it then uses a generator seeded with the given value
+ *
+ * @param[in] seed	the generator seed
+ */
+void seedRandom(const uint64_t seed);
+
 /**
  * @brief Create and initialise the two sessions given in parameter. Alice as sender session and Bob as receiver one
  *	Alice must then send the first message, once bob got it, sessions are fully initialised
@@ -108,6 +123,10 @@ void dr_devicesInit(std::string dbBaseFilename, std::vector<std::vector<std::vec
 
 /* return true if the message buffer is a DR message with the paylod direct encryption flag set */
 bool DR_message_payloadDirectEncrypt(const std::vector<uint8_t> &message);
+/* return true if the message buffer is a DR message with the paylod compressed flag set */
+bool DR_message_payloadCompressed(const std::vector<uint8_t> &message);
+/* return true if the message buffer is a DR message with the sender key distribution flag set */
+bool DR_message_senderKeyDistribution(const std::vector<uint8_t> &message);
 /* return true if the message buffer is a DR message with public keys to perform an asymmetric ratchet */
 bool DR_message_holdsAsymmetricKeys(const std::vector<uint8_t> &message);
 /* return true if the message buffer is a valid DR message holding a X3DH init one in its header */
@@ -122,6 +141,8 @@ bool DR_message_extractX3DHInit(const std::vector<uint8_t> &message, std::vector
 bool DR_message_extractX3DHInit_SPkId(const std::vector<uint8_t> &message, uint32_t &SPkId);
 /* return the Ns header field */
 uint16_t DR_message_get_Ns(const std::vector<uint8_t> &message);
+/* return the base algorithm header field */
+lime::CurveId DR_message_get_curveId(const std::vector<uint8_t> &message);
 
 /* Open provided DB and look for DRSessions established between selfDevice and peerDevice
  * Populate the sessionsId vector with the Ids of sessions found
@@ -143,11 +164,25 @@ bool get_SPks(const std::string &dbFilename, const std::string &selfDeviceId, co
  */
 size_t get_OPks(const std::string &dbFilename, const std::string &selfDeviceId, const lime::CurveId algo) noexcept;
 
+/* For the given deviceId, count the number of associated OPk with the given status: 1 still on server, 0 dispatched by the server
+ */
+size_t get_OPks(const std::string &dbFilename, const std::string &selfDeviceId, const lime::CurveId algo, const int status) noexcept;
+
 /* Move back in time all timeStamps by the given amout of days
  * DB holds timeStamps in DR_sessions and X3DH_SPK tables
  */
 void forwardTime(const std::string &dbFilename, int days) noexcept;
 
+/* Count the rows of every table in the given DB
+ * return false if the DB could not be read
+ */
+bool get_tablesRowCount(const std::string &dbFilename, std::map<std::string, size_t> &rowCounts) noexcept;
+
+/* Log the statements profile collected on a local storage since its profiler started
+ * return the number of profiled statements
+ */
+size_t dumpDbProfile(std::shared_ptr<lime::Db> localStorage) noexcept;
+
 /**
  * @brief append a random suffix to user name to avoid collision if test server is user by several tests runs
  *
@@ -19,6 +19,8 @@
 
 #include "lime_log.hpp"
 #include "belle-sip/belle-sip.h"
+#include "lime/lime.hpp"
+#include <cstdlib>
 
 #include "lime-tester.hpp"
 #include "lime-tester-utils.hpp"
@@ -95,8 +97,11 @@ static const char* lime_helper =
 		"\t\t\t--operation-timeout <delay in ms to complete basic operations involving server>, default : 4000\n\t\t\t                    you may want to increase this value if you are not using a local X3DH server and experience tests failures\n"
 		"\t\t\t--keep-tmp-db, when set don't delete temporary db files created by tests, useful for debug\n"
 
+		"\t\t\t--rng-seed <seed>, use deterministic random generators seeded with this value so runs are reproducible\n\t\t\t                    requires lime built with ENABLE_DETERMINISTIC_RNG. Device names repeat from run to run: use a fresh X3DH server\n"
 		"\t\t\t--log-file <output log file path>\n"
-		"\t\t\t--bench run benchmarks when set";
+		"\t\t\t--bench run benchmarks when set\n"
+		"\t\t\t--soak-devices <number of devices simulated by the soak benchmark>, default : 8\n"
+		"\t\t\t--soak-days <number of days simulated by the soak benchmark>, default : 180";
 
 int main(int argc, char *argv[]) {
 	int i;
@@ -138,8 +143,24 @@ int main(int argc, char *argv[]) {
 		} else if (strcmp(argv[i],"--operation-timeout")==0){
 			CHECK_ARG("--operation-timeout", ++i, argc);
 			lime_tester::wait_for_timeout=std::atoi(argv[i]);
+		} else if (strcmp(argv[i],"--soak-devices")==0){
+			CHECK_ARG("--soak-devices", ++i, argc);
+			lime_tester::soak_devices=std::atoi(argv[i]);
+		} else if (strcmp(argv[i],"--soak-days")==0){
+			CHECK_ARG("--soak-days", ++i, argc);
+			lime_tester::soak_days=std::atoi(argv[i]);
 		} else if (strcmp(argv[i],"--keep-tmp-db")==0){
 			cleanDatabase=false;
+		} else if (strcmp(argv[i],"--rng-seed")==0){
+			CHECK_ARG("--rng-seed", ++i, argc);
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+			const uint64_t seed = std::strtoull(argv[i], nullptr, 10);
+			lime::LimeManager::set_deterministic_RNG(seed);
+			lime_tester::seedRandom(seed);
+#else
+			LIME_LOGE<<"--rng-seed requires lime built with ENABLE_DETERMINISTIC_RNG";
+			return -2;
+#endif
 		} else if (strcmp(argv[i],"--bench")==0){
 			bench=true;
 		}else {
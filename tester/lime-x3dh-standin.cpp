@@ -0,0 +1,276 @@
+/*
+	lime-x3dh-standin.cpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "lime_log.hpp"
+#include "lime_keys.hpp"
+#include "lime_x3dh.hpp"
+#include "lime_x3dh_protocol.hpp"
+#include "lime-x3dh-standin.hpp"
+
+using namespace::lime;
+using lime::x3dh_protocol::x3dh_message_type;
+using lime::x3dh_protocol::x3dh_error_code;
+
+namespace lime_tester {
+
+namespace {
+	constexpr uint8_t protocolVersion = 0x01;
+	constexpr size_t headerSize = 3;
+
+	/// size of the keys exchanged with the server for a base algorithm
+	struct KeySizes {
+		size_t Ik; /**< identity key */
+		size_t SPk; /**< signed pre key public part, without signature nor Id */
+		size_t SPkSig; /**< signed pre key signature */
+		size_t OPk; /**< one time pre key public part, without Id */
+	};
+
+	template <typename Curve>
+	KeySizes keySizes(void) {
+		return KeySizes{DSA<Curve, lime::DSAtype::publicKey>::ssize(),
+			SignedPreKey<Curve>::signedMessageSize(),
+			SignedPreKey<Curve>::serializedPublicSize() - SignedPreKey<Curve>::signedMessageSize() - 4,
+			OneTimePreKey<Curve>::serializedPublicSize() - 4};
+	}
+
+	/// @return false if the curve id is not supported by this build
+	bool keySizes(const uint8_t curveId, KeySizes &sizes) {
+		switch (static_cast<lime::CurveId>(curveId)) {
+#ifdef EC25519_ENABLED
+			case lime::CurveId::c25519:
+				sizes = keySizes<C255>();
+				return true;
+#endif
+#ifdef EC448_ENABLED
+			case lime::CurveId::c448:
+				sizes = keySizes<C448>();
+				return true;
+#endif
+#ifdef HAVE_BCTBXPQ
+			case lime::CurveId::c25519k512:
+				sizes = keySizes<C255K512>();
+				return true;
+			case lime::CurveId::c25519mlk512:
+				sizes = keySizes<C255MLK512>();
+				return true;
+			case lime::CurveId::c448mlk1024:
+				sizes = keySizes<C448MLK1024>();
+				return true;
+#endif
+			default:
+				return false;
+		}
+	}
+
+	std::vector<uint8_t> header(const x3dh_message_type type, const uint8_t curveId) {
+		return std::vector<uint8_t>{protocolVersion, static_cast<uint8_t>(type), curveId};
+	}
+
+	std::vector<uint8_t> error(const uint8_t curveId, const x3dh_error_code code, const std::string &message) {
+		auto response = header(x3dh_message_type::error, curveId);
+		response.push_back(static_cast<uint8_t>(code));
+		response.insert(response.end(), message.cbegin(), message.cend());
+		return response;
+	}
+
+	uint16_t readU16(const std::vector<uint8_t> &buffer, const size_t index) {
+		return static_cast<uint16_t>(buffer[index]<<8 | buffer[index+1]);
+	}
+
+	void pushU16(std::vector<uint8_t> &buffer, const size_t value) {
+		buffer.push_back(static_cast<uint8_t>((value>>8)&0xFF));
+		buffer.push_back(static_cast<uint8_t>(value&0xFF));
+	}
+
+	/// read an uploaded SPk: public key || signature || Id and store it in key bundle order: public key || Id || signature
+	std::vector<uint8_t> readSPk(const std::vector<uint8_t> &buffer, const size_t index, const KeySizes &sizes) {
+		auto SPk = std::vector<uint8_t>(buffer.cbegin()+index, buffer.cbegin()+index+sizes.SPk);
+		const auto sig = buffer.cbegin()+index+sizes.SPk;
+		SPk.insert(SPk.end(), sig+sizes.SPkSig, sig+sizes.SPkSig+4);
+		SPk.insert(SPk.end(), sig, sig+sizes.SPkSig);
+		return SPk;
+	}
+
+	/// read a list of uploaded OPks: count(2 bytes) || (public key || Id)...
+	bool readOPks(const std::vector<uint8_t> &buffer, const size_t index, const KeySizes &sizes, std::list<std::vector<uint8_t>> &OPks) {
+		if (buffer.size() < index + 2) return false;
+		const size_t count = readU16(buffer, index);
+		const size_t OPkSize = sizes.OPk + 4;
+		if (buffer.size() != index + 2 + count*OPkSize) return false;
+		for (size_t i=0; i<count; i++) {
+			const auto OPk = buffer.cbegin() + index + 2 + i*OPkSize;
+			OPks.emplace_back(OPk, OPk+OPkSize);
+		}
+		return true;
+	}
+} // anonymous namespace
+
+lime::limeX3DHServerPostData X3DHServerStandIn::postData(void) {
+	return [this](const std::string &url, const std::string &from, std::vector<uint8_t> &&message, const lime::limeX3DHServerResponseProcess &responseProcess) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_requests.push_back(Request{from, std::move(message), responseProcess});
+	};
+}
+
+size_t X3DHServerStandIn::process(void) {
+	size_t processed = 0;
+	while (true) {
+		Request request;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_requests.empty()) return processed;
+			request = std::move(m_requests.front());
+			m_requests.pop_front();
+		}
+		auto response = answer(request.from, request.message);
+		processed++;
+		// the response process may post new requests: call it without holding the lock
+		request.responseProcess(200, response);
+	}
+}
+
+size_t X3DHServerStandIn::devicesCount(void) {
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_devices.size();
+}
+
+/**
+ * @brief Build the server response to a request, as the nodejs test server does
+ *
+ * @param[in]	from	the device Id posting the request
+ * @param[in]	message	the request
+ *
+ * @return the response body
+ */
+std::vector<uint8_t> X3DHServerStandIn::answer(const std::string &from, const std::vector<uint8_t> &message) {
+	if (message.size() < headerSize) {
+		return error(0, x3dh_error_code::bad_size, "Packet is not even holding a header");
+	}
+	const uint8_t curveId = message[2];
+	if (message[0] != protocolVersion) {
+		return error(curveId, x3dh_error_code::bad_x3dh_protocol_version, "Server running X3DH procotol version 1");
+	}
+	KeySizes sizes{};
+	if (!keySizes(curveId, sizes)) {
+		return error(curveId, x3dh_error_code::bad_curve, "Unsupported curve");
+	}
+	if (from.empty()) {
+		return error(curveId, x3dh_error_code::missing_senderId, "Missing sender Id");
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const auto deviceKey = std::make_pair(curveId, from);
+	auto device = m_devices.find(deviceKey);
+	const auto type = static_cast<x3dh_message_type>(message[1]);
+
+	if (type != x3dh_message_type::registerUser && type != x3dh_message_type::getPeerBundle && device == m_devices.end()) {
+		return error(curveId, x3dh_error_code::user_not_found, "User not found");
+	}
+
+	switch (type) {
+		case x3dh_message_type::registerUser: {
+			if (device != m_devices.end()) {
+				return error(curveId, x3dh_error_code::user_already_in, "Can't insert user - already in");
+			}
+			const size_t SPkIndex = headerSize + sizes.Ik;
+			const size_t OPksIndex = SPkIndex + sizes.SPk + sizes.SPkSig + 4;
+			Device newDevice{};
+			if (message.size() < OPksIndex || !readOPks(message, OPksIndex, sizes, newDevice.OPks)) {
+				return error(curveId, x3dh_error_code::bad_size, "Register user packet is invalid");
+			}
+			newDevice.Ik.assign(message.cbegin()+headerSize, message.cbegin()+SPkIndex);
+			newDevice.SPk = readSPk(message, SPkIndex, sizes);
+			m_devices.emplace(deviceKey, std::move(newDevice));
+			return header(type, curveId);
+		}
+
+		case x3dh_message_type::deleteUser:
+			m_devices.erase(device);
+			return header(type, curveId);
+
+		case x3dh_message_type::postSPk:
+			if (message.size() != headerSize + sizes.SPk + sizes.SPkSig + 4) {
+				return error(curveId, x3dh_error_code::bad_size, "post SPk packet is invalid");
+			}
+			device->second.SPk = readSPk(message, headerSize, sizes);
+			return header(type, curveId);
+
+		case x3dh_message_type::postOPks: {
+			std::list<std::vector<uint8_t>> OPks{};
+			if (!readOPks(message, headerSize, sizes, OPks)) {
+				return error(curveId, x3dh_error_code::bad_size, "post OPks packet is invalid");
+			}
+			device->second.OPks.splice(device->second.OPks.end(), OPks);
+			return header(type, curveId);
+		}
+
+		case x3dh_message_type::getPeerBundle: {
+			if (message.size() < headerSize + 2) {
+				return error(curveId, x3dh_error_code::bad_size, "get Peer Bundles packet is invalid");
+			}
+			const size_t count = readU16(message, headerSize);
+			auto response = header(x3dh_message_type::peerBundle, curveId);
+			pushU16(response, count);
+			size_t index = headerSize + 2;
+			for (size_t i=0; i<count; i++) {
+				if (message.size() < index + 2) {
+					return error(curveId, x3dh_error_code::bad_size, "get Peer Bundles packet is invalid");
+				}
+				const size_t idSize = readU16(message, index);
+				index += 2;
+				if (message.size() < index + idSize) {
+					return error(curveId, x3dh_error_code::bad_size, "get Peer Bundles packet is invalid");
+				}
+				const std::string peerId{message.cbegin()+index, message.cbegin()+index+idSize};
+				index += idSize;
+				pushU16(response, idSize);
+				response.insert(response.end(), peerId.cbegin(), peerId.cend());
+
+				auto peer = m_devices.find(std::make_pair(curveId, peerId));
+				if (peer == m_devices.end()) {
+					response.push_back(static_cast<uint8_t>(lime::X3DHKeyBundleFlag::noBundle));
+					continue;
+				}
+				auto &peerKeys = peer->second;
+				response.push_back(static_cast<uint8_t>(peerKeys.OPks.empty()?lime::X3DHKeyBundleFlag::noOPk:lime::X3DHKeyBundleFlag::OPk));
+				response.insert(response.end(), peerKeys.Ik.cbegin(), peerKeys.Ik.cend());
+				response.insert(response.end(), peerKeys.SPk.cbegin(), peerKeys.SPk.cend());
+				if (!peerKeys.OPks.empty()) { // an OPk is served only once
+					response.insert(response.end(), peerKeys.OPks.front().cbegin(), peerKeys.OPks.front().cend());
+					peerKeys.OPks.pop_front();
+				}
+			}
+			return response;
+		}
+
+		case x3dh_message_type::getSelfOPks: {
+			auto response = header(x3dh_message_type::selfOPks, curveId);
+			pushU16(response, device->second.OPks.size());
+			for (const auto &OPk : device->second.OPks) {
+				response.insert(response.end(), OPk.cend()-4, OPk.cend());
+			}
+			return response;
+		}
+
+		default:
+			LIME_LOGE<<"X3DH server stand-in got an unexpected message type "<<static_cast<unsigned int>(message[1]);
+			return error(curveId, x3dh_error_code::bad_request, "Unexpected message type");
+	}
+}
+
+} // namespace lime_tester
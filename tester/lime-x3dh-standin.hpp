@@ -0,0 +1,77 @@
+/*
+	lime-x3dh-standin.hpp
+	@copyright	Copyright (C) 2026  Belledonne Communications SARL
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef lime_x3dh_standin_hpp
+#define lime_x3dh_standin_hpp
+
+#include "lime/lime.hpp"
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace lime_tester {
+
+/**
+ * @brief An in-process stand-in for the X3DH key server
+ *
+ * It speaks the X3DH protocol the way the nodejs test server does but keeps the users in memory, without users lifetime nor
+ * resource limits. The requests are queued and answered when process() is called: the managers using it get their responses
+ * on the thread calling process(), as they would when ticking the belle-sip stack with the actual server.
+ * The stand-in must outlive the managers it serves.
+ */
+class X3DHServerStandIn {
+	private:
+		/// a device published on the server, keys are stored as they are sent in a key bundle
+		struct Device {
+			std::vector<uint8_t> Ik;
+			std::vector<uint8_t> SPk; /**< public key || Id || signature */
+			std::list<std::vector<uint8_t>> OPks; /**< public key || Id */
+		};
+		/// a request waiting for process()
+		struct Request {
+			std::string from;
+			std::vector<uint8_t> message;
+			lime::limeX3DHServerResponseProcess responseProcess;
+		};
+
+		std::mutex m_mutex; // protect the requests queue and the devices
+		std::deque<Request> m_requests;
+		std::map<std::pair<uint8_t, std::string>, Device> m_devices; // indexed by curve id and device id
+
+		std::vector<uint8_t> answer(const std::string &from, const std::vector<uint8_t> &message);
+
+	public:
+		X3DHServerStandIn() = default;
+		X3DHServerStandIn(const X3DHServerStandIn &) = delete;
+		X3DHServerStandIn &operator=(const X3DHServerStandIn &) = delete;
+
+		/// @return the function to give to a LimeManager so it posts its X3DH requests to this stand-in
+		lime::limeX3DHServerPostData postData(void);
+		/**
+		 * @brief Answer the queued requests, including the ones posted while processing
+		 * @return the number of requests answered
+		 */
+		size_t process(void);
+		/// @return the number of devices published, all curves included
+		size_t devicesCount(void);
+};
+
+} // namespace lime_tester
+
+#endif //lime_x3dh_standin_hpp
@@ -686,6 +686,228 @@ static void hashMac_KDF(void) {
 	}
 }
 
+using chainKey = lime::sBuffer<lime::settings::DRChainKeySize>;
+using messageKey = lime::sBuffer<lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize>;
+
+/* Run the symmetric ratchet derivation(as in DR KDF_CK) on a chain of steps, using HMAC or HMAC key schedule */
+static void hashMac_chain(chainKey &CK, messageKey &MK, const size_t steps, const bool useKeySchedule) {
+	const std::array<uint8_t,1> mk_info{{0x01}};
+	const std::array<uint8_t,1> ck_info{{0x02}};
+	for (size_t i=0; i<steps; i++) {
+		if (useKeySchedule) {
+			HMACKeySchedule<SHA512> hmacCK(CK.data(), CK.size());
+			hmacCK.compute(mk_info.data(), mk_info.size(), MK.data(), MK.size());
+			hmacCK.compute(ck_info.data(), ck_info.size(), CK.data(), CK.size());
+		} else {
+			HMAC<SHA512>(CK.data(), CK.size(), mk_info.data(), mk_info.size(), MK.data(), MK.size());
+			chainKey tmp;
+			HMAC<SHA512>(CK.data(), CK.size(), ck_info.data(), ck_info.size(), tmp.data(), tmp.size());
+			CK = tmp;
+		}
+	}
+}
+
+static void hashMac_chain_bench(uint64_t runTime_ms, const size_t steps, const bool useKeySchedule) {
+	chainKey CK;
+	messageKey MK;
+	lime_tester::randomize(CK.data(), CK.size());
+
+	auto start = bctbx_get_cur_time_ms();
+	uint64_t span=0;
+	size_t runCount = 0;
+
+	while (span<runTime_ms) {
+		hashMac_chain(CK, MK, steps, useKeySchedule);
+		span = bctbx_get_cur_time_ms() - start;
+		runCount++;
+	}
+
+	auto freq = 1000*runCount/static_cast<double>(span);
+	std::string freq_unit, period_unit;
+	snprintSI(freq_unit, freq, "catch-up/s");
+	snprintSI(period_unit, 1/freq, "s/catch-up");
+	LIME_LOGI<<(useKeySchedule?"HMAC key schedule":"HMAC")<<": run "<<int(runCount)<<" chain catch-up of "<<int(steps)<<" steps in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl<<endl;
+}
+
+/* Derive the next message key of recipientsCount sending chains(as in DR KDF_CK), one by one with the key schedule or all at once with the multi-key schedule */
+static void hashMac_fanOut(std::vector<chainKey> &CKs, std::vector<messageKey> &MKs, const bool useMultiKey) {
+	const std::array<uint8_t,1> mk_info{{0x01}};
+	const std::array<uint8_t,1> ck_info{{0x02}};
+	if (useMultiKey) {
+		std::vector<const uint8_t *> keys{};
+		std::vector<uint8_t *> MKptr{};
+		std::vector<uint8_t *> CKptr{};
+		for (size_t i=0; i<CKs.size(); i++) {
+			keys.push_back(CKs[i].data());
+			MKptr.push_back(MKs[i].data());
+			CKptr.push_back(CKs[i].data());
+		}
+		HMACMultiKeySchedule<SHA512> hmacCKs(keys, lime::settings::DRChainKeySize);
+		hmacCKs.compute(std::vector<const uint8_t *>(CKs.size(), mk_info.data()), mk_info.size(), MKptr, lime::settings::DRMessageKeySize+lime::settings::DRMessageIVSize);
+		hmacCKs.compute(std::vector<const uint8_t *>(CKs.size(), ck_info.data()), ck_info.size(), CKptr, lime::settings::DRChainKeySize);
+	} else {
+		for (size_t i=0; i<CKs.size(); i++) {
+			HMACKeySchedule<SHA512> hmacCK(CKs[i].data(), CKs[i].size());
+			hmacCK.compute(mk_info.data(), mk_info.size(), MKs[i].data(), MKs[i].size());
+			hmacCK.compute(ck_info.data(), ck_info.size(), CKs[i].data(), CKs[i].size());
+		}
+	}
+}
+
+static void hashMac_fanOut_bench(uint64_t runTime_ms, const size_t recipientsCount, const bool useMultiKey) {
+	std::vector<chainKey> CKs(recipientsCount);
+	std::vector<messageKey> MKs(recipientsCount);
+	for (auto &CK : CKs) {
+		lime_tester::randomize(CK.data(), CK.size());
+	}
+
+	auto start = bctbx_get_cur_time_ms();
+	uint64_t span=0;
+	size_t runCount = 0;
+
+	while (span<runTime_ms) {
+		hashMac_fanOut(CKs, MKs, useMultiKey);
+		span = bctbx_get_cur_time_ms() - start;
+		runCount++;
+	}
+
+	auto freq = 1000*runCount/static_cast<double>(span);
+	std::string freq_unit, period_unit;
+	snprintSI(freq_unit, freq, "fan-out/s");
+	snprintSI(period_unit, 1/freq, "s/fan-out");
+	LIME_LOGI<<(useMultiKey?"HMAC multi-key schedule(":"HMAC key schedule(")<<(useMultiKey?int(HMACMultiKeySchedule<SHA512>::lanes()):1)<<" lanes): run "<<int(runCount)<<" derivations for "<<int(recipientsCount)<<" recipients in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit<<endl<<endl;
+}
+
+static void hashMac(void) {
+	/* test patterns from RFC4231 for HMAC-SHA512 */
+	/* test case 1 */
+	std::vector<uint8_t> key(20, 0x0b);
+	std::string data{"Hi There"};
+	std::vector<uint8_t> pattern{0x87, 0xaa, 0x7c, 0xde, 0xa5, 0xef, 0x61, 0x9d, 0x4f, 0xf0, 0xb4, 0x24, 0x1a, 0x1d, 0x6c, 0xb0, 0x23, 0x79, 0xf4, 0xe2, 0xce, 0x4e, 0xc2, 0x78, 0x7a, 0xd0, 0xb3, 0x05, 0x45, 0xe1, 0x7c, 0xde, 0xda, 0xa8, 0x33, 0xb7, 0xd6, 0xb8, 0xa7, 0x02, 0x03, 0x8b, 0x27, 0x4e, 0xae, 0xa3, 0xf4, 0xe4, 0xbe, 0x9d, 0x91, 0x4e, 0xeb, 0x61, 0xf1, 0x70, 0x2e, 0x69, 0x6c, 0x20, 0x3a, 0x12, 0x68, 0x54};
+	std::vector<uint8_t> output(SHA512::ssize());
+	HMACKeySchedule<SHA512> hmac1(key.data(), key.size());
+	hmac1.compute(reinterpret_cast<const uint8_t *>(data.data()), data.size(), output.data(), output.size());
+	BC_ASSERT_TRUE(output==pattern);
+
+	/* test case 2 */
+	std::string jefe{"Jefe"};
+	data.assign("what do ya want for nothing?");
+	pattern.assign({0x16, 0x4b, 0x7a, 0x7b, 0xfc, 0xf8, 0x19, 0xe2, 0xe3, 0x95, 0xfb, 0xe7, 0x3b, 0x56, 0xe0, 0xa3, 0x87, 0xbd, 0x64, 0x22, 0x2e, 0x83, 0x1f, 0xd6, 0x10, 0x27, 0x0c, 0xd7, 0xea, 0x25, 0x05, 0x54, 0x97, 0x58, 0xbf, 0x75, 0xc0, 0x5a, 0x99, 0x4a, 0x6d, 0x03, 0x4f, 0x65, 0xf8, 0xf0, 0xe6, 0xfd, 0xca, 0xea, 0xb1, 0xa3, 0x4d, 0x4a, 0x6b, 0x4b, 0x63, 0x6e, 0x07, 0x0a, 0x38, 0xbc, 0xe7, 0x37});
+	HMACKeySchedule<SHA512> hmac2(reinterpret_cast<const uint8_t *>(jefe.data()), jefe.size());
+	hmac2.compute(reinterpret_cast<const uint8_t *>(data.data()), data.size(), output.data(), output.size());
+	BC_ASSERT_TRUE(output==pattern);
+
+	/* test case 6: key larger than the block size */
+	key.assign(131, 0xaa);
+	data.assign("Test Using Larger Than Block-Size Key - Hash Key First");
+	pattern.assign({0x80, 0xb2, 0x42, 0x63, 0xc7, 0xc1, 0xa3, 0xeb, 0xb7, 0x14, 0x93, 0xc1, 0xdd, 0x7b, 0xe8, 0xb4, 0x9b, 0x46, 0xd1, 0xf4, 0x1b, 0x4a, 0xee, 0xc1, 0x12, 0x1b, 0x01, 0x37, 0x83, 0xf8, 0xf3, 0x52, 0x6b, 0x56, 0xd0, 0x37, 0xe0, 0x5f, 0x25, 0x98, 0xbd, 0x0f, 0xd2, 0x21, 0x5d, 0x6a, 0x1e, 0x52, 0x95, 0xe6, 0x4f, 0x73, 0xf6, 0x3f, 0x0a, 0xec, 0x8b, 0x91, 0x5a, 0x98, 0x5d, 0x78, 0x65, 0x98});
+	HMACKeySchedule<SHA512> hmac6(key.data(), key.size());
+	hmac6.compute(reinterpret_cast<const uint8_t *>(data.data()), data.size(), output.data(), output.size());
+	BC_ASSERT_TRUE(output==pattern);
+	/* the key schedule can be used several times */
+	hmac6.compute(reinterpret_cast<const uint8_t *>(data.data()), data.size(), output.data(), output.size());
+	BC_ASSERT_TRUE(output==pattern);
+
+	/* check against the one call HMAC on random keys and inputs of various sizes, with truncated output */
+	for (auto keySize : {0, 32, 128, 129, 200}) {
+		for (auto inputSize : {0, 3, 111, 112, 128, 300}) {
+			std::vector<uint8_t> randomKey(keySize);
+			std::vector<uint8_t> input(inputSize);
+			lime_tester::randomize(randomKey.data(), randomKey.size());
+			lime_tester::randomize(input.data(), input.size());
+			std::vector<uint8_t> expected(48);
+			std::vector<uint8_t> computed(48);
+			HMAC<SHA512>(randomKey.data(), randomKey.size(), input.data(), input.size(), expected.data(), expected.size());
+			HMACKeySchedule<SHA512> hmac(randomKey.data(), randomKey.size());
+			hmac.compute(input.data(), input.size(), computed.data(), computed.size());
+			BC_ASSERT_TRUE(expected==computed);
+		}
+	}
+
+	/* a symmetric ratchet chain gives the same keys with both */
+	chainKey CK1, CK2;
+	messageKey MK1, MK2;
+	lime_tester::randomize(CK1.data(), CK1.size());
+	CK2 = CK1;
+	hashMac_chain(CK1, MK1, 512, false);
+	hashMac_chain(CK2, MK2, 512, true);
+	BC_ASSERT_TRUE(CK1==CK2);
+	BC_ASSERT_TRUE(MK1==MK2);
+
+	/* multi-key schedule: check against the one call HMAC with every kernel available (scalar, 4 and 8 lanes) and a count of keys not multiple of the lanes */
+	for (auto maxLanes : {1, 4, 8}) {
+		HMACMultiKeySchedule<SHA512>::limitLanes(maxLanes);
+		for (auto keysCount : {1, 3, 4, 7, 8, 13, 33}) {
+			for (auto keySize : {32, 129}) {
+				for (auto inputSize : {1, 3, 112, 200}) {
+					std::vector<std::vector<uint8_t>> randomKeys(keysCount, std::vector<uint8_t>(keySize));
+					std::vector<std::vector<uint8_t>> inputs(keysCount, std::vector<uint8_t>(inputSize));
+					std::vector<std::vector<uint8_t>> computed(keysCount, std::vector<uint8_t>(48));
+					std::vector<const uint8_t *> keysPtr{};
+					std::vector<const uint8_t *> inputsPtr{};
+					std::vector<uint8_t *> computedPtr{};
+					for (int i=0; i<keysCount; i++) {
+						lime_tester::randomize(randomKeys[i].data(), randomKeys[i].size());
+						lime_tester::randomize(inputs[i].data(), inputs[i].size());
+						keysPtr.push_back(randomKeys[i].data());
+						inputsPtr.push_back(inputs[i].data());
+						computedPtr.push_back(computed[i].data());
+					}
+					HMACMultiKeySchedule<SHA512> hmac(keysPtr, keySize);
+					BC_ASSERT_EQUAL(hmac.size(), static_cast<size_t>(keysCount), size_t, "%zu");
+					hmac.compute(inputsPtr, inputSize, computedPtr, 48);
+					for (int i=0; i<keysCount; i++) {
+						std::vector<uint8_t> expected(48);
+						HMAC<SHA512>(randomKeys[i].data(), randomKeys[i].size(), inputs[i].data(), inputs[i].size(), expected.data(), expected.size());
+						BC_ASSERT_TRUE(expected==computed[i]);
+					}
+				}
+			}
+		}
+		/* a sending chains fan-out gives the same keys than the single key schedule */
+		std::vector<chainKey> CKs1(37), CKs2;
+		std::vector<messageKey> MKs1(37), MKs2(37);
+		for (auto &CK : CKs1) {
+			lime_tester::randomize(CK.data(), CK.size());
+		}
+		CKs2 = CKs1;
+		hashMac_fanOut(CKs1, MKs1, false);
+		hashMac_fanOut(CKs2, MKs2, true);
+		BC_ASSERT_TRUE(CKs1==CKs2);
+		BC_ASSERT_TRUE(MKs1==MKs2);
+	}
+	HMACMultiKeySchedule<SHA512>::limitLanes(8);
+
+	/* inputs count must match the keys count */
+	{
+		std::vector<uint8_t> k(32), in(1), out(64);
+		HMACMultiKeySchedule<SHA512> hmac(std::vector<const uint8_t *>{k.data(), k.data()}, k.size());
+		bool thrown = false;
+		try {
+			hmac.compute(std::vector<const uint8_t *>{in.data()}, in.size(), std::vector<uint8_t *>{out.data()}, out.size());
+		} catch (BctbxException &) {
+			thrown = true;
+		}
+		BC_ASSERT_TRUE(thrown);
+	}
+
+	/* Run benchmarks: a decrypt catching up through 512 skipped messages */
+	if (bench) {
+		LIME_LOGI<<"Bench for symmetric ratchet chain catch-up of 512 steps"<<endl;
+		hashMac_chain_bench(BENCH_TIMING_MS, 512, false);
+		hashMac_chain_bench(BENCH_TIMING_MS, 512, true);
+
+		/* an encryption to 1000 recipients devices */
+		LIME_LOGI<<"Bench for sending chains derivation of 1000 recipients"<<endl;
+		hashMac_fanOut_bench(BENCH_TIMING_MS, 1000, false);
+		for (auto maxLanes : {1, 4, 8}) {
+			HMACMultiKeySchedule<SHA512>::limitLanes(maxLanes);
+			hashMac_fanOut_bench(BENCH_TIMING_MS, 1000, true);
+		}
+		HMACMultiKeySchedule<SHA512>::limitLanes(8);
+	}
+}
+
 static void AEAD(void) {
 	std::vector<uint8_t> cipher{};
 	std::vector<uint8_t> tag{};
@@ -885,6 +1107,227 @@ static void AEAD(void) {
 	BC_ASSERT_TRUE(plain==pattern_plain);
 }
 
+/* Run f in a loop for runTime_ms and log the timing */
+template <typename F>
+static void cryptoProviders_benchRun(const std::string &label, uint64_t runTime_ms, F &&f) {
+	constexpr size_t batch_size = 100;
+	auto start = bctbx_get_cur_time_ms();
+	uint64_t span=0;
+	size_t runCount = 0;
+
+	while (span<runTime_ms) {
+		for (size_t i=0; i<batch_size; i++) {
+			f();
+		}
+		span = bctbx_get_cur_time_ms() - start;
+		runCount += batch_size;
+	}
+
+	auto freq = 1000*runCount/static_cast<double>(span);
+	std::string freq_unit, period_unit;
+	snprintSI(freq_unit, freq, "op/s");
+	snprintSI(period_unit, 1/freq, "s/op");
+	LIME_LOGI<<label<<": "<<int(runCount)<<" operations in "<<int(span)<<" ms : "<<period_unit<<" "<<freq_unit;
+}
+
+template <typename Curve>
+static void cryptoProviders_bench(const CryptoProvider provider, uint64_t runTime_ms) {
+	auto rng = make_RNG();
+	auto Alice = make_keyExchange<Curve>(provider);
+	auto Bob = make_keyExchange<Curve>(provider);
+	Alice->createKeyPair(rng);
+	Bob->createKeyPair(rng);
+	Alice->set_peerPublic(Bob->get_selfPublic());
+	cryptoProviders_benchRun("  Shared secret", runTime_ms, [&Alice]() {Alice->computeSharedSecret();});
+
+	auto signer = make_Signature<Curve>(provider);
+	auto verifier = make_Signature<Curve>(provider);
+	signer->createKeyPair(rng);
+	verifier->set_public(signer->get_public());
+	auto message = Alice->get_selfPublic();
+	DSA<Curve, lime::DSAtype::signature> signature;
+	cryptoProviders_benchRun("  Sign", runTime_ms, [&]() {signer->sign(message, signature);});
+	cryptoProviders_benchRun("  Verify", runTime_ms, [&]() {verifier->verify(message, signature);});
+}
+
+static void cryptoProviders_bench(const CryptoProvider provider, uint64_t runTime_ms) {
+	/* HMAC as used by the symmetric ratchet: 32 bytes key, 1 byte input */
+	std::vector<uint8_t> key(AES256GCM::keySize());
+	std::vector<uint8_t> input(1, 0x01);
+	std::vector<uint8_t> output(SHA512::ssize());
+	lime_tester::randomize(key.data(), key.size());
+	cryptoProviders_benchRun("  HMAC-SHA512", runTime_ms, [&]() {HMAC<SHA512>(provider, key.data(), key.size(), input.data(), input.size(), output.data(), output.size());});
+
+	/* HKDF as used by X3DH */
+	std::vector<uint8_t> salt(SHA512::ssize(), 0);
+	std::vector<uint8_t> IKM(128);
+	lime_tester::randomize(IKM.data(), IKM.size());
+	std::string info{"The lime tester info string"};
+	cryptoProviders_benchRun("  HKDF-SHA512", runTime_ms, [&]() {HMAC_KDF<SHA512>(provider, salt.data(), salt.size(), IKM.data(), IKM.size(), info.data(), info.size(), output.data(), output.size());});
+
+	/* AEAD on a chat message size payload and on a file transfer chunk size */
+	std::vector<uint8_t> IV(12);
+	std::vector<uint8_t> AD(64);
+	std::vector<uint8_t> tag(AES256GCM::tagSize());
+	lime_tester::randomize(IV.data(), IV.size());
+	lime_tester::randomize(AD.data(), AD.size());
+	for (size_t plainSize : {64, 4096}) {
+		std::vector<uint8_t> plain(plainSize);
+		std::vector<uint8_t> cipher(plainSize);
+		lime_tester::randomize(plain.data(), plain.size());
+		cryptoProviders_benchRun("  AES256-GCM encrypt "+std::to_string(plainSize)+" bytes", runTime_ms, [&]() {
+			AEAD_encrypt<AES256GCM>(provider, key.data(), key.size(), IV.data(), IV.size(), plain.data(), plain.size(), AD.data(), AD.size(), tag.data(), tag.size(), cipher.data());
+		});
+		cryptoProviders_benchRun("  AES256-GCM decrypt "+std::to_string(plainSize)+" bytes", runTime_ms, [&]() {
+			AEAD_decrypt<AES256GCM>(provider, key.data(), key.size(), IV.data(), IV.size(), cipher.data(), cipher.size(), AD.data(), AD.size(), tag.data(), tag.size(), plain.data());
+		});
+	}
+#ifdef EC25519_ENABLED
+	LIME_LOGI<<" Curve 25519:";
+	cryptoProviders_bench<C255>(provider, runTime_ms);
+#endif
+#ifdef EC448_ENABLED
+	LIME_LOGI<<" Curve 448:";
+	cryptoProviders_bench<C448>(provider, runTime_ms);
+#endif
+}
+
+/* Keys and outputs given by one provider must be accepted and matched by the other one */
+template <typename Curve>
+static void cryptoProviders_test(const CryptoProvider providerA, const CryptoProvider providerB) {
+	auto rng = make_RNG();
+	std::vector<uint8_t> message(200);
+	lime_tester::randomize(message.data(), message.size());
+
+	/* Signature: same public key derivation, EdDSA is deterministic so signatures must match */
+	auto signerA = make_Signature<Curve>(providerA);
+	auto signerB = make_Signature<Curve>(providerB);
+	signerA->createKeyPair(rng);
+	signerB->set_secret(signerA->get_secret());
+	signerB->derivePublic();
+	BC_ASSERT_TRUE(signerA->get_public() == signerB->get_public());
+	DSA<Curve, lime::DSAtype::signature> signatureA, signatureB;
+	signerA->sign(message, signatureA);
+	signerB->sign(message, signatureB);
+	BC_ASSERT_TRUE(signatureA == signatureB);
+	auto verifierB = make_Signature<Curve>(providerB);
+	verifierB->set_public(signerA->get_public());
+	BC_ASSERT_TRUE(verifierB->verify(message, signatureA));
+	message[0] ^= 0x01;
+	BC_ASSERT_FALSE(verifierB->verify(message, signatureA));
+
+	/* Key exchange: same public key derivation and shared secret */
+	auto AliceA = make_keyExchange<Curve>(providerA);
+	auto AliceB = make_keyExchange<Curve>(providerB);
+	auto BobB = make_keyExchange<Curve>(providerB);
+	AliceA->createKeyPair(rng);
+	AliceB->set_secret(AliceA->get_secret());
+	AliceB->deriveSelfPublic();
+	BC_ASSERT_TRUE(AliceA->get_selfPublic() == AliceB->get_selfPublic());
+	BobB->createKeyPair(rng);
+	AliceA->set_peerPublic(BobB->get_selfPublic());
+	BobB->set_peerPublic(AliceA->get_selfPublic());
+	AliceA->computeSharedSecret();
+	BobB->computeSharedSecret();
+	BC_ASSERT_TRUE(AliceA->get_sharedSecret() == BobB->get_sharedSecret());
+
+	/* Signature keys conversion into key exchange ones */
+	AliceA->set_secret(signerA->get_secret());
+	AliceB->set_secret(signerA->get_secret());
+	BC_ASSERT_TRUE(AliceA->get_secret() == AliceB->get_secret());
+	AliceA->set_selfPublic(signerA->get_public());
+	AliceB->set_selfPublic(signerA->get_public());
+	BC_ASSERT_TRUE(AliceA->get_selfPublic() == AliceB->get_selfPublic());
+	AliceB->deriveSelfPublic(); // the converted public key matches the one derived from the converted private key
+	BC_ASSERT_TRUE(AliceA->get_selfPublic() == AliceB->get_selfPublic());
+	AliceA->set_peerPublic(signerA->get_public());
+	BC_ASSERT_TRUE(AliceA->get_peerPublic() == AliceB->get_selfPublic());
+}
+
+static void cryptoProviders_test(const CryptoProvider providerA, const CryptoProvider providerB) {
+	/* HMAC and HKDF on keys, inputs and outputs of various sizes */
+	for (auto keySize : {0, 32, 64, 129}) {
+		for (auto inputSize : {0, 1, 33, 200}) {
+			std::vector<uint8_t> key(keySize);
+			std::vector<uint8_t> input(inputSize);
+			lime_tester::randomize(key.data(), key.size());
+			lime_tester::randomize(input.data(), input.size());
+			for (auto outputSize : {16, 48, 64}) {
+				std::vector<uint8_t> outputA(outputSize), outputB(outputSize);
+				HMAC<SHA512>(providerA, key.data(), key.size(), input.data(), input.size(), outputA.data(), outputA.size());
+				HMAC<SHA512>(providerB, key.data(), key.size(), input.data(), input.size(), outputB.data(), outputB.size());
+				BC_ASSERT_TRUE(outputA == outputB);
+			}
+			if (inputSize > 0) { // input key material for HKDF
+				std::string info{"cross provider"};
+				for (auto outputSize : {32, 64, 96}) {
+					std::vector<uint8_t> outputA(outputSize), outputB(outputSize);
+					HMAC_KDF<SHA512>(providerA, key.data(), key.size(), input.data(), input.size(), info.data(), info.size(), outputA.data(), outputA.size());
+					HMAC_KDF<SHA512>(providerB, key.data(), key.size(), input.data(), input.size(), info.data(), info.size(), outputB.data(), outputB.size());
+					BC_ASSERT_TRUE(outputA == outputB);
+				}
+			}
+		}
+	}
+
+	/* AEAD: encrypt with one, decrypt with the other */
+	std::vector<uint8_t> key(AES256GCM::keySize());
+	std::vector<uint8_t> IV(12);
+	lime_tester::randomize(key.data(), key.size());
+	lime_tester::randomize(IV.data(), IV.size());
+	for (auto ADSize : {0, 20, 200}) {
+		for (auto plainSize : {0, 1, 16, 33, 1000}) {
+			std::vector<uint8_t> AD(ADSize);
+			std::vector<uint8_t> plain(plainSize);
+			lime_tester::randomize(AD.data(), AD.size());
+			lime_tester::randomize(plain.data(), plain.size());
+			std::vector<uint8_t> cipherA(plainSize), cipherB(plainSize), decrypted(plainSize);
+			std::vector<uint8_t> tagA(AES256GCM::tagSize()), tagB(AES256GCM::tagSize());
+			AEAD_encrypt<AES256GCM>(providerA, key.data(), key.size(), IV.data(), IV.size(), plain.data(), plain.size(), AD.data(), AD.size(), tagA.data(), tagA.size(), cipherA.data());
+			AEAD_encrypt<AES256GCM>(providerB, key.data(), key.size(), IV.data(), IV.size(), plain.data(), plain.size(), AD.data(), AD.size(), tagB.data(), tagB.size(), cipherB.data());
+			BC_ASSERT_TRUE(cipherA == cipherB);
+			BC_ASSERT_TRUE(tagA == tagB);
+			BC_ASSERT_TRUE(AEAD_decrypt<AES256GCM>(providerB, key.data(), key.size(), IV.data(), IV.size(), cipherA.data(), cipherA.size(), AD.data(), AD.size(), tagA.data(), tagA.size(), decrypted.data()));
+			BC_ASSERT_TRUE(decrypted == plain);
+			tagA[0] ^= 0x01;
+			BC_ASSERT_FALSE(AEAD_decrypt<AES256GCM>(providerB, key.data(), key.size(), IV.data(), IV.size(), cipherA.data(), cipherA.size(), AD.data(), AD.size(), tagA.data(), tagA.size(), decrypted.data()));
+		}
+	}
+
+#ifdef EC25519_ENABLED
+	cryptoProviders_test<C255>(providerA, providerB);
+#endif
+#ifdef EC448_ENABLED
+	cryptoProviders_test<C448>(providerA, providerB);
+#endif
+}
+
+static void cryptoProviders(void) {
+	if (!cryptoProviderAvailable(CryptoProvider::openssl)) {
+		LIME_LOGI<<"OpenSSL crypto provider is not part of this build, skip cross provider tests";
+#ifdef EC25519_ENABLED
+		bool thrown = false;
+		try {
+			auto ecdh = make_keyExchange<C255>(CryptoProvider::openssl);
+		} catch (BctbxException &) {
+			thrown = true;
+		}
+		BC_ASSERT_TRUE(thrown);
+#endif
+		return;
+	}
+
+	cryptoProviders_test(CryptoProvider::bctoolbox, CryptoProvider::openssl);
+	cryptoProviders_test(CryptoProvider::openssl, CryptoProvider::bctoolbox);
+
+	if (bench) {
+		for (auto provider : {CryptoProvider::bctoolbox, CryptoProvider::openssl}) {
+			LIME_LOGI<<"Bench for "<<((provider == CryptoProvider::openssl)?"OpenSSL":"bctoolbox")<<" crypto provider:";
+			cryptoProviders_bench(provider, BENCH_TIMING_MS);
+		}
+	}
+}
+
 /**
  * @brief Test the Random Number Generator used to generate keys Id
  * The Id generation gives a 31 bits unsigned integer, is used when RNG->randomize function returns an uint32_t value
@@ -937,13 +1380,55 @@ static void RNG_test(void) {
 	LIME_LOGD << NB_INT31_TESTED << " 31 bits unsigned integers generated Mean " << m0 << " Sigma "<<s0<<std::endl;
 }
 
+static void deterministic_RNG_test(void) {
+#ifdef LIME_DETERMINISTIC_RNG_ENABLED
+	constexpr size_t NB_BYTES_TESTED=100;
+	const uint64_t seed = 0x6c696d65;
+
+	/* same seed gives the same sequences, from any RNG created after seeding */
+	LimeManager::set_deterministic_RNG(seed);
+	auto rng = make_RNG();
+	auto id1 = rng->randomize();
+	std::vector<uint8_t> buffer1(NB_BYTES_TESTED);
+	rng->randomize(buffer1.data(), buffer1.size());
+	BC_ASSERT_TRUE((id1&0x80000000) == 0); // keys Id MSbit must still be 0
+
+	LimeManager::set_deterministic_RNG(seed);
+	rng = make_RNG();
+	auto id2 = rng->randomize();
+	std::vector<uint8_t> buffer2(NB_BYTES_TESTED);
+	rng->randomize(buffer2.data(), buffer2.size());
+	BC_ASSERT_EQUAL(id1, id2, uint32_t, "%u");
+	BC_ASSERT_TRUE(buffer1 == buffer2);
+
+	/* another seed gives another sequence */
+	LimeManager::set_deterministic_RNG(seed+1);
+	rng = make_RNG();
+	rng->randomize(buffer2.data(), buffer2.size());
+	BC_ASSERT_TRUE(buffer1 != buffer2);
+
+	/* back to the regular RNG, or to the one set by the --rng-seed argument */
+	if (lime_tester::randomSeeded) {
+		LimeManager::set_deterministic_RNG(lime_tester::randomSeed);
+	} else {
+		LimeManager::clear_deterministic_RNG();
+		rng = make_RNG();
+		rng->randomize(buffer2.data(), buffer2.size());
+		BC_ASSERT_TRUE(buffer1 != buffer2);
+	}
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Key Exchange", exchange),
 	TEST_NO_TAG("KEM", keyEncapsulation),
 	TEST_NO_TAG("Signature", signAndVerify),
+	TEST_NO_TAG("HMAC", hashMac),
 	TEST_NO_TAG("HKDF", hashMac_KDF),
 	TEST_NO_TAG("AEAD", AEAD),
+	TEST_NO_TAG("Crypto providers", cryptoProviders),
 	TEST_NO_TAG("RNG", RNG_test),
+	TEST_NO_TAG("Deterministic RNG", deterministic_RNG_test),
 };
 
 test_suite_t lime_crypto_test_suite = {
@@ -21,6 +21,8 @@
 #include "lime-tester.hpp"
 #include "lime-tester-utils.hpp"
 #include "lime_localStorage.hpp"
+#include "lime_double_ratchet_protocol.hpp"
+#include "lime_metrics.hpp"
 
 #include <bctoolbox/tester.h>
 #include <bctoolbox/exception.hh>
@@ -29,6 +31,8 @@
 #include <sstream>
 #include <string>
 #include <filesystem>
+#include <algorithm>
+#include <chrono>
 
 #include "bctoolbox/crypto.h"
 
@@ -711,6 +715,97 @@ static void dr_skip_too_much(void) {
 #endif
 }
 
+/* alice send maxMessageSkip+1 messages, bob receives the last one first and then the skipped ones in a scrambled order
+ * skipped message keys are stored as checkpoints and derived on demand, check the content of bob's local storage along the way */
+template <typename Curve>
+static void dr_skip_lazy_test(std::string db_filename) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+
+	// remove temporary db file if they are here
+	remove(aliceFilename.data());
+	remove(bobFilename.data());
+
+	// fully establish session
+	dr_simple_exchange<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename);
+
+	// alice encrypts maxMessageSkip+1 messages, keep them all
+	const size_t messagesCount = lime::settings::maxMessageSkip+1;
+	std::vector<std::vector<uint8_t>> aliceCipher(messagesCount);
+	std::vector<std::vector<RecipientInfos>> recipients(messagesCount);
+	std::vector<uint8_t> plaintextAlice{lime_tester::messages_pattern[1].begin(), lime_tester::messages_pattern[1].end()};
+	for (size_t i=0; i<messagesCount; i++) {
+		recipients[i].emplace_back("bob",alice);
+		encryptMessage(recipients[i], plaintextAlice, bobUserId, "alice", aliceCipher[i], lime::EncryptionPolicy::optimizeUploadSize, localStorageAlice);
+	}
+
+	auto countRows = [&localStorageBob](const std::string &table) {
+		int count=0;
+		localStorageBob->sql<<"SELECT count(*) FROM "<<table<<";", soci::into(count);
+		return count;
+	};
+	auto bobDecrypt = [&](size_t i) {
+		std::vector<shared_ptr<DR>> recipientDRSessions{};
+		recipientDRSessions.push_back(bob);
+		std::vector<uint8_t> plainBuffer{};
+		auto ret = decryptMessage("alice", "bob", bobUserId, recipientDRSessions, recipients[i][0].DRmessage, aliceCipher[i], plainBuffer);
+		return (ret != nullptr && plainBuffer == plaintextAlice);
+	};
+
+	// bob decrypts the last one: all the others are skipped but no message key is stored, only one checkpoint
+	BC_ASSERT_TRUE(bobDecrypt(messagesCount-1));
+	BC_ASSERT_EQUAL(countRows("DR_MSk_MK"), 0, int, "%d");
+	BC_ASSERT_EQUAL(countRows("DR_MSk_CK"), 1, int, "%d");
+
+	// the first one consumes the checkpoint head: it moves forward
+	BC_ASSERT_TRUE(bobDecrypt(0));
+	BC_ASSERT_EQUAL(countRows("DR_MSk_MK"), 0, int, "%d");
+	BC_ASSERT_EQUAL(countRows("DR_MSk_CK"), 1, int, "%d");
+
+	// one in the middle: the keys before it are now stored, the checkpoint moves after it
+	const size_t middle = messagesCount/2;
+	BC_ASSERT_TRUE(bobDecrypt(middle));
+	BC_ASSERT_EQUAL(countRows("DR_MSk_MK"), (int)(middle-1), int, "%d");
+	BC_ASSERT_EQUAL(countRows("DR_MSk_CK"), 1, int, "%d");
+
+	// all the others, in reverse order
+	for (size_t i=messagesCount-2; i>0; i--) {
+		if (i!=middle) {
+			BC_ASSERT_TRUE(bobDecrypt(i));
+		}
+	}
+	// nothing is left in storage
+	BC_ASSERT_EQUAL(countRows("DR_MSk_MK"), 0, int, "%d");
+	BC_ASSERT_EQUAL(countRows("DR_MSk_CK"), 0, int, "%d");
+	BC_ASSERT_EQUAL(countRows("DR_MSk_DHr"), 0, int, "%d");
+
+	// a consumed message cannot be decrypted again
+	BC_ASSERT_FALSE(bobDecrypt(middle));
+	BC_ASSERT_FALSE(bobDecrypt(0));
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_skip_lazy(void) {
+#ifdef EC25519_ENABLED
+	dr_skip_lazy_test<C255>("dr_skip_lazy_C25519");
+#endif
+#ifdef EC448_ENABLED
+	dr_skip_lazy_test<C448>("dr_skip_lazy_C448");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_skip_lazy_test<C255K512>("dr_skip_lazy_C255K512");
+#endif
+}
+
 /* alice send a message to bob, and he replies */
 template <typename Curve>
 static void dr_encryptionPolicy_basic_test(std::string db_filename) {
@@ -836,6 +931,687 @@ static void dr_encryptionPolicy_multidevice(void) {
 	dr_encryptionPolicy_multidevice_test<C255K512>("dr_encryptionPolicy_multidevice_C255K512");
 #endif
 }
+/* alice.dev0 encrypts messages to the 5 other devices with the optimizeUploadSize and optimizeCost policies
+ * - with the default encryption cost, optimizeCost selects as optimizeUploadSize
+ * - a cipher message transport overhead makes optimizeCost select the DR message mode when optimizeUploadSize selects the cipher message one
+ * - an encryption weight makes optimizeCost select the cipher message mode when optimizeUploadSize selects the DR message one
+ * The DR headers, X3DH init and KEM parts included, are the same in both modes: they do not impact the selection
+ */
+template <typename Curve>
+static void dr_encryptionPolicy_cost_test(std::string db_filename) {
+	/* we have 2 users "alice" and "bob" with 3 devices each */
+	std::vector<std::string> usernames{"alice", "bob"};
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+	std::vector<std::vector<std::vector<std::vector<lime_tester::sessionDetails<Curve>>>>> users;
+	users.resize(usernames.size());
+	for (auto &user : users) user.resize(3);
+	std::vector<std::string> created_db_files{};
+	lime_tester::dr_devicesInit(db_filename, users, usernames, created_db_files, RNG_context);
+	std::string sourceId = usernames[0];
+	sourceId.append("@").append(to_string(0)); // source deviceId shall be alice@0
+
+	// with the default cost, the selection is the optimizeUploadSize one
+	for (size_t recipientsCount : std::vector<size_t>{1, 2, 5, 100}) {
+		for (size_t plaintextSize : std::vector<size_t>{0, 1, 16, 32, 48, 64, 100, 500, 4000}) {
+			BC_ASSERT_EQUAL(isPayloadDirectEncryption(lime::EncryptionPolicy::optimizeCost, plaintextSize, recipientsCount),
+					isPayloadDirectEncryption(lime::EncryptionPolicy::optimizeUploadSize, plaintextSize, recipientsCount), bool, "%d");
+		}
+	}
+
+	struct costCase {
+		size_t plaintextSize;
+		lime::EncryptionCost cost;
+		bool uploadSizeDirect; // mode selected by optimizeUploadSize
+		bool costDirect; // mode selected by optimizeCost
+	};
+	// to 5 recipients, cipher message mode output is plaintext + 16 + 5*32, DR message mode is 5*plaintext
+	std::vector<costCase> cases{
+		{40, {0, 0}, true, true}, // 200 <= 216
+		{60, {0, 0}, false, false}, // 300 > 236
+		{4000, {0, 0}, false, false},
+		{60, {100, 0}, false, true}, // 300 <= 236 + 100 transport overhead
+		{42, {0, 2000}, true, false}, // 210 <= 218 but 210 + 2*210 > 218 + 2*(42 + 5*32)
+	};
+
+	for (const auto &c : cases) {
+		std::vector<uint8_t> plaintext(c.plaintextSize, 0xA5);
+		for (const auto policy : std::vector<lime::EncryptionPolicy>{lime::EncryptionPolicy::optimizeUploadSize, lime::EncryptionPolicy::optimizeCost}) {
+			std::vector<RecipientInfos> recipients;
+			for (size_t u=0; u<users.size(); u++) { // loop users
+				for (size_t d=0; d<users[u].size(); d++) { // devices
+					if (u!=0 || d!=0) { // sender is users 0, device 0, do not encode for him
+						std::string devId{users[0][0][u][d].peer_userId};
+						devId.append("@").append(std::to_string(users[0][0][u][d].peer_deviceIndex));
+						recipients.emplace_back(devId, users[0][0][u][d].DRSession);
+					}
+				}
+			}
+
+			std::vector<uint8_t> cipherMessage;
+			encryptMessage(recipients, plaintext, bobUserId, sourceId, cipherMessage, policy, users[0][0][1][0].localStorage, nullptr, c.cost);
+
+			bool expectedDirect = (policy == lime::EncryptionPolicy::optimizeCost) ? c.costDirect : c.uploadSizeDirect;
+			BC_ASSERT_EQUAL(isPayloadDirectEncryption(policy, c.plaintextSize, recipients.size(), c.cost), expectedDirect, bool, "%d");
+			BC_ASSERT_EQUAL(cipherMessage.empty(), expectedDirect, bool, "%d");
+			for (const auto &recipient : recipients) {
+				BC_ASSERT_EQUAL(lime_tester::DR_message_payloadDirectEncrypt(recipient.DRmessage), expectedDirect, bool, "%d");
+			}
+
+			// decrypt on every device: keep the sessions in sync for the next round
+			size_t recipientsIndex=0;
+			for (size_t u=0; u<users.size(); u++) { // loop users
+				for (size_t d=0; d<users[u].size(); d++) { // devices
+					if (u!=0 || d!=0) {
+						std::vector<shared_ptr<DR>> recipientDRSessions{};
+						recipientDRSessions.push_back(users[u][d][0][0].DRSession); // we are u,d receiving from 0,0
+						std::vector<uint8_t> plaintext_back;
+						BC_ASSERT_TRUE(decryptMessage(sourceId, recipients[recipientsIndex].deviceId, bobUserId, recipientDRSessions, recipients[recipientsIndex].DRmessage, cipherMessage, plaintext_back) != nullptr);
+						BC_ASSERT_TRUE(plaintext_back == plaintext);
+						recipientsIndex++;
+					}
+				}
+			}
+		}
+	}
+
+	if (cleanDatabase) {
+		for (auto &filename : created_db_files) {
+			remove(filename.data());
+		}
+	}
+}
+
+static void dr_encryptionPolicy_cost(void) {
+#ifdef EC25519_ENABLED
+	dr_encryptionPolicy_cost_test<C255>("dr_encryptionPolicy_cost_C25519");
+#endif
+#ifdef EC448_ENABLED
+	dr_encryptionPolicy_cost_test<C448>("dr_encryptionPolicy_cost_C448");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_encryptionPolicy_cost_test<C255K512>("dr_encryptionPolicy_cost_C255K512");
+#endif
+}
+
+#ifdef HAVE_ZLIB
+/* chat payloads used by the compression tests: a CPIM wrapped IMDN, a CPIM wrapped text message and a JSON document */
+static std::vector<std::vector<uint8_t>> compression_payloads(void) {
+	std::string imdn{"From: <sip:alice@sip.example.org>\r\nTo: <sip:bob@sip.example.org>\r\nDateTime: 2026-10-18T09:12:45Z\r\nNS: imdn <urn:ietf:params:imdn>\r\nimdn.Message-ID: 6k5Gt9cXqLm3\r\n\r\n"
+		"Content-Type: message/imdn+xml\r\nContent-Disposition: notification\r\n\r\n"
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?><imdn xmlns=\"urn:ietf:params:xml:ns:imdn\"><message-id>Pz7bXq3kLw</message-id>"
+		"<datetime>2026-10-18T09:12:44Z</datetime><delivery-notification><status><delivered/></status></delivery-notification></imdn>"};
+	std::string text{"From: <sip:alice@sip.example.org>\r\nTo: <sip:bob@sip.example.org>\r\nDateTime: 2026-10-18T09:12:45Z\r\nNS: imdn <urn:ietf:params:imdn>\r\n"
+		"imdn.Message-ID: 7Hd0PqR2sVx1\r\nimdn.Disposition-Notification: positive-delivery, display\r\n\r\nContent-Type: text/plain;charset=UTF-8\r\n\r\n"};
+	text.append(lime_tester::longMessage.cbegin(), lime_tester::longMessage.cend());
+	std::string json{"{\"participants\":["};
+	for (int i=0; i<12; i++) {
+		json.append("{\"address\":\"sip:user").append(std::to_string(i)).append("@sip.example.org\",\"role\":\"member\",\"devices\":[{\"gruu\":\"sip:user").append(std::to_string(i)).append("@sip.example.org;gr=urn:uuid:5b3e0c0a-1f4d-4c9e-8f20-").append(std::to_string(100000000000+i)).append("\"}]}");
+		if (i<11) json.append(",");
+	}
+	json.append("]}");
+	return {{imdn.cbegin(), imdn.cend()}, {text.cbegin(), text.cend()}, {json.cbegin(), json.cend()}};
+}
+
+/* alice and bob exchange compressible payloads
+ * - the first message from alice is not compressed: she does not know yet bob can decompress it
+ * - bob's reply and alice's next messages are compressed, and shorter
+ * - payloads shorter than the threshold or not compressible are sent as is
+ */
+template <typename Curve>
+static void dr_compression_test(std::string db_filename, lime::EncryptionPolicy encryptionPolicy) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> aliceUserId{'a','l','i','c','e'};
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+
+	lime_tester::dr_sessionsInit<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename, true, RNG_context);
+	BC_ASSERT_FALSE(alice->peerSupportsCompression());
+
+	auto payloads = compression_payloads();
+	// send a message from sender to receiver, return true if it was compressed and check the output is shorter than the payload
+	auto exchange = [encryptionPolicy](std::shared_ptr<DR> sender, const std::string &senderId, std::shared_ptr<lime::Db> senderStorage, std::shared_ptr<DR> receiver, const std::string &receiverId, const std::vector<uint8_t> &receiverUserId, const std::vector<uint8_t> &payload) {
+		std::vector<RecipientInfos> recipients;
+		recipients.emplace_back(receiverId, sender);
+		std::vector<uint8_t> cipherMessage{};
+		encryptMessage(recipients, payload, receiverUserId, senderId, cipherMessage, encryptionPolicy, senderStorage);
+		bool compressed = lime_tester::DR_message_payloadCompressed(recipients[0].DRmessage);
+		if (compressed) {
+			if (encryptionPolicy == lime::EncryptionPolicy::cipherMessage) {
+				BC_ASSERT_TRUE(cipherMessage.size() < payload.size() + lime::settings::DRMessageAuthTagSize);
+			} else {
+				BC_ASSERT_TRUE(recipients[0].DRmessage.size() < double_ratchet_protocol::headerSize<Curve>(recipients[0].DRmessage[1]) + payload.size() + lime::settings::DRMessageAuthTagSize);
+			}
+		}
+		std::vector<std::shared_ptr<DR>> receiverSessions{receiver};
+		std::vector<uint8_t> plaintext{};
+		BC_ASSERT_TRUE(decryptMessage(senderId, receiverId, receiverUserId, receiverSessions, recipients[0].DRmessage, cipherMessage, plaintext) == receiver);
+		BC_ASSERT_TRUE(plaintext == payload);
+		return compressed;
+	};
+
+	BC_ASSERT_FALSE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId, payloads[1])); // alice does not know bob supports compression
+	BC_ASSERT_TRUE(bob->peerSupportsCompression()); // but bob now knows alice does
+	for (const auto &payload : payloads) {
+		BC_ASSERT_TRUE(exchange(bob, "bob", localStorageBob, alice, "alice", aliceUserId, payload));
+	}
+	BC_ASSERT_TRUE(alice->peerSupportsCompression());
+	for (const auto &payload : payloads) {
+		BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId, payload));
+	}
+
+	// short payload: not compressed
+	std::vector<uint8_t> shortPayload(lime_tester::shortMessage.cbegin(), lime_tester::shortMessage.cend());
+	BC_ASSERT_TRUE(shortPayload.size() < lime::settings::compression_threshold);
+	BC_ASSERT_FALSE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId, shortPayload));
+	// random payload: does not compress
+	std::vector<uint8_t> randomPayload(512);
+	RNG_context->randomize(randomPayload.data(), randomPayload.size());
+	BC_ASSERT_FALSE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId, randomPayload));
+
+	// the peer compression support is saved with the session
+	auto reloadedAlice = make_DR_from_localStorage<Curve>(localStorageAlice, alice->dbSessionId(), RNG_context);
+	BC_ASSERT_TRUE(reloadedAlice->peerSupportsCompression());
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+#endif // HAVE_ZLIB
+
+static void dr_compression(void) {
+#ifdef HAVE_ZLIB
+#ifdef EC25519_ENABLED
+	dr_compression_test<C255>("dr_compression_C25519", lime::EncryptionPolicy::DRMessage);
+	dr_compression_test<C255>("dr_compression_C25519", lime::EncryptionPolicy::cipherMessage);
+#endif
+#ifdef EC448_ENABLED
+	dr_compression_test<C448>("dr_compression_C448", lime::EncryptionPolicy::DRMessage);
+	dr_compression_test<C448>("dr_compression_C448", lime::EncryptionPolicy::cipherMessage);
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_compression_test<C255K512>("dr_compression_C255K512", lime::EncryptionPolicy::DRMessage);
+	dr_compression_test<C255K512>("dr_compression_C255K512", lime::EncryptionPolicy::cipherMessage);
+#endif
+#endif // HAVE_ZLIB
+}
+
+#ifdef HAVE_ZLIB
+/* Bandwidth used by the chat payloads to a growing number of peer devices, with and without compression */
+template <typename Curve>
+static void dr_compression_bench_test(std::string db_filename) {
+	std::vector<std::string> usernames{"alice", "bob"};
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+	std::vector<std::vector<std::vector<std::vector<lime_tester::sessionDetails<Curve>>>>> users;
+	users.resize(usernames.size());
+	for (auto &user : users) user.resize(8);
+	std::vector<std::string> created_db_files{};
+	lime_tester::dr_devicesInit(db_filename, users, usernames, created_db_files, RNG_context);
+
+	// alice.dev0 sends a message to each device and they reply so she learns they support compression
+	std::vector<uint8_t> aliceUserId{'a','l','i','c','e'};
+	for (size_t u=0; u<users.size(); u++) {
+		for (size_t d=0; d<users[u].size(); d++) {
+			if (u!=0 || d!=0) {
+				std::string devId{usernames[u]};
+				devId.append("@").append(std::to_string(d));
+				std::vector<RecipientInfos> recipients;
+				recipients.emplace_back(devId, users[0][0][u][d].DRSession);
+				std::vector<uint8_t> cipherMessage{};
+				std::vector<uint8_t> plaintext{};
+				encryptMessage(recipients, lime_tester::shortMessage, bobUserId, "alice@0", cipherMessage, lime::EncryptionPolicy::DRMessage, users[0][0][u][d].localStorage);
+				std::vector<std::shared_ptr<DR>> sessions{users[u][d][0][0].DRSession};
+				BC_ASSERT_TRUE(decryptMessage("alice@0", devId, bobUserId, sessions, recipients[0].DRmessage, cipherMessage, plaintext) != nullptr);
+
+				std::vector<RecipientInfos> replyRecipients;
+				replyRecipients.emplace_back("alice@0", users[u][d][0][0].DRSession);
+				encryptMessage(replyRecipients, lime_tester::shortMessage, aliceUserId, devId, cipherMessage, lime::EncryptionPolicy::DRMessage, users[u][d][0][0].localStorage);
+				sessions[0] = users[0][0][u][d].DRSession;
+				BC_ASSERT_TRUE(decryptMessage(devId, "alice@0", aliceUserId, sessions, replyRecipients[0].DRmessage, cipherMessage, plaintext) != nullptr);
+			}
+		}
+	}
+
+	auto payloads = compression_payloads();
+	std::vector<std::string> payloadNames{"CPIM IMDN", "CPIM text", "JSON"};
+	for (size_t p=0; p<payloads.size(); p++) {
+		for (size_t recipientsCount : std::vector<size_t>{1, 3, 15}) {
+			std::vector<RecipientInfos> recipients;
+			for (size_t u=0; u<users.size() && recipients.size()<recipientsCount; u++) {
+				for (size_t d=0; d<users[u].size() && recipients.size()<recipientsCount; d++) {
+					if (u!=0 || d!=0) {
+						std::string devId{usernames[u]};
+						devId.append("@").append(std::to_string(d));
+						recipients.emplace_back(devId, users[0][0][u][d].DRSession);
+					}
+				}
+			}
+			std::vector<uint8_t> cipherMessage{};
+			encryptMessage(recipients, payloads[p], bobUserId, "alice@0", cipherMessage, lime::EncryptionPolicy::optimizeUploadSize, users[0][0][1][0].localStorage);
+			// the uncompressed output size is computed using the headers actually written, the sessions are established: there is no X3DH init in them
+			bool isDirect = lime_tester::DR_message_payloadDirectEncrypt(recipients[0].DRmessage);
+			size_t compressedSize = cipherMessage.size();
+			size_t uncompressedSize = isDirect ? 0 : payloads[p].size() + lime::settings::DRMessageAuthTagSize;
+			for (const auto &recipient : recipients) {
+				compressedSize += recipient.DRmessage.size();
+				uncompressedSize += double_ratchet_protocol::headerSize<Curve>(recipient.DRmessage[1]) + lime::settings::DRMessageAuthTagSize + (isDirect ? payloads[p].size() : lime::settings::DRrandomSeedSize);
+			}
+			LIME_LOGI<<payloadNames[p]<<" payload("<<payloads[p].size()<<" bytes) to "<<recipientsCount<<" devices: "<<uncompressedSize<<" bytes, compressed: "<<compressedSize<<" bytes ("<<(100*compressedSize/uncompressedSize)<<"%)";
+		}
+	}
+
+	if (cleanDatabase) {
+		for (auto &filename : created_db_files) {
+			remove(filename.data());
+		}
+	}
+}
+#endif // HAVE_ZLIB
+
+static void dr_compression_bench(void) {
+	if (!bench) return;
+#ifdef HAVE_ZLIB
+#ifdef EC25519_ENABLED
+	dr_compression_bench_test<C255>("dr_compression_bench_C25519");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_compression_bench_test<C255K512>("dr_compression_bench_C255K512");
+#endif
+#endif // HAVE_ZLIB
+}
+
+/* Count how many times a log statement argument is formatted */
+struct LogFormatCounter {
+	size_t &count;
+};
+static std::ostream &operator<<(std::ostream &os, const LogFormatCounter &counter) {
+	counter.count++;
+	return os;
+}
+
+/* Log statements under the runtime level do not evaluate their arguments */
+static void dr_lazyLogging(void) {
+	auto savedLevelMask = bctbx_get_log_level_mask(BCTBX_LOG_DOMAIN);
+	bctbx_set_log_level(BCTBX_LOG_DOMAIN, BCTBX_LOG_WARNING);
+
+	size_t formatted = 0;
+	LIME_LOGD<<"not formatted "<<LogFormatCounter{formatted};
+	LIME_LOGI<<"not formatted "<<LogFormatCounter{formatted};
+	BC_ASSERT_EQUAL(formatted, 0, size_t, "%zu");
+	BC_ASSERT_FALSE(LIME_LOG_ENABLED(INFO));
+
+	// enabled level: formatted unless the build removed it
+	LIME_LOGW<<"Lazy logging test, formatted "<<LogFormatCounter{formatted};
+	BC_ASSERT_EQUAL(formatted, (LIME_LOG_LEVEL_WARNING >= LIME_LOG_MIN_LEVEL)?1:0, size_t, "%zu");
+
+	// a log statement is an expression: it fits an unbraced if/else
+	formatted = 0;
+	if (formatted == 0) LIME_LOGI<<"not formatted "<<LogFormatCounter{formatted}; else formatted = 42;
+	BC_ASSERT_EQUAL(formatted, 0, size_t, "%zu");
+
+	bctbx_set_log_level_mask(BCTBX_LOG_DOMAIN, savedLevelMask);
+}
+
+/* Cost per message of a hot path log statement(device ids and curve converted to text) when its level is off:
+ * the lazy log statement checks the level only, the stream one formats then drops the message */
+template <typename Curve>
+static void dr_logging_bench_test(std::string db_filename) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+	lime_tester::dr_sessionsInit<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename, true, RNG_context);
+
+	auto savedLevelMask = bctbx_get_log_level_mask(BCTBX_LOG_DOMAIN);
+	bctbx_set_log_level(BCTBX_LOG_DOMAIN, BCTBX_LOG_WARNING);
+	constexpr size_t messagesCount = 200;
+	constexpr size_t statementsCount = 100000;
+	const std::string selfDeviceId{"alice"}, peerDeviceId{"bob"};
+	size_t formatted = 0;
+
+	// the messages, logging as Lime::encrypt/decrypt do
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i=0; i<messagesCount; i++) {
+		LIME_LOGI<<"encrypt from "<<selfDeviceId<<" on "<<CurveId2String(Curve::curveId())<<" to 1 recipients"<<LogFormatCounter{formatted};
+		std::vector<RecipientInfos> recipients;
+		recipients.emplace_back("bob", alice);
+		std::vector<uint8_t> cipherMessage{};
+		encryptMessage(recipients, lime_tester::shortMessage, bobUserId, "alice", cipherMessage, lime::EncryptionPolicy::DRMessage, localStorageAlice);
+		LIME_LOGI<<peerDeviceId<<" decrypts from "<<selfDeviceId<<LogFormatCounter{formatted};
+		std::vector<std::shared_ptr<DR>> sessions{bob};
+		std::vector<uint8_t> plaintext{};
+		BC_ASSERT_TRUE(decryptMessage("alice", "bob", bobUserId, sessions, recipients[0].DRmessage, cipherMessage, plaintext) == bob);
+	}
+	auto messageNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()/messagesCount;
+	BC_ASSERT_EQUAL(formatted, 0, size_t, "%zu");
+
+	// the log statement alone, lazy then formatted
+	start = std::chrono::steady_clock::now();
+	for (size_t i=0; i<statementsCount; i++) {
+		LIME_LOGI<<"encrypt from "<<selfDeviceId<<" on "<<CurveId2String(Curve::curveId())<<" to "<<i<<" recipients"<<LogFormatCounter{formatted};
+	}
+	auto lazyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()/statementsCount;
+	BC_ASSERT_EQUAL(formatted, 0, size_t, "%zu");
+
+	start = std::chrono::steady_clock::now();
+	for (size_t i=0; i<statementsCount; i++) {
+		BCTBX_SLOGI<<"encrypt from "<<selfDeviceId<<" on "<<CurveId2String(Curve::curveId())<<" to "<<i<<" recipients"<<LogFormatCounter{formatted};
+	}
+	auto eagerNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()/statementsCount;
+	bctbx_set_log_level_mask(BCTBX_LOG_DOMAIN, savedLevelMask);
+
+	LIME_LOGI<<"Logging bench "<<CurveId2String(Curve::curveId())<<": message encrypt+decrypt "<<messageNs<<" ns with no argument formatted. Disabled log statement: lazy "<<lazyNs<<" ns, stream "<<eagerNs<<" ns";
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_logging_bench(void) {
+	if (!bench) return;
+#ifdef EC25519_ENABLED
+	dr_logging_bench_test<C255>("dr_logging_bench_C25519");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_logging_bench_test<C255K512>("dr_logging_bench_C255K512");
+#endif
+}
+
+/* Profile the local storage statements during an exchange then a session reload:
+ * - the profile is sorted by total time and each statement was executed
+ * - the values are normalized out of the statements text
+ * - the profiler is off unless built with ENABLE_DB_PROFILER
+ */
+template <typename Curve>
+static void dr_dbProfiler_test(std::string db_filename) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> aliceUserId{'a','l','i','c','e'};
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+
+	lime_tester::dr_sessionsInit<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename, true, RNG_context);
+	bool profiling = localStorageAlice->start_profiler();
+#ifdef LIME_DB_PROFILER_ENABLED
+	BC_ASSERT_TRUE(profiling);
+#else
+	BC_ASSERT_FALSE(profiling);
+#endif
+
+	// a few round trips, bob skips one of alice messages so his storage holds a skipped key
+	for (size_t i=0; i<4; i++) {
+		std::vector<RecipientInfos> recipients;
+		recipients.emplace_back("bob", alice);
+		std::vector<uint8_t> plaintext{lime_tester::messages_pattern[i].begin(), lime_tester::messages_pattern[i].end()};
+		std::vector<uint8_t> cipherMessage{};
+		encryptMessage(recipients, plaintext, bobUserId, "alice", cipherMessage, lime::EncryptionPolicy::DRMessage, localStorageAlice);
+		if (i == 1) continue;
+		std::vector<std::shared_ptr<DR>> sessions{bob};
+		std::vector<uint8_t> decrypted{};
+		BC_ASSERT_TRUE(decryptMessage("alice", "bob", bobUserId, sessions, recipients[0].DRmessage, cipherMessage, decrypted) == bob);
+
+		std::vector<RecipientInfos> replyRecipients;
+		replyRecipients.emplace_back("alice", bob);
+		encryptMessage(replyRecipients, plaintext, aliceUserId, "bob", cipherMessage, lime::EncryptionPolicy::DRMessage, localStorageBob);
+		sessions[0] = alice;
+		BC_ASSERT_TRUE(decryptMessage("bob", "alice", aliceUserId, sessions, replyRecipients[0].DRmessage, cipherMessage, decrypted) == alice);
+	}
+	// reload alice session from storage
+	alice = make_DR_from_localStorage<Curve>(localStorageAlice, alice->dbSessionId(), RNG_context);
+
+	auto statementsCount = lime_tester::dumpDbProfile(localStorageAlice);
+	std::vector<lime::DbStatementProfile> profile{};
+	localStorageAlice->get_profile(profile);
+	BC_ASSERT_EQUAL(profile.size(), statementsCount, size_t, "%zu");
+#ifdef LIME_DB_PROFILER_ENABLED
+	BC_ASSERT_TRUE(profile.size() > 0);
+	for (size_t i=0; i<profile.size(); i++) {
+		BC_ASSERT_TRUE(profile[i].count > 0);
+		BC_ASSERT_TRUE(profile[i].p50_ns <= profile[i].p99_ns);
+		BC_ASSERT_TRUE(profile[i].total_ns >= profile[i].p99_ns);
+		if (i>0) BC_ASSERT_TRUE(profile[i-1].total_ns >= profile[i].total_ns);
+		// literals do not show in the normalized statements
+		BC_ASSERT_TRUE(profile[i].statement.find('\'') == std::string::npos);
+	}
+	// the session saves and the session load were profiled
+	BC_ASSERT_TRUE(std::any_of(profile.cbegin(), profile.cend(), [](const lime::DbStatementProfile &p){return p.statement.rfind("UPDATE DR_sessions", 0) == 0 && p.rows > 0;}));
+	BC_ASSERT_TRUE(std::any_of(profile.cbegin(), profile.cend(), [](const lime::DbStatementProfile &p){return p.statement.find("FROM DR_sessions") != std::string::npos;}));
+	// transaction statements modify no row: they are not credited with the rows modified by the previous statement
+	for (const auto &p : profile) {
+		if (p.statement.rfind("BEGIN", 0) == 0 || p.statement.rfind("COMMIT", 0) == 0) {
+			BC_ASSERT_TRUE(p.rows == 0);
+		}
+	}
+
+	// once stopped, the profile is kept but not updated anymore
+	localStorageAlice->stop_profiler();
+	alice = make_DR_from_localStorage<Curve>(localStorageAlice, alice->dbSessionId(), RNG_context);
+	std::vector<lime::DbStatementProfile> stoppedProfile{};
+	localStorageAlice->get_profile(stoppedProfile);
+	BC_ASSERT_EQUAL(stoppedProfile.size(), profile.size(), size_t, "%zu");
+	for (size_t i=0; i<profile.size() && i<stoppedProfile.size(); i++) {
+		BC_ASSERT_TRUE(stoppedProfile[i].count == profile[i].count);
+	}
+#else
+	BC_ASSERT_TRUE(profile.empty());
+#endif
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_dbProfiler(void) {
+#ifdef EC25519_ENABLED
+	dr_dbProfiler_test<C255>("dr_dbProfiler_C25519");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_dbProfiler_test<C255K512>("dr_dbProfiler_C255K512");
+#endif
+}
+
+/* Alice sends messages to Bob who gets them out of order, check the metrics account for it:
+ * - one encryption/decryption latency sample per message
+ * - the keys of the messages delivered late are stored then consumed
+ */
+template <typename Curve>
+static void dr_metrics_test(std::string db_filename) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+
+	lime_tester::dr_sessionsInit<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename, true, RNG_context);
+	lime::metrics::reset();
+
+	constexpr size_t messagesCount = 5;
+	std::vector<std::vector<uint8_t>> DRmessages{};
+	std::vector<std::vector<uint8_t>> cipherMessages(messagesCount);
+	for (size_t i=0; i<messagesCount; i++) {
+		std::vector<RecipientInfos> recipients;
+		recipients.emplace_back("bob", alice);
+		std::vector<uint8_t> plaintext{lime_tester::messages_pattern[i].begin(), lime_tester::messages_pattern[i].end()};
+		encryptMessage(recipients, plaintext, bobUserId, "alice", cipherMessages[i], lime::EncryptionPolicy::cipherMessage, localStorageAlice);
+		DRmessages.push_back(recipients[0].DRmessage);
+	}
+
+	// bob gets the last message first, then the first one
+	for (auto i : std::vector<size_t>{messagesCount-1, 0}) {
+		std::vector<std::shared_ptr<DR>> bobSessions{bob};
+		std::vector<uint8_t> plaintext{};
+		BC_ASSERT_TRUE(decryptMessage("alice", "bob", bobUserId, bobSessions, DRmessages[i], cipherMessages[i], plaintext) == bob);
+		BC_ASSERT_TRUE(plaintext == std::vector<uint8_t>(lime_tester::messages_pattern[i].begin(), lime_tester::messages_pattern[i].end()));
+	}
+
+	auto metrics = LimeManager::get_metrics();
+#ifdef LIME_METRICS_ENABLED
+	LIME_LOGI<<"Metrics after an out of order exchange:"<<std::endl<<metrics;
+	BC_ASSERT_TRUE(metrics.find("# TYPE lime_ratchet_encrypt_seconds histogram\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("\nlime_ratchet_encrypt_seconds_count "+std::to_string(messagesCount)+"\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("\nlime_ratchet_encrypt_seconds_bucket{le=\"+Inf\"} "+std::to_string(messagesCount)+"\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("\nlime_ratchet_decrypt_seconds_count 2\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("# TYPE lime_skipped_keys_stored_total counter\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("\nlime_skipped_keys_stored_total "+std::to_string(messagesCount-1)+"\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("\nlime_skipped_keys_consumed_total 1\n") != std::string::npos);
+	BC_ASSERT_TRUE(metrics.find("\nlime_session_save_seconds_count 0\n") == std::string::npos);
+
+	lime::metrics::reset();
+	BC_ASSERT_TRUE(LimeManager::get_metrics().find("\nlime_ratchet_encrypt_seconds_count 0\n") != std::string::npos);
+#else
+	BC_ASSERT_TRUE(metrics.empty());
+#endif
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_metrics(void) {
+#ifdef EC25519_ENABLED
+	dr_metrics_test<C255>("dr_metrics_C25519");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_metrics_test<C255K512>("dr_metrics_C255K512");
+#endif
+}
+
+/* A tracer recording the spans */
+class RecordingTracer : public lime::Tracer {
+	public:
+		struct RecordedSpan {
+			std::string name;
+			SpanId parent;
+			bool ended;
+			bool success;
+			std::map<std::string, AttributeValue> attributes;
+		};
+		std::mutex mutex;
+		std::map<SpanId, RecordedSpan> spans;
+		SpanId nextId = 1;
+
+		SpanId startSpan(const std::string &name, const SpanId parent) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			spans[nextId] = RecordedSpan{name, parent, false, false, {}};
+			return nextId++;
+		}
+		void setAttribute(const SpanId span, const std::string &key, const AttributeValue &value) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			spans[span].attributes[key] = value;
+		}
+		void endSpan(const SpanId span, const bool success) override {
+			std::lock_guard<std::mutex> lock(mutex);
+			spans[span].ended = true;
+			spans[span].success = success;
+		}
+		/// @return the ids of the spans with the given name
+		std::vector<SpanId> find(const std::string &name) {
+			std::lock_guard<std::mutex> lock(mutex);
+			std::vector<SpanId> ids{};
+			for (const auto &span : spans) {
+				if (span.second.name == name) ids.push_back(span.first);
+			}
+			return ids;
+		}
+};
+
+/* Alice and Bob exchange messages with a tracer installed
+ * - the DR encryption and decryption spans are emitted with their attributes, the local storage transactions are their children
+ * - a failed decryption ends its span as failed
+ * - no span is emitted once the tracer is removed
+ */
+template <typename Curve>
+static void dr_tracing_test(std::string db_filename) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+
+	lime_tester::dr_sessionsInit<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename, true, RNG_context);
+	auto tracer = std::make_shared<RecordingTracer>();
+	LimeManager::set_tracer(tracer);
+
+	std::vector<RecipientInfos> recipients;
+	recipients.emplace_back("bob", alice);
+	std::vector<uint8_t> plaintext{lime_tester::messages_pattern[0].begin(), lime_tester::messages_pattern[0].end()};
+	std::vector<uint8_t> cipherMessage{};
+	encryptMessage(recipients, plaintext, bobUserId, "alice", cipherMessage, lime::EncryptionPolicy::DRMessage, localStorageAlice);
+
+	std::vector<std::shared_ptr<DR>> bobSessions{bob};
+	std::vector<uint8_t> decrypted{};
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", bobUserId, bobSessions, recipients[0].DRmessage, cipherMessage, decrypted) == bob);
+	BC_ASSERT_TRUE(decrypted == plaintext);
+	// a tampered message fails to decrypt
+	auto tamperedDRmessage = recipients[0].DRmessage;
+	tamperedDRmessage.back() ^= 0xFF;
+	BC_ASSERT_TRUE(decryptMessage("alice", "bob", bobUserId, bobSessions, tamperedDRmessage, cipherMessage, decrypted) == nullptr);
+
+	auto encryptSpans = tracer->find("lime.dr.encryptMessage");
+	auto decryptSpans = tracer->find("lime.dr.decryptMessage");
+	BC_ASSERT_EQUAL(encryptSpans.size(), 1, size_t, "%zu");
+	BC_ASSERT_EQUAL(decryptSpans.size(), 2, size_t, "%zu");
+	if (encryptSpans.size() == 1 && decryptSpans.size() == 2) {
+		const auto &encryptSpan = tracer->spans[encryptSpans[0]];
+		BC_ASSERT_TRUE(encryptSpan.parent == 0);
+		BC_ASSERT_TRUE(encryptSpan.ended && encryptSpan.success);
+		BC_ASSERT_TRUE(std::get<int64_t>(encryptSpan.attributes.at("lime.recipients")) == 1);
+		BC_ASSERT_TRUE(std::get<int64_t>(encryptSpan.attributes.at("lime.plaintext_bytes")) == static_cast<int64_t>(plaintext.size()));
+		BC_ASSERT_TRUE(std::get<bool>(encryptSpan.attributes.at("lime.payload_direct")));
+		BC_ASSERT_TRUE(tracer->spans[decryptSpans[0]].ended && tracer->spans[decryptSpans[0]].success);
+		// the failed decryption
+		BC_ASSERT_TRUE(tracer->spans[decryptSpans[1]].ended);
+		BC_ASSERT_FALSE(tracer->spans[decryptSpans[1]].success);
+		// the encryption commits the sessions in a transaction
+		bool transactionFound = false;
+		for (auto id : tracer->find("lime.db.transaction")) {
+			if (tracer->spans[id].parent == encryptSpans[0]) {
+				transactionFound = true;
+				BC_ASSERT_TRUE(tracer->spans[id].ended && tracer->spans[id].success);
+			}
+		}
+		BC_ASSERT_TRUE(transactionFound);
+	}
+
+	// remove the tracer: no more spans
+	LimeManager::set_tracer(nullptr);
+	const auto spansCount = tracer->spans.size();
+	recipients[0].DRmessage.clear();
+	encryptMessage(recipients, plaintext, bobUserId, "alice", cipherMessage, lime::EncryptionPolicy::DRMessage, localStorageAlice);
+	BC_ASSERT_EQUAL(tracer->spans.size(), spansCount, size_t, "%zu");
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_tracing(void) {
+#ifdef EC25519_ENABLED
+	dr_tracing_test<C255>("dr_tracing_C25519");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_tracing_test<C255K512>("dr_tracing_C255K512");
+#endif
+}
+
 /* Alice send a encrypt a message to Bob, with forced encryption policy but the cipher message is deleted
  * expect an exeption
  *
@@ -906,6 +1682,93 @@ static void dr_encryptionPolicy_error(void) {
 #endif
 }
 
+/* A failed encryption must leave the sending chain in sync with the peer and the local storage
+ * - alice's random seed callback throws
+ * - alice's local storage fails to save the session, after the message keys were derived and the asymmetric ratchet performed
+ * after each failure, alice and bob still exchange messages and the alice session reloaded from local storage too
+ */
+template <typename Curve>
+static void dr_encryption_failure_test(std::string db_filename) {
+	std::shared_ptr<DR> alice, bob;
+	std::shared_ptr<lime::Db> localStorageAlice, localStorageBob;
+	std::string aliceFilename(db_filename);
+	std::string bobFilename(db_filename);
+	aliceFilename.append(".alice.sqlite3");
+	bobFilename.append(".bob.sqlite3");
+	std::vector<uint8_t> aliceUserId{'a','l','i','c','e'};
+	std::vector<uint8_t> bobUserId{'b','o','b'};
+
+	lime_tester::dr_sessionsInit<Curve>(alice, bob, localStorageAlice, localStorageBob, aliceFilename, bobFilename, true, RNG_context);
+
+	// send a message from sender to receiver, return true if the receiver decrypts it
+	auto exchange = [](std::shared_ptr<DR> sender, const std::string &senderId, std::shared_ptr<lime::Db> senderStorage, std::shared_ptr<DR> receiver, const std::string &receiverId, const std::vector<uint8_t> &receiverUserId) {
+		std::vector<RecipientInfos> recipients;
+		recipients.emplace_back(receiverId, sender);
+		std::vector<uint8_t> cipherMessage{};
+		encryptMessage(recipients, lime_tester::shortMessage, receiverUserId, senderId, cipherMessage, lime::EncryptionPolicy::DRMessage, senderStorage);
+		std::vector<std::shared_ptr<DR>> receiverSessions{receiver};
+		std::vector<uint8_t> plaintext{};
+		return (decryptMessage(senderId, receiverId, receiverUserId, receiverSessions, recipients[0].DRmessage, cipherMessage, plaintext) == receiver && plaintext == lime_tester::shortMessage);
+	};
+	// alice encrypts to bob, return true if the encryption failed
+	auto failingEncrypt = [&alice, &localStorageAlice, &bobUserId](const std::shared_ptr<limeRandomSeedCallback> randomSeedCallback) {
+		std::vector<RecipientInfos> recipients;
+		recipients.emplace_back("bob", alice);
+		std::vector<uint8_t> cipherMessage{};
+		try {
+			encryptMessage(recipients, lime_tester::shortMessage, bobUserId, "alice", cipherMessage, lime::EncryptionPolicy::cipherMessage, localStorageAlice, randomSeedCallback);
+		} catch (BctbxException const &e) {
+			LIME_LOGI<<"Expected encryption failure: "<<e.str();
+			return true;
+		}
+		return false;
+	};
+
+	BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId));
+	BC_ASSERT_TRUE(exchange(bob, "bob", localStorageBob, alice, "alice", aliceUserId)); // alice shall now perform an asymmetric ratchet on her next encryption
+
+	// random seed callback failure
+	auto throwingCallback = std::make_shared<limeRandomSeedCallback>([](const bool, std::shared_ptr<std::vector<uint8_t>> &) -> bool {
+		throw BCTBX_EXCEPTION << "Random seed callback failure";
+	});
+	BC_ASSERT_TRUE(failingEncrypt(throwingCallback));
+	BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId));
+	BC_ASSERT_TRUE(exchange(bob, "bob", localStorageBob, alice, "alice", aliceUserId));
+
+	// local storage failure: any update of a DR session is rejected
+	localStorageAlice->sql<<"CREATE TEMP TRIGGER tester_failure BEFORE UPDATE ON DR_sessions BEGIN SELECT RAISE(ABORT, 'DR session update failure'); END;";
+	BC_ASSERT_TRUE(failingEncrypt(nullptr));
+	localStorageAlice->sql<<"DROP TRIGGER tester_failure;";
+	BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId));
+	BC_ASSERT_TRUE(exchange(bob, "bob", localStorageBob, alice, "alice", aliceUserId));
+
+	// the local storage holds the asymmetric ratchet performed before the batch derivation
+	BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId));
+	auto aliceSessionId = alice->dbSessionId();
+	alice = nullptr;
+	alice = make_DR_from_localStorage<Curve>(localStorageAlice, aliceSessionId, RNG_context);
+	BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId));
+	BC_ASSERT_TRUE(exchange(bob, "bob", localStorageBob, alice, "alice", aliceUserId));
+	BC_ASSERT_TRUE(exchange(alice, "alice", localStorageAlice, bob, "bob", bobUserId));
+
+	if (cleanDatabase) {
+		remove(aliceFilename.data());
+		remove(bobFilename.data());
+	}
+}
+
+static void dr_encryption_failure(void) {
+#ifdef EC25519_ENABLED
+	dr_encryption_failure_test<C255>("dr_encryption_failure_C25519");
+#endif
+#ifdef EC448_ENABLED
+	dr_encryption_failure_test<C448>("dr_encryption_failure_C448");
+#endif
+#ifdef HAVE_BCTBXPQ
+	dr_encryption_failure_test<C255K512>("dr_encryption_failure_C255K512");
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Basic", dr_basic),
 	TEST_NO_TAG("Pattern", dr_pattern),
@@ -915,9 +1778,19 @@ static test_t tests[] = {
 	TEST_NO_TAG("Skip message", dr_skippedMessages_basic),
 	TEST_NO_TAG("Multidevices", dr_multidevice_basic),
 	TEST_NO_TAG("Skip more messages than limit", dr_skip_too_much),
+	TEST_NO_TAG("Skipped message keys derived on demand", dr_skip_lazy),
 	TEST_NO_TAG("Encryption Policy basic", dr_encryptionPolicy_basic),
 	TEST_NO_TAG("Encryption Policy multidevice", dr_encryptionPolicy_multidevice),
+	TEST_NO_TAG("Encryption Policy cost", dr_encryptionPolicy_cost),
+	TEST_NO_TAG("Payload compression", dr_compression),
+	TEST_NO_TAG("Payload compression Bench", dr_compression_bench),
+	TEST_NO_TAG("Metrics", dr_metrics),
+	TEST_NO_TAG("Tracing", dr_tracing),
+	TEST_NO_TAG("Local storage profiler", dr_dbProfiler),
+	TEST_NO_TAG("Lazy logging", dr_lazyLogging),
+	TEST_NO_TAG("Logging Bench", dr_logging_bench),
 	TEST_NO_TAG("Wrong Encryption Policy", dr_encryptionPolicy_error),
+	TEST_NO_TAG("Encryption failure", dr_encryption_failure),
 };
 
 test_suite_t lime_double_ratchet_test_suite = {
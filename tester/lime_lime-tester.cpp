@@ -23,6 +23,10 @@
 #include "lime-tester.hpp"
 #include "lime_keys.hpp"
 #include "lime-tester-utils.hpp"
+#include "lime-x3dh-standin.hpp"
+#include "lime_x3dh_protocol.hpp"
+#include "lime_settings.hpp"
+#include "lime-replay.hpp"
 
 #include <bctoolbox/tester.h>
 #include <bctoolbox/exception.hh>
@@ -37,7 +41,9 @@
 #include <thread>
 #include <deque>
 #include <mutex>
+#include <condition_variable>
 #include <list>
+#include <atomic>
 
 using namespace::std;
 using namespace::lime;
@@ -1115,6 +1121,14 @@ static void lime_peerDeviceStatus_test(const lime::CurveId curve) {
 		// Now Alice's storage has Bob as trusted and Carol as untrusted and does not know Dave
 		// Getting status for all of them as a list shall return unknown (alice considers herself as trusted)
 		BC_ASSERT_TRUE(aliceManager->get_peerDeviceStatus(allDevicesId) == lime::PeerDeviceStatus::unknown);
+		// Getting them one by one in a single query gives the status of each device
+		std::map<std::string, lime::PeerDeviceStatus> allDevicesStatus{};
+		aliceManager->get_peerDeviceStatus(allDevicesId, allDevicesStatus);
+		BC_ASSERT_EQUAL((int)allDevicesStatus.size(), (int)allDevicesId.size(), int, "%d");
+		BC_ASSERT_TRUE(allDevicesStatus[*aliceDeviceId] == lime::PeerDeviceStatus::trusted);
+		BC_ASSERT_TRUE(allDevicesStatus[*bobDeviceId] == lime::PeerDeviceStatus::trusted);
+		BC_ASSERT_TRUE(allDevicesStatus[*carolDeviceId] == lime::PeerDeviceStatus::untrusted);
+		BC_ASSERT_TRUE(allDevicesStatus[*daveDeviceId] == lime::PeerDeviceStatus::unknown);
 
 		// Alice encrypts a message for Bob, Carol and Dave
 		auto encryptionContext = make_shared<EncryptionContext>("my friends group", lime_tester::messages_pattern[0]);
@@ -1187,6 +1201,9 @@ static void lime_peerDeviceStatus_test(const lime::CurveId curve) {
 		// Turn Dave to unsafe, the group status shall be unsafe
 		aliceManager->set_peerDeviceStatus(*daveDeviceId, curve, daveIk, lime::PeerDeviceStatus::unsafe);
 		BC_ASSERT_TRUE(aliceManager->get_peerDeviceStatus(allDevicesId) == lime::PeerDeviceStatus::unsafe);
+		aliceManager->get_peerDeviceStatus(allDevicesId, allDevicesStatus);
+		BC_ASSERT_TRUE(allDevicesStatus[*carolDeviceId] == lime::PeerDeviceStatus::trusted);
+		BC_ASSERT_TRUE(allDevicesStatus[*daveDeviceId] == lime::PeerDeviceStatus::unsafe);
 		
 		// Remove Carol from Alice cache, Alice is unknown but the group is still unsafe
 		aliceManager->delete_peerDevice(*carolDeviceId);
@@ -1194,6 +1211,27 @@ static void lime_peerDeviceStatus_test(const lime::CurveId curve) {
 		BC_ASSERT_TRUE(aliceManager->get_peerDeviceStatus(*aliceDeviceId) == lime::PeerDeviceStatus::trusted); // query herself as peer, should be trusted
 		BC_ASSERT_TRUE(aliceManager->get_peerDeviceStatus(std::list<std::string>{*aliceDeviceId}) == lime::PeerDeviceStatus::trusted); // query herself as peer, should be trusted
 		BC_ASSERT_TRUE(aliceManager->get_peerDeviceStatus(allDevicesId) == lime::PeerDeviceStatus::unsafe);
+		// duplicated device Ids in the list are ignored
+		std::list<std::string> duplicatedDevicesId{allDevicesId};
+		duplicatedDevicesId.push_back(*carolDeviceId);
+		aliceManager->get_peerDeviceStatus(duplicatedDevicesId, allDevicesStatus);
+		BC_ASSERT_EQUAL((int)allDevicesStatus.size(), (int)allDevicesId.size(), int, "%d");
+		BC_ASSERT_TRUE(allDevicesStatus[*aliceDeviceId] == lime::PeerDeviceStatus::trusted);
+		BC_ASSERT_TRUE(allDevicesStatus[*bobDeviceId] == lime::PeerDeviceStatus::trusted);
+		BC_ASSERT_TRUE(allDevicesStatus[*carolDeviceId] == lime::PeerDeviceStatus::unknown);
+		BC_ASSERT_TRUE(allDevicesStatus[*daveDeviceId] == lime::PeerDeviceStatus::unsafe);
+		// Bob gets a second active row, as when known on another base algorithm: the most recent one is used
+		{
+			soci::session sql("sqlite3", dbFilenameAlice);
+			sql<<"INSERT INTO lime_PeerDevices(DeviceId, curveId, Active, Ik, Status) VALUES(:deviceId, 0, 1, x'00', 2);", soci::use(*bobDeviceId);
+		}
+		aliceManager->get_peerDeviceStatus(allDevicesId, allDevicesStatus);
+		BC_ASSERT_EQUAL((int)allDevicesStatus.size(), (int)allDevicesId.size(), int, "%d");
+		BC_ASSERT_TRUE(allDevicesStatus[*bobDeviceId] == lime::PeerDeviceStatus::unsafe);
+		{
+			soci::session sql("sqlite3", dbFilenameAlice);
+			sql<<"DELETE FROM lime_PeerDevices WHERE DeviceId = :deviceId AND curveId = 0;", soci::use(*bobDeviceId);
+		}
 
 		if (cleanDatabase) {
 			aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
@@ -1603,7 +1641,7 @@ static void write_db_version(uint32_t version, std::string &dbFilename) {
 }
 
 static void lime_db_migration() {
-	// migrate from version 0x000001 to 0x000300
+	// migrate from version 0x000001 to 0x000500
 	std::string dbFilename("lime_db_migration-v000001.sqlite3");
 	remove(dbFilename.data());
 	soci::session	sql;
@@ -1637,7 +1675,7 @@ static void lime_db_migration() {
 		return;
 	}
 
-	// Open a manager giving the same DB, it shall migrate the structure to version 0x000300
+	// Open a manager giving the same DB, it shall migrate the structure to version 0x000400
 	try  {
 		// create Manager
 		std::unique_ptr<LimeManager> manager = std::make_unique<LimeManager>(dbFilename, X3DHServerPost);
@@ -1651,7 +1689,15 @@ static void lime_db_migration() {
 		sql.open("sqlite3", dbFilename);
 		int userVersion=-1;
 		sql<<"SELECT version FROM db_module_version WHERE name='lime'", soci::into(userVersion);
-		BC_ASSERT_EQUAL(userVersion, 0x300, int, "%d");
+		BC_ASSERT_EQUAL(userVersion, 0x500, int, "%d");
+		// Version 0x000400 of db added the DR_MSk_CK table
+		int haveMSkCK=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='DR_MSk_CK'", soci::into(haveMSkCK);
+		BC_ASSERT_EQUAL(haveMSkCK, 1, int, "%d");
+		// Version 0x000500 of db added the sender key tables
+		int haveSenderKeys=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name IN ('lime_SenderKeys', 'lime_SenderKeyRecipients', 'lime_SenderKeyMSk')", soci::into(haveSenderKeys);
+		BC_ASSERT_EQUAL(haveSenderKeys, 3, int, "%d");
 		// Version 0x000100 of db added a Timestamp
 		int haveTs=0;
 		sql<<"SELECT COUNT(*) FROM pragma_table_info('lime_LocalUsers') WHERE name='updateTs'", soci::into(haveTs);
@@ -1689,7 +1735,7 @@ static void lime_db_migration() {
 		remove(dbFilename.data());
 	}
 
-	// migrate from version 0x000100 to 0x000300
+	// migrate from version 0x000100 to 0x000500
 	dbFilename = std::string("lime_db_migration-v000100.sqlite3");
 	remove(dbFilename.data());
 	try{
@@ -1722,7 +1768,7 @@ static void lime_db_migration() {
 		return;
 	}
 
-	// Open a manager giving the same DB, it shall migrate the structure to version 0x000300
+	// Open a manager giving the same DB, it shall migrate the structure to version 0x000400
 	try  {
 		// create Manager
 		std::unique_ptr<LimeManager> manager = std::make_unique<LimeManager>(dbFilename, X3DHServerPost);
@@ -1736,7 +1782,15 @@ static void lime_db_migration() {
 		sql.open("sqlite3", dbFilename);
 		int userVersion=-1;
 		sql<<"SELECT version FROM db_module_version WHERE name='lime'", soci::into(userVersion);
-		BC_ASSERT_EQUAL(userVersion, 0x300, int, "%d");
+		BC_ASSERT_EQUAL(userVersion, 0x500, int, "%d");
+		// Version 0x000400 of db added the DR_MSk_CK table
+		int haveMSkCK=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='DR_MSk_CK'", soci::into(haveMSkCK);
+		BC_ASSERT_EQUAL(haveMSkCK, 1, int, "%d");
+		// Version 0x000500 of db added the sender key tables
+		int haveSenderKeys=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name IN ('lime_SenderKeys', 'lime_SenderKeyRecipients', 'lime_SenderKeyMSk')", soci::into(haveSenderKeys);
+		BC_ASSERT_EQUAL(haveSenderKeys, 3, int, "%d");
 		// Version 0x000100 of db added a Timestamp
 		int haveTs=0;
 		sql<<"SELECT COUNT(*) FROM pragma_table_info('lime_LocalUsers') WHERE name='updateTs'", soci::into(haveTs);
@@ -1774,7 +1828,7 @@ static void lime_db_migration() {
 		remove(dbFilename.data());
 	}
 
-	// migrate from version 0x000200 to 0x000300
+	// migrate from version 0x000200 to 0x000500
 	dbFilename = std::string("lime_db_migration-v000200.sqlite3");
 	remove(dbFilename.data());
 	try{
@@ -1807,7 +1861,7 @@ static void lime_db_migration() {
 		return;
 	}
 
-	// Open a manager giving the same DB, it shall migrate the structure to version 0x000300
+	// Open a manager giving the same DB, it shall migrate the structure to version 0x000400
 	try  {
 		// create Manager
 		std::unique_ptr<LimeManager> manager = std::make_unique<LimeManager>(dbFilename, X3DHServerPost);
@@ -1821,7 +1875,15 @@ static void lime_db_migration() {
 		sql.open("sqlite3", dbFilename);
 		int userVersion=-1;
 		sql<<"SELECT version FROM db_module_version WHERE name='lime'", soci::into(userVersion);
-		BC_ASSERT_EQUAL(userVersion, 0x300, int, "%d");
+		BC_ASSERT_EQUAL(userVersion, 0x500, int, "%d");
+		// Version 0x000400 of db added the DR_MSk_CK table
+		int haveMSkCK=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='DR_MSk_CK'", soci::into(haveMSkCK);
+		BC_ASSERT_EQUAL(haveMSkCK, 1, int, "%d");
+		// Version 0x000500 of db added the sender key tables
+		int haveSenderKeys=0;
+		sql<<"SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name IN ('lime_SenderKeys', 'lime_SenderKeyRecipients', 'lime_SenderKeyMSk')", soci::into(haveSenderKeys);
+		BC_ASSERT_EQUAL(haveSenderKeys, 3, int, "%d");
 		// Version 0x000100 of db added a Timestamp
 		int haveTs=0;
 		sql<<"SELECT COUNT(*) FROM pragma_table_info('lime_LocalUsers') WHERE name='updateTs'", soci::into(haveTs);
@@ -2007,6 +2069,128 @@ static void lime_update_OPk() {
 #endif
 }
 
+/**
+ * Scenario, running on the in-process X3DH server stand-in: check the OPk status transitions performed by the update
+ * - Create Alice with a batch of 5 OPks, all of them are on server(status 1)
+ * - Bob, Carol and Dave encrypt to Alice: the server dispatched three of her OPks
+ * - Alice decrypts Bob's message: his OPk is deleted
+ * - Update: the two other dispatched OPks are set to status 0, the ones still on server keep status 1
+ * - Update again with the same server list: nothing changes
+ * - Alice decrypts Carol's message: the OPk is still usable while in limbo, then deleted
+ * - Forward time past the OPk limbo time and update: Dave's OPk, never used, is deleted, his message cannot be decrypted
+ */
+static void lime_update_OPk_status_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_update_OPk_status"};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string dbFilenameAlice = dbBaseFilename + ".alice" + dbSuffix;
+	const std::string dbFilenamePeers = dbBaseFilename + ".peers" + dbSuffix;
+	remove(dbFilenameAlice.data());
+	remove(dbFilenamePeers.data());
+	constexpr uint16_t OPkBatchSize = 5;
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		const std::vector<lime::CurveId> algos{curve};
+		lime_tester::X3DHServerStandIn server{};
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		auto peersManager = make_unique<LimeManager>(dbFilenamePeers, server.postData());
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+		server.process();
+		BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 1), OPkBatchSize, int, "%d");
+
+		// Bob, Carol and Dave encrypt to Alice, each one consumes one OPk on server
+		std::vector<std::shared_ptr<std::string>> peerDeviceIds{};
+		std::vector<std::shared_ptr<lime::EncryptionContext>> encryptionContexts{};
+		for (const auto name : {"bob.d1.", "carol.d1.", "dave.d1."}) {
+			peerDeviceIds.push_back(lime_tester::makeRandomDeviceName(name));
+			peersManager->create_user(*peerDeviceIds.back(), algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+			encryptionContexts.push_back(make_shared<EncryptionContext>("alice", lime_tester::messages_pattern[encryptionContexts.size()]));
+			encryptionContexts.back()->addRecipient(*aliceDeviceId);
+			peersManager->encrypt(*peerDeviceIds.back(), algos, encryptionContexts.back(), callback);
+			server.process();
+			expected_success += 2;
+			BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+		}
+		// Alice does not know yet: all her OPks are still flagged on server
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 1), OPkBatchSize, int, "%d");
+
+		// decrypting Bob's message deletes his OPk
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *peerDeviceIds[0], encryptionContexts[0]->m_recipients[0].DRmessage, encryptionContexts[0]->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve), OPkBatchSize-1, int, "%d");
+
+		// update without uploading new OPks: Carol's and Dave's OPks are now known as dispatched
+		for (int i=0; i<2; i++) { // the second update gets the same server list and shall not change anything
+			aliceManager = nullptr; // destroy manager before modifying DB
+			lime_tester::forwardTime(dbFilenameAlice, 2); // Forward time by 2 days so the update actually do something
+			aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+			aliceManager->update(*aliceDeviceId, algos, callback, 0, 0);
+			server.process();
+			BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+			BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 1), OPkBatchSize-3, int, "%d");
+			BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 0), 2, int, "%d");
+		}
+
+		// Carol's OPk is in limbo but still usable
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *peerDeviceIds[1], encryptionContexts[1]->m_recipients[0].DRmessage, encryptionContexts[1]->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[1]);
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 0), 1, int, "%d");
+
+		// after the limbo time, Dave's OPk is deleted by the update, the ones on server are kept
+		aliceManager = nullptr; // destroy manager before modifying DB
+		lime_tester::forwardTime(dbFilenameAlice, lime::settings::OPk_limboTime_days+1);
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		aliceManager->update(*aliceDeviceId, algos, callback, 0, 0);
+		server.process();
+		BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 1), OPkBatchSize-3, int, "%d");
+		BC_ASSERT_EQUAL((int)lime_tester::get_OPks(dbFilenameAlice, *aliceDeviceId, curve, 0), 0, int, "%d");
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *peerDeviceIds[2], encryptionContexts[2]->m_recipients[0].DRmessage, encryptionContexts[2]->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::fail);
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d");
+
+		aliceManager = nullptr;
+		peersManager = nullptr;
+		if (cleanDatabase) {
+			remove(dbFilenameAlice.data());
+			remove(dbFilenamePeers.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_update_OPk_status() {
+#ifdef EC25519_ENABLED
+	lime_update_OPk_status_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_update_OPk_status_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_update_OPk_status_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_update_OPk_status_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+}
+
 /**
  * Scenario:
  * - Create a user alice
@@ -2181,24 +2365,26 @@ static void lime_update_SPk() {
 }
 
 /**
- * Scenario:
- * - Establish a session between alice and bob
- * - Skip two messages and keep on exchanging post until maxMessagesReceivedAfterSkip
- * - Check we have two message key in localStorage
- * - decrypt a message
- * - Check we have one message key in localStorage
- * - call the update
- * - Check we have no more message key in storage
- * - try to decrypt the message, it shall fail
+ * Scenario: alice keeps the same manager, so her SPk cache, during the whole test
+ * - Create alice, bob device 1 encrypts to alice, she decrypts: the SPk is now in her cache
+ * - bob device 2 encrypts to alice with the same SPk, alice does not decrypt yet
+ * - Forward time by SPK_lifeTime_days and update: alice rotates her SPk, bob device 3 encrypts to alice with the new one
+ * - Forward time by more than SPK_limboTime_days and update: the first SPk is deleted, the second one is in limbo and a third one is active
+ * - bob device 4 encrypts to alice with the third SPk
+ * - alice fails to decrypt the message from bob device 2, without exception, and decrypts the ones from bob devices 3 and 4
+ *
+ * alice database is modified while her manager is alive: it works only if the manager does not keep any statement holding a read lock
  */
-static void lime_update_clean_MK_test(const lime::CurveId curve) {
-	const std::string dbBaseFilename{"lime_update_clean_MK"};
-	std::string dbFilenameAlice;
-	std::shared_ptr<std::string> aliceDeviceId;
-	std::unique_ptr<LimeManager> aliceManager;
-	std::string dbFilenameBob;
-	std::shared_ptr<std::string> bobDeviceId;
-	std::unique_ptr<LimeManager> bobManager;
+static void lime_update_SPk_cache_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_update_SPk_cache"};
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append(CurveId2String(curve)).append(".sqlite3");
+	dbFilenameBob.append(".bob.").append(CurveId2String(curve)).append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
 
 	lime_tester::events_counters_t counters={};
 	int expected_success=0;
@@ -2213,53 +2399,84 @@ static void lime_update_clean_MK_test(const lime::CurveId curve) {
 				};
 	try {
 		std::vector<lime::CurveId> algos{curve};
-		lime_session_establishment(algos, dbBaseFilename,
-					dbFilenameAlice, aliceDeviceId, aliceManager,
-					dbFilenameBob, bobDeviceId, bobManager);
-
-		/* Alice encrypt 2 messages that are kept */
-		auto aliceEncCtx1 = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[0]);
-		aliceEncCtx1->addRecipient(*bobDeviceId);
-		auto aliceEncCtx2 = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[1]);
-		aliceEncCtx2->addRecipient(*bobDeviceId);
-		aliceManager->encrypt(*aliceDeviceId, algos, aliceEncCtx1, callback);
-		aliceManager->encrypt(*aliceDeviceId, algos, aliceEncCtx2, callback);
-		expected_success+=2;
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success, lime_tester::wait_for_timeout));
-
-		/* Alice and Bob exchange more than maxMessagesReceivedAfterSkip messages(do batches of 4 to be faster) */
-		lime_exchange_messages(aliceDeviceId, aliceManager, bobDeviceId, bobManager, algos, lime::settings::maxMessagesReceivedAfterSkip/4+1, 4);
 
-		/* Check that bob got 2 message key in local Storage */
-		BC_ASSERT_EQUAL(lime_tester::get_StoredMessageKeyCount(dbFilenameBob, *bobDeviceId, *aliceDeviceId, curve), 2, unsigned int, "%d");
-
-		/* decrypt held message 1, we know that device but no trust was ever established */
-		std::vector<uint8_t> receivedMessage{};
-		BC_ASSERT_TRUE(bobManager->decrypt(*bobDeviceId, "bob", *aliceDeviceId, aliceEncCtx1->m_recipients[0].DRmessage, aliceEncCtx1->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
-		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+		// create Manager and device for alice
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
 
-		/* Check that bob got 1 message key in local Storage */
-		BC_ASSERT_EQUAL(lime_tester::get_StoredMessageKeyCount(dbFilenameBob, *bobDeviceId, *aliceDeviceId, curve), 1, unsigned int, "%d");
+		// bob devices are all in the same manager
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
+		std::vector<std::shared_ptr<std::string>> bobDeviceIds{};
+		std::vector<std::shared_ptr<lime::EncryptionContext>> encryptionContexts{};
+		std::vector<uint32_t> SPkIds{};
+		// create a new bob device, encrypt to alice and return the SPk id used by the message
+		auto bobEncrypt = [&]() {
+			bobDeviceIds.push_back(lime_tester::makeRandomDeviceName("bob.d"));
+			bobManager->create_user(*(bobDeviceIds.back()), algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+			encryptionContexts.push_back(make_shared<EncryptionContext>("alice", lime_tester::messages_pattern[encryptionContexts.size()]));
+			encryptionContexts.back()->addRecipient(*aliceDeviceId);
+			bobManager->encrypt(*(bobDeviceIds.back()), algos, encryptionContexts.back(), callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+			uint32_t SPkIdMessage=0;
+			BC_ASSERT_TRUE(lime_tester::DR_message_extractX3DHInit_SPkId(encryptionContexts.back()->m_recipients[0].DRmessage, SPkIdMessage));
+			return SPkIdMessage;
+		};
+		auto aliceDecrypt = [&](const size_t i) {
+			std::vector<uint8_t> receivedMessage{};
+			auto status = aliceManager->decrypt(*aliceDeviceId, "alice", *(bobDeviceIds[i]), encryptionContexts[i]->m_recipients[0].DRmessage, encryptionContexts[i]->m_cipherMessage, receivedMessage);
+			if (status != lime::PeerDeviceStatus::fail) {
+				BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[i]);
+			}
+			return status;
+		};
+		auto aliceActiveSPkId = [&]() {
+			size_t SPkCount=0;
+			uint32_t activeSPkId=0;
+			BC_ASSERT_TRUE(lime_tester::get_SPks(dbFilenameAlice, *aliceDeviceId, curve, SPkCount, activeSPkId));
+			return activeSPkId;
+		};
 
-		/* update belle-sip stack processing possible incoming messages from server */
-		belle_sip_stack_sleep(bc_stack,0);
+		// bob device 1 encrypts, alice decrypts: her SPk is in cache
+		SPkIds.push_back(aliceActiveSPkId());
+		BC_ASSERT_EQUAL(bobEncrypt(), SPkIds[0], uint32_t, "%x");
+		BC_ASSERT_TRUE(aliceDecrypt(0) != lime::PeerDeviceStatus::fail);
+		// bob device 2 encrypts with the same SPk
+		BC_ASSERT_EQUAL(bobEncrypt(), SPkIds[0], uint32_t, "%x");
 
-		/* call the update function, forwardtime by 2 days before or the update is skipped */
-		lime_tester::forwardTime(dbFilenameBob, 2);
-		bobManager->update(*bobDeviceId, algos, callback, 0, lime_tester::OPkInitialBatchSize);
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success, lime_tester::wait_for_timeout));
+		// rotate the SPk
+		lime_tester::forwardTime(dbFilenameAlice, lime::settings::SPK_lifeTime_days);
+		aliceManager->update(*aliceDeviceId, algos, callback, 0, lime_tester::OPkInitialBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		SPkIds.push_back(aliceActiveSPkId());
+		BC_ASSERT_NOT_EQUAL(SPkIds[1], SPkIds[0], uint32_t, "%x");
+		BC_ASSERT_EQUAL(bobEncrypt(), SPkIds[1], uint32_t, "%x");
 
-		/* Check that bob got 0 message key in local Storage */
-		BC_ASSERT_EQUAL(lime_tester::get_StoredMessageKeyCount(dbFilenameBob, *bobDeviceId, *aliceDeviceId, curve), 0, unsigned int, "%d");
+		// age the first SPk past its limbo time: it is deleted and the second one is rotated
+		lime_tester::forwardTime(dbFilenameAlice, lime::settings::SPK_limboTime_days+1);
+		aliceManager->update(*aliceDeviceId, algos, callback, 0, lime_tester::OPkInitialBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		SPkIds.push_back(aliceActiveSPkId());
+		BC_ASSERT_NOT_EQUAL(SPkIds[2], SPkIds[1], uint32_t, "%x");
+		size_t SPkCount=0;
+		uint32_t activeSPkId=0;
+		BC_ASSERT_TRUE(lime_tester::get_SPks(dbFilenameAlice, *aliceDeviceId, curve, SPkCount, activeSPkId));
+		BC_ASSERT_EQUAL((int)SPkCount, 2, int, "%d");
+		BC_ASSERT_EQUAL(bobEncrypt(), SPkIds[2], uint32_t, "%x");
 
-		/* try to decrypt message 2, it shall fail */
-		receivedMessage.clear();
-		BC_ASSERT_TRUE(bobManager->decrypt(*bobDeviceId, "bob", *aliceDeviceId, aliceEncCtx2->m_recipients[0].DRmessage, aliceEncCtx2->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::fail);
+		// the message to the deleted SPk fails, the ones to the limbo and active SPks are decrypted
+		BC_ASSERT_TRUE(aliceDecrypt(1) == lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(aliceDecrypt(2) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(aliceDecrypt(3) != lime::PeerDeviceStatus::fail);
 
 		if (cleanDatabase) {
+			for (const auto &bobDeviceId : bobDeviceIds) {
+				bobManager->delete_user(DeviceId(*bobDeviceId, curve), callback);
+			}
 			aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
-			bobManager->delete_user(DeviceId(*bobDeviceId, curve), callback);
-			expected_success +=2;
+			expected_success += 1+(int)bobDeviceIds.size();
 			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
 			remove(dbFilenameAlice.data());
 			remove(dbFilenameBob.data());
@@ -2270,46 +2487,42 @@ static void lime_update_clean_MK_test(const lime::CurveId curve) {
 	}
 }
 
-static void lime_update_clean_MK() {
+static void lime_update_SPk_cache() {
 #ifdef EC25519_ENABLED
-	lime_update_clean_MK_test(lime::CurveId::c25519);
+	lime_update_SPk_cache_test(lime::CurveId::c25519);
 #endif
 #ifdef EC448_ENABLED
-	lime_update_clean_MK_test(lime::CurveId::c448);
+	lime_update_SPk_cache_test(lime::CurveId::c448);
 #endif
 #ifdef HAVE_BCTBXPQ
 #ifdef EC25519_ENABLED
-	lime_update_clean_MK_test(lime::CurveId::c25519k512);
+	lime_update_SPk_cache_test(lime::CurveId::c25519k512);
 
-	lime_update_clean_MK_test(lime::CurveId::c25519mlk512);
+	lime_update_SPk_cache_test(lime::CurveId::c25519mlk512);
 #endif
 #ifdef EC448_ENABLED
-	lime_update_clean_MK_test(lime::CurveId::c448mlk1024);
+	lime_update_SPk_cache_test(lime::CurveId::c448mlk1024);
 #endif
 #endif
 }
 
 /**
  * Scenario:
- * - Create Alice and Bob users
- * - Backup local Alice DB.
- * - Delete Alice user (so it is not anymore on the server)
- * - restore local Alice DB and do an update, it shall republish the user on server(using new OPks)
- * - Bob encrypt a message to Alice, it shall work as the user has been republished
- * - Alice decrypt just to be sure we're good with the OPks
+ * - Create alice and bob with three devices
+ * - Alice prefetches sessions with bob's devices with an OPk budget of two: get sessions with bob devices 1 and 2 only
+ * - Alice prefetches again with the default budget: get a session with bob device 3
+ * - Alice encrypts to bob device 1: the encryption does not need the X3DH server so the callback is called before encrypt returns
+ * - Bob device 1 decrypts
+ * - Forward time and update: the prefetched sessions never used are deleted, the one used is kept
  */
-static void lime_update_republish_test(const lime::CurveId curve) {
-	const std::string dbBaseFilename{"lime_update_republish"};
-	// create DB
+static void lime_prefetch_sessions_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_prefetch_sessions"};
 	std::string dbFilenameAlice{dbBaseFilename};
-	std::string dbFilenameAliceBackup{dbBaseFilename};
 	dbFilenameAlice.append(".alice.").append(CurveId2String(curve)).append(".sqlite3");
-	dbFilenameAliceBackup.append(".alice.backup.").append(CurveId2String(curve)).append(".sqlite3");
 	std::string dbFilenameBob{dbBaseFilename};
 	dbFilenameBob.append(".bob.").append(CurveId2String(curve)).append(".sqlite3");
 
 	remove(dbFilenameAlice.data()); // delete the database file if already exists
-	remove(dbFilenameAliceBackup.data()); // delete the database file if already exists
 	remove(dbFilenameBob.data()); // delete the database file if already exists
 
 	lime_tester::events_counters_t counters={};
@@ -2326,49 +2539,77 @@ static void lime_update_republish_test(const lime::CurveId curve) {
 
 	try {
 		std::vector<lime::CurveId> algos{curve};
-		// create Managers and devices for alice and Bob
 		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
-		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.");
-		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
 		auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
-		auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.");
-		bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
-		expected_success += 2;
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
 
-		// Backup Alice Database
-		std::ifstream  src(dbFilenameAlice, std::ios::binary);
-		std::ofstream  dst(dbFilenameAliceBackup,   std::ios::binary);
-		dst << src.rdbuf();
-		src.close();
-		dst.close();
+		auto aliceDevice = lime_tester::makeRandomDeviceName("alice.d.");
+		aliceManager->create_user(*aliceDevice, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		expected_success++;
+		std::vector<std::string> bobDevices{};
+		for (size_t i=0; i<3; i++) {
+			bobDevices.push_back(*lime_tester::makeRandomDeviceName("bob.d."));
+			bobManager->create_user(bobDevices.back(), algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+			expected_success++;
+		}
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// prefetch with a budget of two OPks, self and duplicated devices are ignored
+		std::vector<std::string> prefetchList{bobDevices[0], *aliceDevice, bobDevices[1], bobDevices[0], bobDevices[2]};
+		aliceManager->prefetch_sessions(*aliceDevice, algos, prefetchList, callback, 2);
+		expected_success++;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+
+		std::vector<long int> sessionsId{};
+		BC_ASSERT_TRUE(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[0], sessionsId) > 0);
+		BC_ASSERT_TRUE(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[1], sessionsId) > 0);
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[2], sessionsId), 0, long int, "%ld");
+
+		// prefetch again with the default budget: only bob device 3 is requested
+		auto device1SessionId = lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[0], sessionsId);
+		aliceManager->prefetch_sessions(*aliceDevice, algos, prefetchList, callback);
+		expected_success++;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[0], sessionsId), device1SessionId, long int, "%ld");
+		BC_ASSERT_EQUAL((int)sessionsId.size(), 1, int, "%d");
+		BC_ASSERT_TRUE(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[2], sessionsId) > 0);
+
+		// encrypt to bob device 1: the session is loaded from local storage, the callback is called before encrypt returns
+		auto aliceEnc = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[0]);
+		aliceEnc->addRecipient(bobDevices[0]);
+		aliceManager->encrypt(*aliceDevice, algos, aliceEnc, callback);
+		expected_success++;
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+		BC_ASSERT_TRUE(lime_tester::DR_message_holdsX3DHInit(aliceEnc->m_recipients[0].DRmessage));
 
-		// Delete Alice user
-		aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
-		// Start a new manager using the backuped local base, so the user is present in local but no more on remote
-		aliceManager = nullptr;
-		lime_tester::forwardTime(dbFilenameAliceBackup, 2); // forward time otherwise the update won't do anything
-		aliceManager = make_unique<LimeManager>(dbFilenameAliceBackup, X3DHServerPost);
-		// Update: that shall set all current OPk as dispatched, create a new batch of default creation size and republish the user on server
-		aliceManager->update(*aliceDeviceId, algos, callback, lime_tester::OPkInitialBatchSize, lime_tester::OPkInitialBatchSize);
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
-		// Bob encrypt a message to Alice, it will fetch keys from server
-		auto enc = make_shared<EncryptionContext>("alice", lime_tester::messages_pattern[0]);
-		enc->addRecipient(*aliceDeviceId);
-		bobManager->encrypt(*bobDeviceId, algos, enc, callback);
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
-		// Alice decrypt
 		std::vector<uint8_t> receivedMessage{};
-		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *bobDeviceId, enc->m_recipients[0].DRmessage, enc->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::unknown);
+		BC_ASSERT_TRUE(bobManager->decrypt(bobDevices[0], "bob", *aliceDevice, aliceEnc->m_recipients[0].DRmessage, aliceEnc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
 		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
 
+		// forward time after the prefetched sessions lifetime and update
+		aliceManager = nullptr;
+		lime_tester::forwardTime(dbFilenameAlice, lime::settings::prefetch_sessionLifeTime_days+1);
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		aliceManager->update(*aliceDevice, algos, callback, 0, lime_tester::OPkInitialBatchSize);
+		expected_success++;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+
+		// the session used to encrypt is still there, the others were deleted
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[0], sessionsId), device1SessionId, long int, "%ld");
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[1], sessionsId), 0, long int, "%ld");
+		BC_ASSERT_EQUAL((int)sessionsId.size(), 0, int, "%d");
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDevice, bobDevices[2], sessionsId), 0, long int, "%ld");
+		BC_ASSERT_EQUAL((int)sessionsId.size(), 0, int, "%d");
+
 		if (cleanDatabase) {
-			aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
-			bobManager->delete_user(DeviceId(*bobDeviceId, curve), callback);
-			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+2,lime_tester::wait_for_timeout));
+			aliceManager->delete_user(DeviceId(*aliceDevice, curve), callback);
+			expected_success++;
+			for (const auto &bobDevice : bobDevices) {
+				bobManager->delete_user(DeviceId(bobDevice, curve), callback);
+				expected_success++;
+			}
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
 			remove(dbFilenameAlice.data());
-			remove(dbFilenameAliceBackup.data());
 			remove(dbFilenameBob.data());
 		}
 	} catch (BctbxException &e) {
@@ -2377,34 +2618,34 @@ static void lime_update_republish_test(const lime::CurveId curve) {
 	}
 }
 
-
-static void lime_update_republish() {
+static void lime_prefetch_sessions(void) {
 #ifdef EC25519_ENABLED
-	lime_update_republish_test(lime::CurveId::c25519);
+	lime_prefetch_sessions_test(lime::CurveId::c25519);
 #endif
 #ifdef EC448_ENABLED
-	lime_update_republish_test(lime::CurveId::c448);
+	lime_prefetch_sessions_test(lime::CurveId::c448);
 #endif
 #ifdef HAVE_BCTBXPQ
 #ifdef EC25519_ENABLED
-	lime_update_republish_test(lime::CurveId::c25519k512);
-
-	lime_update_republish_test(lime::CurveId::c25519mlk512);
+	lime_prefetch_sessions_test(lime::CurveId::c25519k512);
+	lime_prefetch_sessions_test(lime::CurveId::c25519mlk512);
 #endif
 #ifdef EC448_ENABLED
-	lime_update_republish_test(lime::CurveId::c448mlk1024);
+	lime_prefetch_sessions_test(lime::CurveId::c448mlk1024);
 #endif
 #endif
 }
-/** Scenario
- * - Create one device for alice
- * - Create OPk_batch_size devices for bob, they will all fetch a key and encrypt a messaage to alice, server shall not have anymore OPks
- * - Create another device for alice and send a message to bob, it shall get a non OPk bundle, check it is the case in the message sent to Alice
- * Alice decrypt all messages to complete the check
- *
+
+/**
+ * Scenario:
+ * - Create alice and bob, alice encrypts to bob and bob decrypts
+ * - Restart alice manager and warm its cache: alice user and her session with bob are loaded
+ * - Warm it again: everything is already in cache, nothing is loaded
+ * - Restart alice manager and warm its cache with a memory budget of 0: nothing is loaded
+ * - Restart alice manager with the cache warmer started by the constructor, alice encrypts to bob and bob decrypts
  */
-static void x3dh_without_OPk_test(const lime::CurveId curve, const std::string &dbBaseFilename, bool continuousSession=true) {
-	// create DB
+static void lime_warm_cache_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_warm_cache"};
 	std::string dbFilenameAlice{dbBaseFilename};
 	dbFilenameAlice.append(".alice.").append(CurveId2String(curve)).append(".sqlite3");
 	std::string dbFilenameBob{dbBaseFilename};
@@ -2424,20 +2665,513 @@ static void x3dh_without_OPk_test(const lime::CurveId curve, const std::string &
 						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
 					}
 				};
+
+	// the cache warmer callback is called from its own thread
+	auto warmerMutex = std::make_shared<std::recursive_mutex>();
+	int warmerDone = 0;
+	int expectedWarmerDone = 0;
+	std::string warmerMessage{};
+	limeCallback warmerCallback = [&warmerDone, &warmerMessage, warmerMutex](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					std::lock_guard<std::recursive_mutex> lock(*warmerMutex);
+					BC_ASSERT_TRUE(returnCode == lime::CallbackReturn::success);
+					warmerMessage = anythingToSay;
+					warmerDone++;
+				};
+
 	try {
 		std::vector<lime::CurveId> algos{curve};
-		// create Manager and device for alice
 		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
-		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
-		auto aliceOPkInitialBatchSize = 3; // give it only 3 OPks as initial batch
-		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, aliceOPkInitialBatchSize, callback);
-		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
 
-		for (auto i=0; i<aliceOPkInitialBatchSize+1; i++) {
-			// Create manager and device for bob
-			auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
-			auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.d");
-			bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		auto aliceDevice = lime_tester::makeRandomDeviceName("alice.d.");
+		aliceManager->create_user(*aliceDevice, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		expected_success++;
+		auto bobDevice = lime_tester::makeRandomDeviceName("bob.d.");
+		bobManager->create_user(*bobDevice, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		expected_success++;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// alice encrypts to bob, bob decrypts
+		auto aliceEnc = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[0]);
+		aliceEnc->addRecipient(*bobDevice);
+		aliceManager->encrypt(*aliceDevice, algos, aliceEnc, callback);
+		expected_success++;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice, "bob", *aliceDevice, aliceEnc->m_recipients[0].DRmessage, aliceEnc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+
+		// restart alice manager and warm its cache
+		aliceManager = nullptr;
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		aliceManager->warm_cache(warmerCallback);
+		BC_ASSERT_TRUE(lime_tester::wait_for_mutex(bc_stack,&warmerDone,++expectedWarmerDone,lime_tester::wait_for_timeout, warmerMutex));
+		{
+			std::lock_guard<std::recursive_mutex> lock(*warmerMutex);
+			BC_ASSERT_TRUE(warmerMessage == "1 users and 1 sessions loaded in cache");
+		}
+
+		// everything is already in cache
+		aliceManager->warm_cache(warmerCallback);
+		BC_ASSERT_TRUE(lime_tester::wait_for_mutex(bc_stack,&warmerDone,++expectedWarmerDone,lime_tester::wait_for_timeout, warmerMutex));
+		{
+			std::lock_guard<std::recursive_mutex> lock(*warmerMutex);
+			BC_ASSERT_TRUE(warmerMessage == "0 users and 0 sessions loaded in cache");
+		}
+
+		// no memory budget: nothing is loaded
+		aliceManager = nullptr;
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		aliceManager->warm_cache(lime::settings::cacheWarmer_maxSessions, 0, warmerCallback);
+		BC_ASSERT_TRUE(lime_tester::wait_for_mutex(bc_stack,&warmerDone,++expectedWarmerDone,lime_tester::wait_for_timeout, warmerMutex));
+		{
+			std::lock_guard<std::recursive_mutex> lock(*warmerMutex);
+			BC_ASSERT_TRUE(warmerMessage == "0 users and 0 sessions loaded in cache");
+		}
+
+		// a callback restarting the warmer from the warmer thread is told it is still running, without joining its own thread
+		{
+			int reentrantDone = 0;
+			lime::CallbackReturn reentrantReturn = lime::CallbackReturn::success;
+			LimeManager *reentrantManager = aliceManager.get();
+			limeCallback reentrantCallback = [&reentrantDone, &reentrantReturn, reentrantManager, warmerMutex](lime::CallbackReturn, std::string) {
+							reentrantManager->warm_cache([&reentrantReturn](lime::CallbackReturn returnCode, std::string) {
+								reentrantReturn = returnCode; // called synchronously: the warmer did not restart
+							});
+							std::lock_guard<std::recursive_mutex> lock(*warmerMutex);
+							reentrantDone++;
+						};
+			aliceManager->warm_cache(reentrantCallback);
+			BC_ASSERT_TRUE(lime_tester::wait_for_mutex(bc_stack,&reentrantDone,1,lime_tester::wait_for_timeout, warmerMutex));
+			BC_ASSERT_TRUE(reentrantReturn == lime::CallbackReturn::fail);
+			// the previous run is over: a foreground call restarts the warmer
+			aliceManager->warm_cache(warmerCallback);
+			BC_ASSERT_TRUE(lime_tester::wait_for_mutex(bc_stack,&warmerDone,++expectedWarmerDone,lime_tester::wait_for_timeout, warmerMutex));
+		}
+
+		// start the cache warmer at construction and encrypt right away: the encryption runs concurrently with the warmer
+		aliceManager = nullptr;
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost, true);
+		aliceEnc = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[1]);
+		aliceEnc->addRecipient(*bobDevice);
+		aliceManager->encrypt(*aliceDevice, algos, aliceEnc, callback);
+		expected_success++;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDevice, "bob", *aliceDevice, aliceEnc->m_recipients[0].DRmessage, aliceEnc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[1]);
+
+		if (cleanDatabase) {
+			aliceManager->delete_user(DeviceId(*aliceDevice, curve), callback);
+			bobManager->delete_user(DeviceId(*bobDevice, curve), callback);
+			expected_success += 2;
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_warm_cache(void) {
+#ifdef EC25519_ENABLED
+	lime_warm_cache_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_warm_cache_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_warm_cache_test(lime::CurveId::c25519k512);
+	lime_warm_cache_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_warm_cache_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+}
+
+/**
+ * Scenario:
+ * - Create alice and more peer devices than a peer bundles request chunk holds
+ * - Alice encrypts to all of them: the key bundles are requested in two chunks, the second one fails
+ * - Check the callback is called once, after the failed chunk, the encryption succeeds
+ * - Check the devices requested in the failed chunk are set to fail, the others got a DR message and decrypt it
+ */
+static void lime_bundles_chunk_failure_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_bundles_chunk_failure"};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string dbFilenameAlice = dbBaseFilename + ".alice" + dbSuffix;
+	const std::string dbFilenamePeers = dbBaseFilename + ".peers" + dbSuffix;
+	remove(dbFilenameAlice.data());
+	remove(dbFilenamePeers.data());
+	constexpr size_t peerDevicesCount = lime::settings::X3DH_peerBundlesChunkSize + 10;
+	constexpr uint16_t OPkBatchSize = 2;
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		const std::vector<lime::CurveId> algos{curve};
+		lime_tester::X3DHServerStandIn server{};
+		// alice requests go to the server except the second peer bundles request: its response is given after the first chunk is processed
+		auto serverPost = server.postData();
+		int peerBundlesRequests = 0;
+		std::vector<lime::limeX3DHServerResponseProcess> failedChunks{};
+		limeX3DHServerPostData alicePost = [&serverPost, &peerBundlesRequests, &failedChunks](const std::string &url, const std::string &from, std::vector<uint8_t> &&message, const limeX3DHServerResponseProcess &responseProcess) {
+			if (message.size()>1 && message[1] == static_cast<uint8_t>(lime::x3dh_protocol::x3dh_message_type::getPeerBundle) && ++peerBundlesRequests == 2) {
+				failedChunks.push_back(responseProcess);
+				return;
+			}
+			serverPost(url, from, std::move(message), responseProcess);
+		};
+
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, alicePost);
+		auto peersManager = make_unique<LimeManager>(dbFilenamePeers, server.postData());
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+		std::vector<std::shared_ptr<std::string>> peerDeviceIds{};
+		for (size_t i=0; i<peerDevicesCount; i++) {
+			peerDeviceIds.push_back(lime_tester::makeRandomDeviceName("bob.d"));
+			peersManager->create_user(*peerDeviceIds.back(), algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+		}
+		server.process();
+		expected_success += 1+(int)peerDevicesCount;
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+
+		auto encryptionContext = make_shared<EncryptionContext>("group", lime_tester::messages_pattern[0]);
+		for (const auto &peerDeviceId : peerDeviceIds) {
+			encryptionContext->addRecipient(*peerDeviceId);
+		}
+		aliceManager->encrypt(*aliceDeviceId, algos, encryptionContext, callback);
+		server.process();
+		// the first chunk is processed, the encryption waits for the second one
+		BC_ASSERT_EQUAL(peerBundlesRequests, 2, int, "%d");
+		BC_ASSERT_EQUAL((int)failedChunks.size(), 1, int, "%d");
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d");
+		for (const auto &failedChunk : failedChunks) {
+			failedChunk(500, std::vector<uint8_t>{});
+		}
+		server.process();
+		BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d");
+
+		// the second chunk devices are set to fail, the others decrypt
+		size_t failedCount = 0;
+		for (size_t i=0; i<peerDevicesCount; i++) {
+			const auto &recipient = encryptionContext->m_recipients[i];
+			if (recipient.peerStatus == lime::PeerDeviceStatus::fail) {
+				failedCount++;
+				BC_ASSERT_TRUE(recipient.DRmessage.empty());
+				continue;
+			}
+			BC_ASSERT_FALSE(recipient.DRmessage.empty());
+			std::vector<uint8_t> receivedMessage{};
+			BC_ASSERT_TRUE(peersManager->decrypt(*peerDeviceIds[i], "group", *aliceDeviceId, recipient.DRmessage, encryptionContext->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+		}
+		BC_ASSERT_EQUAL((int)failedCount, (int)(peerDevicesCount - lime::settings::X3DH_peerBundlesChunkSize), int, "%d");
+
+		aliceManager = nullptr;
+		peersManager = nullptr;
+		if (cleanDatabase) {
+			remove(dbFilenameAlice.data());
+			remove(dbFilenamePeers.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_bundles_chunk_failure(void) {
+#ifdef EC25519_ENABLED
+	lime_bundles_chunk_failure_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_bundles_chunk_failure_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_bundles_chunk_failure_test(lime::CurveId::c25519k512);
+	lime_bundles_chunk_failure_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_bundles_chunk_failure_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+}
+
+/**
+ * Scenario:
+ * - Establish a session between alice and bob
+ * - Skip two messages and keep on exchanging post until maxMessagesReceivedAfterSkip
+ * - Check we have two message key in localStorage
+ * - decrypt a message
+ * - Check we have one message key in localStorage
+ * - call the update
+ * - Check we have no more message key in storage
+ * - try to decrypt the message, it shall fail
+ */
+static void lime_update_clean_MK_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_update_clean_MK"};
+	std::string dbFilenameAlice;
+	std::shared_ptr<std::string> aliceDeviceId;
+	std::unique_ptr<LimeManager> aliceManager;
+	std::string dbFilenameBob;
+	std::shared_ptr<std::string> bobDeviceId;
+	std::unique_ptr<LimeManager> bobManager;
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+	try {
+		std::vector<lime::CurveId> algos{curve};
+		lime_session_establishment(algos, dbBaseFilename,
+					dbFilenameAlice, aliceDeviceId, aliceManager,
+					dbFilenameBob, bobDeviceId, bobManager);
+
+		/* Alice encrypt 2 messages that are kept */
+		auto aliceEncCtx1 = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[0]);
+		aliceEncCtx1->addRecipient(*bobDeviceId);
+		auto aliceEncCtx2 = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[1]);
+		aliceEncCtx2->addRecipient(*bobDeviceId);
+		aliceManager->encrypt(*aliceDeviceId, algos, aliceEncCtx1, callback);
+		aliceManager->encrypt(*aliceDeviceId, algos, aliceEncCtx2, callback);
+		expected_success+=2;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success, lime_tester::wait_for_timeout));
+
+		/* Alice and Bob exchange more than maxMessagesReceivedAfterSkip messages(do batches of 4 to be faster) */
+		lime_exchange_messages(aliceDeviceId, aliceManager, bobDeviceId, bobManager, algos, lime::settings::maxMessagesReceivedAfterSkip/4+1, 4);
+
+		/* Check that bob got 2 message key in local Storage */
+		BC_ASSERT_EQUAL(lime_tester::get_StoredMessageKeyCount(dbFilenameBob, *bobDeviceId, *aliceDeviceId, curve), 2, unsigned int, "%d");
+
+		/* decrypt held message 1, we know that device but no trust was ever established */
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDeviceId, "bob", *aliceDeviceId, aliceEncCtx1->m_recipients[0].DRmessage, aliceEncCtx1->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::untrusted);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+
+		/* Check that bob got 1 message key in local Storage */
+		BC_ASSERT_EQUAL(lime_tester::get_StoredMessageKeyCount(dbFilenameBob, *bobDeviceId, *aliceDeviceId, curve), 1, unsigned int, "%d");
+
+		/* update belle-sip stack processing possible incoming messages from server */
+		belle_sip_stack_sleep(bc_stack,0);
+
+		/* call the update function, forwardtime by 2 days before or the update is skipped */
+		lime_tester::forwardTime(dbFilenameBob, 2);
+		bobManager->update(*bobDeviceId, algos, callback, 0, lime_tester::OPkInitialBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success, lime_tester::wait_for_timeout));
+
+		/* Check that bob got 0 message key in local Storage */
+		BC_ASSERT_EQUAL(lime_tester::get_StoredMessageKeyCount(dbFilenameBob, *bobDeviceId, *aliceDeviceId, curve), 0, unsigned int, "%d");
+
+		/* try to decrypt message 2, it shall fail */
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDeviceId, "bob", *aliceDeviceId, aliceEncCtx2->m_recipients[0].DRmessage, aliceEncCtx2->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::fail);
+
+		if (cleanDatabase) {
+			aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
+			bobManager->delete_user(DeviceId(*bobDeviceId, curve), callback);
+			expected_success +=2;
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_update_clean_MK() {
+#ifdef EC25519_ENABLED
+	lime_update_clean_MK_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_update_clean_MK_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_update_clean_MK_test(lime::CurveId::c25519k512);
+
+	lime_update_clean_MK_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_update_clean_MK_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+}
+
+/**
+ * Scenario:
+ * - Create Alice and Bob users
+ * - Backup local Alice DB.
+ * - Delete Alice user (so it is not anymore on the server)
+ * - restore local Alice DB and do an update, it shall republish the user on server(using new OPks)
+ * - Bob encrypt a message to Alice, it shall work as the user has been republished
+ * - Alice decrypt just to be sure we're good with the OPks
+ */
+static void lime_update_republish_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_update_republish"};
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	std::string dbFilenameAliceBackup{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append(CurveId2String(curve)).append(".sqlite3");
+	dbFilenameAliceBackup.append(".alice.backup.").append(CurveId2String(curve)).append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append(CurveId2String(curve)).append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameAliceBackup.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		std::vector<lime::CurveId> algos{curve};
+		// create Managers and devices for alice and Bob
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.");
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
+		auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.");
+		bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		expected_success += 2;
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, expected_success,lime_tester::wait_for_timeout));
+
+		// Backup Alice Database
+		std::ifstream  src(dbFilenameAlice, std::ios::binary);
+		std::ofstream  dst(dbFilenameAliceBackup,   std::ios::binary);
+		dst << src.rdbuf();
+		src.close();
+		dst.close();
+
+		// Delete Alice user
+		aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		// Start a new manager using the backuped local base, so the user is present in local but no more on remote
+		aliceManager = nullptr;
+		lime_tester::forwardTime(dbFilenameAliceBackup, 2); // forward time otherwise the update won't do anything
+		aliceManager = make_unique<LimeManager>(dbFilenameAliceBackup, X3DHServerPost);
+		// Update: that shall set all current OPk as dispatched, create a new batch of default creation size and republish the user on server
+		aliceManager->update(*aliceDeviceId, algos, callback, lime_tester::OPkInitialBatchSize, lime_tester::OPkInitialBatchSize);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		// Bob encrypt a message to Alice, it will fetch keys from server
+		auto enc = make_shared<EncryptionContext>("alice", lime_tester::messages_pattern[0]);
+		enc->addRecipient(*aliceDeviceId);
+		bobManager->encrypt(*bobDeviceId, algos, enc, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		// Alice decrypt
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *bobDeviceId, enc->m_recipients[0].DRmessage, enc->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::unknown);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+
+		if (cleanDatabase) {
+			aliceManager->delete_user(DeviceId(*aliceDeviceId, curve), callback);
+			bobManager->delete_user(DeviceId(*bobDeviceId, curve), callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success+2,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameAliceBackup.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+
+static void lime_update_republish() {
+#ifdef EC25519_ENABLED
+	lime_update_republish_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_update_republish_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_update_republish_test(lime::CurveId::c25519k512);
+
+	lime_update_republish_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_update_republish_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+}
+/** Scenario
+ * - Create one device for alice
+ * - Create OPk_batch_size devices for bob, they will all fetch a key and encrypt a messaage to alice, server shall not have anymore OPks
+ * - Create another device for alice and send a message to bob, it shall get a non OPk bundle, check it is the case in the message sent to Alice
+ * Alice decrypt all messages to complete the check
+ *
+ */
+static void x3dh_without_OPk_test(const lime::CurveId curve, const std::string &dbBaseFilename, bool continuousSession=true) {
+	// create DB
+	std::string dbFilenameAlice{dbBaseFilename};
+	dbFilenameAlice.append(".alice.").append(CurveId2String(curve)).append(".sqlite3");
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append(CurveId2String(curve)).append(".sqlite3");
+
+	remove(dbFilenameAlice.data()); // delete the database file if already exists
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+	try {
+		std::vector<lime::CurveId> algos{curve};
+		// create Manager and device for alice
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto aliceOPkInitialBatchSize = 3; // give it only 3 OPks as initial batch
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, aliceOPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+
+		for (auto i=0; i<aliceOPkInitialBatchSize+1; i++) {
+			// Create manager and device for bob
+			auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
+			auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.d");
+			bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
 			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
 
 			// encrypt a message to Alice
@@ -2883,6 +3617,278 @@ static void x3dh_multiple_DRsessions(void) {
 #endif
 }
 
+/*
+ * Scenario, running on the in-process X3DH server stand-in: a message header matching only the session in cache
+ * - Alice encrypts to Bob(never delivered) while Bob encrypts to Alice: Alice decrypts, her first session is now stale
+ * - A second manager opens Alice's local storage and exchanges messages with Bob until Bob ratchets twice
+ * - Alice's first manager still holds in cache the active session as it was before: it cannot decrypt Bob's next message
+ *   but the message header matches that session in local storage, the only match: it is reloaded and decrypts
+ */
+static void lime_session_cache_only_match_test(const lime::CurveId curve, const std::string &dbBaseFilename) {
+	const std::vector<lime::CurveId> algos{curve};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string dbFilenameAlice = dbBaseFilename + ".alice" + dbSuffix;
+	const std::string dbFilenameBob = dbBaseFilename + ".bob" + dbSuffix;
+	remove(dbFilenameAlice.data());
+	remove(dbFilenameBob.data());
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		lime_tester::X3DHServerStandIn server{};
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, server.postData());
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.d1.");
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		server.process();
+		expected_success += 2;
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+
+		size_t patternIndex = 0;
+		auto encrypt = [&](LimeManager &manager, const std::string &sender, const std::string &recipient) {
+			auto enc = make_shared<lime::EncryptionContext>(recipient, lime_tester::messages_pattern[patternIndex%lime_tester::messages_pattern.size()]);
+			patternIndex++;
+			enc->addRecipient(recipient);
+			manager.encrypt(sender, algos, enc, callback);
+			server.process();
+			BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+			return enc;
+		};
+		auto decrypt = [](LimeManager &manager, const std::string &recipient, const std::string &sender, const std::shared_ptr<lime::EncryptionContext> &enc) {
+			std::vector<uint8_t> receivedMessage{};
+			auto status = manager.decrypt(recipient, recipient, sender, enc->m_recipients[0].DRmessage, enc->m_cipherMessage, receivedMessage);
+			return status != lime::PeerDeviceStatus::fail && receivedMessage == enc->m_plainMessage;
+		};
+
+		// crossed session establishment, Alice's message is never delivered: her session becomes stale
+		encrypt(*aliceManager, *aliceDeviceId, *bobDeviceId);
+		auto bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+		BC_ASSERT_TRUE(decrypt(*aliceManager, *aliceDeviceId, *bobDeviceId, bobEnc)); // the active session is now in cache
+		std::vector<long int> sessionsId{};
+		const auto activeSessionId = lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDeviceId, *bobDeviceId, sessionsId);
+		BC_ASSERT_EQUAL((int)sessionsId.size(), 2, int, "%d");
+
+		// a second manager on Alice's local storage moves the active session forward: Bob ratchets twice
+		{
+			auto aliceManager2 = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+			for (int i=0; i<2; i++) {
+				auto aliceEnc = encrypt(*aliceManager2, *aliceDeviceId, *bobDeviceId);
+				BC_ASSERT_TRUE(decrypt(*bobManager, *bobDeviceId, *aliceDeviceId, aliceEnc));
+				bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+				BC_ASSERT_TRUE(decrypt(*aliceManager2, *aliceDeviceId, *bobDeviceId, bobEnc));
+			}
+		}
+
+		// the first manager cached session is out of date, the local storage one is the only one matching the message: it decrypts
+		bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+		BC_ASSERT_TRUE(decrypt(*aliceManager, *aliceDeviceId, *bobDeviceId, bobEnc));
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDeviceId, *bobDeviceId, sessionsId), activeSessionId, long int, "%ld");
+		BC_ASSERT_EQUAL((int)sessionsId.size(), 2, int, "%d");
+		// and the session is back in sync in cache
+		bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+		BC_ASSERT_TRUE(decrypt(*aliceManager, *aliceDeviceId, *bobDeviceId, bobEnc));
+
+		aliceManager = nullptr;
+		bobManager = nullptr;
+		if (cleanDatabase) {
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_session_cache_only_match(void) {
+#ifdef EC25519_ENABLED
+	lime_session_cache_only_match_test(lime::CurveId::c25519, "lime_session_cache_only_match");
+#endif
+#ifdef EC448_ENABLED
+	lime_session_cache_only_match_test(lime::CurveId::c448, "lime_session_cache_only_match");
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_session_cache_only_match_test(lime::CurveId::c25519k512, "lime_session_cache_only_match");
+	lime_session_cache_only_match_test(lime::CurveId::c25519mlk512, "lime_session_cache_only_match");
+#endif
+#ifdef EC448_ENABLED
+	lime_session_cache_only_match_test(lime::CurveId::c448mlk1024, "lime_session_cache_only_match");
+#endif
+#endif
+}
+
+/* A tracer recording how many DR sessions each message decryption tries */
+class SessionsTriedTracer : public lime::Tracer {
+	private:
+		std::mutex m_mutex;
+		SpanId m_nextId = 1;
+	public:
+		std::vector<int64_t> sessionsTried;
+
+		SpanId startSpan(const std::string &name, const SpanId) override {
+			if (name != "lime.dr.decryptMessage") return 0; // drop the other spans
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_nextId++;
+		}
+		void setAttribute(const SpanId, const std::string &key, const AttributeValue &value) override {
+			if (key != "lime.sessions") return;
+			std::lock_guard<std::mutex> lock(m_mutex);
+			sessionsTried.push_back(std::get<int64_t>(value));
+		}
+		void endSpan(const SpanId, const bool) override {}
+};
+
+/*
+ * Scenario, running on the in-process X3DH server stand-in: Alice holds several stale sessions with Bob
+ * - Bob marks his session with Alice stale and starts a new one, three times: Alice gets one active and three stale sessions
+ * - Alice's manager is restarted before each decryption so the sessions are selected from local storage
+ * - a message opening a new receiving chain: on KEM based curves its header gives the index of Alice's KEM ratchet key,
+ *   only the active session is tried. EC only headers do not identify it: all sessions are tried
+ * - the next message in that chain matches the active session peer ratchet key: only this session is tried
+ */
+static void lime_session_stale_skip_test(const lime::CurveId curve, const std::string &dbBaseFilename) {
+	const std::vector<lime::CurveId> algos{curve};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string dbFilenameAlice = dbBaseFilename + ".alice" + dbSuffix;
+	const std::string dbFilenameBob = dbBaseFilename + ".bob" + dbSuffix;
+	remove(dbFilenameAlice.data());
+	remove(dbFilenameBob.data());
+
+	constexpr size_t staleSessionsCount = 3;
+	const bool KEMBased = (curve == lime::CurveId::c25519k512 || curve == lime::CurveId::c25519mlk512 || curve == lime::CurveId::c448mlk1024);
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		lime_tester::X3DHServerStandIn server{};
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, server.postData());
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.d1.");
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		server.process();
+		expected_success += 2;
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+
+		size_t patternIndex = 0;
+		auto encrypt = [&](LimeManager &manager, const std::string &sender, const std::string &recipient) {
+			auto enc = make_shared<lime::EncryptionContext>(recipient, lime_tester::messages_pattern[patternIndex%lime_tester::messages_pattern.size()]);
+			patternIndex++;
+			enc->addRecipient(recipient);
+			manager.encrypt(sender, algos, enc, callback);
+			server.process();
+			BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+			return enc;
+		};
+		auto decrypt = [](LimeManager &manager, const std::string &recipient, const std::string &sender, const std::shared_ptr<lime::EncryptionContext> &enc) {
+			std::vector<uint8_t> receivedMessage{};
+			auto status = manager.decrypt(recipient, recipient, sender, enc->m_recipients[0].DRmessage, enc->m_cipherMessage, receivedMessage);
+			return status != lime::PeerDeviceStatus::fail && receivedMessage == enc->m_plainMessage;
+		};
+		// a few round trips Bob first, so the KEM keys are exchanged and the headers carry their index only
+		auto exchange = [&]() {
+			for (int i=0; i<3; i++) {
+				auto bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+				BC_ASSERT_TRUE(decrypt(*aliceManager, *aliceDeviceId, *bobDeviceId, bobEnc));
+				auto aliceEnc = encrypt(*aliceManager, *aliceDeviceId, *bobDeviceId);
+				BC_ASSERT_TRUE(decrypt(*bobManager, *bobDeviceId, *aliceDeviceId, aliceEnc));
+			}
+		};
+
+		exchange();
+		for (size_t i=0; i<staleSessionsCount; i++) {
+			// Bob's session goes stale: his next encryption fetches Alice's key bundle and starts a new session
+			{
+				soci::session sql("sqlite3", dbFilenameBob);
+				sql<<"UPDATE DR_sessions SET Status = 0;";
+			}
+			bobManager = make_unique<LimeManager>(dbFilenameBob, server.postData());
+			exchange();
+		}
+		std::vector<long int> sessionsId{};
+		const auto activeSessionId = lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDeviceId, *bobDeviceId, sessionsId);
+		BC_ASSERT_EQUAL((int)sessionsId.size(), (int)staleSessionsCount+1, int, "%d");
+
+		auto tracer = std::make_shared<SessionsTriedTracer>();
+		LimeManager::set_tracer(tracer);
+
+		// Bob's message opens a new receiving chain on Alice's side
+		auto bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+		if (KEMBased) {
+			BC_ASSERT_FALSE(lime_tester::DR_message_holdsAsymmetricKeys(bobEnc->m_recipients[0].DRmessage));
+		}
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		BC_ASSERT_TRUE(decrypt(*aliceManager, *aliceDeviceId, *bobDeviceId, bobEnc));
+		BC_ASSERT_EQUAL((int)tracer->sessionsTried.size(), 1, int, "%d");
+		if (tracer->sessionsTried.size() == 1) {
+			BC_ASSERT_EQUAL((int)tracer->sessionsTried[0], KEMBased?1:(int)staleSessionsCount+1, int, "%d");
+		}
+
+		// the next message of this chain matches the active session only
+		tracer->sessionsTried.clear();
+		bobEnc = encrypt(*bobManager, *bobDeviceId, *aliceDeviceId);
+		aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		BC_ASSERT_TRUE(decrypt(*aliceManager, *aliceDeviceId, *bobDeviceId, bobEnc));
+		BC_ASSERT_EQUAL((int)tracer->sessionsTried.size(), 1, int, "%d");
+		if (tracer->sessionsTried.size() == 1) {
+			BC_ASSERT_EQUAL((int)tracer->sessionsTried[0], 1, int, "%d");
+		}
+		LimeManager::set_tracer(nullptr);
+		BC_ASSERT_EQUAL(lime_tester::get_DRsessionsId(dbFilenameAlice, *aliceDeviceId, *bobDeviceId, sessionsId), activeSessionId, long int, "%ld");
+
+		aliceManager = nullptr;
+		bobManager = nullptr;
+		if (cleanDatabase) {
+			remove(dbFilenameAlice.data());
+			remove(dbFilenameBob.data());
+		}
+	} catch (BctbxException &e) {
+		LimeManager::set_tracer(nullptr);
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_session_stale_skip(void) {
+#ifdef EC25519_ENABLED
+	lime_session_stale_skip_test(lime::CurveId::c25519, "lime_session_stale_skip");
+#endif
+#ifdef EC448_ENABLED
+	lime_session_stale_skip_test(lime::CurveId::c448, "lime_session_stale_skip");
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_session_stale_skip_test(lime::CurveId::c25519k512, "lime_session_stale_skip");
+	lime_session_stale_skip_test(lime::CurveId::c25519mlk512, "lime_session_stale_skip");
+#endif
+#ifdef EC448_ENABLED
+	lime_session_stale_skip_test(lime::CurveId::c448mlk1024, "lime_session_stale_skip");
+#endif
+#endif
+}
+
 
 /*
  * alice.d1 will encrypt to bob.d1, bob.d2, bob.d3, bob.d4
@@ -4621,52 +5627,424 @@ static void lime_multithread_test(const lime::CurveId curve) {
 			activeThreads.emplace_back(lime_multithread_create_thread, arg);
 		}
 
-		// wait for the threads to complete
+		// wait for the threads to complete
+		for (auto &t : activeThreads) {
+			t.join();
+		}
+		activeThreads.clear();
+
+		// encrypt, three encryption threads per user
+		for (auto i=0; i<3; i++) {
+			for (const auto &arg : devArg) {
+				activeThreads.emplace_back(lime_multithread_encrypt_thread, arg);
+			}
+		}
+
+		// decrypt, two decryption threads per user
+		for (auto i=0; i<2; i++) {
+			for (const auto &arg : devArg) {
+				activeThreads.emplace_back(lime_multithread_decrypt_thread, arg);
+			}
+		}
+
+		//update, two threads per user
+		for (auto i=0; i<2; i++) {
+			for (const auto &arg : devArg) {
+				activeThreads.emplace_back(lime_multithread_update_thread, arg);
+			}
+		}
+		// wait for the threads to complete
+		for (auto &t : activeThreads) {
+			t.join();
+		}
+		activeThreads.clear();
+
+		// delete devices
+		for (const auto &arg : devArg) {
+			activeThreads.emplace_back(lime_multithread_delete_thread, arg);
+		}
+
+		// wait for the threads to complete
+		for (auto &t : activeThreads) {
+			t.join();
+		}
+		activeThreads.clear();
+
+		if (cleanDatabase) {
+			remove(dbFilenameAlice.data()); // delete the database file if already exists
+			remove(dbFilenameBob.data()); // delete the database file if already exists
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_multithread(void) {
+	for (size_t i=0; i<3; i++) { // loop several times as the first messages sending/receiving are the most susceptible to bump into problems
+#ifdef EC25519_ENABLED
+	lime_multithread_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_multithread_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_multithread_test(lime::CurveId::c25519k512);
+
+	lime_multithread_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_multithread_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+	}
+}
+
+/*
+ * Scenario:
+ * - Create one bob device and several peer devices
+ * - Each peer device encrypts a burst of messages to bob
+ * - Bob decrypts them concurrently: two threads per peer device, one decrypting the odd messages, the other the even ones
+ * - Bob encrypts concurrently: one thread per peer device encrypting to it, one thread encrypting to all of them
+ * - Peer devices decrypt all bob's messages
+ */
+/* A tracer measuring how many DR sending chains preparations run at the same time
+ * The first preparation waits, for a while, for another one to start: if they were serialized the wait times out and the
+ * concurrency measured stays 1
+ */
+class ConcurrencyTracer : public lime::Tracer {
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		size_t m_inFlight = 0; // the preparation spans not ended yet
+		SpanId m_nextId = 1;
+	public:
+		size_t maxConcurrency = 0;
+
+		SpanId startSpan(const std::string &name, const SpanId) override {
+			if (name != "lime.dr.prepareSendingChains") return 0;
+			std::unique_lock<std::mutex> lock(m_mutex);
+			SpanId id = m_nextId++;
+			m_inFlight++;
+			maxConcurrency = std::max(maxConcurrency, m_inFlight);
+			m_cv.notify_all();
+			if (maxConcurrency < 2) {
+				m_cv.wait_for(lock, std::chrono::seconds(2), [this]{return maxConcurrency >= 2;});
+			}
+			return id;
+		}
+		void setAttribute(const SpanId, const std::string &, const AttributeValue &) override {}
+		void endSpan(const SpanId, const bool) override {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_inFlight--;
+		}
+};
+
+static void lime_multithread_peers_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_multithread_peers"};
+	std::string dbFilenameBob{dbBaseFilename};
+	dbFilenameBob.append(".bob.").append(CurveId2String(curve)).append(".sqlite3");
+	std::string dbFilenamePeers{dbBaseFilename};
+	dbFilenamePeers.append(".peers.").append(CurveId2String(curve)).append(".sqlite3");
+
+	remove(dbFilenameBob.data()); // delete the database file if already exists
+	remove(dbFilenamePeers.data()); // delete the database file if already exists
+
+	constexpr size_t peersCount = 6;
+	constexpr size_t messagesCount = 20;
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		std::vector<lime::CurveId> algos{curve};
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, X3DHServerPost);
+		auto peersManager = make_unique<LimeManager>(dbFilenamePeers, X3DHServerPost);
+
+		auto bobDevice = lime_tester::makeRandomDeviceName("bob.d.");
+		bobManager->create_user(*bobDevice, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		expected_success++;
+		std::vector<std::string> peerDevices{};
+		for (size_t i=0; i<peersCount; i++) {
+			peerDevices.push_back(*lime_tester::makeRandomDeviceName("peer.d."));
+			peersManager->create_user(peerDevices.back(), algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+			expected_success++;
+		}
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+		if (counters.operation_failed != 0) return; // skip the end of the test if we can't do this
+
+		// each peer device encrypts a burst of messages to bob
+		std::vector<std::vector<std::shared_ptr<lime::EncryptionContext>>> peersEncs(peersCount);
+		for (size_t i=0; i<peersCount; i++) {
+			for (size_t j=0; j<messagesCount; j++) {
+				auto enc = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[j]);
+				enc->addRecipient(*bobDevice);
+				peersManager->encrypt(peerDevices[i], algos, enc, callback);
+				expected_success++;
+				peersEncs[i].push_back(enc);
+			}
+		}
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+
+		// bob decrypts them concurrently
+		std::atomic<int> decryptSuccess{0};
+		std::deque<std::thread> activeThreads{};
+		for (size_t i=0; i<peersCount; i++) {
+			for (size_t parity=0; parity<2; parity++) {
+				activeThreads.emplace_back([&, i, parity]() {
+					for (size_t j=parity; j<messagesCount; j+=2) {
+						std::vector<uint8_t> receivedMessage{};
+						auto &enc = peersEncs[i][j];
+						if (bobManager->decrypt(*bobDevice, "bob", peerDevices[i], enc->m_recipients[0].DRmessage, enc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail
+							&& receivedMessage == lime_tester::messages_pattern[j]) {
+							decryptSuccess++;
+						}
+					}
+				});
+			}
+		}
 		for (auto &t : activeThreads) {
 			t.join();
 		}
 		activeThreads.clear();
-
-		// encrypt, three encryption threads per user
-		for (auto i=0; i<3; i++) {
-			for (const auto &arg : devArg) {
-				activeThreads.emplace_back(lime_multithread_encrypt_thread, arg);
+		BC_ASSERT_EQUAL(decryptSuccess.load(), (int)(peersCount*messagesCount), int, "%d");
+
+		// bob encrypts concurrently: sessions are all in cache, encryptions are processed synchronously
+		// the ratchet and message keys derivations of different peer devices must overlap: they are not serialized on the database lock
+		auto tracer = std::make_shared<ConcurrencyTracer>();
+		LimeManager::set_tracer(tracer);
+		std::atomic<int> encryptSuccess{0};
+		std::mutex bobEncsMutex;
+		std::vector<std::shared_ptr<lime::EncryptionContext>> bobEncs{};
+		auto bobEncrypt = [&](std::shared_ptr<lime::EncryptionContext> enc) {
+			bobManager->encrypt(*bobDevice, algos, enc, [&encryptSuccess](lime::CallbackReturn returnCode, std::string anythingToSay) {
+				if (returnCode == lime::CallbackReturn::success) {
+					encryptSuccess++;
+				} else {
+					LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+				}
+			});
+			std::lock_guard<std::mutex> lock(bobEncsMutex);
+			bobEncs.push_back(enc);
+		};
+		for (size_t i=0; i<peersCount; i++) {
+			activeThreads.emplace_back([&, i]() {
+				for (size_t j=0; j<messagesCount; j++) {
+					auto enc = make_shared<lime::EncryptionContext>("peers", lime_tester::messages_pattern[j]);
+					enc->addRecipient(peerDevices[i]);
+					bobEncrypt(enc);
+				}
+			});
+		}
+		activeThreads.emplace_back([&]() {
+			for (size_t j=0; j<messagesCount; j++) {
+				auto enc = make_shared<lime::EncryptionContext>("peers", lime_tester::messages_pattern[j]);
+				// add the recipients in reverse order: locks on peer devices must be taken in the same order whatever the recipient list order is
+				for (auto peer = peerDevices.crbegin(); peer != peerDevices.crend(); peer++) {
+					enc->addRecipient(*peer);
+				}
+				bobEncrypt(enc);
 			}
+		});
+		for (auto &t : activeThreads) {
+			t.join();
 		}
+		activeThreads.clear();
+		LimeManager::set_tracer(nullptr);
+		BC_ASSERT_EQUAL(encryptSuccess.load(), (int)((peersCount+1)*messagesCount), int, "%d");
+		BC_ASSERT_TRUE(tracer->maxConcurrency >= 2);
 
-		// decrypt, two decryption threads per user
-		for (auto i=0; i<2; i++) {
-			for (const auto &arg : devArg) {
-				activeThreads.emplace_back(lime_multithread_decrypt_thread, arg);
+		// peers decrypt everything
+		for (const auto &enc : bobEncs) {
+			for (const auto &recipient : enc->m_recipients) {
+				std::vector<uint8_t> receivedMessage{};
+				BC_ASSERT_TRUE(peersManager->decrypt(recipient.deviceId, "peers", *bobDevice, recipient.DRmessage, enc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+				BC_ASSERT_TRUE(receivedMessage == enc->m_plainMessage);
 			}
 		}
 
-		//update, two threads per user
-		for (auto i=0; i<2; i++) {
-			for (const auto &arg : devArg) {
-				activeThreads.emplace_back(lime_multithread_update_thread, arg);
+		if (cleanDatabase) {
+			bobManager->delete_user(DeviceId(*bobDevice, curve), callback);
+			expected_success++;
+			for (const auto &peerDevice : peerDevices) {
+				peersManager->delete_user(DeviceId(peerDevice, curve), callback);
+				expected_success++;
 			}
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,expected_success,lime_tester::wait_for_timeout));
+			remove(dbFilenameBob.data());
+			remove(dbFilenamePeers.data());
 		}
-		// wait for the threads to complete
-		for (auto &t : activeThreads) {
-			t.join();
-		}
-		activeThreads.clear();
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
 
-		// delete devices
-		for (const auto &arg : devArg) {
-			activeThreads.emplace_back(lime_multithread_delete_thread, arg);
+static void lime_multithread_peers(void) {
+#ifdef EC25519_ENABLED
+	lime_multithread_peers_test(lime::CurveId::c25519);
+#endif
+#ifdef EC448_ENABLED
+	lime_multithread_peers_test(lime::CurveId::c448);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_multithread_peers_test(lime::CurveId::c25519k512);
+	lime_multithread_peers_test(lime::CurveId::c25519mlk512);
+#endif
+#ifdef EC448_ENABLED
+	lime_multithread_peers_test(lime::CurveId::c448mlk1024);
+#endif
+#endif
+}
+
+/*
+ * Scenario:
+ * - Create one bob device, several peer devices and more local users in bob's manager
+ * - Bob encrypts to all the peer devices: the sessions are established
+ * - Reload bob's manager: its users cache is empty
+ * - Bob encrypts concurrently from several threads while one thread loads some of the other local users and one deletes the others
+ * - Check all encryptions, loads and deletions succeeded and the peer devices decrypt all bob's messages
+ */
+static void lime_multithread_users_cache_test(const lime::CurveId curve) {
+	const std::string dbBaseFilename{"lime_multithread_users_cache"};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string dbFilenameBob = dbBaseFilename + ".bob" + dbSuffix;
+	const std::string dbFilenamePeers = dbBaseFilename + ".peers" + dbSuffix;
+	remove(dbFilenameBob.data());
+	remove(dbFilenamePeers.data());
+
+	constexpr size_t peersCount = 4;
+	constexpr size_t usersCount = 10; // loaded, as many deleted
+	constexpr size_t encryptThreadsCount = 4;
+	constexpr size_t messagesCount = 10;
+	constexpr uint16_t OPkBatchSize = 2;
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		const std::vector<lime::CurveId> algos{curve};
+		lime_tester::X3DHServerStandIn server{};
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, server.postData());
+		auto peersManager = make_unique<LimeManager>(dbFilenamePeers, server.postData());
+
+		auto bobDevice = lime_tester::makeRandomDeviceName("bob.d.");
+		bobManager->create_user(*bobDevice, algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+		std::vector<std::string> userDevices{};
+		for (size_t i=0; i<2*usersCount; i++) {
+			userDevices.push_back(*lime_tester::makeRandomDeviceName("user.d."));
+			bobManager->create_user(userDevices.back(), algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+		}
+		std::vector<std::string> peerDevices{};
+		for (size_t i=0; i<peersCount; i++) {
+			peerDevices.push_back(*lime_tester::makeRandomDeviceName("peer.d."));
+			peersManager->create_user(peerDevices.back(), algos, lime_tester::test_x3dh_default_server, OPkBatchSize, callback);
+		}
+		server.process();
+		expected_success += 1+2*usersCount+peersCount;
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success, int, "%d");
+
+		// establish the sessions: the encryptions from the threads do not need the X3DH server
+		std::vector<std::shared_ptr<lime::EncryptionContext>> bobEncs{};
+		bobEncs.push_back(make_shared<lime::EncryptionContext>("peers", lime_tester::messages_pattern[0]));
+		for (const auto &peerDevice : peerDevices) {
+			bobEncs.back()->addRecipient(peerDevice);
 		}
+		bobManager->encrypt(*bobDevice, algos, bobEncs.back(), callback);
+		server.process();
+		BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
 
-		// wait for the threads to complete
+		// reload bob's manager: the users are loaded again from storage
+		bobManager = make_unique<LimeManager>(dbFilenameBob, server.postData());
+
+		std::atomic<int> encryptSuccess{0};
+		std::atomic<int> loadSuccess{0};
+		std::atomic<int> deleteSuccess{0};
+		std::mutex bobEncsMutex;
+		std::deque<std::thread> activeThreads{};
+		for (size_t i=0; i<encryptThreadsCount; i++) {
+			activeThreads.emplace_back([&]() {
+				for (size_t j=0; j<messagesCount; j++) {
+					auto enc = make_shared<lime::EncryptionContext>("peers", lime_tester::messages_pattern[j]);
+					for (const auto &peerDevice : peerDevices) {
+						enc->addRecipient(peerDevice);
+					}
+					bobManager->encrypt(*bobDevice, algos, enc, [&encryptSuccess](lime::CallbackReturn returnCode, std::string anythingToSay) {
+						if (returnCode == lime::CallbackReturn::success) {
+							encryptSuccess++;
+						} else {
+							LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+						}
+					});
+					std::lock_guard<std::mutex> lock(bobEncsMutex);
+					bobEncs.push_back(enc);
+				}
+			});
+		}
+		activeThreads.emplace_back([&]() {
+			for (size_t i=0; i<usersCount; i++) {
+				if (bobManager->is_user(DeviceId(userDevices[i], curve))) {
+					loadSuccess++;
+				}
+			}
+		});
+		activeThreads.emplace_back([&]() {
+			for (size_t i=usersCount; i<2*usersCount; i++) {
+				bobManager->delete_user(DeviceId(userDevices[i], curve), [&deleteSuccess](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						deleteSuccess++;
+					} else {
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				});
+				// the server response removes the user from the manager cache
+				server.process();
+			}
+		});
 		for (auto &t : activeThreads) {
 			t.join();
 		}
-		activeThreads.clear();
+		BC_ASSERT_EQUAL(encryptSuccess.load(), (int)(encryptThreadsCount*messagesCount), int, "%d");
+		BC_ASSERT_EQUAL(loadSuccess.load(), (int)usersCount, int, "%d");
+		BC_ASSERT_EQUAL(deleteSuccess.load(), (int)usersCount, int, "%d");
+		for (size_t i=usersCount; i<2*usersCount; i++) {
+			BC_ASSERT_FALSE(bobManager->is_user(DeviceId(userDevices[i], curve)));
+		}
+
+		// peers decrypt everything
+		for (const auto &enc : bobEncs) {
+			for (const auto &recipient : enc->m_recipients) {
+				std::vector<uint8_t> receivedMessage{};
+				BC_ASSERT_TRUE(peersManager->decrypt(recipient.deviceId, "peers", *bobDevice, recipient.DRmessage, enc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+				BC_ASSERT_TRUE(receivedMessage == enc->m_plainMessage);
+			}
+		}
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d");
 
+		bobManager = nullptr;
+		peersManager = nullptr;
 		if (cleanDatabase) {
-			remove(dbFilenameAlice.data()); // delete the database file if already exists
-			remove(dbFilenameBob.data()); // delete the database file if already exists
+			remove(dbFilenameBob.data());
+			remove(dbFilenamePeers.data());
 		}
 	} catch (BctbxException &e) {
 		LIME_LOGE << e;
@@ -4674,25 +6052,21 @@ static void lime_multithread_test(const lime::CurveId curve) {
 	}
 }
 
-static void lime_multithread(void) {
-	for (size_t i=0; i<3; i++) { // loop several times as the first messages sending/receiving are the most susceptible to bump into problems
+static void lime_multithread_users_cache(void) {
 #ifdef EC25519_ENABLED
-	lime_multithread_test(lime::CurveId::c25519);
+	lime_multithread_users_cache_test(lime::CurveId::c25519);
 #endif
 #ifdef EC448_ENABLED
-	lime_multithread_test(lime::CurveId::c448);
+	lime_multithread_users_cache_test(lime::CurveId::c448);
 #endif
 #ifdef HAVE_BCTBXPQ
 #ifdef EC25519_ENABLED
-	lime_multithread_test(lime::CurveId::c25519k512);
-
-	lime_multithread_test(lime::CurveId::c25519mlk512);
+	lime_multithread_users_cache_test(lime::CurveId::c25519mlk512);
 #endif
 #ifdef EC448_ENABLED
-	lime_multithread_test(lime::CurveId::c448mlk1024);
+	lime_multithread_users_cache_test(lime::CurveId::c448mlk1024);
 #endif
 #endif
-	}
 }
 
 /*
@@ -5253,6 +6627,389 @@ static void lime_kem_asymmetric_ratchet(void) {
 #endif
 }
 
+/*
+ * Scenario, running on the in-process X3DH server stand-in, no external server needed
+ * - Alice starts a capture, creates her user. Bob creates his user, he is not captured
+ * - Alice encrypts to Bob, Bob decrypts
+ * - Bob encrypts three messages to Alice, Alice decrypts the third one(skipping two) then the first one(late)
+ * - Alice encrypts to Bob again, stops the capture and encrypts once more
+ * - Check the capture holds the captured operations but no device nor group id
+ * - Parse the capture and check the skipped and late decryptions are in
+ * - Replay the capture and check all the operations are replayed with success
+ */
+static void lime_capture_replay_test(const lime::CurveId curve, const std::string &dbBaseFilename) {
+	const std::vector<lime::CurveId> algos{curve};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string dbFilenameAlice = dbBaseFilename + ".alice" + dbSuffix;
+	const std::string dbFilenameBob = dbBaseFilename + ".bob" + dbSuffix;
+	const std::string dbFilenameReplayed = dbBaseFilename + ".replayed" + dbSuffix;
+	const std::string dbFilenamePeers = dbBaseFilename + ".peers" + dbSuffix;
+	const std::string captureFilename = dbBaseFilename + "." + CurveId2String(curve) + ".capture";
+	for (const auto &filename : {dbFilenameAlice, dbFilenameBob, dbFilenameReplayed, dbFilenamePeers, captureFilename}) {
+		remove(filename.data());
+	}
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	try {
+		lime_tester::X3DHServerStandIn server{};
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, server.postData());
+		auto bobManager = make_unique<LimeManager>(dbFilenameBob, server.postData());
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d1.");
+		auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.d1.");
+
+		BC_ASSERT_TRUE(aliceManager->start_capture(captureFilename));
+		aliceManager->create_user(*aliceDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		bobManager->create_user(*bobDeviceId, algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		server.process();
+		BC_ASSERT_EQUAL(counters.operation_success, expected_success+2, int, "%d");
+		expected_success += 2;
+
+		// Alice encrypts to Bob, Bob decrypts
+		auto encAlice = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[0]);
+		encAlice->addRecipient(*bobDeviceId);
+		aliceManager->encrypt(*aliceDeviceId, algos, encAlice, callback);
+		server.process();
+		BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(bobManager->decrypt(*bobDeviceId, "bob", *aliceDeviceId, encAlice->m_recipients[0].DRmessage, encAlice->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+
+		// Bob encrypts three messages, Alice decrypts the third then the first one
+		std::vector<std::shared_ptr<lime::EncryptionContext>> encBob{};
+		for (size_t i=0; i<3; i++) {
+			encBob.push_back(make_shared<lime::EncryptionContext>("alice", lime_tester::messages_pattern[i]));
+			encBob.back()->addRecipient(*aliceDeviceId);
+			bobManager->encrypt(*bobDeviceId, algos, encBob.back(), callback);
+			server.process();
+			BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+		}
+		for (const size_t i : {2, 0}) {
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(aliceManager->decrypt(*aliceDeviceId, "alice", *bobDeviceId, encBob[i]->m_recipients[0].DRmessage, encBob[i]->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[i]);
+		}
+
+		// Alice encrypts again to Bob, stops the capture and encrypts once more: this one is not captured
+		for (size_t i=0; i<2; i++) {
+			if (i == 1) aliceManager->stop_capture();
+			auto enc = make_shared<lime::EncryptionContext>("bob", lime_tester::messages_pattern[1]);
+			enc->addRecipient(*bobDeviceId);
+			aliceManager->encrypt(*aliceDeviceId, algos, enc, callback);
+			server.process();
+			BC_ASSERT_EQUAL(counters.operation_success, ++expected_success, int, "%d");
+		}
+		aliceManager = nullptr;
+		bobManager = nullptr;
+
+		// the capture holds the operations, no device nor group id
+		std::ifstream captureFile(captureFilename);
+		std::string capture{std::istreambuf_iterator<char>(captureFile), std::istreambuf_iterator<char>()};
+		captureFile.close();
+		BC_ASSERT_TRUE(capture.find(*aliceDeviceId) == std::string::npos);
+		BC_ASSERT_TRUE(capture.find(*bobDeviceId) == std::string::npos);
+		BC_ASSERT_TRUE(capture.find("alice") == std::string::npos);
+		BC_ASSERT_TRUE(capture.find("bob") == std::string::npos);
+
+		auto operations = lime_tester::replay::parseCapture(captureFilename);
+		if (!BC_ASSERT_TRUE(operations.size() == 5)) return;
+		BC_ASSERT_TRUE(operations[0].type == "create_user");
+		BC_ASSERT_TRUE(operations[1].type == "encrypt");
+		BC_ASSERT_EQUAL(operations[1].recipients.size(), 1, size_t, "%zu");
+		BC_ASSERT_TRUE(operations[2].type == "decrypt");
+		BC_ASSERT_EQUAL(operations[2].skipped, 2, uint32_t, "%u");
+		BC_ASSERT_FALSE(operations[2].late);
+		BC_ASSERT_TRUE(operations[3].type == "decrypt");
+		BC_ASSERT_EQUAL(operations[3].skipped, 0, uint32_t, "%u");
+		BC_ASSERT_TRUE(operations[3].late);
+		BC_ASSERT_TRUE(operations[4].type == "encrypt");
+		BC_ASSERT_TRUE(operations[2].sender == operations[1].recipients[0]);
+
+		// replay it
+		{
+			lime_tester::replay::Replayer replayer(dbFilenameReplayed, dbFilenamePeers, algos);
+			replayer.run(operations, false);
+			LIME_LOGI<<"Capture replay:"<<std::endl<<replayer.report();
+			const auto &stats = replayer.stats();
+			const std::vector<std::pair<std::string, size_t>> expected{{"create_user", 1}, {"encrypt", 2}, {"decrypt", 2}};
+			BC_ASSERT_EQUAL(stats.size(), expected.size(), size_t, "%zu");
+			for (const auto &operation : expected) {
+				auto stat = stats.find(operation.first);
+				if (!BC_ASSERT_TRUE(stat != stats.end())) continue;
+				BC_ASSERT_EQUAL(stat->second.latencies.size(), operation.second, size_t, "%zu");
+				BC_ASSERT_EQUAL(stat->second.failed, 0, size_t, "%zu");
+			}
+		}
+
+		if (cleanDatabase) {
+			for (const auto &filename : {dbFilenameAlice, dbFilenameBob, dbFilenameReplayed, dbFilenamePeers, captureFilename}) {
+				remove(filename.data());
+			}
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_capture_replay(void) {
+#ifdef EC25519_ENABLED
+	lime_capture_replay_test(lime::CurveId::c25519, "lime_capture_replay");
+#endif
+#ifdef EC448_ENABLED
+	lime_capture_replay_test(lime::CurveId::c448, "lime_capture_replay");
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_capture_replay_test(lime::CurveId::c25519mlk512, "lime_capture_replay");
+#endif
+#endif
+}
+
+/*
+ * Soak benchmark, running on the in-process X3DH server stand-in: simulate months of traffic in accelerated time
+ * - lime_tester::soak_devices devices, each one in its own local storage, exchange messages during lime_tester::soak_days days
+ * - every day each device sends messagesPerDay messages: most to one peer, some to all the others encrypted with the sender key policy
+ *   some messages are delivered a day late, some are never delivered, both leave skipped message keys behind
+ * - every churnPeriod days a device is deleted and replaced by a new one: its peers keep their sessions with the old one
+ * - at the end of the day all timestamps are moved back by one day and every device runs its update
+ * - every samplePeriod days, sample the local storages size, their rows count per table and the encrypt/decrypt latencies
+ * The time series is logged and written in a csv file, a storage growth or a latency drift shows up as a trend in it.
+ */
+static void lime_soak_test(const lime::CurveId curve, const std::string &dbBaseFilename) {
+	constexpr int messagesPerDay = 4;
+	constexpr int samplePeriod = 7; // days
+	constexpr int churnPeriod = 30; // days
+	constexpr uint32_t groupRate = 20; // percentage of messages sent to all devices
+	constexpr uint32_t lateRate = 10; // percentage of messages delivered the next day
+	constexpr uint32_t lostRate = 2; // percentage of messages never delivered
+
+	const std::vector<lime::CurveId> algos{curve};
+	const std::string dbSuffix = std::string{"."}.append(CurveId2String(curve)).append(".sqlite3");
+	const std::string csvFilename = dbBaseFilename + "." + CurveId2String(curve) + ".csv";
+	const size_t devicesCount = static_cast<size_t>(std::max(2, lime_tester::soak_devices));
+	std::vector<std::string> dbFilenames{};
+	for (size_t i=0; i<devicesCount; i++) {
+		dbFilenames.push_back(dbBaseFilename + ".d" + std::to_string(i) + dbSuffix);
+		remove(dbFilenames.back().data());
+	}
+
+	// a message waiting for its delivery
+	struct Delivery {
+		size_t recipient; // index of the recipient device
+		std::string recipientId; // the recipient device may be replaced before the delivery
+		std::string senderId;
+		std::string associatedData;
+		std::vector<uint8_t> DRmessage;
+		std::shared_ptr<lime::EncryptionContext> encryptionContext; // holds the cipher message and the plaintext
+	};
+
+	lime_tester::events_counters_t counters={};
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+	// draw in [0, n[, reproducible when the tester is seeded
+	auto draw = [](const uint32_t n) {
+		uint32_t r=0;
+		lime_tester::randomize(reinterpret_cast<uint8_t *>(&r), sizeof(r));
+		return r%n;
+	};
+
+	try {
+		lime_tester::X3DHServerStandIn server{};
+		std::vector<std::unique_ptr<LimeManager>> managers(devicesCount);
+		std::vector<std::string> devices(devicesCount);
+		auto openManagers = [&]() {
+			for (size_t i=0; i<devicesCount; i++) {
+				managers[i] = make_unique<LimeManager>(dbFilenames[i], server.postData());
+			}
+		};
+		auto createDevice = [&](const size_t i) {
+			devices[i] = *lime_tester::makeRandomDeviceName(std::string{"soak.d"}.append(std::to_string(i)).append(".").data());
+			managers[i]->create_user(devices[i], algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+			server.process();
+		};
+
+		openManagers();
+		for (size_t i=0; i<devicesCount; i++) {
+			createDevice(i);
+		}
+
+		std::ofstream csv(csvFilename);
+		std::vector<std::string> tables{};
+		lime_tester::replay::OperationStats encryptStats{}, decryptStats{};
+		size_t decryptFailed = 0;
+		std::vector<Delivery> lateDeliveries{};
+
+		auto deliver = [&](const Delivery &delivery) {
+			if (devices[delivery.recipient] != delivery.recipientId) return; // the recipient was replaced
+			std::vector<uint8_t> plainMessage{};
+			const auto start = std::chrono::steady_clock::now();
+			const auto status = managers[delivery.recipient]->decrypt(delivery.recipientId, delivery.associatedData, delivery.senderId, delivery.DRmessage, delivery.encryptionContext->m_cipherMessage, plainMessage);
+			decryptStats.latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+			if (status == lime::PeerDeviceStatus::fail || plainMessage != delivery.encryptionContext->m_plainMessage) {
+				decryptFailed++; // legit when a message holding the sender key distribution was lost
+			}
+		};
+
+		auto sample = [&](const int day) {
+			std::map<std::string, size_t> rowCounts{};
+			uint64_t dbSize = 0;
+			for (const auto &dbFilename : dbFilenames) {
+				std::map<std::string, size_t> dbRowCounts{};
+				lime_tester::get_tablesRowCount(dbFilename, dbRowCounts);
+				for (const auto &table : dbRowCounts) {
+					rowCounts[table.first] += table.second;
+				}
+				std::ifstream db(dbFilename, std::ios::binary|std::ios::ate);
+				dbSize += static_cast<uint64_t>(db.tellg());
+			}
+			if (tables.empty()) { // first sample: the header
+				std::ostringstream header;
+				header<<"day,db_size_bytes";
+				for (const auto &table : rowCounts) {
+					tables.push_back(table.first);
+					header<<","<<table.first;
+				}
+				header<<",encrypt_p50_us,encrypt_p99_us,decrypt_p50_us,decrypt_p99_us,decrypt_failed";
+				csv<<header.str()<<std::endl;
+				LIME_LOGI<<"Soak "<<CurveId2String(curve)<<": "<<header.str();
+			}
+			std::ostringstream line;
+			line<<day<<","<<dbSize/devicesCount;
+			for (const auto &table : tables) {
+				line<<","<<rowCounts[table];
+			}
+			line<<","<<encryptStats.percentile(50)<<","<<encryptStats.percentile(99)<<","<<decryptStats.percentile(50)<<","<<decryptStats.percentile(99)<<","<<decryptFailed;
+			csv<<line.str()<<std::endl;
+			LIME_LOGI<<"Soak "<<CurveId2String(curve)<<": "<<line.str();
+			encryptStats = lime_tester::replay::OperationStats{};
+			decryptStats = lime_tester::replay::OperationStats{};
+			decryptFailed = 0;
+		};
+
+		sample(0);
+		for (int day=1; day<=lime_tester::soak_days; day++) {
+			// yesterday late messages
+			auto late = std::move(lateDeliveries);
+			lateDeliveries.clear();
+			for (const auto &delivery : late) {
+				deliver(delivery);
+			}
+
+			for (size_t sender=0; sender<devicesCount; sender++) {
+				for (int m=0; m<messagesPerDay; m++) {
+					std::vector<size_t> recipients{};
+					std::string associatedData{};
+					auto policy = lime::EncryptionPolicy::optimizeUploadSize;
+					if (draw(100) < groupRate) {
+						associatedData = "soak.group";
+						policy = lime::EncryptionPolicy::senderKey;
+						for (size_t i=0; i<devicesCount; i++) {
+							if (i != sender) recipients.push_back(i);
+						}
+					} else {
+						auto peer = (sender + 1 + draw(static_cast<uint32_t>(devicesCount-1)))%devicesCount;
+						recipients.push_back(peer);
+						associatedData = std::string{"soak.chat."}.append(std::to_string(std::min(sender, peer))).append(".").append(std::to_string(std::max(sender, peer)));
+					}
+
+					auto enc = make_shared<lime::EncryptionContext>(associatedData, lime_tester::messages_pattern[draw(static_cast<uint32_t>(lime_tester::messages_pattern.size()))], policy);
+					for (const auto recipient : recipients) {
+						enc->addRecipient(devices[recipient]);
+					}
+					const auto failed = counters.operation_failed;
+					const auto start = std::chrono::steady_clock::now();
+					managers[sender]->encrypt(devices[sender], algos, enc, callback);
+					server.process();
+					encryptStats.latencies.push_back(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count()));
+					if (counters.operation_failed != failed) continue;
+
+					for (size_t i=0; i<recipients.size(); i++) {
+						const auto fate = draw(100);
+						if (fate < lostRate) continue;
+						Delivery delivery{recipients[i], devices[recipients[i]], devices[sender], associatedData, enc->m_recipients[i].DRmessage, enc};
+						if (fate < lostRate + lateRate) {
+							lateDeliveries.push_back(std::move(delivery));
+						} else {
+							deliver(delivery);
+						}
+					}
+				}
+			}
+
+			// replace a device, its peers keep their sessions with it
+			if (day%churnPeriod == 0) {
+				const auto churned = draw(static_cast<uint32_t>(devicesCount));
+				managers[churned]->delete_user(DeviceId(devices[churned], curve), callback);
+				server.process();
+				createDevice(churned);
+			}
+
+			// one day later
+			for (auto &manager : managers) {
+				manager = nullptr; // destroy managers before modifying DB
+			}
+			for (const auto &dbFilename : dbFilenames) {
+				lime_tester::forwardTime(dbFilename, 1);
+			}
+			openManagers();
+			for (size_t i=0; i<devicesCount; i++) {
+				managers[i]->update(devices[i], algos, callback);
+			}
+			server.process();
+
+			if (day%samplePeriod == 0) {
+				sample(day);
+			}
+		}
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d");
+		LIME_LOGI<<"Soak "<<CurveId2String(curve)<<" time series written in "<<csvFilename;
+
+		for (size_t i=0; i<devicesCount; i++) {
+			managers[i]->delete_user(DeviceId(devices[i], curve), callback);
+		}
+		server.process();
+		managers.clear();
+		if (cleanDatabase) {
+			for (const auto &dbFilename : dbFilenames) {
+				remove(dbFilename.data());
+			}
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void lime_soak(void) {
+	if (!bench) return;
+#ifdef EC25519_ENABLED
+	lime_soak_test(lime::CurveId::c25519, "lime_soak");
+#endif
+#ifdef EC448_ENABLED
+	lime_soak_test(lime::CurveId::c448, "lime_soak");
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	lime_soak_test(lime::CurveId::c25519mlk512, "lime_soak");
+#endif
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Basic", x3dh_basic),
 	TEST_NO_TAG("User Management", user_management),
@@ -5262,11 +7019,18 @@ static test_t tests[] = {
 	TEST_NO_TAG("Queued encryption", x3dh_operation_queue),
 	TEST_NO_TAG("Multi devices queued encryption", x3dh_multidev_operation_queue),
 	TEST_NO_TAG("Multiple sessions", x3dh_multiple_DRsessions),
+	TEST_NO_TAG("Multiple sessions - cache only match", lime_session_cache_only_match),
+	TEST_NO_TAG("Multiple sessions - stale sessions skipped", lime_session_stale_skip),
 	TEST_NO_TAG("Sending chain limit", x3dh_sending_chain_limit),
 	TEST_NO_TAG("Without OPk", x3dh_without_OPk),
+	TEST_NO_TAG("Prefetch sessions", lime_prefetch_sessions),
+	TEST_NO_TAG("Warm cache", lime_warm_cache),
+	TEST_NO_TAG("Chunked bundles - chunk failure", lime_bundles_chunk_failure),
 	TEST_NO_TAG("Update - clean MK", lime_update_clean_MK),
 	TEST_NO_TAG("Update - SPk", lime_update_SPk),
+	TEST_NO_TAG("Update - SPk cache", lime_update_SPk_cache),
 	TEST_NO_TAG("Update - OPk", lime_update_OPk),
+	TEST_NO_TAG("Update - OPk status", lime_update_OPk_status),
 	TEST_NO_TAG("Update - Republish", lime_update_republish),
 	TEST_NO_TAG("get self Identity Key", lime_getSelfIk),
 	TEST_NO_TAG("Verified Status", lime_identityVerifiedStatus),
@@ -5276,10 +7040,14 @@ static test_t tests[] = {
 	TEST_NO_TAG("Encryption Policy Error", lime_encryptionPolicyError),
 	TEST_NO_TAG("Identity theft", lime_identity_theft),
 	TEST_NO_TAG("Multithread", lime_multithread),
+	TEST_NO_TAG("Multithread - concurrent peers", lime_multithread_peers),
+	TEST_NO_TAG("Multithread - users cache", lime_multithread_users_cache),
 	TEST_NO_TAG("Session cancel", lime_session_cancel),
 	TEST_NO_TAG("DR Session clean", lime_DR_session_clean),
 	TEST_NO_TAG("DB Migration", lime_db_migration),
-	TEST_NO_TAG("KEM asymmetric ratchet", lime_kem_asymmetric_ratchet)
+	TEST_NO_TAG("KEM asymmetric ratchet", lime_kem_asymmetric_ratchet),
+	TEST_NO_TAG("Capture and replay", lime_capture_replay),
+	TEST_NO_TAG("Soak", lime_soak)
 };
 
 test_suite_t lime_lime_test_suite = {
@@ -21,6 +21,7 @@
 #include "lime_log.hpp"
 #include "lime-tester.hpp"
 #include "lime-tester-utils.hpp"
+#include "lime_settings.hpp"
 
 #include <bctoolbox/tester.h>
 #include <bctoolbox/exception.hh>
@@ -141,8 +142,9 @@ static limeX3DHServerPostData X3DHServerPost([](const std::string &url, const st
  * - do it again : first device post a message to all the others -> each of them decrypt (they use already existing sessions)
  * In allTalking mode:
  * - every device takes turn to send messages to all the others
+ * All messages are encrypted using the given encryption policy
  */
-static void group_basic_test(const lime::CurveId curve, const std::string &dbBaseFilename, const int deviceNumber, bool oneTalking=false, bool oneDecrypt=false) {
+static void group_basic_test(const lime::CurveId curve, const std::string &dbBaseFilename, const int deviceNumber, bool oneTalking=false, bool oneDecrypt=false, const lime::EncryptionPolicy policy=lime::EncryptionPolicy::optimizeUploadSize) {
 
 	std::string groupName("group Name");
 
@@ -173,7 +175,7 @@ static void group_basic_test(const lime::CurveId curve, const std::string &dbBas
 		std::vector<lime::CurveId> algos{curve};
 		uint64_t start=0,span,startEncrypt=0;
 		if (bench) { // use LOGE for bench report to avoid being flooded by debug logs
-			LIME_LOGE<<"### Running a group of "<<to_string(deviceNumber)<<" on curve "<<lime::CurveId2String(curve);
+			LIME_LOGE<<"### Running a group of "<<to_string(deviceNumber)<<" on curve "<<lime::CurveId2String(curve)<<((policy==lime::EncryptionPolicy::senderKey)?" in sender key mode":"");
 			start = bctbx_get_cur_time_ms();
 		}
 		// loop on all devices and create basics
@@ -211,7 +213,7 @@ static void group_basic_test(const lime::CurveId curve, const std::string &dbBas
 
 			// select a message to encrypt
 			auto messages_pattern_index = i%lime_tester::messages_pattern.size();
-			auto encryptionContext = make_shared<lime::EncryptionContext>(groupName, lime_tester::messages_pattern[messages_pattern_index]);
+			auto encryptionContext = make_shared<lime::EncryptionContext>(groupName, lime_tester::messages_pattern[messages_pattern_index], policy);
 			// create the list of recipients
 			for (auto j=0; j<deviceNumber; j++) {
 				if (j!=senderIndex) { // don't write to self
@@ -319,6 +321,18 @@ static void group_one_talking() {
 #endif
 }
 
+/* group large enough to get the peer bundles requested in several chunks */
+static void group_one_talking_chunked() {
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519, "group_one_talking_chunked", lime::settings::X3DH_peerBundlesChunkSize + 10, true);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519mlk512, "group_one_talking_chunked", lime::settings::X3DH_peerBundlesChunkSize + 10, true);
+#endif
+#endif
+}
+
 static void group_one_talking_bench() {
 	if (!bench) return;
 	int deviceNumber=10;
@@ -545,12 +559,279 @@ static void group_all_talking_bench() {
 #endif
 }
 
+static void group_one_talking_senderKey() {
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519, "group_one_talking_senderKey", 10, true, false, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef EC448_ENABLED
+	group_basic_test(lime::CurveId::c448, "group_one_talking_senderKey", 10, true, false, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519mlk512, "group_one_talking_senderKey", 10, true, false, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef EC448_ENABLED
+	group_basic_test(lime::CurveId::c448mlk1024, "group_one_talking_senderKey", 10, true, false, lime::EncryptionPolicy::senderKey);
+#endif
+#endif
+}
+
+static void group_all_talking_senderKey() {
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519, "group_all_talking_senderKey", 10, false, false, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef EC448_ENABLED
+	group_basic_test(lime::CurveId::c448, "group_all_talking_senderKey", 10, false, false, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519mlk512, "group_all_talking_senderKey", 10, false, false, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef EC448_ENABLED
+	group_basic_test(lime::CurveId::c448mlk1024, "group_all_talking_senderKey", 10, false, false, lime::EncryptionPolicy::senderKey);
+#endif
+#endif
+}
+
+/**
+ * Scenario: sender key mode on a group of 5 devices, device 0 is talking
+ * - first message: the sessions are new, no recipient advertised sender key support yet: the message is in cipher message mode
+ * - all recipients reply to device 0, advertising their sender key support
+ * - next message: all recipients get the sender chain in their DR message
+ * - second and third messages: all recipients get an empty DR message, one of them decrypts them out of order, replay fails
+ * - device 4 leaves the group: the sender chain is renewed so all the remaining recipients get a DR message again
+ *   and device 4 cannot decrypt the message anymore
+ * - device 0 deletes device 1 from its local storage: its new session did not advertise sender key support, the message is in
+ *   cipher message mode. Once device 1 replied, the sender chain is renewed even if device 1 is still a recipient
+ */
+static void group_senderKey_membership_test(const lime::CurveId curve, const std::string &dbBaseFilename) {
+	const int deviceNumber = 5;
+	std::string groupName("group Name");
+
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+
+	std::unique_ptr<LimeManager> manager; // only one manager at a time
+	std::vector<std::string> devicesId{};
+	std::vector<std::string> dbFilename{};
+	auto base_deviceId = *(lime_tester::makeRandomDeviceName("alice.")); // the base user name, each manager gets one user
+	base_deviceId.append(".d");
+
+	try {
+		std::vector<lime::CurveId> algos{curve};
+		for (auto i=0; i<deviceNumber; i++) {
+			dbFilename.push_back(dbBaseFilename);
+			dbFilename.back().append(".d").append(to_string(i)).append(".sqlite3");
+			remove(dbFilename.back().data()); // delete the database file if already exists
+			manager = make_unique<LimeManager>(dbFilename.back(), X3DHServerPost);
+			devicesId.push_back(base_deviceId + to_string(i));
+			manager->create_user(devicesId.back(), algos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		}
+
+		// device 0 encrypts to the devices 1 to recipientsNumber
+		auto encrypt = [&](const size_t patternIndex, const int recipientsNumber) {
+			auto encryptionContext = make_shared<lime::EncryptionContext>(groupName, lime_tester::messages_pattern[patternIndex], lime::EncryptionPolicy::senderKey);
+			for (auto j=1; j<=recipientsNumber; j++) {
+				encryptionContext->addRecipient(devicesId[j]);
+			}
+			manager = make_unique<LimeManager>(dbFilename[0], X3DHServerPost);
+			manager->encrypt(devicesId[0], algos, encryptionContext, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			BC_ASSERT_FALSE(encryptionContext->m_cipherMessage.empty());
+			return encryptionContext;
+		};
+		// device j decrypts, its DR message is at index j-1 in the recipients
+		auto decrypt = [&](std::shared_ptr<lime::EncryptionContext> encryptionContext, const int j, std::vector<uint8_t> &receivedMessage) {
+			manager = make_unique<LimeManager>(dbFilename[j], X3DHServerPost);
+			return manager->decrypt(devicesId[j], groupName, devicesId[0], encryptionContext->m_recipients[j-1].DRmessage, encryptionContext->m_cipherMessage, receivedMessage);
+		};
+		// device j sends a message to device 0, its DR message header advertises the sender key support
+		auto reply = [&](const int j) {
+			auto encryptionContext = make_shared<lime::EncryptionContext>(groupName, lime_tester::messages_pattern[0], lime::EncryptionPolicy::DRMessage);
+			encryptionContext->addRecipient(devicesId[0]);
+			manager = make_unique<LimeManager>(dbFilename[j], X3DHServerPost);
+			manager->encrypt(devicesId[j], algos, encryptionContext, callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			manager = make_unique<LimeManager>(dbFilename[0], X3DHServerPost);
+			std::vector<uint8_t> receivedMessage{};
+			BC_ASSERT_TRUE(manager->decrypt(devicesId[0], groupName, devicesId[j], encryptionContext->m_recipients[0].DRmessage, encryptionContext->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+		};
+
+		// first message: the recipients did not advertise their sender key support yet, fallback to cipher message mode
+		auto message0 = encrypt(0, deviceNumber-1);
+		for (auto j=1; j<deviceNumber; j++) {
+			BC_ASSERT_FALSE(message0->m_recipients[j-1].DRmessage.empty());
+			BC_ASSERT_FALSE(lime_tester::DR_message_senderKeyDistribution(message0->m_recipients[j-1].DRmessage));
+			BC_ASSERT_FALSE(lime_tester::DR_message_payloadDirectEncrypt(message0->m_recipients[j-1].DRmessage));
+			std::vector<uint8_t> receivedMessage{};
+			BC_ASSERT_TRUE(decrypt(message0, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+			reply(j);
+		}
+
+		// everyone advertised the support: everyone gets the sender chain
+		auto message1 = encrypt(0, deviceNumber-1);
+		for (auto j=1; j<deviceNumber; j++) {
+			BC_ASSERT_FALSE(message1->m_recipients[j-1].DRmessage.empty());
+			BC_ASSERT_TRUE(lime_tester::DR_message_senderKeyDistribution(message1->m_recipients[j-1].DRmessage));
+			std::vector<uint8_t> receivedMessage{};
+			BC_ASSERT_TRUE(decrypt(message1, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[0]);
+		}
+
+		// second and third messages: no more DR message
+		auto message2 = encrypt(1, deviceNumber-1);
+		auto message3 = encrypt(2, deviceNumber-1);
+		for (auto j=1; j<deviceNumber; j++) {
+			BC_ASSERT_TRUE(message2->m_recipients[j-1].DRmessage.empty());
+			BC_ASSERT_TRUE(message3->m_recipients[j-1].DRmessage.empty());
+			BC_ASSERT_TRUE(message3->m_recipients[j-1].peerStatus != lime::PeerDeviceStatus::fail);
+		}
+		// device 1 decrypts them out of order, the message key of the second one is stored when decrypting the third one
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(decrypt(message3, 1, receivedMessage) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[2]);
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(decrypt(message2, 1, receivedMessage) != lime::PeerDeviceStatus::fail);
+		BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[1]);
+		// replay fails
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(decrypt(message2, 1, receivedMessage) == lime::PeerDeviceStatus::fail);
+		// the others decrypt in order
+		for (auto j=2; j<deviceNumber; j++) {
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(decrypt(message2, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[1]);
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(decrypt(message3, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[2]);
+		}
+
+		// device 4 leaves the group: a new sender chain is distributed to the remaining ones
+		auto message4 = encrypt(3, deviceNumber-2);
+		for (auto j=1; j<deviceNumber-1; j++) {
+			BC_ASSERT_FALSE(message4->m_recipients[j-1].DRmessage.empty());
+			BC_ASSERT_TRUE(lime_tester::DR_message_senderKeyDistribution(message4->m_recipients[j-1].DRmessage));
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(decrypt(message4, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[3]);
+		}
+		// device 4 gets the cipher message anyway but cannot decrypt it
+		manager = make_unique<LimeManager>(dbFilename[deviceNumber-1], X3DHServerPost);
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(manager->decrypt(devicesId[deviceNumber-1], groupName, devicesId[0], std::vector<uint8_t>{}, message4->m_cipherMessage, receivedMessage) == lime::PeerDeviceStatus::fail);
+
+		// next message to the remaining devices does not need DR message anymore
+		auto message5 = encrypt(4, deviceNumber-2);
+		for (auto j=1; j<deviceNumber-1; j++) {
+			BC_ASSERT_TRUE(message5->m_recipients[j-1].DRmessage.empty());
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(decrypt(message5, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[4]);
+		}
+
+		// device 0 deletes device 1: its holder record is gone with it, the chain must be renewed or device 1 could still decrypt
+		auto chainId = [](const std::vector<uint8_t> &cipherMessage) { // sender key message header: version, curveId, chainId, index
+			return (cipherMessage.size() < 6) ? 0 : (static_cast<uint32_t>(cipherMessage[2])<<24 | static_cast<uint32_t>(cipherMessage[3])<<16
+				| static_cast<uint32_t>(cipherMessage[4])<<8 | static_cast<uint32_t>(cipherMessage[5]));
+		};
+		manager = make_unique<LimeManager>(dbFilename[0], X3DHServerPost);
+		manager->delete_peerDevice(devicesId[1]);
+		// the session with device 1 is new: cipher message mode for everyone
+		auto message6 = encrypt(5, deviceNumber-2);
+		for (auto j=1; j<deviceNumber-1; j++) {
+			BC_ASSERT_FALSE(message6->m_recipients[j-1].DRmessage.empty());
+			BC_ASSERT_FALSE(lime_tester::DR_message_senderKeyDistribution(message6->m_recipients[j-1].DRmessage));
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(decrypt(message6, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[5]);
+		}
+		reply(1);
+		auto message7 = encrypt(6, deviceNumber-2);
+		BC_ASSERT_TRUE(chainId(message7->m_cipherMessage) != chainId(message5->m_cipherMessage));
+		for (auto j=1; j<deviceNumber-1; j++) {
+			BC_ASSERT_TRUE(lime_tester::DR_message_senderKeyDistribution(message7->m_recipients[j-1].DRmessage));
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(decrypt(message7, j, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[6]);
+		}
+
+		if (cleanDatabase) {
+			for (auto i=0; i<deviceNumber; i++) {
+				manager = make_unique<LimeManager>(dbFilename[i], X3DHServerPost);
+				manager->delete_user(DeviceId(devicesId[i], curve), callback);
+				BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			}
+			manager = nullptr;
+			for (auto i=0; i<deviceNumber; i++) {
+				remove(dbFilename[i].data());
+			}
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void group_senderKey_membership() {
+#ifdef EC25519_ENABLED
+	group_senderKey_membership_test(lime::CurveId::c25519, "group_senderKey_membership");
+#endif
+#ifdef EC448_ENABLED
+	group_senderKey_membership_test(lime::CurveId::c448, "group_senderKey_membership");
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	group_senderKey_membership_test(lime::CurveId::c25519mlk512, "group_senderKey_membership");
+#endif
+#ifdef EC448_ENABLED
+	group_senderKey_membership_test(lime::CurveId::c448mlk1024, "group_senderKey_membership");
+#endif
+#endif
+}
+
+/* compare the cipher message and sender key policies on the same group size: look at the second message encrypt time, sessions are already established */
+static void group_senderKey_bench() {
+	if (!bench) return;
+	const int deviceNumber=200;
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519, "group_senderKey_bench", deviceNumber, true, true, lime::EncryptionPolicy::cipherMessage);
+	group_basic_test(lime::CurveId::c25519, "group_senderKey_bench", deviceNumber, true, true, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef EC448_ENABLED
+	group_basic_test(lime::CurveId::c448, "group_senderKey_bench", deviceNumber, true, true, lime::EncryptionPolicy::cipherMessage);
+	group_basic_test(lime::CurveId::c448, "group_senderKey_bench", deviceNumber, true, true, lime::EncryptionPolicy::senderKey);
+#endif
+#ifdef HAVE_BCTBXPQ
+#ifdef EC25519_ENABLED
+	group_basic_test(lime::CurveId::c25519mlk512, "group_senderKey_bench", deviceNumber, true, true, lime::EncryptionPolicy::cipherMessage);
+	group_basic_test(lime::CurveId::c25519mlk512, "group_senderKey_bench", deviceNumber, true, true, lime::EncryptionPolicy::senderKey);
+#endif
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("One message each", group_all_talking),
 	TEST_NO_TAG("One message each Bench", group_all_talking_bench),
 	TEST_NO_TAG("One encrypt to all", group_one_talking),
+	TEST_NO_TAG("One encrypt to all - chunked bundles requests", group_one_talking_chunked),
 	TEST_NO_TAG("One encrypt to all Bench", group_one_talking_bench),
 	TEST_NO_TAG("One encrypt to all Only one decrypt Bench", group_one_talking_one_decrypt_bench),
+	TEST_NO_TAG("One message each - sender key", group_all_talking_senderKey),
+	TEST_NO_TAG("One encrypt to all - sender key", group_one_talking_senderKey),
+	TEST_NO_TAG("Sender key membership change", group_senderKey_membership),
+	TEST_NO_TAG("Sender key vs cipher message Bench", group_senderKey_bench),
 };
 
 test_suite_t lime_massive_group_test_suite = {
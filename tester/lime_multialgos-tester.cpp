@@ -687,11 +687,138 @@ static void multialgos_peerStatus() {
 #endif // defined(EC25519_ENABLED) && defined(HAVE_BCTBXPQ)
 }
 
+/**
+ * Scenario: encryption with recipients partitioned by base algorithm
+ * - Create alice on two base algorithms, bob on the first one, claire and dave on the second one
+ * - alice encrypts to bob and claire: claire is not found on the first base algorithm and is served by the second one
+ * - alice encrypts to bob, claire and dave in a cipher message: bob and claire are known, their partitions are encrypted concurrently,
+ *   dave is unknown, he goes in the first base algorithm partition, is not found and is served by the second one
+ * - check the callback is called once, each recipient got one DR message on its base algorithm and all decrypt the same cipher message
+ */
+static void multialgos_partitions_test(const lime::CurveId firstAlgo, const lime::CurveId secondAlgo) {
+	std::string dbBaseFilename("multialgos_partitions");
+	lime_tester::events_counters_t counters={};
+	int expected_success=0;
+
+	limeCallback callback = [&counters](lime::CallbackReturn returnCode, std::string anythingToSay) {
+					if (returnCode == lime::CallbackReturn::success) {
+						counters.operation_success++;
+					} else {
+						counters.operation_failed++;
+						LIME_LOGE<<"Lime operation failed : "<<anythingToSay;
+					}
+				};
+	const std::vector<lime::CurveId> aliceAlgos{firstAlgo, secondAlgo};
+	const std::vector<lime::CurveId> bobAlgos{firstAlgo};
+	const std::vector<lime::CurveId> claireAlgos{secondAlgo};
+
+	try {
+		// create DB
+		auto dbFilenameAlice = dbBaseFilename;
+		dbFilenameAlice.append(".alice.").append(CurveId2String(aliceAlgos, "-")).append(".sqlite3");
+		auto dbFilenamePeers = dbBaseFilename;
+		dbFilenamePeers.append(".peers.").append(CurveId2String(aliceAlgos, "-")).append(".sqlite3");
+		remove(dbFilenameAlice.data()); // delete the database file if already exists
+		remove(dbFilenamePeers.data()); // delete the database file if already exists
+
+		auto aliceManager = make_unique<LimeManager>(dbFilenameAlice, X3DHServerPost);
+		auto aliceDeviceId = lime_tester::makeRandomDeviceName("alice.d.");
+		aliceManager->create_user(*aliceDeviceId, aliceAlgos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+
+		auto peersManager = make_unique<LimeManager>(dbFilenamePeers, X3DHServerPost);
+		auto bobDeviceId = lime_tester::makeRandomDeviceName("bob.d.");
+		peersManager->create_user(*bobDeviceId, bobAlgos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		auto claireDeviceId = lime_tester::makeRandomDeviceName("claire.d.");
+		peersManager->create_user(*claireDeviceId, claireAlgos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+		auto daveDeviceId = lime_tester::makeRandomDeviceName("dave.d.");
+		peersManager->create_user(*daveDeviceId, claireAlgos, lime_tester::test_x3dh_default_server, lime_tester::OPkInitialBatchSize, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success, ++expected_success,lime_tester::wait_for_timeout));
+
+		// alice encrypts to bob and claire: it establishes the sessions
+		auto enc = make_shared<lime::EncryptionContext>("friends", lime_tester::messages_pattern[0], lime::EncryptionPolicy::cipherMessage);
+		enc->addRecipient(*bobDeviceId);
+		enc->addRecipient(*claireDeviceId);
+		aliceManager->encrypt(*aliceDeviceId, aliceAlgos, enc, callback);
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_TRUE(lime_tester::DR_message_get_curveId(enc->m_recipients[0].DRmessage) == firstAlgo);
+		BC_ASSERT_TRUE(lime_tester::DR_message_get_curveId(enc->m_recipients[1].DRmessage) == secondAlgo);
+		std::vector<uint8_t> receivedMessage{};
+		BC_ASSERT_TRUE(peersManager->decrypt(*bobDeviceId, "friends", *aliceDeviceId, enc->m_recipients[0].DRmessage, enc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+		receivedMessage.clear();
+		BC_ASSERT_TRUE(peersManager->decrypt(*claireDeviceId, "friends", *aliceDeviceId, enc->m_recipients[1].DRmessage, enc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+
+		// alice encrypts to bob, claire and dave, count the callback calls
+		int encryptCallbacks = 0;
+		enc = make_shared<lime::EncryptionContext>("friends", lime_tester::messages_pattern[1], lime::EncryptionPolicy::cipherMessage);
+		enc->addRecipient(*bobDeviceId);
+		enc->addRecipient(*claireDeviceId);
+		enc->addRecipient(*daveDeviceId);
+		aliceManager->encrypt(*aliceDeviceId, aliceAlgos, enc, [&encryptCallbacks, &callback](lime::CallbackReturn returnCode, std::string anythingToSay) {
+			encryptCallbacks++;
+			callback(returnCode, anythingToSay);
+		});
+		BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+		BC_ASSERT_FALSE(lime_tester::wait_for(bc_stack,&encryptCallbacks,2,lime_tester::wait_for_timeout)); // the callback is not called again
+		BC_ASSERT_EQUAL(encryptCallbacks, 1, int, "%d");
+		BC_ASSERT_EQUAL(counters.operation_failed, 0, int, "%d");
+
+		// one encryption per base algorithm: bob and claire sessions encrypted once more, dave got a new one on the second base algorithm
+		BC_ASSERT_TRUE(lime_tester::DR_message_get_curveId(enc->m_recipients[0].DRmessage) == firstAlgo);
+		BC_ASSERT_TRUE(lime_tester::DR_message_get_curveId(enc->m_recipients[1].DRmessage) == secondAlgo);
+		BC_ASSERT_TRUE(lime_tester::DR_message_get_curveId(enc->m_recipients[2].DRmessage) == secondAlgo);
+		BC_ASSERT_EQUAL(lime_tester::DR_message_get_Ns(enc->m_recipients[0].DRmessage), 1, uint16_t, "%d");
+		BC_ASSERT_EQUAL(lime_tester::DR_message_get_Ns(enc->m_recipients[1].DRmessage), 1, uint16_t, "%d");
+		BC_ASSERT_TRUE(lime_tester::DR_message_holdsX3DHInit(enc->m_recipients[2].DRmessage));
+
+		// everyone decrypts the same cipher message
+		BC_ASSERT_FALSE(enc->m_cipherMessage.empty());
+		for (size_t i=0; i<enc->m_recipients.size(); i++) {
+			BC_ASSERT_TRUE(enc->m_recipients[i].peerStatus != lime::PeerDeviceStatus::fail);
+			receivedMessage.clear();
+			BC_ASSERT_TRUE(peersManager->decrypt(enc->m_recipients[i].deviceId, "friends", *aliceDeviceId, enc->m_recipients[i].DRmessage, enc->m_cipherMessage, receivedMessage) != lime::PeerDeviceStatus::fail);
+			BC_ASSERT_TRUE(receivedMessage == lime_tester::messages_pattern[1]);
+		}
+
+		// delete the users
+		if (cleanDatabase) {
+			for (const auto &algo:aliceAlgos) {
+				aliceManager->delete_user(DeviceId(*aliceDeviceId, algo), callback);
+				BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			}
+			peersManager->delete_user(DeviceId(*bobDeviceId, firstAlgo), callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			peersManager->delete_user(DeviceId(*claireDeviceId, secondAlgo), callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			peersManager->delete_user(DeviceId(*daveDeviceId, secondAlgo), callback);
+			BC_ASSERT_TRUE(lime_tester::wait_for(bc_stack,&counters.operation_success,++expected_success,lime_tester::wait_for_timeout));
+			remove(dbFilenameAlice.data());
+			remove(dbFilenamePeers.data());
+		}
+	} catch (BctbxException &e) {
+		LIME_LOGE << e;
+		BC_FAIL("");
+	}
+}
+
+static void multialgos_partitions() {
+#if defined(EC25519_ENABLED) && defined(HAVE_BCTBXPQ)
+	multialgos_partitions_test(lime::CurveId::c25519k512, lime::CurveId::c25519);
+	multialgos_partitions_test(lime::CurveId::c25519, lime::CurveId::c25519mlk512);
+#endif
+#if defined(EC25519_ENABLED) && defined(EC448_ENABLED)
+	multialgos_partitions_test(lime::CurveId::c448, lime::CurveId::c25519);
+#endif
+}
+
 static test_t tests[] = {
 	TEST_NO_TAG("Basic", multialgos_basic),
 	TEST_NO_TAG("four users", multialgos_four_users_basic),
 	TEST_NO_TAG("four users migration", multialgos_four_users_migration),
-	TEST_NO_TAG("Peer status", multialgos_peerStatus)
+	TEST_NO_TAG("Peer status", multialgos_peerStatus),
+	TEST_NO_TAG("Partitioned encryption", multialgos_partitions)
 };
 
 test_suite_t lime_multialgos_test_suite = {